@@ -2,6 +2,7 @@ package Slic3r::Test;
 use strict;
 use warnings;
 use Cwd 'abs_path';
+use IO::Uncompress::Gunzip;
 
 require Exporter;
 our @ISA = qw(Exporter);
@@ -204,20 +205,29 @@ sub init_print {
 }
 
 sub gcode {
-    my ($print) = @_;
+    my ($print, %params) = @_;
     
     $print = $print->print if $print->isa('Slic3r::Test::Print');
     
     # Write the resulting G-code into a temporary file.
     my $gcode_temp_path = abs_path($0) . '.gcode.temp';
+    # The G-code is compressed if exported into a file with the .gz suffix.
+    $gcode_temp_path .= '.gz' if $params{gzip};
     # Remove the existing temp file.
     unlink $gcode_temp_path;
     $print->set_status_silent;
-    $print->process;
-    $print->export_gcode($gcode_temp_path);
+    if ($params{streaming}) {
+        $print->process_and_export_gcode($gcode_temp_path);
+    } else {
+        $print->process;
+        $print->export_gcode($gcode_temp_path);
+    }
     # Read the temoprary G-code file.
     my $gcode;
-    {
+    if ($params{gzip}) {
+        IO::Uncompress::Gunzip::gunzip($gcode_temp_path => \$gcode)
+            or die "Test.pm: can't decompress $gcode_temp_path: $IO::Uncompress::Gunzip::GunzipError";
+    } else {
         local $/;
         open my $fh, '<', $gcode_temp_path or die "Test.pm: can't open $gcode_temp_path: $!";
         $gcode = <$fh>;
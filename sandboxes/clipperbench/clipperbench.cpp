@@ -0,0 +1,172 @@
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/nowide/cstdio.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <libslic3r/libslic3r.h>
+#include <libslic3r/ClipperUtils.hpp>
+#include <libslic3r/TriangleMesh.hpp>
+#include <libnest2d/tools/benchmark.h>
+
+#include <tbb/parallel_for.h>
+#include <tbb/task_scheduler_init.h>
+
+const std::string USAGE_STR = {
+    "Usage: clipperbench stlfilename.stl [layer_height]\n"
+    "       clipperbench clipper_input.bin [repeats]\n"
+    "The .bin files are written by export_clipper_input_polygons_bin() if CLIPPER_UTILS_DEBUG is defined."
+};
+
+// Read the subject and clip paths in the format written by export_clipper_input_polygons_bin().
+static bool import_clipper_input_polygons_bin(const char *path, ClipperLib::Paths &input_subject, ClipperLib::Paths &input_clip)
+{
+    FILE *pfile = boost::nowide::fopen(path, "rb");
+    if (pfile == nullptr)
+        return false;
+    auto read_paths = [pfile](ClipperLib::Paths &paths) {
+        uint32_t sz;
+        if (fread(&sz, sizeof(sz), 1, pfile) != 1)
+            return false;
+        paths.assign(sz, ClipperLib::Path());
+        for (ClipperLib::Path &path : paths) {
+            if (fread(&sz, sizeof(sz), 1, pfile) != 1)
+                return false;
+            path.assign(sz, ClipperLib::IntPoint());
+            if (sz > 0 && fread(path.data(), sizeof(ClipperLib::IntPoint), sz, pfile) != sz)
+                return false;
+        }
+        return true;
+    };
+    bool ok = read_paths(input_subject) && read_paths(input_clip);
+    fclose(pfile);
+    return ok;
+}
+
+int main(const int argc, const char *argv[]) {
+    using namespace Slic3r;
+    using std::cout; using std::endl;
+
+    if(argc < 2) {
+        cout << USAGE_STR << endl;
+        return EXIT_SUCCESS;
+    }
+
+    // Pairs of subject / clip polygons. For a mesh, a layer is clipped with the layer below, as done by the overhang
+    // and bridge detection. A .bin file is a single pair, which is repeated to get a measurable time.
+    std::vector<Polygons> subjects;
+    std::vector<Polygons> clips;
+    if (boost::iends_with(argv[1], ".bin")) {
+        ClipperLib::Paths input_subject, input_clip;
+        if (! import_clipper_input_polygons_bin(argv[1], input_subject, input_clip)) {
+            cout << "Failed to read " << argv[1] << endl;
+            return EXIT_FAILURE;
+        }
+        const size_t repeats = (argc > 2) ? size_t(atol(argv[2])) : 100;
+        subjects.assign(repeats, ClipperPaths_to_Slic3rPolygons(input_subject));
+        clips.assign(repeats, ClipperPaths_to_Slic3rPolygons(input_clip));
+    } else {
+        TriangleMesh model;
+        model.ReadSTLFile(argv[1]);
+        model.repair();
+        model.align_to_origin();
+        const float layer_height = (argc > 2) ? float(atof(argv[2])) : 0.1f;
+        const BoundingBoxf3 bb = model.bounding_box();
+        std::vector<float> z;
+        for (float slice_z = 0.5f * layer_height; slice_z < float(bb.max(2)); slice_z += layer_height)
+            z.emplace_back(slice_z);
+        std::vector<ExPolygons> layers;
+        TriangleMeshSlicer(&model).slice(z, &layers, [](){});
+        for (size_t i = 1; i < layers.size(); ++ i) {
+            subjects.emplace_back(to_polygons(layers[i]));
+            clips.emplace_back(to_polygons(layers[i - 1]));
+        }
+    }
+
+    size_t num_points = 0;
+    for (const Polygons &polygons : subjects)
+        for (const Polygon &polygon : polygons)
+            num_points += polygon.points.size();
+    cout << subjects.size() << " subject / clip pairs, " << num_points << " subject points" << endl;
+
+    Benchmark bench;
+    auto report = [&bench](const char *name, size_t num_threads, double time_reference) {
+        cout << std::setw(24) << std::left << name << std::setw(3) << std::right << num_threads << " threads: " << std::setprecision(4)
+             << bench.getElapsedSec() << " seconds, speedup " << time_reference / bench.getElapsedSec() << endl;
+    };
+
+    // Reference: Clipper engine constructed for each operation vs. a single engine reused for all the operations,
+    // which recycles the memory allocated for the edges, output polygons and output points.
+    {
+        std::vector<ClipperLib::Paths> subject_paths, clip_paths;
+        for (size_t i = 0; i < subjects.size(); ++ i) {
+            subject_paths.emplace_back(Slic3rMultiPoints_to_ClipperPaths(subjects[i]));
+            clip_paths.emplace_back(Slic3rMultiPoints_to_ClipperPaths(clips[i]));
+        }
+        ClipperLib::Paths out;
+        bench.start();
+        for (size_t i = 0; i < subject_paths.size(); ++ i) {
+            ClipperLib::Clipper clipper;
+            clipper.AddPaths(subject_paths[i], ClipperLib::ptSubject, true);
+            clipper.AddPaths(clip_paths[i], ClipperLib::ptClip, true);
+            clipper.Execute(ClipperLib::ctDifference, out, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+        }
+        bench.stop();
+        double time_reference = bench.getElapsedSec();
+        report("Clipper per operation:", 1, time_reference);
+        bench.start();
+        ClipperLib::Clipper clipper;
+        for (size_t i = 0; i < subject_paths.size(); ++ i) {
+            clipper.Clear();
+            clipper.AddPaths(subject_paths[i], ClipperLib::ptSubject, true);
+            clipper.AddPaths(clip_paths[i], ClipperLib::ptClip, true);
+            clipper.Execute(ClipperLib::ctDifference, out, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
+        }
+        bench.stop();
+        report("Clipper reused:", 1, time_reference);
+    }
+
+    // The ClipperUtils operations, which lease the Clipper engines of the worker threads,
+    // run with an increasing number of worker threads to show how the Clipper operations scale.
+    const int max_threads = std::max<int>(1, std::thread::hardware_concurrency());
+    std::vector<int> thread_counts;
+    for (int num_threads = 1; num_threads < max_threads; num_threads *= 2)
+        thread_counts.emplace_back(num_threads);
+    thread_counts.emplace_back(max_threads);
+
+    const float delta = float(scale_(0.45));
+    struct Operation {
+        const char *name;
+        std::function<size_t(const Polygons&, const Polygons&)> fn;
+    };
+    std::vector<Operation> operations {
+        { "offset:",            [delta](const Polygons &subject, const Polygons &)      { return offset(subject, - delta).size(); } },
+        { "offset2_ex:",        [delta](const Polygons &subject, const Polygons &)      { return offset2_ex(subject, - delta, 0.5f * delta).size(); } },
+        { "diff:",              [](const Polygons &subject, const Polygons &clip)       { return diff(subject, clip).size(); } },
+        { "intersection_ex:",   [](const Polygons &subject, const Polygons &clip)       { return intersection_ex(subject, clip).size(); } },
+        { "union_ex:",          [](const Polygons &subject, const Polygons &clip)       { Polygons both = subject; polygons_append(both, clip); return union_ex(both).size(); } }
+    };
+    for (const Operation &operation : operations) {
+        double time_single_thread = 0.;
+        for (int num_threads : thread_counts) {
+            tbb::task_scheduler_init tbb_init(num_threads);
+            std::vector<size_t> results(subjects.size(), 0);
+            bench.start();
+            tbb::parallel_for(tbb::blocked_range<size_t>(0, subjects.size()),
+                [&operation, &subjects, &clips, &results](const tbb::blocked_range<size_t> &range) {
+                    for (size_t i = range.begin(); i < range.end(); ++ i)
+                        results[i] = operation.fn(subjects[i], clips[i]);
+                });
+            bench.stop();
+            if (num_threads == 1)
+                time_single_thread = bench.getElapsedSec();
+            report(operation.name, num_threads, time_single_thread);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include <boost/nowide/cstdio.hpp>
+
+#include <libslic3r/libslic3r.h>
+#include <libslic3r/GCodeWriter.hpp>
+#include <libslic3r/GCode/OutputSink.hpp>
+#include <libnest2d/tools/benchmark.h>
+
+const std::string USAGE_STR = {
+    "Usage: gcodeoutput output_path [number_of_lines]"
+};
+
+int main(const int argc, const char *argv[]) {
+    using namespace Slic3r;
+    using std::cout; using std::endl;
+
+    if(argc < 2) {
+        cout << USAGE_STR << endl;
+        return EXIT_SUCCESS;
+    }
+
+    const std::string path      = argv[1];
+    const size_t      num_lines = (argc > 2) ? size_t(atol(argv[2])) : 5000000;
+
+    // Short G-code lines as produced by the G-code export, each written by a separate call.
+    std::vector<std::string> lines;
+    lines.reserve(num_lines);
+    for (size_t i = 0; i < num_lines; ++ i) {
+        GCodeG1Formatter w;
+        w.emit_xy(Vec2d(100. + 0.013 * double(i % 5000), 100. + 0.007 * double(i % 3000)));
+        w.emit_e("E", 0.0123 * double(i % 100));
+        lines.emplace_back(w.string());
+    }
+
+    Benchmark bench;
+    auto report = [&bench](const char *name, size_t size) {
+        cout << std::setw(20) << std::left << name << std::setprecision(10) << bench.getElapsedSec() << " seconds, " << size << " bytes." << endl;
+    };
+    auto file_size = [](const std::string &path) {
+        FILE *file = boost::nowide::fopen(path.c_str(), "rb");
+        fseek(file, 0, SEEK_END);
+        size_t size = size_t(ftell(file));
+        fclose(file);
+        return size;
+    };
+
+    // Reference: A fwrite() call per line, as done by the G-code export before.
+    {
+        FILE *file = boost::nowide::fopen(path.c_str(), "wb");
+        bench.start();
+        for (const std::string &line : lines)
+            fwrite(line.data(), 1, line.size(), file);
+        fclose(file);
+        bench.stop();
+        report("fwrite per line:", file_size(path));
+    }
+
+    {
+        FILE *file = boost::nowide::fopen(path.c_str(), "wb");
+        bench.start();
+        GCodeFileSink sink(file);
+        for (const std::string &line : lines)
+            sink.write(line);
+        sink.close();
+        fclose(file);
+        bench.stop();
+        report("GCodeFileSink:", file_size(path));
+    }
+
+    {
+        bench.start();
+        GCodeMemorySink sink;
+        for (const std::string &line : lines)
+            sink.write(line);
+        sink.close();
+        bench.stop();
+        report("GCodeMemorySink:", sink.data().size());
+    }
+
+    {
+        const std::string path_gz = path + ".gz";
+        FILE *file = boost::nowide::fopen(path_gz.c_str(), "wb");
+        bench.start();
+        GCodeGzipSink sink(file);
+        for (const std::string &line : lines)
+            sink.write(line);
+        sink.close();
+        fclose(file);
+        bench.stop();
+        report("GCodeGzipSink:", file_size(path_gz));
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <libslic3r/libslic3r.h>
+#include <libslic3r/GCodeWriter.hpp>
+#include <libnest2d/tools/benchmark.h>
+
+const std::string USAGE_STR = {
+    "Usage: gcodewriter [number_of_moves]"
+};
+
+int main(const int argc, const char *argv[]) {
+    using namespace Slic3r;
+    using std::cout; using std::endl;
+
+    const size_t num_moves = (argc > 1) ? size_t(atol(argv[1])) : 1000000;
+    if (num_moves == 0) {
+        cout << USAGE_STR << endl;
+        return EXIT_SUCCESS;
+    }
+
+    // Random extrusion moves over a 250x210mm bed, with a few values rounding exactly to a tie or to a negative zero.
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> coord(-10., 250.);
+    std::uniform_real_distribution<double> e(-2., 2.);
+    std::vector<Vec3d> points;
+    std::vector<double> extrusions;
+    points.reserve(num_moves);
+    extrusions.reserve(num_moves);
+    for (size_t i = 0; i < num_moves; ++ i) {
+        points.emplace_back(coord(rng), coord(rng), (i % 100 == 0) ? 0.0005 * double(i % 7) : coord(rng));
+        extrusions.emplace_back((i % 100 == 1) ? -0.000001 : e(rng));
+    }
+
+    Benchmark bench;
+
+    // The former implementation of GCodeWriter::extrude_to_xyz().
+    std::vector<std::string> lines_stream;
+    lines_stream.reserve(num_moves);
+    bench.start();
+    for (size_t i = 0; i < num_moves; ++ i) {
+        std::ostringstream gcode;
+        gcode << "G1 X" << std::fixed << std::setprecision(3) << points[i](0)
+              <<   " Y" << std::fixed << std::setprecision(3) << points[i](1)
+              <<   " Z" << std::fixed << std::setprecision(3) << points[i](2)
+              <<   " E" << std::fixed << std::setprecision(5) << extrusions[i]
+              << "\n";
+        lines_stream.emplace_back(gcode.str());
+    }
+    bench.stop();
+    cout << "ostringstream:    " << std::setprecision(10) << bench.getElapsedSec() << " seconds." << endl;
+
+    std::vector<std::string> lines_formatter;
+    lines_formatter.reserve(num_moves);
+    const std::string axis_e = "E";
+    bench.start();
+    for (size_t i = 0; i < num_moves; ++ i) {
+        GCodeG1Formatter w;
+        w.emit_xyz(points[i]);
+        w.emit_e(axis_e, extrusions[i]);
+        lines_formatter.emplace_back(w.string());
+    }
+    bench.stop();
+    cout << "GCodeG1Formatter: " << std::setprecision(10) << bench.getElapsedSec() << " seconds." << endl;
+
+    size_t num_different = 0;
+    for (size_t i = 0; i < num_moves; ++ i)
+        if (lines_stream[i] != lines_formatter[i]) {
+            if (num_different ++ < 10)
+                cout << "Mismatch: " << lines_stream[i] << "      vs: " << lines_formatter[i];
+        }
+    cout << num_different << " of " << num_moves << " lines differ." << endl;
+
+    return (num_different == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <tuple>
+
+#include <libslic3r/libslic3r.h>
+#include <libslic3r/TriangleMesh.hpp>
+#include <libnest2d/tools/benchmark.h>
+
+#include <tbb/task_scheduler_init.h>
+
+const std::string USAGE_STR = {
+    "Usage: meshslicing stlfilename.stl [layer_height]"
+};
+
+int main(const int argc, const char *argv[]) {
+    using namespace Slic3r;
+    using std::cout; using std::endl;
+
+    if(argc < 2) {
+        cout << USAGE_STR << endl;
+        return EXIT_SUCCESS;
+    }
+
+    TriangleMesh model;
+    Benchmark bench;
+
+    model.ReadSTLFile(argv[1]);
+    model.repair();
+    model.align_to_origin();
+
+    const float layer_height = (argc > 2) ? float(atof(argv[2])) : 0.1f;
+    const BoundingBoxf3 bb = model.bounding_box();
+    std::vector<float> z;
+    for (float slice_z = 0.5f * layer_height; slice_z < float(bb.max(2)); slice_z += layer_height)
+        z.emplace_back(slice_z);
+
+    cout << model.facets_count() << " facets, " << z.size() << " layers" << endl;
+
+    const int max_threads = std::max<int>(1, std::thread::hardware_concurrency());
+    std::vector<int> thread_counts;
+    for (int num_threads = 1; num_threads < max_threads; num_threads *= 2)
+        thread_counts.emplace_back(num_threads);
+    thread_counts.emplace_back(max_threads);
+
+    // The slicer indexes the mesh once, the index is then reused by all the slice() calls.
+    bench.start();
+    TriangleMeshSlicer slicer(&model);
+    bench.stop();
+    cout << "Slicer setup: " << std::setprecision(4) << bench.getElapsedSec() << " seconds" << endl;
+
+    // The order of the islands of a layer and the start points of their contours depend on the order, in which
+    // the worker threads produced the intersection lines. Describe the islands by their bounding boxes and areas
+    // sorted, so that the slices produced by different thread counts or by two runs could be compared.
+    typedef std::tuple<coord_t, coord_t, coord_t, coord_t, double> IslandKey;
+    auto sorted_islands = [](const std::vector<ExPolygons> &layers) {
+        std::vector<std::vector<IslandKey>> out(layers.size());
+        for (size_t i = 0; i < layers.size(); ++ i) {
+            for (const ExPolygon &expoly : layers[i]) {
+                BoundingBox bbox = get_extents(expoly);
+                out[i].emplace_back(bbox.min(0), bbox.min(1), bbox.max(0), bbox.max(1), expoly.area());
+            }
+            std::sort(out[i].begin(), out[i].end());
+        }
+        return out;
+    };
+
+    // Slice the same mesh with an increasing number of worker threads to show how the slicing scales.
+    double time_single_thread = 0.;
+    std::vector<std::vector<IslandKey>> islands_single_thread;
+    for (int num_threads : thread_counts) {
+        tbb::task_scheduler_init tbb_init(num_threads);
+        std::vector<ExPolygons> layers;
+        bench.start();
+        slicer.slice(z, &layers, [](){});
+        bench.stop();
+        std::vector<std::vector<IslandKey>> islands = sorted_islands(layers);
+        if (num_threads == 1) {
+            time_single_thread = bench.getElapsedSec();
+            islands_single_thread = std::move(islands);
+        }
+        cout << std::setw(3) << num_threads << " threads: " << std::setprecision(4)
+             << bench.getElapsedSec() << " seconds, speedup " << time_single_thread / bench.getElapsedSec();
+        if (num_threads != 1 && islands != islands_single_thread)
+            cout << ", SLICES DIFFER FROM THE SINGLE THREADED RUN";
+        cout << endl;
+    }
+
+    for (size_t i = 0; i < islands_single_thread.size(); ++ i) {
+        cout << "Layer " << i << " z " << std::setprecision(6) << z[i] << ": " << islands_single_thread[i].size() << " islands";
+        for (const IslandKey &island : islands_single_thread[i])
+            cout << ", (" << unscale<double>(std::get<0>(island)) << ", " << unscale<double>(std::get<1>(island)) << ")-("
+                 << unscale<double>(std::get<2>(island)) << ", " << unscale<double>(std::get<3>(island)) << ") area "
+                 << std::get<4>(island) * SCALING_FACTOR * SCALING_FACTOR;
+        cout << endl;
+    }
+
+    return EXIT_SUCCESS;
+}
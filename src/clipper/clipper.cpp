@@ -723,12 +723,12 @@ bool ClipperBase::AddPath(const Path &pg, PolyType PolyTyp, bool Closed)
     return false;
 
   // Allocate a new edge array.
-  std::vector<TEdge> edges(highI + 1);
+  std::vector<TEdge> &edges = AllocateEdges(highI + 1);
   // Fill in the edge array.
   bool result = AddPathInternal(pg, highI, PolyTyp, Closed, edges.data());
-  if (result)
-    // Success, remember the edge array.
-    m_edges.emplace_back(std::move(edges));
+  if (! result)
+    // Failure, return the edge array.
+    -- m_edgesUsed;
   return result;
 }
 
@@ -756,7 +756,7 @@ bool ClipperBase::AddPaths(const Paths &ppg, PolyType PolyTyp, bool Closed)
     return false;
 
   // Allocate a new edge array.
-  std::vector<TEdge> edges(num_edges_total);
+  std::vector<TEdge> &edges = AllocateEdges(num_edges_total);
   // Fill in the edge array.
   bool result = false;
   TEdge *p_edge = edges.data();
@@ -768,12 +768,22 @@ bool ClipperBase::AddPaths(const Paths &ppg, PolyType PolyTyp, bool Closed)
         result = true;
       }
     }
-  if (result)
-    // At least some edges were generated. Remember the edge array.
-    m_edges.emplace_back(std::move(edges));
+  if (! result)
+    // No edges were generated. Return the edge array.
+    -- m_edgesUsed;
   return result;
 }
 
+std::vector<TEdge>& ClipperBase::AllocateEdges(size_t num_edges)
+{
+  if (m_edgesUsed == m_edges.size())
+    m_edges.emplace_back();
+  std::vector<TEdge> &edges = m_edges[m_edgesUsed ++];
+  // Zero the edges as if they were newly allocated.
+  edges.assign(num_edges, TEdge());
+  return edges;
+}
+
 bool ClipperBase::AddPathInternal(const Path &pg, int highI, PolyType PolyTyp, bool Closed, TEdge* edges)
 {
   PROFILE_FUNC();
@@ -952,12 +962,30 @@ void ClipperBase::Clear()
 {
   PROFILE_FUNC();
   m_MinimaList.clear();
-  m_edges.clear();
+  // Keep the edge arrays for reuse.
+  m_edgesUsed = 0;
   m_UseFullRange = false;
   m_HasOpenPaths = false;
 }
 //------------------------------------------------------------------------------
 
+size_t ClipperBase::RetainedMemory() const
+{
+  size_t mem = m_MinimaList.capacity() * sizeof(LocalMinimum) + m_edges.capacity() * sizeof(std::vector<TEdge>);
+  for (const std::vector<TEdge> &edges : m_edges)
+    mem += edges.capacity() * sizeof(TEdge);
+  return mem;
+}
+//------------------------------------------------------------------------------
+
+void ClipperBase::ReleaseMemory()
+{
+  std::vector<LocalMinimum>().swap(m_MinimaList);
+  std::vector<std::vector<TEdge>>().swap(m_edges);
+  m_edgesUsed = 0;
+}
+//------------------------------------------------------------------------------
+
 // Initialize the Local Minima List:
 // Sort the LML entries, initialize the left / right bound edges of each Local Minima.
 void ClipperBase::Reset()
@@ -1034,6 +1062,7 @@ IntRect ClipperBase::GetBounds()
 
 Clipper::Clipper(int initOptions) : 
   ClipperBase(),
+  m_OutPtsChunksUsed(0),
   m_OutPtsFree(nullptr),
   m_OutPtsChunkSize(32),
   m_OutPtsChunkLast(32),
@@ -1050,6 +1079,45 @@ Clipper::Clipper(int initOptions) :
 }
 //------------------------------------------------------------------------------
 
+Clipper::~Clipper()
+{
+  Clear();
+  for (OutPt *pts : m_OutPts)
+    delete[] pts;
+  for (OutRec *rec : m_PolyOutsFree)
+    delete rec;
+}
+//------------------------------------------------------------------------------
+
+size_t Clipper::RetainedMemory() const
+{
+  return ClipperBase::RetainedMemory() +
+    m_OutPts.size() * m_OutPtsChunkSize * sizeof(OutPt) +
+    (m_PolyOuts.size() + m_PolyOutsFree.size()) * sizeof(OutRec) +
+    (m_Joins.capacity() + m_GhostJoins.capacity()) * sizeof(Join) +
+    m_IntersectList.capacity() * sizeof(IntersectNode) +
+    m_Maxima.capacity() * sizeof(cInt);
+}
+//------------------------------------------------------------------------------
+
+void Clipper::ReleaseMemory()
+{
+  ClipperBase::ReleaseMemory();
+  DisposeAllOutRecs();
+  for (OutPt *pts : m_OutPts)
+    delete[] pts;
+  std::vector<OutPt*>().swap(m_OutPts);
+  for (OutRec *rec : m_PolyOutsFree)
+    delete rec;
+  std::vector<OutRec*>().swap(m_PolyOutsFree);
+  std::vector<OutRec*>().swap(m_PolyOuts);
+  std::vector<Join>().swap(m_Joins);
+  std::vector<Join>().swap(m_GhostJoins);
+  std::vector<IntersectNode>().swap(m_IntersectList);
+  std::vector<cInt>().swap(m_Maxima);
+}
+//------------------------------------------------------------------------------
+
 void Clipper::Reset()
 {
   PROFILE_FUNC();
@@ -1176,26 +1244,25 @@ OutPt* Clipper::AllocateOutPt()
     m_OutPtsFree = pt->Next;
   } else if (m_OutPtsChunkLast < m_OutPtsChunkSize) {
     // Get a point from the last chunk.
-    pt = m_OutPts.back() + (m_OutPtsChunkLast ++);
+    pt = m_OutPts[m_OutPtsChunksUsed - 1] + (m_OutPtsChunkLast ++);
   } else {
-    // The last chunk is full. Allocate a new one.
-    m_OutPts.push_back(new OutPt[m_OutPtsChunkSize]);
+    // The last chunk is full. Reuse a chunk of a previous operation or allocate a new one.
+    if (m_OutPtsChunksUsed == m_OutPts.size())
+      m_OutPts.push_back(new OutPt[m_OutPtsChunkSize]);
+    pt = m_OutPts[m_OutPtsChunksUsed ++];
     m_OutPtsChunkLast = 1;
-    pt = m_OutPts.back();
   }
   return pt;
 }
 
+// Release the output polygons and points. The memory is kept for the next operation of this Clipper instance.
 void Clipper::DisposeAllOutRecs()
 {
-  for (OutPt *pts : m_OutPts)
-    delete[] pts;
-  for (OutRec *rec : m_PolyOuts)
-    delete rec;
-  m_OutPts.clear();
+  m_PolyOutsFree.insert(m_PolyOutsFree.end(), m_PolyOuts.begin(), m_PolyOuts.end());
+  m_PolyOuts.clear();
+  m_OutPtsChunksUsed = 0;
   m_OutPtsFree = nullptr;
   m_OutPtsChunkLast = m_OutPtsChunkSize;
-  m_PolyOuts.clear();
 }
 //------------------------------------------------------------------------------
 
@@ -1975,7 +2042,13 @@ void Clipper::AppendPolygon(TEdge *e1, TEdge *e2) const
 
 OutRec* Clipper::CreateOutRec()
 {
-  OutRec* result = new OutRec;
+  OutRec* result;
+  if (m_PolyOutsFree.empty())
+    result = new OutRec;
+  else {
+    result = m_PolyOutsFree.back();
+    m_PolyOutsFree.pop_back();
+  }
   result->IsHole = false;
   result->IsOpen = false;
   result->FirstLeft = 0;
@@ -3320,20 +3393,62 @@ DoublePoint GetUnitNormal(const IntPoint &pt1, const IntPoint &pt2)
 // ClipperOffset class
 //------------------------------------------------------------------------------
 
+ClipperOffset::~ClipperOffset()
+{
+  Clear();
+  for (PolyNode *node : m_polyNodesFree)
+    delete node;
+}
+//------------------------------------------------------------------------------
+
+// Release the input paths. The nodes are kept for the next operation of this ClipperOffset instance.
 void ClipperOffset::Clear()
 {
-  for (int i = 0; i < m_polyNodes.ChildCount(); ++i)
-    delete m_polyNodes.Childs[i];
+  m_polyNodesFree.insert(m_polyNodesFree.end(), m_polyNodes.Childs.begin(), m_polyNodes.Childs.end());
   m_polyNodes.Childs.clear();
   m_lowest.X = -1;
 }
 //------------------------------------------------------------------------------
 
+size_t ClipperOffset::RetainedMemory() const
+{
+  size_t mem = m_clipper.RetainedMemory() + m_polyNodesFree.capacity() * sizeof(PolyNode*) +
+    (m_srcPoly.capacity() + m_destPoly.capacity()) * sizeof(IntPoint) + m_normals.capacity() * sizeof(DoublePoint);
+  for (const PolyNode *node : m_polyNodesFree)
+    mem += sizeof(PolyNode) + node->Contour.capacity() * sizeof(IntPoint);
+  for (const Path &path : m_destPolys)
+    mem += path.capacity() * sizeof(IntPoint);
+  return mem;
+}
+//------------------------------------------------------------------------------
+
+void ClipperOffset::ReleaseMemory()
+{
+  Clear();
+  for (PolyNode *node : m_polyNodesFree)
+    delete node;
+  PolyNodes().swap(m_polyNodesFree);
+  Paths().swap(m_destPolys);
+  Path().swap(m_srcPoly);
+  Path().swap(m_destPoly);
+  std::vector<DoublePoint>().swap(m_normals);
+  m_clipper.Clear();
+  m_clipper.ReleaseMemory();
+}
+//------------------------------------------------------------------------------
+
 void ClipperOffset::AddPath(const Path& path, JoinType joinType, EndType endType)
 {
   int highI = (int)path.size() - 1;
   if (highI < 0) return;
-  PolyNode* newNode = new PolyNode();
+  PolyNode* newNode;
+  if (m_polyNodesFree.empty())
+    newNode = new PolyNode();
+  else {
+    newNode = m_polyNodesFree.back();
+    m_polyNodesFree.pop_back();
+    newNode->Contour.clear();
+  }
   newNode->m_jointype = joinType;
   newNode->m_endtype = endType;
 
@@ -3373,7 +3488,7 @@ void ClipperOffset::AddPath(const Path& path, JoinType joinType, EndType endType
   }
   if (endType == etClosedPolygon && j < 2)
   {
-    delete newNode;
+    m_polyNodesFree.push_back(newNode);
     return;
   }
   m_polyNodes.AddChild(*newNode);
@@ -3433,7 +3548,9 @@ void ClipperOffset::Execute(Paths& solution, double delta)
   DoOffset(delta);
   
   //now clean up 'corners' ...
-  Clipper clpr;
+  Clipper &clpr = m_clipper;
+  clpr.Clear();
+  clpr.ReverseSolution(false);
   clpr.AddPaths(m_destPolys, ptSubject, true);
   if (delta > 0)
   {
@@ -3463,7 +3580,9 @@ void ClipperOffset::Execute(PolyTree& solution, double delta)
   DoOffset(delta);
 
   //now clean up 'corners' ...
-  Clipper clpr;
+  Clipper &clpr = m_clipper;
+  clpr.Clear();
+  clpr.ReverseSolution(false);
   clpr.AddPaths(m_destPolys, ptSubject, true);
   if (delta > 0)
   {
@@ -284,11 +284,15 @@ enum EdgeSide { esLeft = 1, esRight = 2};
 class ClipperBase
 {
 public:
-  ClipperBase() : m_UseFullRange(false), m_HasOpenPaths(false) {}
+  ClipperBase() : m_UseFullRange(false), m_edgesUsed(0), m_HasOpenPaths(false) {}
   ~ClipperBase() { Clear(); }
   bool AddPath(const Path &pg, PolyType PolyTyp, bool Closed);
   bool AddPaths(const Paths &ppg, PolyType PolyTyp, bool Closed);
   void Clear();
+  // Memory kept by Clear() for the next operation of this instance, in bytes.
+  size_t RetainedMemory() const;
+  // Release the memory kept by Clear(). To be called after Clear().
+  void ReleaseMemory();
   IntRect GetBounds();
   // By default, when three or more vertices are collinear in input polygons (subject or clip), the Clipper object removes the 'inner' vertices before clipping.
   // When enabled the PreserveCollinear property prevents this default behavior to allow these inner vertices to appear in the solution.
@@ -298,6 +302,8 @@ protected:
   bool AddPathInternal(const Path &pg, int highI, PolyType PolyTyp, bool Closed, TEdge* edges);
   TEdge* AddBoundsToLML(TEdge *e, bool IsClosed);
   void Reset();
+  // Get an edge array for a new input path, possibly recycling an edge array released by Clear().
+  std::vector<TEdge>& AllocateEdges(size_t num_edges);
   TEdge* ProcessBound(TEdge* E, bool IsClockwise);
   TEdge* DescendToMin(TEdge *&E);
   void AscendToMax(TEdge *&E, bool Appending, bool IsClosed);
@@ -308,8 +314,10 @@ protected:
   // True if the input polygons have abs values higher than loRange, but lower than hiRange.
   // False if the input polygons have abs values lower or equal to loRange.
   bool              m_UseFullRange;
-  // A vector of edges per each input path.
+  // A vector of edges per each input path. Only the first m_edgesUsed vectors are valid, the vectors are not released by Clear(),
+  // so that a Clipper instance reused for multiple operations does not allocate the edges over and over.
   std::vector<std::vector<TEdge>> m_edges;
+  size_t           m_edgesUsed;
   // Don't remove intermediate vertices of a collinear sequence of points.
   bool             m_PreserveCollinear;
   // Is any of the paths inserted by AddPath() or AddPaths() open?
@@ -321,8 +329,10 @@ class Clipper : public ClipperBase
 {
 public:
   Clipper(int initOptions = 0);
-  ~Clipper() { Clear(); }
+  ~Clipper();
   void Clear() { ClipperBase::Clear(); DisposeAllOutRecs(); }
+  size_t RetainedMemory() const;
+  void ReleaseMemory();
   bool Execute(ClipType clipType,
       Paths &solution,
       PolyFillType fillType = pftEvenOdd) 
@@ -354,8 +364,12 @@ private:
   
   // Output polygons.
   std::vector<OutRec*>  m_PolyOuts;
-  // Output points, allocated by a continuous sets of m_OutPtsChunkSize.
+  // Output polygons released by DisposeAllOutRecs(), to be reused by CreateOutRec().
+  std::vector<OutRec*>  m_PolyOutsFree;
+  // Output points, allocated by a continuous sets of m_OutPtsChunkSize. The first m_OutPtsChunksUsed chunks are in use,
+  // the chunks are not released by DisposeAllOutRecs(), so that they are reused by the next operation of this Clipper instance.
   std::vector<OutPt*>   m_OutPts;
+  size_t                m_OutPtsChunksUsed;
   // List of free output points, to be used before taking a point from m_OutPts or allocating a new chunk.
   OutPt                *m_OutPtsFree;
   size_t                m_OutPtsChunkSize;
@@ -441,12 +455,16 @@ class ClipperOffset
 public:
   ClipperOffset(double miterLimit = 2.0, double roundPrecision = 0.25, double shortestEdgeLength = 0.) :
     MiterLimit(miterLimit), ArcTolerance(roundPrecision), ShortestEdgeLength(shortestEdgeLength), m_lowest(-1, 0) {}
-  ~ClipperOffset() { Clear(); }
+  ~ClipperOffset();
   void AddPath(const Path& path, JoinType joinType, EndType endType);
   void AddPaths(const Paths& paths, JoinType joinType, EndType endType);
   void Execute(Paths& solution, double delta);
   void Execute(PolyTree& solution, double delta);
   void Clear();
+  // Memory kept by Clear() for the next operation of this instance, in bytes.
+  size_t RetainedMemory() const;
+  // Release the memory kept by Clear(). To be called after Clear().
+  void ReleaseMemory();
   double MiterLimit;
   double ArcTolerance;
   double ShortestEdgeLength;
@@ -459,6 +477,10 @@ private:
   double m_miterLim, m_StepsPerRad;
   IntPoint m_lowest;
   PolyNode m_polyNodes;
+  // Nodes released by Clear(), to be reused by AddPath() together with the memory allocated for their contours.
+  PolyNodes m_polyNodesFree;
+  // Clipper to clean up the offsetted polygons, reused by the following calls to Execute().
+  Clipper m_clipper;
 
   void FixOrientations();
   void DoOffset(double delta);
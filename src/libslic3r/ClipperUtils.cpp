@@ -1,6 +1,10 @@
 #include "ClipperUtils.hpp"
 #include "Geometry.hpp"
 
+#include <memory>
+
+#include <tbb/enumerable_thread_specific.h>
+
 // #define CLIPPER_UTILS_DEBUG
 
 #ifdef CLIPPER_UTILS_DEBUG
@@ -89,27 +93,181 @@ void unscaleClipperPolygons(ClipperLib::Paths &polygons)
         }
 }
 
+// Clipper and ClipperOffset engines are kept per thread and reused by the following Clipper operations of the same thread,
+// so that the memory the engines allocate for the edges, the output polygons and the output points is recycled
+// instead of being allocated and released by each operation. An engine retaining more than clipper_engine_retained_memory_max
+// after an operation is trimmed, so that the threads do not hold on to the memory of their largest operations.
+// MSVC 2013 does not support thread_local, therefore tbb::enumerable_thread_specific is used.
+template<typename Engine>
+struct ThreadLocalClipperEngine
+{
+    ThreadLocalClipperEngine() : busy(false) {}
+    Engine  engine;
+    // The engine is leased. A nested Clipper operation of the same thread (for example a task stolen by TBB
+    // while this thread waits for its tasks) will use a temporary engine.
+    bool    busy;
+};
+
+static const size_t clipper_engine_retained_memory_max = 8 * 1024 * 1024;
+
+// Reset the engine into the state of a newly constructed engine, keeping the allocated memory.
+static inline void reset_clipper_engine(ClipperLib::Clipper &clipper)
+{
+    clipper.Clear();
+    clipper.PreserveCollinear(false);
+    clipper.StrictlySimple(false);
+    clipper.ReverseSolution(false);
+}
+
+static inline void reset_clipper_engine(ClipperLib::ClipperOffset &co)
+{
+    co.Clear();
+    co.MiterLimit         = 2.;
+    co.ArcTolerance       = 0.25;
+    co.ShortestEdgeLength = 0.;
+}
+
+// Lease of the thread local Clipper / ClipperOffset engine for the duration of a Clipper operation.
+template<typename Engine>
+class ClipperEngineLease
+{
+public:
+    ClipperEngineLease() : m_thread_engine(s_engines.local()) {
+        if (m_thread_engine.busy)
+            m_temp_engine.reset(new Engine());
+        else {
+            m_thread_engine.busy = true;
+            reset_clipper_engine(m_thread_engine.engine);
+        }
+    }
+    ~ClipperEngineLease() {
+        if (! m_temp_engine) {
+            // Release the input paths, keep the memory up to clipper_engine_retained_memory_max.
+            Engine &engine = m_thread_engine.engine;
+            engine.Clear();
+            if (engine.RetainedMemory() > clipper_engine_retained_memory_max)
+                engine.ReleaseMemory();
+            m_thread_engine.busy = false;
+        }
+    }
+
+    Engine& engine() { return m_temp_engine ? *m_temp_engine : m_thread_engine.engine; }
+
+private:
+    ClipperEngineLease(const ClipperEngineLease&) = delete;
+    ClipperEngineLease& operator=(const ClipperEngineLease&) = delete;
+
+    static tbb::enumerable_thread_specific<ThreadLocalClipperEngine<Engine>> s_engines;
+
+    ThreadLocalClipperEngine<Engine>   &m_thread_engine;
+    std::unique_ptr<Engine>             m_temp_engine;
+};
+
+template<typename Engine>
+tbb::enumerable_thread_specific<ThreadLocalClipperEngine<Engine>> ClipperEngineLease<Engine>::s_engines;
+
+// Slic3r::Point stores its coordinates as a pair of 32bit coord_t, while ClipperLib::IntPoint stores a pair of 64bit cInt,
+// therefore the Slic3r paths cannot be passed to Clipper in place. The conversions below are done in a single pass
+// into exactly sized containers. The offset variants shift the coordinates up by CLIPPER_OFFSET_POWER_OF_2 while converting
+// to Clipper and back down while converting to Slic3r, saving the separate (un)scaling passes over the Clipper paths.
+static inline void points_to_clipper_path(const Points &points, ClipperLib::Path &out)
+{
+    out.resize(points.size());
+    ClipperLib::IntPoint *dst = out.data();
+    for (const Point &pt : points)
+        *dst ++ = ClipperLib::IntPoint(pt(0), pt(1));
+}
+
+static inline void points_to_clipper_path_scaled(const Points &points, ClipperLib::Path &out)
+{
+    out.resize(points.size());
+    ClipperLib::IntPoint *dst = out.data();
+    for (const Point &pt : points)
+        *dst ++ = ClipperLib::IntPoint(ClipperLib::cInt(pt(0)) << CLIPPER_OFFSET_POWER_OF_2, ClipperLib::cInt(pt(1)) << CLIPPER_OFFSET_POWER_OF_2);
+}
+
+static inline void points_to_clipper_path_scaled_reversed(const Points &points, ClipperLib::Path &out)
+{
+    out.resize(points.size());
+    ClipperLib::IntPoint *dst = out.data();
+    for (Points::const_reverse_iterator it = points.rbegin(); it != points.rend(); ++ it)
+        *dst ++ = ClipperLib::IntPoint(ClipperLib::cInt((*it)(0)) << CLIPPER_OFFSET_POWER_OF_2, ClipperLib::cInt((*it)(1)) << CLIPPER_OFFSET_POWER_OF_2);
+}
+
+static inline void clipper_path_to_points(const ClipperLib::Path &path, Points &out)
+{
+    out.clear();
+    out.reserve(path.size());
+    for (const ClipperLib::IntPoint &pt : path)
+        out.emplace_back(coord_t(pt.X), coord_t(pt.Y));
+}
+
+static inline Polygons clipper_paths_to_polygons_unscaled(const ClipperLib::Paths &input)
+{
+    Polygons retval(input.size());
+    for (size_t i = 0; i < input.size(); ++ i) {
+        Points &out = retval[i].points;
+        out.reserve(input[i].size());
+        for (const ClipperLib::IntPoint &pt : input[i])
+            out.emplace_back(
+                coord_t((pt.X + CLIPPER_OFFSET_SCALE_ROUNDING_DELTA) >> CLIPPER_OFFSET_POWER_OF_2),
+                coord_t((pt.Y + CLIPPER_OFFSET_SCALE_ROUNDING_DELTA) >> CLIPPER_OFFSET_POWER_OF_2));
+    }
+    return retval;
+}
+
+template<typename MultiPointsType>
+static inline ClipperLib::Paths multipoints_to_clipper_paths_scaled(const MultiPointsType &input)
+{
+    ClipperLib::Paths retval(input.size());
+    for (size_t i = 0; i < input.size(); ++ i)
+        points_to_clipper_path_scaled(input[i].points, retval[i]);
+    return retval;
+}
+
+static inline ClipperLib::Paths multipoint_to_clipper_paths_scaled(const MultiPoint &input)
+{
+    ClipperLib::Paths retval(1);
+    points_to_clipper_path_scaled(input.points, retval.front());
+    return retval;
+}
+
 //-----------------------------------------------------------
 // legacy code from Clipper documentation
 void AddOuterPolyNodeToExPolygons(ClipperLib::PolyNode& polynode, ExPolygons* expolygons)
 {  
   size_t cnt = expolygons->size();
   expolygons->resize(cnt + 1);
-  (*expolygons)[cnt].contour = ClipperPath_to_Slic3rPolygon(polynode.Contour);
+  clipper_path_to_points(polynode.Contour, (*expolygons)[cnt].contour.points);
   (*expolygons)[cnt].holes.resize(polynode.ChildCount());
   for (int i = 0; i < polynode.ChildCount(); ++i)
   {
-    (*expolygons)[cnt].holes[i] = ClipperPath_to_Slic3rPolygon(polynode.Childs[i]->Contour);
+    clipper_path_to_points(polynode.Childs[i]->Contour, (*expolygons)[cnt].holes[i].points);
     //Add outer polygons contained by (nested within) holes ...
     for (int j = 0; j < polynode.Childs[i]->ChildCount(); ++j)
       AddOuterPolyNodeToExPolygons(*polynode.Childs[i]->Childs[j], expolygons);
   }
 }
  
+// Number of the outer contours in the subtree, thus the number of ExPolygons produced by AddOuterPolyNodeToExPolygons().
+static size_t count_outer_poly_nodes(const ClipperLib::PolyNode &polynode)
+{
+    size_t cnt = 1;
+    for (const ClipperLib::PolyNode *hole : polynode.Childs)
+        for (const ClipperLib::PolyNode *outer : hole->Childs)
+            cnt += count_outer_poly_nodes(*outer);
+    return cnt;
+}
+ 
 ExPolygons
 PolyTreeToExPolygons(ClipperLib::PolyTree& polytree)
 {
     ExPolygons retval;
+    // Reserve exactly to avoid reallocation, which would copy the already converted ExPolygons.
+    size_t cnt = 0;
+    for (const ClipperLib::PolyNode *outer : polytree.Childs)
+        cnt += count_outer_poly_nodes(*outer);
+    retval.reserve(cnt);
     for (int i = 0; i < polytree.ChildCount(); ++i)
         AddOuterPolyNodeToExPolygons(*polytree.Childs[i], &retval);
     return retval;
@@ -119,34 +277,30 @@ PolyTreeToExPolygons(ClipperLib::PolyTree& polytree)
 Slic3r::Polygon ClipperPath_to_Slic3rPolygon(const ClipperLib::Path &input)
 {
     Polygon retval;
-    for (ClipperLib::Path::const_iterator pit = input.begin(); pit != input.end(); ++pit)
-        retval.points.push_back(Point( (*pit).X, (*pit).Y ));
+    clipper_path_to_points(input, retval.points);
     return retval;
 }
 
 Slic3r::Polyline ClipperPath_to_Slic3rPolyline(const ClipperLib::Path &input)
 {
     Polyline retval;
-    for (ClipperLib::Path::const_iterator pit = input.begin(); pit != input.end(); ++pit)
-        retval.points.push_back(Point( (*pit).X, (*pit).Y ));
+    clipper_path_to_points(input, retval.points);
     return retval;
 }
 
 Slic3r::Polygons ClipperPaths_to_Slic3rPolygons(const ClipperLib::Paths &input)
 {
-    Slic3r::Polygons retval;
-    retval.reserve(input.size());
-    for (ClipperLib::Paths::const_iterator it = input.begin(); it != input.end(); ++it)
-        retval.push_back(ClipperPath_to_Slic3rPolygon(*it));
+    Slic3r::Polygons retval(input.size());
+    for (size_t i = 0; i < input.size(); ++ i)
+        clipper_path_to_points(input[i], retval[i].points);
     return retval;
 }
 
 Slic3r::Polylines ClipperPaths_to_Slic3rPolylines(const ClipperLib::Paths &input)
 {
-    Slic3r::Polylines retval;
-    retval.reserve(input.size());
-    for (ClipperLib::Paths::const_iterator it = input.begin(); it != input.end(); ++it)
-        retval.push_back(ClipperPath_to_Slic3rPolyline(*it));
+    Slic3r::Polylines retval(input.size());
+    for (size_t i = 0; i < input.size(); ++ i)
+        clipper_path_to_points(input[i], retval[i].points);
     return retval;
 }
 
@@ -154,8 +308,8 @@ ExPolygons
 ClipperPaths_to_Slic3rExPolygons(const ClipperLib::Paths &input)
 {
     // init Clipper
-    ClipperLib::Clipper clipper;
-    clipper.Clear();
+    ClipperEngineLease<ClipperLib::Clipper> clipper_lease;
+    ClipperLib::Clipper &clipper = clipper_lease.engine();
     
     // perform union
     clipper.AddPaths(input, ClipperLib::ptSubject, true);
@@ -170,8 +324,7 @@ ClipperLib::Path
 Slic3rMultiPoint_to_ClipperPath(const MultiPoint &input)
 {
     ClipperLib::Path retval;
-    for (Points::const_iterator pit = input.points.begin(); pit != input.points.end(); ++pit)
-        retval.push_back(ClipperLib::IntPoint( (*pit)(0), (*pit)(1) ));
+    points_to_clipper_path(input.points, retval);
     return retval;
 }
 
@@ -187,27 +340,26 @@ Slic3rMultiPoint_to_ClipperPath_reversed(const Slic3r::MultiPoint &input)
 
 ClipperLib::Paths Slic3rMultiPoints_to_ClipperPaths(const Polygons &input)
 {
-    ClipperLib::Paths retval;
-    for (Polygons::const_iterator it = input.begin(); it != input.end(); ++it)
-        retval.push_back(Slic3rMultiPoint_to_ClipperPath(*it));
+    ClipperLib::Paths retval(input.size());
+    for (size_t i = 0; i < input.size(); ++ i)
+        points_to_clipper_path(input[i].points, retval[i]);
     return retval;
 }
 
 ClipperLib::Paths Slic3rMultiPoints_to_ClipperPaths(const Polylines &input)
 {
-    ClipperLib::Paths retval;
-    for (Polylines::const_iterator it = input.begin(); it != input.end(); ++it)
-        retval.push_back(Slic3rMultiPoint_to_ClipperPath(*it));
+    ClipperLib::Paths retval(input.size());
+    for (size_t i = 0; i < input.size(); ++ i)
+        points_to_clipper_path(input[i].points, retval[i]);
     return retval;
 }
 
-ClipperLib::Paths _offset(ClipperLib::Paths &&input, ClipperLib::EndType endType, const float delta, ClipperLib::JoinType joinType, double miterLimit)
+// Offset the input scaled by CLIPPER_OFFSET_SCALE, the output is scaled as well.
+static ClipperLib::Paths _offset_scaled(const ClipperLib::Paths &input, ClipperLib::EndType endType, const float delta, ClipperLib::JoinType joinType, double miterLimit)
 {
-    // scale input
-    scaleClipperPolygons(input);
-    
     // perform offset
-    ClipperLib::ClipperOffset co;
+    ClipperEngineLease<ClipperLib::ClipperOffset> co_lease;
+    ClipperLib::ClipperOffset &co = co_lease.engine();
     if (joinType == jtRound)
         co.ArcTolerance = miterLimit;
     else
@@ -217,6 +369,16 @@ ClipperLib::Paths _offset(ClipperLib::Paths &&input, ClipperLib::EndType endType
     co.AddPaths(input, joinType, endType);
     ClipperLib::Paths retval;
     co.Execute(retval, delta_scaled);
+    return retval;
+}
+
+ClipperLib::Paths _offset(ClipperLib::Paths &&input, ClipperLib::EndType endType, const float delta, ClipperLib::JoinType joinType, double miterLimit)
+{
+    // scale input
+    scaleClipperPolygons(input);
+    
+    // perform offset
+    ClipperLib::Paths retval = _offset_scaled(input, endType, delta, joinType, miterLimit);
     
     // unscale output
     unscaleClipperPolygons(retval);
@@ -230,10 +392,80 @@ ClipperLib::Paths _offset(ClipperLib::Path &&input, ClipperLib::EndType endType,
 	return _offset(std::move(paths), endType, delta, joinType, miterLimit);
 }
 
+Slic3r::Polygons offset(const Slic3r::Polygon &polygon, const float delta, ClipperLib::JoinType joinType, double miterLimit)
+    { return clipper_paths_to_polygons_unscaled(_offset_scaled(multipoint_to_clipper_paths_scaled(polygon), ClipperLib::etClosedPolygon, delta, joinType, miterLimit)); }
+Slic3r::Polygons offset(const Slic3r::Polygons &polygons, const float delta, ClipperLib::JoinType joinType, double miterLimit)
+    { return clipper_paths_to_polygons_unscaled(_offset_scaled(multipoints_to_clipper_paths_scaled(polygons), ClipperLib::etClosedPolygon, delta, joinType, miterLimit)); }
+Slic3r::Polygons offset(const Slic3r::Polyline &polyline, const float delta, ClipperLib::JoinType joinType, double miterLimit)
+    { return clipper_paths_to_polygons_unscaled(_offset_scaled(multipoint_to_clipper_paths_scaled(polyline), ClipperLib::etOpenButt, delta, joinType, miterLimit)); }
+Slic3r::Polygons offset(const Slic3r::Polylines &polylines, const float delta, ClipperLib::JoinType joinType, double miterLimit)
+    { return clipper_paths_to_polygons_unscaled(_offset_scaled(multipoints_to_clipper_paths_scaled(polylines), ClipperLib::etOpenButt, delta, joinType, miterLimit)); }
+
+// The union producing the ExPolygons is performed on the unscaled offset, therefore the Clipper paths are unscaled in place first.
+Slic3r::ExPolygons offset_ex(const Slic3r::Polygon &polygon, const float delta, ClipperLib::JoinType joinType, double miterLimit)
+{
+    ClipperLib::Paths output = _offset_scaled(multipoint_to_clipper_paths_scaled(polygon), ClipperLib::etClosedPolygon, delta, joinType, miterLimit);
+    unscaleClipperPolygons(output);
+    return ClipperPaths_to_Slic3rExPolygons(output);
+}
+
+Slic3r::ExPolygons offset_ex(const Slic3r::Polygons &polygons, const float delta, ClipperLib::JoinType joinType, double miterLimit)
+{
+    ClipperLib::Paths output = _offset_scaled(multipoints_to_clipper_paths_scaled(polygons), ClipperLib::etClosedPolygon, delta, joinType, miterLimit);
+    unscaleClipperPolygons(output);
+    return ClipperPaths_to_Slic3rExPolygons(output);
+}
+
+static void expolygon_to_clipper_scaled(const Slic3r::ExPolygon &expolygon, ScaledExPolygon &out)
+{
+    points_to_clipper_path_scaled(expolygon.contour.points, out.contour);
+    out.holes.resize(expolygon.holes.size());
+    for (size_t i = 0; i < expolygon.holes.size(); ++ i)
+        points_to_clipper_path_scaled_reversed(expolygon.holes[i].points, out.holes[i]);
+}
+
+static ScaledExPolygons expolygons_to_clipper_scaled(const Slic3r::ExPolygons &expolygons)
+{
+    ScaledExPolygons retval(expolygons.size());
+    for (size_t i = 0; i < expolygons.size(); ++ i)
+        expolygon_to_clipper_scaled(expolygons[i], retval[i]);
+    return retval;
+}
+
+static void clipper_path_to_clipper_path_scaled(const ClipperLib::Path &path, ClipperLib::Path &out)
+{
+    out.resize(path.size());
+    ClipperLib::IntPoint *dst = out.data();
+    for (const ClipperLib::IntPoint &pt : path)
+        *dst ++ = ClipperLib::IntPoint(ClipperLib::cInt(coord_t(pt.X)) << CLIPPER_OFFSET_POWER_OF_2, ClipperLib::cInt(coord_t(pt.Y)) << CLIPPER_OFFSET_POWER_OF_2);
+}
+
+static void clipper_path_to_clipper_path_scaled_reversed(const ClipperLib::Path &path, ClipperLib::Path &out)
+{
+    out.resize(path.size());
+    ClipperLib::IntPoint *dst = out.data();
+    for (ClipperLib::Path::const_reverse_iterator it = path.rbegin(); it != path.rend(); ++ it)
+        *dst ++ = ClipperLib::IntPoint(ClipperLib::cInt(coord_t(it->X)) << CLIPPER_OFFSET_POWER_OF_2, ClipperLib::cInt(coord_t(it->Y)) << CLIPPER_OFFSET_POWER_OF_2);
+}
+
+// Same as AddOuterPolyNodeToExPolygons() followed by expolygons_to_clipper_scaled().
+static void add_outer_poly_node_to_scaled_expolygons(const ClipperLib::PolyNode &polynode, ScaledExPolygons &out)
+{
+    size_t cnt = out.size();
+    out.emplace_back();
+    clipper_path_to_clipper_path_scaled(polynode.Contour, out[cnt].contour);
+    out[cnt].holes.resize(polynode.ChildCount());
+    for (int i = 0; i < polynode.ChildCount(); ++ i) {
+        clipper_path_to_clipper_path_scaled_reversed(polynode.Childs[i]->Contour, out[cnt].holes[i]);
+        for (int j = 0; j < polynode.Childs[i]->ChildCount(); ++ j)
+            add_outer_poly_node_to_scaled_expolygons(*polynode.Childs[i]->Childs[j], out);
+    }
+}
+
 // This is a safe variant of the polygon offset, tailored for a single ExPolygon:
 // a single polygon with multiple non-overlapping holes.
 // Each contour and hole is offsetted separately, then the holes are subtracted from the outer contours.
-ClipperLib::Paths _offset(const Slic3r::ExPolygon &expolygon, const float delta,
+static ClipperLib::Paths _offset_scaled(const ScaledExPolygon &expolygon, const float delta,
     ClipperLib::JoinType joinType, double miterLimit)
 {
 //    printf("new ExPolygon offset\n");
@@ -241,15 +473,14 @@ ClipperLib::Paths _offset(const Slic3r::ExPolygon &expolygon, const float delta,
     const float delta_scaled = delta * float(CLIPPER_OFFSET_SCALE);
     ClipperLib::Paths contours;
     {
-        ClipperLib::Path input = Slic3rMultiPoint_to_ClipperPath(expolygon.contour);
-        scaleClipperPolygon(input);
-        ClipperLib::ClipperOffset co;
+        ClipperEngineLease<ClipperLib::ClipperOffset> co_lease;
+        ClipperLib::ClipperOffset &co = co_lease.engine();
         if (joinType == jtRound)
             co.ArcTolerance = miterLimit * double(CLIPPER_OFFSET_SCALE);
         else
             co.MiterLimit = miterLimit;
         co.ShortestEdgeLength = double(std::abs(delta_scaled * CLIPPER_OFFSET_SHORTEST_EDGE_FACTOR));
-        co.AddPath(input, joinType, ClipperLib::etClosedPolygon);
+        co.AddPath(expolygon.contour, joinType, ClipperLib::etClosedPolygon);
         co.Execute(contours, delta_scaled);
     }
 
@@ -257,19 +488,18 @@ ClipperLib::Paths _offset(const Slic3r::ExPolygon &expolygon, const float delta,
     ClipperLib::Paths holes;
     {
         holes.reserve(expolygon.holes.size());
-        for (Polygons::const_iterator it_hole = expolygon.holes.begin(); it_hole != expolygon.holes.end(); ++ it_hole) {
-            ClipperLib::Path input = Slic3rMultiPoint_to_ClipperPath_reversed(*it_hole);
-            scaleClipperPolygon(input);
-            ClipperLib::ClipperOffset co;
+        for (const ClipperLib::Path &hole : expolygon.holes) {
+            ClipperEngineLease<ClipperLib::ClipperOffset> co_lease;
+            ClipperLib::ClipperOffset &co = co_lease.engine();
             if (joinType == jtRound)
                 co.ArcTolerance = miterLimit * double(CLIPPER_OFFSET_SCALE);
             else
                 co.MiterLimit = miterLimit;
             co.ShortestEdgeLength = double(std::abs(delta_scaled * CLIPPER_OFFSET_SHORTEST_EDGE_FACTOR));
-            co.AddPath(input, joinType, ClipperLib::etClosedPolygon);
+            co.AddPath(hole, joinType, ClipperLib::etClosedPolygon);
             ClipperLib::Paths out;
             co.Execute(out, - delta_scaled);
-            holes.insert(holes.end(), out.begin(), out.end());
+            holes.insert(holes.end(), std::make_move_iterator(out.begin()), std::make_move_iterator(out.end()));
         }
     }
 
@@ -278,90 +508,109 @@ ClipperLib::Paths _offset(const Slic3r::ExPolygon &expolygon, const float delta,
     if (holes.empty()) {
         output = std::move(contours);
     } else {
-        ClipperLib::Clipper clipper;
-        clipper.Clear();
+        ClipperEngineLease<ClipperLib::Clipper> clipper_lease;
+        ClipperLib::Clipper &clipper = clipper_lease.engine();
         clipper.AddPaths(contours, ClipperLib::ptSubject, true);
         clipper.AddPaths(holes, ClipperLib::ptClip, true);
         clipper.Execute(ClipperLib::ctDifference, output, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
     }
     
-    // 4) Unscale the output.
+    // The output is scaled by CLIPPER_OFFSET_SCALE.
+    return output;
+}
+
+static ClipperLib::Paths _offset_scaled(const Slic3r::ExPolygon &expolygon, const float delta,
+    ClipperLib::JoinType joinType, double miterLimit)
+{
+    ScaledExPolygon input;
+    expolygon_to_clipper_scaled(expolygon, input);
+    return _offset_scaled(input, delta, joinType, miterLimit);
+}
+
+ClipperLib::Paths _offset(const Slic3r::ExPolygon &expolygon, const float delta,
+    ClipperLib::JoinType joinType, double miterLimit)
+{
+    ClipperLib::Paths output = _offset_scaled(expolygon, delta, joinType, miterLimit);
     unscaleClipperPolygons(output);
     return output;
 }
 
+Slic3r::Polygons offset(const Slic3r::ExPolygon &expolygon, const float delta, ClipperLib::JoinType joinType, double miterLimit)
+    { return clipper_paths_to_polygons_unscaled(_offset_scaled(expolygon, delta, joinType, miterLimit)); }
+
 // This is a safe variant of the polygons offset, tailored for multiple ExPolygons.
 // It is required, that the input expolygons do not overlap and that the holes of each ExPolygon don't intersect with their respective outer contours.
 // Each ExPolygon is offsetted separately, then the offsetted ExPolygons are united.
-ClipperLib::Paths _offset(const Slic3r::ExPolygons &expolygons, const float delta,
+// The ExPolygons are accessed by expolygon(i) for i in [0, num_expolygons) as ScaledExPolygon.
+template<typename ExPolygonFn>
+static ClipperLib::Paths _offset_scaled_expolygons(ExPolygonFn expolygon, size_t num_expolygons, const float delta,
     ClipperLib::JoinType joinType, double miterLimit)
 {
     const float delta_scaled = delta * float(CLIPPER_OFFSET_SCALE);
     // Offsetted ExPolygons before they are united.
     ClipperLib::Paths contours_cummulative;
-    contours_cummulative.reserve(expolygons.size());
+    contours_cummulative.reserve(num_expolygons);
     // How many non-empty offsetted expolygons were actually collected into contours_cummulative?
     // If only one, then there is no need to do a final union.
     size_t expolygons_collected = 0;
-    for (Slic3r::ExPolygons::const_iterator it_expoly = expolygons.begin(); it_expoly != expolygons.end(); ++ it_expoly) {
+    for (size_t idx_expoly = 0; idx_expoly < num_expolygons; ++ idx_expoly) {
+        const ScaledExPolygon &expoly = expolygon(idx_expoly);
         // 1) Offset the outer contour.
         ClipperLib::Paths contours;
         {
-            ClipperLib::Path input = Slic3rMultiPoint_to_ClipperPath(it_expoly->contour);
-            scaleClipperPolygon(input);
-            ClipperLib::ClipperOffset co;
+            ClipperEngineLease<ClipperLib::ClipperOffset> co_lease;
+            ClipperLib::ClipperOffset &co = co_lease.engine();
             if (joinType == jtRound)
                 co.ArcTolerance = miterLimit * double(CLIPPER_OFFSET_SCALE);
             else
                 co.MiterLimit = miterLimit;
             co.ShortestEdgeLength = double(std::abs(delta_scaled * CLIPPER_OFFSET_SHORTEST_EDGE_FACTOR));
-            co.AddPath(input, joinType, ClipperLib::etClosedPolygon);
+            co.AddPath(expoly.contour, joinType, ClipperLib::etClosedPolygon);
             co.Execute(contours, delta_scaled);
         }
         if (contours.empty())
             // No need to try to offset the holes.
             continue;
 
-        if (it_expoly->holes.empty()) {
+        if (expoly.holes.empty()) {
             // No need to subtract holes from the offsetted expolygon, we are done.
-            contours_cummulative.insert(contours_cummulative.end(), contours.begin(), contours.end());
+            contours_cummulative.insert(contours_cummulative.end(), std::make_move_iterator(contours.begin()), std::make_move_iterator(contours.end()));
             ++ expolygons_collected;
         } else {
             // 2) Offset the holes one by one, collect the offsetted holes.
             ClipperLib::Paths holes;
             {
-                for (Polygons::const_iterator it_hole = it_expoly->holes.begin(); it_hole != it_expoly->holes.end(); ++ it_hole) {
-                    ClipperLib::Path input = Slic3rMultiPoint_to_ClipperPath_reversed(*it_hole);
-                    scaleClipperPolygon(input);
-                    ClipperLib::ClipperOffset co;
+                for (const ClipperLib::Path &hole : expoly.holes) {
+                    ClipperEngineLease<ClipperLib::ClipperOffset> co_lease;
+                    ClipperLib::ClipperOffset &co = co_lease.engine();
                     if (joinType == jtRound)
                         co.ArcTolerance = miterLimit * double(CLIPPER_OFFSET_SCALE);
                     else
                         co.MiterLimit = miterLimit;
                     co.ShortestEdgeLength = double(std::abs(delta_scaled * CLIPPER_OFFSET_SHORTEST_EDGE_FACTOR));
-                    co.AddPath(input, joinType, ClipperLib::etClosedPolygon);
+                    co.AddPath(hole, joinType, ClipperLib::etClosedPolygon);
                     ClipperLib::Paths out;
                     co.Execute(out, - delta_scaled);
-                    holes.insert(holes.end(), out.begin(), out.end());
+                    holes.insert(holes.end(), std::make_move_iterator(out.begin()), std::make_move_iterator(out.end()));
                 }
             }
 
             // 3) Subtract holes from the contours.
             if (holes.empty()) {
                 // No hole remaining after an offset. Just copy the outer contour.
-                contours_cummulative.insert(contours_cummulative.end(), contours.begin(), contours.end());
+                contours_cummulative.insert(contours_cummulative.end(), std::make_move_iterator(contours.begin()), std::make_move_iterator(contours.end()));
                 ++ expolygons_collected;
             } else if (delta < 0) {
                 // Negative offset. There is a chance, that the offsetted hole intersects the outer contour. 
                 // Subtract the offsetted holes from the offsetted contours.
-                ClipperLib::Clipper clipper;
-                clipper.Clear();
+                ClipperEngineLease<ClipperLib::Clipper> clipper_lease;
+                ClipperLib::Clipper &clipper = clipper_lease.engine();
                 clipper.AddPaths(contours, ClipperLib::ptSubject, true);
                 clipper.AddPaths(holes, ClipperLib::ptClip, true);
                 ClipperLib::Paths output;
                 clipper.Execute(ClipperLib::ctDifference, output, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
                 if (! output.empty()) {
-                    contours_cummulative.insert(contours_cummulative.end(), output.begin(), output.end());
+                    contours_cummulative.insert(contours_cummulative.end(), std::make_move_iterator(output.begin()), std::make_move_iterator(output.end()));
                     ++ expolygons_collected;
                 } else {
                     // The offsetted holes have eaten up the offsetted outer contour.
@@ -371,11 +620,11 @@ ClipperLib::Paths _offset(const Slic3r::ExPolygons &expolygons, const float delt
                 // area than the original hole or even disappear, therefore there will be no new intersections.
                 // Just collect the reversed holes.
                 contours_cummulative.reserve(contours.size() + holes.size());
-                contours_cummulative.insert(contours_cummulative.end(), contours.begin(), contours.end());
+                contours_cummulative.insert(contours_cummulative.end(), std::make_move_iterator(contours.begin()), std::make_move_iterator(contours.end()));
                 // Reverse the holes in place.
                 for (size_t i = 0; i < holes.size(); ++ i)
                     std::reverse(holes[i].begin(), holes[i].end());
-                contours_cummulative.insert(contours_cummulative.end(), holes.begin(), holes.end());
+                contours_cummulative.insert(contours_cummulative.end(), std::make_move_iterator(holes.begin()), std::make_move_iterator(holes.end()));
                 ++ expolygons_collected;
             }
         }
@@ -385,8 +634,8 @@ ClipperLib::Paths _offset(const Slic3r::ExPolygons &expolygons, const float delt
     ClipperLib::Paths output;
     if (expolygons_collected > 1 && delta > 0) {
         // There is a chance that the outwards offsetted expolygons may intersect. Perform a union.
-        ClipperLib::Clipper clipper;
-        clipper.Clear(); 
+        ClipperEngineLease<ClipperLib::Clipper> clipper_lease;
+        ClipperLib::Clipper &clipper = clipper_lease.engine();
         clipper.AddPaths(contours_cummulative, ClipperLib::ptSubject, true);
         clipper.Execute(ClipperLib::ctUnion, output, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
     } else {
@@ -394,23 +643,48 @@ ClipperLib::Paths _offset(const Slic3r::ExPolygons &expolygons, const float delt
         output = std::move(contours_cummulative);
     }
     
-    // 4) Unscale the output.
+    // The output is scaled by CLIPPER_OFFSET_SCALE.
+    return output;
+}
+
+static ClipperLib::Paths _offset_scaled(const Slic3r::ExPolygons &expolygons, const float delta,
+    ClipperLib::JoinType joinType, double miterLimit)
+{
+    // Each ExPolygon is converted to the scaled Clipper paths just before it is offsetted.
+    ScaledExPolygon input;
+    return _offset_scaled_expolygons(
+        [&expolygons, &input](size_t i) -> const ScaledExPolygon& { expolygon_to_clipper_scaled(expolygons[i], input); return input; },
+        expolygons.size(), delta, joinType, miterLimit);
+}
+
+static ClipperLib::Paths _offset_scaled(const ScaledExPolygons &expolygons, const float delta,
+    ClipperLib::JoinType joinType, double miterLimit)
+{
+    return _offset_scaled_expolygons([&expolygons](size_t i) -> const ScaledExPolygon& { return expolygons[i]; },
+        expolygons.size(), delta, joinType, miterLimit);
+}
+
+ClipperLib::Paths _offset(const Slic3r::ExPolygons &expolygons, const float delta,
+    ClipperLib::JoinType joinType, double miterLimit)
+{
+    ClipperLib::Paths output = _offset_scaled(expolygons, delta, joinType, miterLimit);
     unscaleClipperPolygons(output);
     return output;
 }
 
-ClipperLib::Paths
-_offset2(const Polygons &polygons, const float delta1, const float delta2,
+Slic3r::Polygons offset(const Slic3r::ExPolygons &expolygons, const float delta, ClipperLib::JoinType joinType, double miterLimit)
+    { return clipper_paths_to_polygons_unscaled(_offset_scaled(expolygons, delta, joinType, miterLimit)); }
+
+static ClipperLib::Paths
+_offset2_scaled(const Polygons &polygons, const float delta1, const float delta2,
     const ClipperLib::JoinType joinType, const double miterLimit)
 {
-    // read input
-    ClipperLib::Paths input = Slic3rMultiPoints_to_ClipperPaths(polygons);
-    
-    // scale input
-    scaleClipperPolygons(input);
+    // read and scale input
+    ClipperLib::Paths input = multipoints_to_clipper_paths_scaled(polygons);
     
     // prepare ClipperOffset object
-    ClipperLib::ClipperOffset co;
+    ClipperEngineLease<ClipperLib::ClipperOffset> co_lease;
+    ClipperLib::ClipperOffset &co = co_lease.engine();
     if (joinType == jtRound) {
         co.ArcTolerance = miterLimit;
     } else {
@@ -430,6 +704,15 @@ _offset2(const Polygons &polygons, const float delta1, const float delta2,
     co.AddPaths(output1, joinType, ClipperLib::etClosedPolygon);
     ClipperLib::Paths retval;
     co.Execute(retval, delta_scaled2);
+    return retval;
+}
+
+ClipperLib::Paths
+_offset2(const Polygons &polygons, const float delta1, const float delta2,
+    const ClipperLib::JoinType joinType, const double miterLimit)
+{
+    // perform offset
+    ClipperLib::Paths retval = _offset2_scaled(polygons, delta1, delta2, joinType, miterLimit);
     
     // unscale output
     unscaleClipperPolygons(retval);
@@ -440,11 +723,8 @@ Polygons
 offset2(const Polygons &polygons, const float delta1, const float delta2,
     const ClipperLib::JoinType joinType, const double miterLimit)
 {
-    // perform offset
-    ClipperLib::Paths output = _offset2(polygons, delta1, delta2, joinType, miterLimit);
-    
-    // convert into ExPolygons
-    return ClipperPaths_to_Slic3rPolygons(output);
+    // perform offset, unscale while converting into Polygons
+    return clipper_paths_to_polygons_unscaled(_offset2_scaled(polygons, delta1, delta2, joinType, miterLimit));
 }
 
 ExPolygons
@@ -471,6 +751,10 @@ ExPolygons offset2_ex(const ExPolygons &expolygons, const float delta1,
     return union_ex(polys);
 }
 
+// The Clipper input of the difference and intersection is not culled by the bounding boxes of the subject and clip polygons,
+// though the clip polygons far from the subject do not affect the result. Clipper sorts its local minima and intersections
+// with an unstable sort, therefore the order of the output polygons depends on all the input paths. Culling the input would
+// change the order of the extrusions in the G-code.
 template <class T>
 T
 _clipper_do(const ClipperLib::ClipType clipType, const Polygons &subject, 
@@ -490,8 +774,8 @@ _clipper_do(const ClipperLib::ClipType clipType, const Polygons &subject,
     }
     
     // init Clipper
-    ClipperLib::Clipper clipper;
-    clipper.Clear();
+    ClipperEngineLease<ClipperLib::Clipper> clipper_lease;
+    ClipperLib::Clipper &clipper = clipper_lease.engine();
     
     // add polygons
     clipper.AddPaths(input_subject, ClipperLib::ptSubject, true);
@@ -510,18 +794,15 @@ _clipper_do(const ClipperLib::ClipType clipType, const Polygons &subject,
 // This function implmenets a following workaround:
 // 1) Peform the Clipper operation with the output to Paths. This method handles overlaps in a reasonable time.
 // 2) Run Clipper Union once again to extract the PolyTree from the result of 1).
-inline ClipperLib::PolyTree _clipper_do_polytree2(const ClipperLib::ClipType clipType, const Polygons &subject, 
-    const Polygons &clip, const ClipperLib::PolyFillType fillType, const bool safety_offset_)
+static ClipperLib::PolyTree _clipper_do_polytree2(const ClipperLib::ClipType clipType, ClipperLib::Paths &&input_subject, 
+    ClipperLib::Paths &&input_clip, const ClipperLib::PolyFillType fillType, const bool safety_offset_)
 {
-    // read input
-    ClipperLib::Paths input_subject = Slic3rMultiPoints_to_ClipperPaths(subject);
-    ClipperLib::Paths input_clip    = Slic3rMultiPoints_to_ClipperPaths(clip);
-    
     // perform safety offset
     if (safety_offset_)
         safety_offset((clipType == ClipperLib::ctUnion) ? &input_subject : &input_clip);
     
-    ClipperLib::Clipper clipper;
+    ClipperEngineLease<ClipperLib::Clipper> clipper_lease;
+    ClipperLib::Clipper &clipper = clipper_lease.engine();
     clipper.AddPaths(input_subject, ClipperLib::ptSubject, true);
     clipper.AddPaths(input_clip,    ClipperLib::ptClip,    true);
     // Perform the operation with the output to input_subject.
@@ -536,6 +817,13 @@ inline ClipperLib::PolyTree _clipper_do_polytree2(const ClipperLib::ClipType cli
     return retval;
 }
 
+inline ClipperLib::PolyTree _clipper_do_polytree2(const ClipperLib::ClipType clipType, const Polygons &subject, 
+    const Polygons &clip, const ClipperLib::PolyFillType fillType, const bool safety_offset_)
+{
+    // read input
+    return _clipper_do_polytree2(clipType, Slic3rMultiPoints_to_ClipperPaths(subject), Slic3rMultiPoints_to_ClipperPaths(clip), fillType, safety_offset_);
+}
+
 ClipperLib::PolyTree _clipper_do_pl(const ClipperLib::ClipType clipType, const Polylines &subject, 
     const Polygons &clip, const ClipperLib::PolyFillType fillType,
     const bool safety_offset_)
@@ -548,8 +836,8 @@ ClipperLib::PolyTree _clipper_do_pl(const ClipperLib::ClipType clipType, const P
     if (safety_offset_) safety_offset(&input_clip);
     
     // init Clipper
-    ClipperLib::Clipper clipper;
-    clipper.Clear();
+    ClipperEngineLease<ClipperLib::Clipper> clipper_lease;
+    ClipperLib::Clipper &clipper = clipper_lease.engine();
     
     // add polygons
     clipper.AddPaths(input_subject, ClipperLib::ptSubject, false);
@@ -572,11 +860,81 @@ ExPolygons _clipper_ex(ClipperLib::ClipType clipType, const Polygons &subject, c
     return PolyTreeToExPolygons(polytree);
 }
 
+OnionShells::OnionShells(const ExPolygons &island) : m_current(expolygons_to_clipper_scaled(island)) {}
+
+// Same as offset_ex() of the current shell.
+ExPolygons OnionShells::next(const float delta, ClipperLib::JoinType joinType, double miterLimit)
+{
+    ClipperLib::Paths output = _offset_scaled(m_current, delta, joinType, miterLimit);
+    unscaleClipperPolygons(output);
+    ExPolygons shell = ClipperPaths_to_Slic3rExPolygons(output);
+    this->advance(shell);
+    return shell;
+}
+
+// Same as offset2_ex() of the current shell: Each ExPolygon is offsetted by delta1 and united into ExPolygons, which are offsetted
+// by delta2, then all the offsetted ExPolygons are united. The intermediate ExPolygons are kept as the scaled Clipper paths.
+ExPolygons OnionShells::next2(const float delta1, const float delta2, ClipperLib::JoinType joinType, double miterLimit)
+{
+    ClipperLib::Paths polys;
+    for (const ScaledExPolygon &expoly : m_current) {
+        ClipperLib::Paths output = _offset_scaled(expoly, delta1, joinType, miterLimit);
+        unscaleClipperPolygons(output);
+        ScaledExPolygons offsetted;
+        {
+            ClipperEngineLease<ClipperLib::Clipper> clipper_lease;
+            ClipperLib::Clipper &clipper = clipper_lease.engine();
+            clipper.AddPaths(output, ClipperLib::ptSubject, true);
+            ClipperLib::PolyTree polytree;
+            clipper.Execute(ClipperLib::ctUnion, polytree, ClipperLib::pftEvenOdd, ClipperLib::pftEvenOdd);
+            for (const ClipperLib::PolyNode *outer : polytree.Childs)
+                add_outer_poly_node_to_scaled_expolygons(*outer, offsetted);
+        }
+        output = _offset_scaled(offsetted, delta2, joinType, miterLimit);
+        unscaleClipperPolygons(output);
+        polys.insert(polys.end(), std::make_move_iterator(output.begin()), std::make_move_iterator(output.end()));
+    }
+    ClipperLib::PolyTree polytree = _clipper_do_polytree2(ClipperLib::ctUnion, std::move(polys), ClipperLib::Paths(), ClipperLib::pftNonZero, false);
+    ExPolygons shell = PolyTreeToExPolygons(polytree);
+    this->advance(shell);
+    return shell;
+}
+
+// Same as diff_ex(offset(previous shell, delta_previous), offset(current shell, delta_current)).
+ExPolygons OnionShells::gaps(const float delta_previous, const float delta_current, ClipperLib::JoinType joinType, double miterLimit) const
+{
+    ClipperLib::Paths subject = _offset_scaled(m_previous, delta_previous, joinType, miterLimit);
+    ClipperLib::Paths clip    = _offset_scaled(m_current,  delta_current,  joinType, miterLimit);
+    unscaleClipperPolygons(subject);
+    unscaleClipperPolygons(clip);
+    ClipperLib::PolyTree polytree = _clipper_do_polytree2(ClipperLib::ctDifference, std::move(subject), std::move(clip), ClipperLib::pftNonZero, false);
+    return PolyTreeToExPolygons(polytree);
+}
+
+void OnionShells::advance(const ExPolygons &shell)
+{
+    m_previous = std::move(m_current);
+    m_current  = expolygons_to_clipper_scaled(shell);
+}
+
+static void add_poly_node_to_polylines(const ClipperLib::PolyNode &polynode, Polylines &out)
+{
+    if (! polynode.Contour.empty()) {
+        out.emplace_back();
+        clipper_path_to_points(polynode.Contour, out.back().points);
+    }
+    for (const ClipperLib::PolyNode *child : polynode.Childs)
+        add_poly_node_to_polylines(*child, out);
+}
+
 Polylines _clipper_pl(ClipperLib::ClipType clipType, const Polylines &subject, const Polygons &clip, bool safety_offset_)
 {
-    ClipperLib::Paths output;
-    ClipperLib::PolyTreeToPaths(_clipper_do_pl(clipType, subject, clip, ClipperLib::pftNonZero, safety_offset_), output);
-    return ClipperPaths_to_Slic3rPolylines(output);
+    // Convert the contours of the PolyTree in the order of ClipperLib::PolyTreeToPaths() directly into Polylines.
+    ClipperLib::PolyTree polytree = _clipper_do_pl(clipType, subject, clip, ClipperLib::pftNonZero, safety_offset_);
+    Polylines retval;
+    retval.reserve(polytree.Total());
+    add_poly_node_to_polylines(polytree, retval);
+    return retval;
 }
 
 Polylines _clipper_pl(ClipperLib::ClipType clipType, const Polygons &subject, const Polygons &clip, bool safety_offset_)
@@ -696,7 +1054,8 @@ Polygons simplify_polygons(const Polygons &subject, bool preserve_collinear)
     
     ClipperLib::Paths output;
     if (preserve_collinear) {
-        ClipperLib::Clipper c;
+        ClipperEngineLease<ClipperLib::Clipper> c_lease;
+        ClipperLib::Clipper &c = c_lease.engine();
         c.PreserveCollinear(true);
         c.StrictlySimple(true);
         c.AddPaths(input_subject, ClipperLib::ptSubject, true);
@@ -719,7 +1078,8 @@ ExPolygons simplify_polygons_ex(const Polygons &subject, bool preserve_collinear
     
     ClipperLib::PolyTree polytree;
     
-    ClipperLib::Clipper c;
+    ClipperEngineLease<ClipperLib::Clipper> c_lease;
+    ClipperLib::Clipper &c = c_lease.engine();
     c.PreserveCollinear(true);
     c.StrictlySimple(true);
     c.AddPaths(input_subject, ClipperLib::ptSubject, true);
@@ -737,7 +1097,8 @@ void safety_offset(ClipperLib::Paths* paths)
     scaleClipperPolygons(*paths);
     
     // perform offset (delta = scale 1e-05)
-    ClipperLib::ClipperOffset co;
+    ClipperEngineLease<ClipperLib::ClipperOffset> co_lease;
+    ClipperLib::ClipperOffset &co = co_lease.engine();
 #ifdef CLIPPER_UTILS_DEBUG
     if (clipper_export_enabled) {
         static int iRun = 0;
@@ -781,8 +1142,8 @@ void safety_offset(ClipperLib::Paths* paths)
 Polygons top_level_islands(const Slic3r::Polygons &polygons)
 {
     // init Clipper
-    ClipperLib::Clipper clipper;
-    clipper.Clear();
+    ClipperEngineLease<ClipperLib::Clipper> clipper_lease;
+    ClipperLib::Clipper &clipper = clipper_lease.engine();
     // perform union
     clipper.AddPaths(Slic3rMultiPoints_to_ClipperPaths(polygons), ClipperLib::ptSubject, true);
     ClipperLib::PolyTree polytree;
@@ -20,6 +20,9 @@
 #include <boost/nowide/cstdio.hpp>
 #include <boost/nowide/cstdlib.hpp>
 
+#include <tbb/parallel_for.h>
+#include <tbb/task_scheduler_init.h>
+
 #include "SVG.hpp"
 
 #include <Shiny/Shiny.h>
@@ -413,7 +416,30 @@ std::vector<std::pair<coordf_t, std::vector<GCode::LayerToPrint>>> GCode::collec
     return layers_to_print;
 }
 
-void GCode::do_export(Print *print, const char *path, GCodePreviewData *preview_data)
+// The G-code of a layer is generated from the layer itself and from the layers below, with the following exceptions:
+// The tool ordering of a multi-material print with a wipe tower or with wiping into the object, the autospeed
+// (a minimum cross section of all the extrusions of the print) and the support material. The support layers
+// are not streamed: The support is generated at once for the whole object and with dont_support_bridges
+// it is trimmed by the bridging infill (see SupportMaterialInternal::has_bridging_fills()), so the support
+// could only be generated after the infill of all the layers is finished.
+bool GCode::can_stream_export(const Print &print)
+{
+    if (print.objects().size() != 1 || print.config().complete_objects.value || print.has_wipe_tower() || print.has_support_material())
+        return false;
+    if (print.objects().front()->config().wipe_into_objects.value)
+        return false;
+    for (const PrintRegion *region : print.regions())
+        if (region->config().wipe_into_infill.value ||
+            // The perimeters are finished before the G-code export starts, only the autospeed of the infill matters.
+            region->config().get_abs_value("infill_speed"             ) == 0 ||
+            region->config().get_abs_value("solid_infill_speed"       ) == 0 ||
+            region->config().get_abs_value("top_solid_infill_speed"   ) == 0 ||
+            region->config().get_abs_value("bridge_speed"             ) == 0)
+            return false;
+    return true;
+}
+
+void GCode::do_export(Print *print, const char *path, GCodePreviewData *preview_data, bool streaming)
 {
     PROFILE_CLEAR();
 
@@ -431,15 +457,36 @@ void GCode::do_export(Print *print, const char *path, GCodePreviewData *preview_
     std::string path_tmp(path);
     path_tmp += ".tmp";
 
+    // A G-code file with the .gz suffix is compressed. The remaining times are filled in by overwriting
+    // the uncompressed G-code, in that case the G-code is compressed only after it has been written.
+    bool compress            = boost::iends_with(path, ".gz");
+    bool compress_on_the_fly = compress && ! print->config().remaining_times.value;
+    if (compress && ! compress_on_the_fly)
+        path_tmp += ".gcode";
+
     FILE *file = boost::nowide::fopen(path_tmp.c_str(), "wb");
     if (file == nullptr)
         throw std::runtime_error(std::string("G-code export to ") + path + " failed.\nCannot open the file for writing.\n");
 
     try {
+        std::unique_ptr<GCodeOutputSink> sink;
+        if (compress_on_the_fly)
+            sink.reset(new GCodeGzipSink(file));
+        else
+            sink.reset(new GCodeFileSink(file));
         m_placeholder_parser_failed_templates.clear();
-        this->_do_export(*print, file, preview_data);
-        fflush(file);
-        if (ferror(file)) {
+        this->_do_export(*print, *sink, preview_data, streaming);
+        bool ok = sink->close();
+        if (ok && print->config().remaining_times.value) {
+            // Overwrite the placeholders of the remaining times inserted during the export.
+            BOOST_LOG_TRIVIAL(debug) << "Filling in the remaining times";
+            auto patch = [&sink, &ok](size_t offset, const std::string &line) { ok = ok && sink->patch(offset, line.data(), line.size()); };
+            m_normal_time_estimator.fill_remaining_time_placeholders(patch);
+            if (m_silent_time_estimator_enabled)
+                m_silent_time_estimator.fill_remaining_time_placeholders(patch);
+        }
+        if (! ok) {
+            sink.reset();
             fclose(file);
             boost::nowide::remove(path_tmp.c_str());
             throw std::runtime_error(std::string("G-code export to ") + path + " failed\nIs the disk full?\n");
@@ -453,13 +500,16 @@ void GCode::do_export(Print *print, const char *path, GCodePreviewData *preview_
     }
     fclose(file);
 
-    if (print->config().remaining_times.value) {
-        BOOST_LOG_TRIVIAL(debug) << "Processing remaining times for normal mode";
-        m_normal_time_estimator.post_process_remaining_times(path_tmp, 60.0f);
-        if (m_silent_time_estimator_enabled) {
-            BOOST_LOG_TRIVIAL(debug) << "Processing remaining times for silent mode";
-            m_silent_time_estimator.post_process_remaining_times(path_tmp, 60.0f);
+    if (compress && ! compress_on_the_fly) {
+        std::string path_uncompressed = path_tmp;
+        path_tmp = std::string(path) + ".tmp";
+        try {
+            GCodeGzipSink::compress_file(path_uncompressed, path_tmp);
+        } catch (std::exception & /* ex */) {
+            boost::nowide::remove(path_uncompressed.c_str());
+            throw;
         }
+        boost::nowide::remove(path_uncompressed.c_str());
     }
 
     if (! m_placeholder_parser_failed_templates.empty()) {
@@ -488,72 +538,36 @@ void GCode::do_export(Print *print, const char *path, GCodePreviewData *preview_
     PROFILE_OUTPUT(debug_out_path("gcode-export-profile.txt").c_str());
 }
 
-void GCode::_do_export(Print &print, FILE *file, GCodePreviewData *preview_data)
+void GCode::_do_export(Print &print, GCodeOutputSink &file, GCodePreviewData *preview_data, bool streaming)
 {
     PROFILE_FUNC();
 
     // resets time estimators
-    m_normal_time_estimator.reset();
-    m_normal_time_estimator.set_dialect(print.config().gcode_flavor);
     m_silent_time_estimator_enabled = (print.config().gcode_flavor == gcfMarlin) && print.config().silent_mode;
-
-    // Until we have a UI support for the other firmwares than the Marlin, use the hardcoded default values
-    // and let the user to enter the G-code limits into the start G-code.
-    // If the following block is enabled for other firmwares than the Marlin, then the function
+    // If the following block is extended for other firmwares than the Marlin, then the function
     // this->print_machine_envelope(file, print);
     // shall be adjusted as well to produce a G-code block compatible with the particular firmware flavor.
-    if (print.config().gcode_flavor.value == gcfMarlin) {
-        m_normal_time_estimator.set_max_acceleration(print.config().machine_max_acceleration_extruding.values[0]);
-        m_normal_time_estimator.set_retract_acceleration(print.config().machine_max_acceleration_retracting.values[0]);
-        m_normal_time_estimator.set_minimum_feedrate(print.config().machine_min_extruding_rate.values[0]);
-        m_normal_time_estimator.set_minimum_travel_feedrate(print.config().machine_min_travel_rate.values[0]);
-        m_normal_time_estimator.set_axis_max_acceleration(GCodeTimeEstimator::X, print.config().machine_max_acceleration_x.values[0]);
-        m_normal_time_estimator.set_axis_max_acceleration(GCodeTimeEstimator::Y, print.config().machine_max_acceleration_y.values[0]);
-        m_normal_time_estimator.set_axis_max_acceleration(GCodeTimeEstimator::Z, print.config().machine_max_acceleration_z.values[0]);
-        m_normal_time_estimator.set_axis_max_acceleration(GCodeTimeEstimator::E, print.config().machine_max_acceleration_e.values[0]);
-        m_normal_time_estimator.set_axis_max_feedrate(GCodeTimeEstimator::X, print.config().machine_max_feedrate_x.values[0]);
-        m_normal_time_estimator.set_axis_max_feedrate(GCodeTimeEstimator::Y, print.config().machine_max_feedrate_y.values[0]);
-        m_normal_time_estimator.set_axis_max_feedrate(GCodeTimeEstimator::Z, print.config().machine_max_feedrate_z.values[0]);
-        m_normal_time_estimator.set_axis_max_feedrate(GCodeTimeEstimator::E, print.config().machine_max_feedrate_e.values[0]);
-        m_normal_time_estimator.set_axis_max_jerk(GCodeTimeEstimator::X, print.config().machine_max_jerk_x.values[0]);
-        m_normal_time_estimator.set_axis_max_jerk(GCodeTimeEstimator::Y, print.config().machine_max_jerk_y.values[0]);
-        m_normal_time_estimator.set_axis_max_jerk(GCodeTimeEstimator::Z, print.config().machine_max_jerk_z.values[0]);
-        m_normal_time_estimator.set_axis_max_jerk(GCodeTimeEstimator::E, print.config().machine_max_jerk_e.values[0]);
-
+    m_normal_time_estimator.reset();
+    m_normal_time_estimator.set_from_config(print.config());
+    // The layer times are reported while the moves are being planned, possibly at the worker thread of the estimator.
+    m_normal_layer_times.clear();
+    m_normal_time_estimator.set_layer_time_callback([this](const GCodeTimeEstimator::LayerTime &layer_time) {
+        float time = 0.f;
+        for (float role_time : layer_time.time)
+            time += role_time;
+        m_normal_layer_times.emplace_back(layer_time.z, time);
+    });
+    if (m_silent_time_estimator_enabled) {
+        m_silent_time_estimator.reset();
+        m_silent_time_estimator.set_from_config(print.config());
+    }
+    // Run the estimators at worker threads, unless the export queries them for the placement of the remaining time lines.
+    m_time_estimator_workers.reset();
+    if (! print.config().remaining_times.value) {
+        std::vector<GCodeTimeEstimator*> estimators { &m_normal_time_estimator };
         if (m_silent_time_estimator_enabled)
-        {
-            m_silent_time_estimator.reset();
-            m_silent_time_estimator.set_dialect(print.config().gcode_flavor);
-            m_silent_time_estimator.set_max_acceleration(print.config().machine_max_acceleration_extruding.values[1]);
-            m_silent_time_estimator.set_retract_acceleration(print.config().machine_max_acceleration_retracting.values[1]);
-            m_silent_time_estimator.set_minimum_feedrate(print.config().machine_min_extruding_rate.values[1]);
-            m_silent_time_estimator.set_minimum_travel_feedrate(print.config().machine_min_travel_rate.values[1]);
-            m_silent_time_estimator.set_axis_max_acceleration(GCodeTimeEstimator::X, print.config().machine_max_acceleration_x.values[1]);
-            m_silent_time_estimator.set_axis_max_acceleration(GCodeTimeEstimator::Y, print.config().machine_max_acceleration_y.values[1]);
-            m_silent_time_estimator.set_axis_max_acceleration(GCodeTimeEstimator::Z, print.config().machine_max_acceleration_z.values[1]);
-            m_silent_time_estimator.set_axis_max_acceleration(GCodeTimeEstimator::E, print.config().machine_max_acceleration_e.values[1]);
-            m_silent_time_estimator.set_axis_max_feedrate(GCodeTimeEstimator::X, print.config().machine_max_feedrate_x.values[1]);
-            m_silent_time_estimator.set_axis_max_feedrate(GCodeTimeEstimator::Y, print.config().machine_max_feedrate_y.values[1]);
-            m_silent_time_estimator.set_axis_max_feedrate(GCodeTimeEstimator::Z, print.config().machine_max_feedrate_z.values[1]);
-            m_silent_time_estimator.set_axis_max_feedrate(GCodeTimeEstimator::E, print.config().machine_max_feedrate_e.values[1]);
-            m_silent_time_estimator.set_axis_max_jerk(GCodeTimeEstimator::X, print.config().machine_max_jerk_x.values[1]);
-            m_silent_time_estimator.set_axis_max_jerk(GCodeTimeEstimator::Y, print.config().machine_max_jerk_y.values[1]);
-            m_silent_time_estimator.set_axis_max_jerk(GCodeTimeEstimator::Z, print.config().machine_max_jerk_z.values[1]);
-            m_silent_time_estimator.set_axis_max_jerk(GCodeTimeEstimator::E, print.config().machine_max_jerk_e.values[1]);
-            if (print.config().single_extruder_multi_material) {
-                // As of now the fields are shown at the UI dialog in the same combo box as the ramming values, so they
-                // are considered to be active for the single extruder multi-material printers only.
-                m_silent_time_estimator.set_filament_load_times(print.config().filament_load_time.values);
-                m_silent_time_estimator.set_filament_unload_times(print.config().filament_unload_time.values);
-            }
-        }
-    }
-    // Filament load / unload times are not specific to a firmware flavor. Let anybody use it if they find it useful.
-    if (print.config().single_extruder_multi_material) {
-        // As of now the fields are shown at the UI dialog in the same combo box as the ramming values, so they
-        // are considered to be active for the single extruder multi-material printers only.
-        m_normal_time_estimator.set_filament_load_times(print.config().filament_load_time.values);
-        m_normal_time_estimator.set_filament_unload_times(print.config().filament_unload_time.values);
+            estimators.emplace_back(&m_silent_time_estimator);
+        m_time_estimator_workers.reset(new GCodeTimeEstimatorWorkers(estimators));
     }
 
     // resets analyzer
@@ -688,12 +702,12 @@ void GCode::_do_export(Print &print, FILE *file, GCodePreviewData *preview_data)
     }
     print.throw_if_canceled();
     
-    // adds tags for time estimators
+    // adds the first remaining time lines, to be filled in once the print time is known
     if (print.config().remaining_times.value)
     {
-        _writeln(file, GCodeTimeEstimator::Normal_First_M73_Output_Placeholder_Tag);
+        file.write(m_normal_time_estimator.add_remaining_time_placeholder(file.position()));
         if (m_silent_time_estimator_enabled)
-            _writeln(file, GCodeTimeEstimator::Silent_First_M73_Output_Placeholder_Tag);
+            file.write(m_silent_time_estimator.add_remaining_time_placeholder(file.position()));
     }
 
     // Prepare the helper object for replacing placeholders in custom G-code and output filename.
@@ -707,6 +721,19 @@ void GCode::_do_export(Print &print, FILE *file, GCodePreviewData *preview_data)
     unsigned int final_extruder_id   = (unsigned int)-1;
     size_t       initial_print_object_id = 0;
     bool         has_wipe_tower      = false;
+    // Streaming export of a single object: Layers with their tool ordering collected, see wait_for_layer().
+    std::vector<std::pair<coordf_t, std::vector<LayerToPrint>>> layers_to_print;
+    size_t       num_layers_ready    = 0;
+    auto         wait_for_layer      = [&print, &tool_ordering, &layers_to_print, &num_layers_ready](size_t layer_idx) {
+        for (; num_layers_ready <= layer_idx; ++ num_layers_ready) {
+            const PrintObject  &object = *print.objects().front();
+            const LayerToPrint &ltp    = layers_to_print[num_layers_ready].second.front();
+            // The support layers are finished already, the object layers are being infilled by another thread.
+            if (ltp.object_layer != nullptr)
+                object.wait_for_infilled_layers(ltp.object_layer->id() + 1);
+            tool_ordering.append_layer(object, ltp.object_layer, ltp.support_layer);
+        }
+    };
     if (print.config().complete_objects.value) {
         // Find the 1st printing object, find its tool ordering and the initial extruder ID.
         for (; initial_print_object_id < print.objects().size(); ++initial_print_object_id) {
@@ -714,6 +741,13 @@ void GCode::_do_export(Print &print, FILE *file, GCodePreviewData *preview_data)
             if ((initial_extruder_id = tool_ordering.first_extruder()) != (unsigned int)-1)
                 break;
         }
+    } else if (streaming) {
+        // The extruders of a layer are known once the layer is infilled. Wait for the bottom layers
+        // up to the first printing layer to find the initial extruder ID.
+        layers_to_print = collect_layers_to_print(print);
+        while (num_layers_ready < layers_to_print.size() && tool_ordering.first_extruder() == (unsigned int)-1)
+            wait_for_layer(num_layers_ready);
+        initial_extruder_id = tool_ordering.first_extruder();
     } else {
 		// Find tool ordering for all the objects at once, and the initial extruder ID.
         // If the tool ordering has been pre-calculated by Print class for wipe tower already, reuse it.
@@ -915,7 +949,8 @@ void GCode::_do_export(Print &print, FILE *file, GCodePreviewData *preview_data)
         Slic3r::Geometry::chained_path(object_reference_points, object_indices);
         // Sort layers by Z.
         // All extrusion moves with the same top layer height are extruded uninterrupted.
-        std::vector<std::pair<coordf_t, std::vector<LayerToPrint>>> layers_to_print = collect_layers_to_print(print);
+        if (! streaming)
+            layers_to_print = collect_layers_to_print(print);
         // Prusa Multi-Material wipe tower.
         if (has_wipe_tower && ! layers_to_print.empty()) {
             m_wipe_tower.reset(new WipeTowerIntegration(print.config(), *print.wipe_tower_data().priming.get(), print.wipe_tower_data().tool_changes, *print.wipe_tower_data().final_purge.get()));
@@ -946,13 +981,33 @@ void GCode::_do_export(Print &print, FILE *file, GCodePreviewData *preview_data)
             }
             print.throw_if_canceled();
         }
-        // Extrude the layers.
-        for (auto &layer : layers_to_print) {
-            const LayerTools &layer_tools = tool_ordering.tools_for_layer(layer.first);
-            if (m_wipe_tower && layer_tools.has_wipe_tower)
-                m_wipe_tower->next_layer();
-            this->process_layer(file, print, layer.second, layer_tools, size_t(-1));
-            print.throw_if_canceled();
+        // Extrude the layers in batches. The extrusions of the layers of a batch are collected in parallel,
+        // then the G-code is generated layer by layer, as it depends on the state of the G-code generator
+        // left by the layer below (position, retraction, active extruder, cooling and the like).
+        const size_t                 num_layers_batch = 4 * size_t(tbb::task_scheduler_init::default_num_threads());
+        std::vector<LayerExtrusions> layer_extrusions;
+        for (size_t batch_begin = 0; batch_begin < layers_to_print.size(); batch_begin += num_layers_batch) {
+            size_t batch_end = std::min(layers_to_print.size(), batch_begin + num_layers_batch);
+            if (streaming)
+                wait_for_layer(batch_end - 1);
+            layer_extrusions.clear();
+            layer_extrusions.resize(batch_end - batch_begin);
+            tbb::parallel_for(
+                tbb::blocked_range<size_t>(batch_begin, batch_end),
+                [&print, &layers_to_print, &tool_ordering, &layer_extrusions, batch_begin](const tbb::blocked_range<size_t> &range) {
+                    for (size_t i = range.begin(); i < range.end(); ++ i) {
+                        print.throw_if_canceled();
+                        layer_extrusions[i - batch_begin] = collect_layer_extrusions(print, layers_to_print[i].second, tool_ordering.tools_for_layer(layers_to_print[i].first));
+                    }
+                });
+            for (size_t i = batch_begin; i < batch_end; ++ i) {
+                auto             &layer       = layers_to_print[i];
+                const LayerTools &layer_tools = tool_ordering.tools_for_layer(layer.first);
+                if (m_wipe_tower && layer_tools.has_wipe_tower)
+                    m_wipe_tower->next_layer();
+                this->process_layer(file, print, layer.second, layer_tools, size_t(-1), &layer_extrusions[i - batch_begin]);
+                print.throw_if_canceled();
+            }
         }
         if (m_pressure_equalizer)
             _write(file, m_pressure_equalizer->process("", true));
@@ -992,14 +1047,22 @@ void GCode::_do_export(Print &print, FILE *file, GCodePreviewData *preview_data)
     print.throw_if_canceled();
 
     // calculates estimated printing time
-    m_normal_time_estimator.calculate_time(false);
-    if (m_silent_time_estimator_enabled)
-        m_silent_time_estimator.calculate_time(false);
+    if (m_time_estimator_workers) {
+        m_time_estimator_workers->calculate_time();
+        m_time_estimator_workers.reset();
+    } else {
+        m_normal_time_estimator.calculate_time();
+        if (m_silent_time_estimator_enabled)
+            m_silent_time_estimator.calculate_time();
+    }
 
     // Get filament stats.
     print.m_print_statistics.clear();
     print.m_print_statistics.estimated_normal_print_time = m_normal_time_estimator.get_time_dhms();
     print.m_print_statistics.estimated_silent_print_time = m_silent_time_estimator_enabled ? m_silent_time_estimator.get_time_dhms() : "N/A";
+    for (int role = 0; role < GCodeTimeEstimator::Num_Time_Roles; ++ role)
+        print.m_print_statistics.estimated_normal_role_times.emplace_back(m_normal_time_estimator.get_role_time(GCodeTimeEstimator::ETimeRole(role)));
+    print.m_print_statistics.estimated_normal_layer_times = std::move(m_normal_layer_times);
     for (const Extruder &extruder : m_writer.extruders()) {
         double used_filament   = extruder.used_filament() + (has_wipe_tower ? print.wipe_tower_data().used_filament[extruder.id()] : 0.f);
         double extruded_volume = extruder.extruded_volume() + (has_wipe_tower ? print.wipe_tower_data().used_filament[extruder.id()] * 2.4052f : 0.f); // assumes 1.75mm filament diameter
@@ -1113,29 +1176,29 @@ static bool custom_gcode_sets_temperature(const std::string &gcode, const int mc
 
 // Print the machine envelope G-code for the Marlin firmware based on the "machine_max_xxx" parameters.
 // Do not process this piece of G-code by the time estimator, it already knows the values through another sources.
-void GCode::print_machine_envelope(FILE *file, Print &print)
+void GCode::print_machine_envelope(GCodeOutputSink &file, Print &print)
 {
     if (print.config().gcode_flavor.value == gcfMarlin) {
-        fprintf(file, "M201 X%d Y%d Z%d E%d ; sets maximum accelerations, mm/sec^2\n",
+        file.write_format("M201 X%d Y%d Z%d E%d ; sets maximum accelerations, mm/sec^2\n",
             int(print.config().machine_max_acceleration_x.values.front() + 0.5),
             int(print.config().machine_max_acceleration_y.values.front() + 0.5),
             int(print.config().machine_max_acceleration_z.values.front() + 0.5),
             int(print.config().machine_max_acceleration_e.values.front() + 0.5));
-        fprintf(file, "M203 X%d Y%d Z%d E%d ; sets maximum feedrates, mm/sec\n",
+        file.write_format("M203 X%d Y%d Z%d E%d ; sets maximum feedrates, mm/sec\n",
             int(print.config().machine_max_feedrate_x.values.front() + 0.5),
             int(print.config().machine_max_feedrate_y.values.front() + 0.5),
             int(print.config().machine_max_feedrate_z.values.front() + 0.5),
             int(print.config().machine_max_feedrate_e.values.front() + 0.5));
-        fprintf(file, "M204 P%d R%d T%d ; sets acceleration (P, T) and retract acceleration (R), mm/sec^2\n",
+        file.write_format("M204 P%d R%d T%d ; sets acceleration (P, T) and retract acceleration (R), mm/sec^2\n",
             int(print.config().machine_max_acceleration_extruding.values.front() + 0.5),
             int(print.config().machine_max_acceleration_retracting.values.front() + 0.5),
             int(print.config().machine_max_acceleration_extruding.values.front() + 0.5));
-        fprintf(file, "M205 X%.2lf Y%.2lf Z%.2lf E%.2lf ; sets the jerk limits, mm/sec\n",
+        file.write_format("M205 X%.2lf Y%.2lf Z%.2lf E%.2lf ; sets the jerk limits, mm/sec\n",
             print.config().machine_max_jerk_x.values.front(),
             print.config().machine_max_jerk_y.values.front(),
             print.config().machine_max_jerk_z.values.front(),
             print.config().machine_max_jerk_e.values.front());
-        fprintf(file, "M205 S%d T%d ; sets the minimum extruding and travel feed rate, mm/sec\n",
+        file.write_format("M205 S%d T%d ; sets the minimum extruding and travel feed rate, mm/sec\n",
             int(print.config().machine_min_extruding_rate.values.front() + 0.5),
             int(print.config().machine_min_travel_rate.values.front() + 0.5));
     }
@@ -1145,7 +1208,7 @@ void GCode::print_machine_envelope(FILE *file, Print &print)
 // Only do that if the start G-code does not already contain any M-code controlling an extruder temperature.
 // M140 - Set Extruder Temperature
 // M190 - Set Extruder Temperature and Wait
-void GCode::_print_first_layer_bed_temperature(FILE *file, Print &print, const std::string &gcode, unsigned int first_printing_extruder_id, bool wait)
+void GCode::_print_first_layer_bed_temperature(GCodeOutputSink &file, Print &print, const std::string &gcode, unsigned int first_printing_extruder_id, bool wait)
 {
     // Initial bed temperature based on the first extruder.
     int  temp = print.config().first_layer_bed_temperature.get_at(first_printing_extruder_id);
@@ -1165,7 +1228,7 @@ void GCode::_print_first_layer_bed_temperature(FILE *file, Print &print, const s
 // Only do that if the start G-code does not already contain any M-code controlling an extruder temperature.
 // M104 - Set Extruder Temperature
 // M109 - Set Extruder Temperature and Wait
-void GCode::_print_first_layer_extruder_temperatures(FILE *file, Print &print, const std::string &gcode, unsigned int first_printing_extruder_id, bool wait)
+void GCode::_print_first_layer_extruder_temperatures(GCodeOutputSink &file, Print &print, const std::string &gcode, unsigned int first_printing_extruder_id, bool wait)
 {
     // Is the bed temperature set by the provided custom G-code?
     int  temp_by_gcode     = -1;
@@ -1220,6 +1283,168 @@ inline std::vector<GCode::ObjectByExtruder::Island>& object_islands_by_extruder(
     return islands;
 }
 
+// Layer local part of process_layer(): Group the extrusions by an extruder, then by an object, an island and a region,
+// and create the distance fields of the layers below for the seam placement. Independent of the state of the G-code generator,
+// so that _do_export() may collect the extrusions of multiple layers in parallel.
+GCode::LayerExtrusions GCode::collect_layer_extrusions(const Print &print, const std::vector<LayerToPrint> &layers, const LayerTools &layer_tools)
+{
+    LayerExtrusions out;
+    if (layer_tools.extruders.empty())
+        // Nothing to extrude.
+        return out;
+
+    unsigned int first_extruder_id = layer_tools.extruders.front();
+    std::map<unsigned int, std::vector<ObjectByExtruder>> &by_extruder = out.by_extruder;
+    for (const LayerToPrint &layer_to_print : layers) {
+        if (layer_to_print.support_layer != nullptr) {
+            const SupportLayer &support_layer = *layer_to_print.support_layer;
+            const PrintObject  &object = *support_layer.object();
+            if (! support_layer.support_fills.entities.empty()) {
+                ExtrusionRole   role               = support_layer.support_fills.role();
+                bool            has_support        = role == erMixed || role == erSupportMaterial;
+                bool            has_interface      = role == erMixed || role == erSupportMaterialInterface;
+                // Extruder ID of the support base. -1 if "don't care".
+                unsigned int    support_extruder   = object.config().support_material_extruder.value - 1;
+                // Shall the support be printed with the active extruder, preferably with non-soluble, to avoid tool changes?
+                bool            support_dontcare   = object.config().support_material_extruder.value == 0;
+                // Extruder ID of the support interface. -1 if "don't care".
+                unsigned int    interface_extruder = object.config().support_material_interface_extruder.value - 1;
+                // Shall the support interface be printed with the active extruder, preferably with non-soluble, to avoid tool changes?
+                bool            interface_dontcare = object.config().support_material_interface_extruder.value == 0;
+                if (support_dontcare || interface_dontcare) {
+                    // Some support will be printed with "don't care" material, preferably non-soluble.
+                    // Is the current extruder assigned a soluble filament?
+                    unsigned int dontcare_extruder = first_extruder_id;
+                    if (print.config().filament_soluble.get_at(dontcare_extruder)) {
+                        // The last extruder printed on the previous layer extrudes soluble filament.
+                        // Try to find a non-soluble extruder on the same layer.
+                        for (unsigned int extruder_id : layer_tools.extruders)
+                            if (! print.config().filament_soluble.get_at(extruder_id)) {
+                                dontcare_extruder = extruder_id;
+                                break;
+                            }
+                    }
+                    if (support_dontcare)
+                        support_extruder = dontcare_extruder;
+                    if (interface_dontcare)
+                        interface_extruder = dontcare_extruder;
+                }
+                // Both the support and the support interface are printed with the same extruder, therefore
+                // the interface may be interleaved with the support base.
+                bool single_extruder = ! has_support || support_extruder == interface_extruder;
+                // Assign an extruder to the base.
+                ObjectByExtruder &obj = object_by_extruder(by_extruder, has_support ? support_extruder : interface_extruder, &layer_to_print - layers.data(), layers.size());
+                obj.support = &support_layer.support_fills;
+                obj.support_extrusion_role = single_extruder ? erMixed : erSupportMaterial;
+                if (! single_extruder && has_interface) {
+                    ObjectByExtruder &obj_interface = object_by_extruder(by_extruder, interface_extruder, &layer_to_print - layers.data(), layers.size());
+                    obj_interface.support = &support_layer.support_fills;
+                    obj_interface.support_extrusion_role = erSupportMaterialInterface;
+                }
+            }
+        }
+        if (layer_to_print.object_layer != nullptr) {
+            const Layer &layer = *layer_to_print.object_layer;
+            // We now define a strategy for building perimeters and fills. The separation 
+            // between regions doesn't matter in terms of printing order, as we follow 
+            // another logic instead:
+            // - we group all extrusions by extruder so that we minimize toolchanges
+            // - we start from the last used extruder
+            // - for each extruder, we group extrusions by island
+            // - for each island, we extrude perimeters first, unless user set the infill_first
+            //   option
+            // (Still, we have to keep track of regions because we need to apply their config)
+            size_t n_slices = layer.slices.expolygons.size();
+            std::vector<BoundingBox> layer_surface_bboxes;
+            layer_surface_bboxes.reserve(n_slices);
+            for (const ExPolygon &expoly : layer.slices.expolygons)
+                layer_surface_bboxes.push_back(get_extents(expoly.contour));
+            auto point_inside_surface = [&layer, &layer_surface_bboxes](const size_t i, const Point &point) { 
+                const BoundingBox &bbox = layer_surface_bboxes[i];
+                return point(0) >= bbox.min(0) && point(0) < bbox.max(0) &&
+                       point(1) >= bbox.min(1) && point(1) < bbox.max(1) &&
+                       layer.slices.expolygons[i].contour.contains(point);
+            };
+
+            for (size_t region_id = 0; region_id < print.regions().size(); ++ region_id) {
+                const LayerRegion *layerm = (region_id < layer.regions().size()) ? layer.regions()[region_id] : nullptr;
+                if (layerm == nullptr)
+                    continue;
+                const PrintRegion &region = *print.regions()[region_id];
+
+
+                // Now we must process perimeters and infills and create islands of extrusions in by_region std::map.
+                // It is also necessary to save which extrusions are part of MM wiping and which are not.
+                // The process is almost the same for perimeters and infills - we will do it in a cycle that repeats twice:
+                for (std::string entity_type("infills") ; entity_type != "done" ; entity_type = entity_type=="infills" ? "perimeters" : "done") {
+
+                    const ExtrusionEntitiesPtr& source_entities = entity_type=="infills" ? layerm->fills.entities : layerm->perimeters.entities;
+
+                    for (const ExtrusionEntity *ee : source_entities) {
+                        // fill represents infill extrusions of a single island.
+                        const auto *fill = dynamic_cast<const ExtrusionEntityCollection*>(ee);
+                        if (fill->entities.empty()) // This shouldn't happen but first_point() would fail.
+                            continue;
+
+                        // This extrusion is part of certain Region, which tells us which extruder should be used for it:
+                        int correct_extruder_id = Print::get_extruder(*fill, region);
+                        //FIXME what is this?
+                        entity_type=="infills" ? 
+                            std::max<int>(0, (is_solid_infill(fill->entities.front()->role()) ? region.config().solid_infill_extruder : region.config().infill_extruder) - 1) :
+                            std::max<int>(region.config().perimeter_extruder.value - 1, 0);
+
+                        // Let's recover vector of extruder overrides:
+                        out.extruder_overrides.emplace_back(new ExtruderPerCopy(layer_tools.wiping_extrusions().get_extruder_overrides(fill, correct_extruder_id, layer_to_print.object()->copies().size())));
+                        const ExtruderPerCopy* entity_overrides = out.extruder_overrides.back().get();
+
+                        // Now we must add this extrusion into the by_extruder map, once for each extruder that will print it:
+                        for (unsigned int extruder : layer_tools.extruders)
+                        {
+                            // Init by_extruder item only if we actually use the extruder:
+                            if (std::find(entity_overrides->begin(), entity_overrides->end(), extruder) != entity_overrides->end() ||      // at least one copy is overridden to use this extruder
+                                std::find(entity_overrides->begin(), entity_overrides->end(), -extruder-1) != entity_overrides->end() ||   // at least one copy would normally be printed with this extruder (see get_extruder_overrides function for explanation)
+                                (std::find(layer_tools.extruders.begin(), layer_tools.extruders.end(), correct_extruder_id) == layer_tools.extruders.end() && extruder == layer_tools.extruders.back())) // this entity is not overridden, but its extruder is not in layer_tools - we'll print it
+                                                                                                                                            //by last extruder on this layer (could happen e.g. when a wiping object is taller than others - dontcare extruders are eradicated from layer_tools)
+                            {
+                                std::vector<ObjectByExtruder::Island> &islands = object_islands_by_extruder(
+                                    by_extruder,
+                                    extruder,
+                                    &layer_to_print - layers.data(),
+                                    layers.size(), n_slices+1);
+                                for (size_t i = 0; i <= n_slices; ++i)
+                                    if (// fill->first_point does not fit inside any slice
+                                        i == n_slices ||
+                                        // fill->first_point fits inside ith slice
+                                        point_inside_surface(i, fill->first_point())) {
+                                        if (islands[i].by_region.empty())
+                                            islands[i].by_region.assign(print.regions().size(), ObjectByExtruder::Island::Region());
+                                        islands[i].by_region[region_id].append(entity_type, fill, entity_overrides, layer_to_print.object()->copies().size());
+                                        break;
+                                    }
+                            }
+                        }
+                    }
+                }
+            } // for regions
+        }
+    } // for objects
+
+    // The distance field of the layer below is needed by extrude_loop() to place the seams of the perimeters.
+    out.lower_layer_edge_grids.resize(layers.size());
+    for (const LayerToPrint &layer_to_print : layers) {
+        const Layer *layer = layer_to_print.object_layer;
+        if (layer == nullptr || layer->lower_layer == nullptr ||
+            std::all_of(layer->regions().begin(), layer->regions().end(), [](const LayerRegion *layerm){ return layerm->perimeters.entities.empty(); }))
+            continue;
+        const coord_t distance_field_resolution = coord_t(scale_(1.) + 0.5);
+        std::unique_ptr<EdgeGrid::Grid> &grid = out.lower_layer_edge_grids[&layer_to_print - layers.data()];
+        grid = make_unique<EdgeGrid::Grid>();
+        grid->create(layer->lower_layer->slices, distance_field_resolution);
+        grid->calculate_sdf();
+    }
+    return out;
+}
+
 // In sequential mode, process_layer is called once per each object and its copy, 
 // therefore layers will contain a single entry and single_object_idx will point to the copy of the object.
 // In non-sequential mode, process_layer is called per each print_z height with all object and support layers accumulated.
@@ -1227,14 +1452,16 @@ inline std::vector<GCode::ObjectByExtruder::Island>& object_islands_by_extruder(
 // and performing the extruder specific extrusions together.
 void GCode::process_layer(
     // Write into the output file.
-    FILE                            *file,
+    GCodeOutputSink                 &file,
     const Print                     &print,
     // Set of object & print layers of the same PrintObject and with the same print_z.
     const std::vector<LayerToPrint> &layers,
     const LayerTools  &layer_tools,
     // If set to size_t(-1), then print all copies of all objects.
     // Otherwise print a single copy of a single object.
-    const size_t                     single_object_idx)
+    const size_t                     single_object_idx,
+    // Extrusions collected by collect_layer_extrusions(), or nullptr to collect them here.
+    LayerExtrusions                 *layer_extrusions)
 {
     assert(! layers.empty());
 //    assert(! layer_tools.extruders.empty());
@@ -1379,145 +1606,18 @@ void GCode::process_layer(
             skirt_loops_per_extruder[first_extruder_id] = std::pair<size_t, size_t>(0, print.config().skirts.value);
     }
 
-    // Group extrusions by an extruder, then by an object, an island and a region.
-    std::map<unsigned int, std::vector<ObjectByExtruder>> by_extruder;
-    for (const LayerToPrint &layer_to_print : layers) {
-        if (layer_to_print.support_layer != nullptr) {
-            const SupportLayer &support_layer = *layer_to_print.support_layer;
-            const PrintObject  &object = *support_layer.object();
-            if (! support_layer.support_fills.entities.empty()) {
-                ExtrusionRole   role               = support_layer.support_fills.role();
-                bool            has_support        = role == erMixed || role == erSupportMaterial;
-                bool            has_interface      = role == erMixed || role == erSupportMaterialInterface;
-                // Extruder ID of the support base. -1 if "don't care".
-                unsigned int    support_extruder   = object.config().support_material_extruder.value - 1;
-                // Shall the support be printed with the active extruder, preferably with non-soluble, to avoid tool changes?
-                bool            support_dontcare   = object.config().support_material_extruder.value == 0;
-                // Extruder ID of the support interface. -1 if "don't care".
-                unsigned int    interface_extruder = object.config().support_material_interface_extruder.value - 1;
-                // Shall the support interface be printed with the active extruder, preferably with non-soluble, to avoid tool changes?
-                bool            interface_dontcare = object.config().support_material_interface_extruder.value == 0;
-                if (support_dontcare || interface_dontcare) {
-                    // Some support will be printed with "don't care" material, preferably non-soluble.
-                    // Is the current extruder assigned a soluble filament?
-                    unsigned int dontcare_extruder = first_extruder_id;
-                    if (print.config().filament_soluble.get_at(dontcare_extruder)) {
-                        // The last extruder printed on the previous layer extrudes soluble filament.
-                        // Try to find a non-soluble extruder on the same layer.
-                        for (unsigned int extruder_id : layer_tools.extruders)
-                            if (! print.config().filament_soluble.get_at(extruder_id)) {
-                                dontcare_extruder = extruder_id;
-                                break;
-                            }
-                    }
-                    if (support_dontcare)
-                        support_extruder = dontcare_extruder;
-                    if (interface_dontcare)
-                        interface_extruder = dontcare_extruder;
-                }
-                // Both the support and the support interface are printed with the same extruder, therefore
-                // the interface may be interleaved with the support base.
-                bool single_extruder = ! has_support || support_extruder == interface_extruder;
-                // Assign an extruder to the base.
-                ObjectByExtruder &obj = object_by_extruder(by_extruder, has_support ? support_extruder : interface_extruder, &layer_to_print - layers.data(), layers.size());
-                obj.support = &support_layer.support_fills;
-                obj.support_extrusion_role = single_extruder ? erMixed : erSupportMaterial;
-                if (! single_extruder && has_interface) {
-                    ObjectByExtruder &obj_interface = object_by_extruder(by_extruder, interface_extruder, &layer_to_print - layers.data(), layers.size());
-                    obj_interface.support = &support_layer.support_fills;
-                    obj_interface.support_extrusion_role = erSupportMaterialInterface;
-                }
-            }
-        }
-        if (layer_to_print.object_layer != nullptr) {
-            const Layer &layer = *layer_to_print.object_layer;
-            // We now define a strategy for building perimeters and fills. The separation 
-            // between regions doesn't matter in terms of printing order, as we follow 
-            // another logic instead:
-            // - we group all extrusions by extruder so that we minimize toolchanges
-            // - we start from the last used extruder
-            // - for each extruder, we group extrusions by island
-            // - for each island, we extrude perimeters first, unless user set the infill_first
-            //   option
-            // (Still, we have to keep track of regions because we need to apply their config)
-            size_t n_slices = layer.slices.expolygons.size();
-            std::vector<BoundingBox> layer_surface_bboxes;
-            layer_surface_bboxes.reserve(n_slices);
-            for (const ExPolygon &expoly : layer.slices.expolygons)
-                layer_surface_bboxes.push_back(get_extents(expoly.contour));
-            auto point_inside_surface = [&layer, &layer_surface_bboxes](const size_t i, const Point &point) { 
-                const BoundingBox &bbox = layer_surface_bboxes[i];
-                return point(0) >= bbox.min(0) && point(0) < bbox.max(0) &&
-                       point(1) >= bbox.min(1) && point(1) < bbox.max(1) &&
-                       layer.slices.expolygons[i].contour.contains(point);
-            };
-
-            for (size_t region_id = 0; region_id < print.regions().size(); ++ region_id) {
-                const LayerRegion *layerm = (region_id < layer.regions().size()) ? layer.regions()[region_id] : nullptr;
-                if (layerm == nullptr)
-                    continue;
-                const PrintRegion &region = *print.regions()[region_id];
-
-
-                // Now we must process perimeters and infills and create islands of extrusions in by_region std::map.
-                // It is also necessary to save which extrusions are part of MM wiping and which are not.
-                // The process is almost the same for perimeters and infills - we will do it in a cycle that repeats twice:
-                for (std::string entity_type("infills") ; entity_type != "done" ; entity_type = entity_type=="infills" ? "perimeters" : "done") {
-
-                    const ExtrusionEntitiesPtr& source_entities = entity_type=="infills" ? layerm->fills.entities : layerm->perimeters.entities;
-
-                    for (const ExtrusionEntity *ee : source_entities) {
-                        // fill represents infill extrusions of a single island.
-                        const auto *fill = dynamic_cast<const ExtrusionEntityCollection*>(ee);
-                        if (fill->entities.empty()) // This shouldn't happen but first_point() would fail.
-                            continue;
-
-                        // This extrusion is part of certain Region, which tells us which extruder should be used for it:
-                        int correct_extruder_id = Print::get_extruder(*fill, region);
-                        //FIXME what is this?
-                        entity_type=="infills" ? 
-                            std::max<int>(0, (is_solid_infill(fill->entities.front()->role()) ? region.config().solid_infill_extruder : region.config().infill_extruder) - 1) :
-                            std::max<int>(region.config().perimeter_extruder.value - 1, 0);
-
-                        // Let's recover vector of extruder overrides:
-                        const ExtruderPerCopy* entity_overrides = const_cast<LayerTools&>(layer_tools).wiping_extrusions().get_extruder_overrides(fill, correct_extruder_id, layer_to_print.object()->copies().size());
-
-                        // Now we must add this extrusion into the by_extruder map, once for each extruder that will print it:
-                        for (unsigned int extruder : layer_tools.extruders)
-                        {
-                            // Init by_extruder item only if we actually use the extruder:
-                            if (std::find(entity_overrides->begin(), entity_overrides->end(), extruder) != entity_overrides->end() ||      // at least one copy is overridden to use this extruder
-                                std::find(entity_overrides->begin(), entity_overrides->end(), -extruder-1) != entity_overrides->end() ||   // at least one copy would normally be printed with this extruder (see get_extruder_overrides function for explanation)
-                                (std::find(layer_tools.extruders.begin(), layer_tools.extruders.end(), correct_extruder_id) == layer_tools.extruders.end() && extruder == layer_tools.extruders.back())) // this entity is not overridden, but its extruder is not in layer_tools - we'll print it
-                                                                                                                                            //by last extruder on this layer (could happen e.g. when a wiping object is taller than others - dontcare extruders are eradicated from layer_tools)
-                            {
-                                std::vector<ObjectByExtruder::Island> &islands = object_islands_by_extruder(
-                                    by_extruder,
-                                    extruder,
-                                    &layer_to_print - layers.data(),
-                                    layers.size(), n_slices+1);
-                                for (size_t i = 0; i <= n_slices; ++i)
-                                    if (// fill->first_point does not fit inside any slice
-                                        i == n_slices ||
-                                        // fill->first_point fits inside ith slice
-                                        point_inside_surface(i, fill->first_point())) {
-                                        if (islands[i].by_region.empty())
-                                            islands[i].by_region.assign(print.regions().size(), ObjectByExtruder::Island::Region());
-                                        islands[i].by_region[region_id].append(entity_type, fill, entity_overrides, layer_to_print.object()->copies().size());
-                                        break;
-                                    }
-                            }
-                        }
-                    }
-                }
-            } // for regions
-        }
-    } // for objects
+    // Group extrusions by an extruder, then by an object, an island and a region, unless collected by the caller already.
+    LayerExtrusions layer_extrusions_local;
+    if (layer_extrusions == nullptr) {
+        layer_extrusions_local = collect_layer_extrusions(print, layers, layer_tools);
+        layer_extrusions = &layer_extrusions_local;
+    }
+    std::map<unsigned int, std::vector<ObjectByExtruder>> &by_extruder            = layer_extrusions->by_extruder;
+    std::vector<std::unique_ptr<EdgeGrid::Grid>>          &lower_layer_edge_grids = layer_extrusions->lower_layer_edge_grids;
 
 
 
     // Extrude the skirt, brim, support, perimeters, infill ordered by the extruders.
-    std::vector<std::unique_ptr<EdgeGrid::Grid>> lower_layer_edge_grids(layers.size());
     for (unsigned int extruder_id : layer_tools.extruders)
     {
         gcode += (layer_tools.has_wipe_tower && m_wipe_tower) ?
@@ -1571,7 +1671,7 @@ void GCode::process_layer(
         if (objects_by_extruder_it == by_extruder.end())
             continue;
         // We are almost ready to print. However, we must go through all the objects twice to print the the overridden extrusions first (infill/perimeter wiping feature):
-        for (int print_wipe_extrusions=const_cast<LayerTools&>(layer_tools).wiping_extrusions().is_anything_overridden(); print_wipe_extrusions>=0; --print_wipe_extrusions) {
+        for (int print_wipe_extrusions=layer_tools.wiping_extrusions().is_anything_overridden(); print_wipe_extrusions>=0; --print_wipe_extrusions) {
             if (print_wipe_extrusions == 0)
                 gcode+="; PURGING FINISHED\n";
 
@@ -1609,7 +1709,7 @@ void GCode::process_layer(
                         m_layer = layers[layer_id].layer();
                     }
                     for (ObjectByExtruder::Island &island : object_by_extruder.islands) {
-                        const auto& by_region_specific = const_cast<LayerTools&>(layer_tools).wiping_extrusions().is_anything_overridden() ? island.by_region_per_copy(copy_id, extruder_id, print_wipe_extrusions) : island.by_region;
+                        const auto& by_region_specific = layer_tools.wiping_extrusions().is_anything_overridden() ? island.by_region_per_copy(copy_id, extruder_id, print_wipe_extrusions) : island.by_region;
 
                         if (print.config().infill_first) {
                             gcode += this->extrude_infill(print, by_region_specific);
@@ -1643,6 +1743,9 @@ void GCode::process_layer(
         gcode = m_pressure_equalizer->process(gcode.c_str(), false);
     // printf("G-code after filter:\n%s\n", out.c_str());
     
+    //FIXME The layer G-code is parsed as text by each of the filters above and once more by _write() for the analyzer
+    // and for the time estimators. A move representation produced by GCodeWriter and edited in place by the filters
+    // would save the repeated parsing.
     _write(file, gcode);
 }
 
@@ -2301,55 +2404,95 @@ std::string GCode::extrude_support(const ExtrusionEntityCollection &support_fill
     return gcode;
 }
 
-void GCode::_write(FILE* file, const char *what)
+void GCode::_write(GCodeOutputSink &file, const char *what, size_t length)
 {
-    if (what != nullptr) {
-        // apply analyzer, if enabled
-        const char* gcode = m_enable_analyzer ? m_analyzer.process_gcode(what).c_str() : what;
-
-        // writes string to file
-        fwrite(gcode, 1, ::strlen(gcode), file);
-        // updates time estimator and gcode lines vector
-        m_normal_time_estimator.add_gcode_block(gcode);
+    // Parse the G-code once, pass the parsed lines to the analyzer, if enabled, and to the time estimators.
+    GCodeReader::GCodeLine gline;
+    bool normal_remaining_time_due = false;
+    bool silent_remaining_time_due = false;
+    auto process_line = [this, &file, &normal_remaining_time_due, &silent_remaining_time_due](GCodeReader&, const GCodeReader::GCodeLine &line) {
+        if (m_enable_analyzer) {
+            // The analyzer removes its workcodes from the G-code.
+            if (! m_analyzer.process_gcode_line(line))
+                return;
+            file.write(line.raw());
+            file.write("\n", 1);
+        }
+        if (m_time_estimator_workers) {
+            m_time_estimator_workers->add_gcode_line(line);
+            return;
+        }
+        m_normal_time_estimator.add_gcode_line(line);
         if (m_silent_time_estimator_enabled)
-            m_silent_time_estimator.add_gcode_block(gcode);
+            m_silent_time_estimator.add_gcode_line(line);
+        if (m_config.remaining_times.value) {
+            normal_remaining_time_due = m_normal_time_estimator.is_remaining_time_due(60.f);
+            silent_remaining_time_due = m_silent_time_estimator_enabled && m_silent_time_estimator.is_remaining_time_due(60.f);
+        }
+    };
+    // Start of the G-code not written yet if the analyzer is disabled.
+    const char *unwritten = what;
+    for (const char *ptr = what; *ptr != 0;) {
+        gline.reset();
+        ptr = m_reader.parse_line(ptr, gline, process_line);
+        if (normal_remaining_time_due || silent_remaining_time_due) {
+            // Insert the remaining time lines after the current line, they will be filled in at the end of the export.
+            if (! m_enable_analyzer) {
+                file.write(unwritten, ptr - unwritten);
+                unwritten = ptr;
+            }
+            if (normal_remaining_time_due)
+                file.write(m_normal_time_estimator.add_remaining_time_placeholder(file.position()));
+            if (silent_remaining_time_due)
+                file.write(m_silent_time_estimator.add_remaining_time_placeholder(file.position()));
+            normal_remaining_time_due = false;
+            silent_remaining_time_due = false;
+        }
     }
+
+    // writes string to file
+    if (! m_enable_analyzer)
+        file.write(unwritten, what + length - unwritten);
 }
 
-void GCode::_writeln(FILE* file, const std::string &what)
+void GCode::_writeln(GCodeOutputSink &file, const std::string &what)
 {
     if (! what.empty())
         _write(file, (what.back() == '\n') ? what : (what + '\n'));
 }
 
-void GCode::_write_format(FILE* file, const char* format, ...)
+void GCode::_write_format(GCodeOutputSink &file, const char* format, ...)
 {
     va_list args;
     va_start(args, format);
 
-    int buflen;
+    // Format into a stack buffer, only measure and format again if the result does not fit.
+    char buffer[1024];
+    int  res;
     {
         va_list args2;
         va_copy(args2, args);
-        buflen =
-    #ifdef _MSC_VER
-            ::_vscprintf(format, args2)
-    #else
-            ::vsnprintf(nullptr, 0, format, args2)
-    #endif
-            + 1;
+        res = ::vsnprintf(buffer, sizeof(buffer), format, args2);
         va_end(args2);
     }
-
-    char buffer[1024];
-    bool buffer_dynamic = buflen > 1024;
-    char *bufptr = buffer_dynamic ? (char*)malloc(buflen) : buffer;
-    int res = ::vsnprintf(bufptr, buflen, format, args);
-    if (res > 0)
-        _write(file, bufptr);
-
-    if (buffer_dynamic)
-        free(bufptr);
+#ifdef _MSC_VER
+    if (res < 0) {
+        // vsnprintf() of MSVC 2013 returns -1 if the output does not fit.
+        va_list args2;
+        va_copy(args2, args);
+        res = ::_vscprintf(format, args2);
+        va_end(args2);
+    }
+#endif
+    if (res > 0) {
+        if (size_t(res) < sizeof(buffer))
+            _write(file, buffer, size_t(res));
+        else {
+            std::vector<char> buffer_dynamic(size_t(res) + 1);
+            ::vsnprintf(buffer_dynamic.data(), buffer_dynamic.size(), format, args);
+            _write(file, buffer_dynamic.data(), size_t(res));
+        }
+    }
 
     va_end(args);
 }
@@ -2710,7 +2853,7 @@ const std::vector<GCode::ObjectByExtruder::Island::Region>& GCode::ObjectByExtru
             const std::vector<const ExtruderPerCopy*>& overrides   = (iter ? reg.infills_overrides : reg.perimeters_overrides);
 
             // Now the most important thing - which extrusion should we print.
-            // See function ToolOrdering::get_extruder_overrides for details about the negative numbers hack.
+            // See function WipingExtrusions::get_extruder_overrides for details about the negative numbers hack.
             int this_extruder_mark = wiping_entities ? extruder : -extruder-1;
 
             for (unsigned int i=0;i<entities.size();++i)
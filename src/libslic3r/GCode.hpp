@@ -18,6 +18,7 @@
 #include "GCodeTimeEstimator.hpp"
 #include "EdgeGrid.hpp"
 #include "GCode/Analyzer.hpp"
+#include "GCode/OutputSink.hpp"
 
 #include <memory>
 #include <string>
@@ -152,7 +153,10 @@ public:
 
     // throws std::runtime_exception on error,
     // throws CanceledException through print->throw_if_canceled().
-    void            do_export(Print *print, const char *path, GCodePreviewData *preview_data = nullptr);
+    // If streaming, the layers are exported while being infilled by another thread, see Print::process_and_export_gcode().
+    void            do_export(Print *print, const char *path, GCodePreviewData *preview_data = nullptr, bool streaming = false);
+    // Is the G-code of each layer independent of the layers above, so that it could be exported as soon as the layer is infilled?
+    static bool     can_stream_export(const Print &print);
 
     // Exported for the helper classes (OozePrevention, Wipe) and for the Perl binding for unit tests.
     const Vec2d&   origin() const { return m_origin; }
@@ -180,7 +184,7 @@ public:
     static void append_full_config(const Print& print, std::string& str);
 
 protected:
-    void            _do_export(Print &print, FILE *file, GCodePreviewData *preview_data);
+    void            _do_export(Print &print, GCodeOutputSink &file, GCodePreviewData *preview_data, bool streaming);
 
     // Object and support extrusions of the same PrintObject at the same print_z.
     struct LayerToPrint
@@ -194,16 +198,19 @@ protected:
     };
     static std::vector<GCode::LayerToPrint>                            collect_layers_to_print(const PrintObject &object);
     static std::vector<std::pair<coordf_t, std::vector<LayerToPrint>>> collect_layers_to_print(const Print &print);
+    struct LayerExtrusions;
     void            process_layer(
         // Write into the output file.
-        FILE                            *file,
+        GCodeOutputSink                 &file,
         const Print                     &print,
         // Set of object & print layers of the same PrintObject and with the same print_z.
         const std::vector<LayerToPrint> &layers,
         const LayerTools  &layer_tools,
         // If set to size_t(-1), then print all copies of all objects.
         // Otherwise print a single copy of a single object.
-        const size_t                     single_object_idx = size_t(-1));
+        const size_t                     single_object_idx = size_t(-1),
+        // Extrusions collected by collect_layer_extrusions(), or nullptr to collect them by process_layer().
+        LayerExtrusions                 *layer_extrusions = nullptr);
 
     void            set_last_pos(const Point &pos) { m_last_pos = pos; m_last_pos_defined = true; }
     bool            last_pos_defined() const { return m_last_pos_defined; }
@@ -248,6 +255,17 @@ protected:
         std::vector<Island>         islands;
     };
 
+    // Extrusions of a set of layers with the same print_z, grouped by an extruder, then by an object, an island and a region.
+    struct LayerExtrusions
+    {
+        std::map<unsigned int, std::vector<ObjectByExtruder>> by_extruder;
+        // Distance fields of the layers below the object layers for the seam placement, indexed by the LayerToPrint.
+        std::vector<std::unique_ptr<EdgeGrid::Grid>>          lower_layer_edge_grids;
+        // Extruders printing the copies of the extrusions, referenced by ObjectByExtruder::Island::Region.
+        std::vector<std::unique_ptr<ExtruderPerCopy>>         extruder_overrides;
+    };
+    static LayerExtrusions collect_layer_extrusions(const Print &print, const std::vector<LayerToPrint> &layers, const LayerTools &layer_tools);
+
 
     std::string     extrude_perimeters(const Print &print, const std::vector<ObjectByExtruder::Island::Region> &by_region, std::unique_ptr<EdgeGrid::Grid> &lower_layer_edge_grid);
     std::string     extrude_infill(const Print &print, const std::vector<ObjectByExtruder::Island::Region> &by_region);
@@ -325,26 +343,35 @@ protected:
     GCodeTimeEstimator m_normal_time_estimator;
     GCodeTimeEstimator m_silent_time_estimator;
     bool m_silent_time_estimator_enabled;
+    // Z and printing time in seconds of the layers, as reported by the normal mode estimator.
+    std::vector<std::pair<float, float>> m_normal_layer_times;
+    // Runs the time estimators at worker threads during the export, if the remaining times are not exported.
+    // Declared after the estimators, so that the workers are stopped before the estimators are destroyed.
+    std::unique_ptr<GCodeTimeEstimatorWorkers> m_time_estimator_workers;
 
     // Analyzer
     GCodeAnalyzer m_analyzer;
 
+    // Parses the exported G-code once for the analyzer and for the time estimators.
+    GCodeReader m_reader;
+
     // Write a string into a file.
-    void _write(FILE* file, const std::string& what) { this->_write(file, what.c_str()); }
-    void _write(FILE* file, const char *what);
+    void _write(GCodeOutputSink &file, const std::string& what) { this->_write(file, what.c_str(), what.size()); }
+    void _write(GCodeOutputSink &file, const char *what) { if (what != nullptr) this->_write(file, what, strlen(what)); }
+    void _write(GCodeOutputSink &file, const char *what, size_t length);
 
     // Write a string into a file. 
     // Add a newline, if the string does not end with a newline already.
     // Used to export a custom G-code section processed by the PlaceholderParser.
-    void _writeln(FILE* file, const std::string& what);
+    void _writeln(GCodeOutputSink &file, const std::string& what);
 
     // Formats and write into a file the given data. 
-    void _write_format(FILE* file, const char* format, ...);
+    void _write_format(GCodeOutputSink &file, const char* format, ...);
 
     std::string _extrude(const ExtrusionPath &path, std::string description = "", double speed = -1);
-    void print_machine_envelope(FILE *file, Print &print);
-    void _print_first_layer_bed_temperature(FILE *file, Print &print, const std::string &gcode, unsigned int first_printing_extruder_id, bool wait);
-    void _print_first_layer_extruder_temperatures(FILE *file, Print &print, const std::string &gcode, unsigned int first_printing_extruder_id, bool wait);
+    void print_machine_envelope(GCodeOutputSink &file, Print &print);
+    void _print_first_layer_bed_temperature(GCodeOutputSink &file, Print &print, const std::string &gcode, unsigned int first_printing_extruder_id, bool wait);
+    void _print_first_layer_extruder_temperatures(GCodeOutputSink &file, Print &print, const std::string &gcode, unsigned int first_printing_extruder_id, bool wait);
     // this flag triggers first layer speeds
     bool                                on_first_layer() const { return m_layer != nullptr && m_layer->id() == 0; }
 
@@ -9,6 +9,8 @@
 #include "Analyzer.hpp"
 #include "PreviewData.hpp"
 
+#include <tbb/parallel_for.h>
+
 static const std::string AXIS_STR = "XYZE";
 static const float MMMIN_TO_MMSEC = 1.0f / 60.0f;
 static const float INCHES_TO_MM = 25.4f;
@@ -77,18 +79,8 @@ bool GCodeAnalyzer::Metadata::operator != (const GCodeAnalyzer::Metadata& other)
     return false;
 }
 
-GCodeAnalyzer::GCodeMove::GCodeMove(GCodeMove::EType type, ExtrusionRole extrusion_role, unsigned int extruder_id, double mm3_per_mm, float width, float height, float feedrate, const Vec3d& start_position, const Vec3d& end_position, float delta_extruder, unsigned int cp_color_id/* = 0*/)
-    : type(type)
-    , data(extrusion_role, extruder_id, mm3_per_mm, width, height, feedrate, cp_color_id)
-    , start_position(start_position)
-    , end_position(end_position)
-    , delta_extruder(delta_extruder)
-{
-}
-
-GCodeAnalyzer::GCodeMove::GCodeMove(GCodeMove::EType type, const GCodeAnalyzer::Metadata& data, const Vec3d& start_position, const Vec3d& end_position, float delta_extruder)
-    : type(type)
-    , data(data)
+GCodeAnalyzer::GCodeMove::GCodeMove(unsigned int data_id, const Vec3f& start_position, const Vec3f& end_position, float delta_extruder)
+    : data_id(data_id)
     , start_position(start_position)
     , end_position(end_position)
     , delta_extruder(delta_extruder)
@@ -117,6 +109,7 @@ void GCodeAnalyzer::reset()
     _reset_axes_position();
 
     m_moves_map.clear();
+    m_moves_data.clear();
 }
 
 const std::string& GCodeAnalyzer::process_gcode(const std::string& gcode)
@@ -155,15 +148,21 @@ bool GCodeAnalyzer::is_valid_extrusion_role(ExtrusionRole role)
 
 void GCodeAnalyzer::_process_gcode_line(GCodeReader&, const GCodeReader::GCodeLine& line)
 {
-    // processes 'special' comments contained in line
-    if (_process_tags(line))
-    {
+    if (process_gcode_line(line))
+        // puts the line back into the gcode
+        m_process_output += line.raw() + "\n";
 #if 0
+    else
         // DEBUG ONLY: puts the line back into the gcode
         m_process_output += line.raw() + "\n";
 #endif
-        return;
-    }
+}
+
+bool GCodeAnalyzer::process_gcode_line(const GCodeReader::GCodeLine& line)
+{
+    // processes 'special' comments contained in line
+    if (_process_tags(line))
+        return false;
 
     // sets new start position/extrusion
     _set_start_position(_get_end_position());
@@ -254,8 +253,7 @@ void GCodeAnalyzer::_process_gcode_line(GCodeReader&, const GCodeReader::GCodeLi
         }
     }
 
-    // puts the line back into the gcode
-    m_process_output += line.raw() + "\n";
+    return true;
 }
 
 // Returns the new absolute position on the given axis in dependence of the given parameters
@@ -652,8 +650,12 @@ void GCodeAnalyzer::_store_move(GCodeAnalyzer::GCodeMove::EType type)
     if (it == m_moves_map.end())
         it = m_moves_map.insert(TypeToMovesMap::value_type(type, GCodeMovesList())).first;
 
+    // store the metadata only if they changed since the last stored move
+    if (m_moves_data.empty() || (m_moves_data.back() != m_state.data))
+        m_moves_data.push_back(m_state.data);
+
     // store move
-    it->second.emplace_back(type, _get_extrusion_role(), _get_extruder_id(), _get_mm3_per_mm(), _get_width(), _get_height(), _get_feedrate(), _get_start_position(), _get_end_position(), _get_delta_extrusion(), _get_cp_color_id());
+    it->second.emplace_back((unsigned int)m_moves_data.size() - 1, _get_start_position().cast<float>(), _get_end_position().cast<float>(), _get_delta_extrusion());
 }
 
 bool GCodeAnalyzer::_is_valid_extrusion_role(int value) const
@@ -667,6 +669,10 @@ void GCodeAnalyzer::_calc_gcode_preview_extrusion_layers(GCodePreviewData& previ
     {
         static GCodePreviewData::Extrusion::Layer& get_layer_at_z(GCodePreviewData::Extrusion::LayersList& layers, float z)
         {
+            // the moves are sorted by layers, the last layer is the most likely one
+            if (!layers.empty() && (layers.back().z == z))
+                return layers.back();
+
             for (GCodePreviewData::Extrusion::Layer& layer : layers)
             {
                 // if layer found, return it
@@ -675,34 +681,40 @@ void GCodeAnalyzer::_calc_gcode_preview_extrusion_layers(GCodePreviewData& previ
             }
 
             // if layer not found, create and return it
-            layers.emplace_back(z, ExtrusionPaths());
+            layers.emplace_back(z);
             return layers.back();
         }
 
-        static void store_polyline(const Polyline& polyline, const Metadata& data, float z, GCodePreviewData& preview_data)
+        static void append_vertex(std::vector<float>& vertices, const Vec3f& position)
         {
-            // if the polyline is valid, create the extrusion path from it and store it
-            if (polyline.is_valid())
+            // skip duplicate vertices
+            size_t size = vertices.size();
+            if ((size < 2) || (vertices[size - 2] != position.x()) || (vertices[size - 1] != position.y()))
             {
-                ExtrusionPath path(data.extrusion_role, data.mm3_per_mm, data.width, data.height);
-                path.polyline = polyline;
-                path.feedrate = data.feedrate;
-                path.extruder_id = data.extruder_id;
-                path.cp_color_id = data.cp_color_id;
-
-                get_layer_at_z(preview_data.extrusion.layers, z).paths.push_back(path);
+                vertices.push_back(position.x());
+                vertices.push_back(position.y());
             }
         }
+
+        static void store_polyline(const std::vector<float>& vertices, const Metadata& data, float z, GCodePreviewData& preview_data)
+        {
+            // if the polyline is valid, store it as a path of the layer
+            if (vertices.size() >= 4)
+                get_layer_at_z(preview_data.extrusion.layers, z).add_path(data.extrusion_role, data.width, data.height, data.feedrate, (float)data.mm3_per_mm,
+                    data.extruder_id, data.cp_color_id, vertices.data(), vertices.size() / 2);
+        }
     };
 
     TypeToMovesMap::iterator extrude_moves = m_moves_map.find(GCodeMove::Extrude);
     if (extrude_moves == m_moves_map.end())
         return;
 
+    unsigned int data_id = -1;
     Metadata data;
     float z = FLT_MAX;
-    Polyline polyline;
-    Vec3d position(FLT_MAX, FLT_MAX, FLT_MAX);
+    // x, y coordinates of the vertices of the current polyline
+    std::vector<float> vertices;
+    Vec3f position(FLT_MAX, FLT_MAX, FLT_MAX);
     float volumetric_rate = FLT_MAX;
     GCodePreviewData::Range height_range;
     GCodePreviewData::Range width_range;
@@ -712,39 +724,47 @@ void GCodeAnalyzer::_calc_gcode_preview_extrusion_layers(GCodePreviewData& previ
     // constructs the polylines while traversing the moves
     for (const GCodeMove& move : extrude_moves->second)
     {
-        if ((data != move.data) || (z != move.start_position.z()) || (position != move.start_position) || (volumetric_rate != move.data.feedrate * (float)move.data.mm3_per_mm))
+        const Metadata& move_data = m_moves_data[move.data_id];
+        if (((data_id != move.data_id) && (data != move_data)) || (z != move.start_position.z()) || (position != move.start_position) || (volumetric_rate != move_data.feedrate * (float)move_data.mm3_per_mm))
         {
             // store current polyline
-            polyline.remove_duplicate_points();
-            Helper::store_polyline(polyline, data, z, preview_data);
+            Helper::store_polyline(vertices, data, z, preview_data);
 
             // reset current polyline
-            polyline = Polyline();
+            vertices.clear();
 
             // add both vertices of the move
-            polyline.append(Point(scale_(move.start_position.x()), scale_(move.start_position.y())));
-            polyline.append(Point(scale_(move.end_position.x()), scale_(move.end_position.y())));
+            Helper::append_vertex(vertices, move.start_position);
+            Helper::append_vertex(vertices, move.end_position);
 
             // update current values
-            data = move.data;
-            z = (float)move.start_position.z();
-            volumetric_rate = move.data.feedrate * (float)move.data.mm3_per_mm;
-            height_range.update_from(move.data.height);
-            width_range.update_from(move.data.width);
-            feedrate_range.update_from(move.data.feedrate);
+            data = move_data;
+            z = move.start_position.z();
+            volumetric_rate = move_data.feedrate * (float)move_data.mm3_per_mm;
+            height_range.update_from(move_data.height);
+            width_range.update_from(move_data.width);
+            feedrate_range.update_from(move_data.feedrate);
             volumetric_rate_range.update_from(volumetric_rate);
         }
         else
             // append end vertex of the move to current polyline
-            polyline.append(Point(scale_(move.end_position.x()), scale_(move.end_position.y())));
+            Helper::append_vertex(vertices, move.end_position);
 
         // update current values
+        data_id = move.data_id;
         position = move.end_position;
     }
 
     // store last polyline
-    polyline.remove_duplicate_points();
-    Helper::store_polyline(polyline, data, z, preview_data);
+    Helper::store_polyline(vertices, data, z, preview_data);
+
+    // calculates the levels of detail
+    GCodePreviewData::Extrusion::LayersList& layers = preview_data.extrusion.layers;
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, layers.size()),
+        [&layers](const tbb::blocked_range<size_t>& range) {
+            for (size_t i = range.begin(); i < range.end(); ++i)
+                layers[i].finalize();
+        });
 
     // updates preview ranges data
     preview_data.ranges.height.update_from(height_range);
@@ -757,12 +777,24 @@ void GCodeAnalyzer::_calc_gcode_preview_travel(GCodePreviewData& preview_data)
 {
     struct Helper
     {
-        static void store_polyline(const Polyline3& polyline, GCodePreviewData::Travel::EType type, GCodePreviewData::Travel::Polyline::EDirection direction, 
+        static void append_vertex(std::vector<float>& vertices, const Vec3f& position)
+        {
+            // skip duplicate vertices
+            size_t size = vertices.size();
+            if ((size < 3) || (vertices[size - 3] != position.x()) || (vertices[size - 2] != position.y()) || (vertices[size - 1] != position.z()))
+            {
+                vertices.push_back(position.x());
+                vertices.push_back(position.y());
+                vertices.push_back(position.z());
+            }
+        }
+
+        static void store_polyline(const std::vector<float>& vertices, GCodePreviewData::Travel::EType type, GCodePreviewData::Travel::EDirection direction,
             float feedrate, unsigned int extruder_id, GCodePreviewData& preview_data)
         {
             // if the polyline is valid, store it
-            if (polyline.is_valid())
-                preview_data.travel.polylines.emplace_back(type, direction, feedrate, extruder_id, polyline);
+            if (vertices.size() >= 6)
+                preview_data.travel.polylines.add(type, direction, feedrate, extruder_id, vertices.data(), vertices.size() / 3);
         }
     };
 
@@ -770,10 +802,11 @@ void GCodeAnalyzer::_calc_gcode_preview_travel(GCodePreviewData& preview_data)
     if (travel_moves == m_moves_map.end())
         return;
 
-    Polyline3 polyline;
-    Vec3d position(FLT_MAX, FLT_MAX, FLT_MAX);
+    // x, y, z coordinates of the vertices of the current polyline
+    std::vector<float> vertices;
+    Vec3f position(FLT_MAX, FLT_MAX, FLT_MAX);
     GCodePreviewData::Travel::EType type = GCodePreviewData::Travel::Num_Types;
-    GCodePreviewData::Travel::Polyline::EDirection direction = GCodePreviewData::Travel::Polyline::Num_Directions;
+    GCodePreviewData::Travel::EDirection direction = GCodePreviewData::Travel::Num_Directions;
     float feedrate = FLT_MAX;
     unsigned int extruder_id = -1;
 
@@ -784,39 +817,39 @@ void GCodeAnalyzer::_calc_gcode_preview_travel(GCodePreviewData& preview_data)
     // constructs the polylines while traversing the moves
     for (const GCodeMove& move : travel_moves->second)
     {
+        const Metadata& move_data = m_moves_data[move.data_id];
         GCodePreviewData::Travel::EType move_type = (move.delta_extruder < 0.0f) ? GCodePreviewData::Travel::Retract : ((move.delta_extruder > 0.0f) ? GCodePreviewData::Travel::Extrude : GCodePreviewData::Travel::Move);
-        GCodePreviewData::Travel::Polyline::EDirection move_direction = ((move.start_position.x() != move.end_position.x()) || (move.start_position.y() != move.end_position.y())) ? GCodePreviewData::Travel::Polyline::Generic : GCodePreviewData::Travel::Polyline::Vertical;
+        GCodePreviewData::Travel::EDirection move_direction = ((move.start_position.x() != move.end_position.x()) || (move.start_position.y() != move.end_position.y())) ? GCodePreviewData::Travel::Generic : GCodePreviewData::Travel::Vertical;
 
-        if ((type != move_type) || (direction != move_direction) || (feedrate != move.data.feedrate) || (position != move.start_position) || (extruder_id != move.data.extruder_id))
+        if ((type != move_type) || (direction != move_direction) || (feedrate != move_data.feedrate) || (position != move.start_position) || (extruder_id != move_data.extruder_id))
         {
             // store current polyline
-            polyline.remove_duplicate_points();
-            Helper::store_polyline(polyline, type, direction, feedrate, extruder_id, preview_data);
+            Helper::store_polyline(vertices, type, direction, feedrate, extruder_id, preview_data);
 
             // reset current polyline
-            polyline = Polyline3();
+            vertices.clear();
 
             // add both vertices of the move
-            polyline.append(Vec3crd(scale_(move.start_position.x()), scale_(move.start_position.y()), scale_(move.start_position.z())));
-            polyline.append(Vec3crd(scale_(move.end_position.x()), scale_(move.end_position.y()), scale_(move.end_position.z())));
+            Helper::append_vertex(vertices, move.start_position);
+            Helper::append_vertex(vertices, move.end_position);
         }
         else
             // append end vertex of the move to current polyline
-            polyline.append(Vec3crd(scale_(move.end_position.x()), scale_(move.end_position.y()), scale_(move.end_position.z())));
+            Helper::append_vertex(vertices, move.end_position);
 
         // update current values
         position = move.end_position;
         type = move_type;
-        feedrate = move.data.feedrate;
-        extruder_id = move.data.extruder_id;
-        height_range.update_from(move.data.height);
-        width_range.update_from(move.data.width);
-        feedrate_range.update_from(move.data.feedrate);
+        feedrate = move_data.feedrate;
+        extruder_id = move_data.extruder_id;
+        height_range.update_from(move_data.height);
+        width_range.update_from(move_data.width);
+        feedrate_range.update_from(move_data.feedrate);
     }
 
     // store last polyline
-    polyline.remove_duplicate_points();
-    Helper::store_polyline(polyline, type, direction, feedrate, extruder_id, preview_data);
+    Helper::store_polyline(vertices, type, direction, feedrate, extruder_id, preview_data);
+    preview_data.travel.polylines.shrink_to_fit();
 
     // updates preview ranges data
     preview_data.ranges.height.update_from(height_range);
@@ -833,8 +866,9 @@ void GCodeAnalyzer::_calc_gcode_preview_retractions(GCodePreviewData& preview_da
     for (const GCodeMove& move : retraction_moves->second)
     {
         // store position
+        const Metadata& move_data = m_moves_data[move.data_id];
         Vec3crd position(scale_(move.start_position.x()), scale_(move.start_position.y()), scale_(move.start_position.z()));
-        preview_data.retraction.positions.emplace_back(position, move.data.width, move.data.height);
+        preview_data.retraction.positions.emplace_back(position, move_data.width, move_data.height);
     }
 }
 
@@ -847,8 +881,9 @@ void GCodeAnalyzer::_calc_gcode_preview_unretractions(GCodePreviewData& preview_
     for (const GCodeMove& move : unretraction_moves->second)
     {
         // store position
+        const Metadata& move_data = m_moves_data[move.data_id];
         Vec3crd position(scale_(move.start_position.x()), scale_(move.start_position.y()), scale_(move.start_position.z()));
-        preview_data.unretraction.positions.emplace_back(position, move.data.width, move.data.height);
+        preview_data.unretraction.positions.emplace_back(position, move_data.width, move_data.height);
     }
 }
 
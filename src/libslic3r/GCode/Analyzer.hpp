@@ -74,14 +74,14 @@ public:
             Num_Types
         };
 
-        EType type;
-        Metadata data;
-        Vec3d start_position;
-        Vec3d end_position;
+        // Index into the table of metadata, the metadata change seldom compared to the positions.
+        unsigned int data_id;
+        // The axes positions are tracked in single precision by the analyzer.
+        Vec3f start_position;
+        Vec3f end_position;
         float delta_extruder;
 
-        GCodeMove(EType type, ExtrusionRole extrusion_role, unsigned int extruder_id, double mm3_per_mm, float width, float height, float feedrate, const Vec3d& start_position, const Vec3d& end_position, float delta_extruder, unsigned int cp_color_id = 0);
-        GCodeMove(EType type, const Metadata& data, const Vec3d& start_position, const Vec3d& end_position, float delta_extruder);
+        GCodeMove(unsigned int data_id, const Vec3f& start_position, const Vec3f& end_position, float delta_extruder);
     };
 
     typedef std::vector<GCodeMove> GCodeMovesList;
@@ -104,6 +104,8 @@ private:
     State m_state;
     GCodeReader m_parser;
     TypeToMovesMap m_moves_map;
+    // Metadata of the stored moves, referenced by GCodeMove::data_id.
+    std::vector<Metadata> m_moves_data;
 
     // The output of process_layer()
     std::string m_process_output;
@@ -117,6 +119,10 @@ public:
     // Adds the gcode contained in the given string to the analysis and returns it after removing the workcodes
     const std::string& process_gcode(const std::string& gcode);
 
+    // Adds a single gcode line parsed by the caller to the analysis.
+    // Returns false if the line is a workcode, which shall be removed from the gcode.
+    bool process_gcode_line(const GCodeReader::GCodeLine& line);
+
     // Calculates all data needed for gcode visualization
     void calc_gcode_preview_data(GCodePreviewData& preview_data);
 
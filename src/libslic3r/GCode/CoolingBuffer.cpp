@@ -1,9 +1,8 @@
 #include "../GCode.hpp"
 #include "CoolingBuffer.hpp"
-#include <boost/algorithm/string/predicate.hpp>
-#include <boost/algorithm/string/replace.hpp>
 #include <iostream>
 #include <float.h>
+#include <string.h>
 
 #if 0
     #define DEBUG
@@ -228,6 +227,33 @@ std::string CoolingBuffer::process_layer(const std::string &gcode, size_t layer_
     return this->apply_layer_cooldown(gcode, layer_id, layer_time_stretched, per_extruder_adjustments);
 }
 
+// Does the line [begin, end) start with the prefix?
+static inline bool starts_with(const char *begin, const char *end, const char *prefix)
+{
+    for (; *prefix != 0; ++ begin, ++ prefix)
+        if (begin == end || *begin != *prefix)
+            return false;
+    return true;
+}
+
+// Does the comment [comment, end) contain the marker? The comment starts with the first ';' of a line or it is null.
+static inline bool comment_contains(const char *comment, const char *end, const char *marker)
+{
+    size_t len = strlen(marker);
+    for (; comment != nullptr; comment = (const char*)memchr(comment + 1, ';', end - comment - 1))
+        if (size_t(end - comment) >= len && memcmp(comment, marker, len) == 0)
+            return true;
+    return false;
+}
+
+// Parse a number at c, which is not followed by a number on the next line.
+static inline float parse_float(const char *c, const char *end)
+{
+    const char *p = c;
+    for (; p != end && (*p == ' ' || *p == '\t'); ++ p);
+    return (p == end) ? 0.f : float(atof(c));
+}
+
 // Parse the layer G-code for the moves, which could be adjusted.
 // Return the list of parsed lines, bucketed by an extruder.
 std::vector<PerExtruderAdjustments> CoolingBuffer::parse_layer_gcode(const std::string &gcode, std::vector<float> &current_pos) const
@@ -260,37 +286,39 @@ std::vector<PerExtruderAdjustments> CoolingBuffer::parse_layer_gcode(const std::
     // for a sequence of extrusion moves.
     size_t            active_speed_modifier = size_t(-1);
 
+    // The lines are parsed in place, without copying them.
     for (; *line_start != 0; line_start = line_end) 
     {
         while (*line_end != '\n' && *line_end != 0)
             ++ line_end;
-        // sline will not contain the trailing '\n'.
-        std::string sline(line_start, line_end);
+        // sline_end points to the end of the line without the trailing '\n'.
+        const char *sline_end = line_end;
         // CoolingLine will contain the trailing '\n'.
         if (*line_end == '\n')
             ++ line_end;
         CoolingLine line(0, line_start - gcode.c_str(), line_end - gcode.c_str());
-        if (boost::starts_with(sline, "G0 "))
+        if (starts_with(line_start, sline_end, "G0 "))
             line.type = CoolingLine::TYPE_G0;
-        else if (boost::starts_with(sline, "G1 "))
+        else if (starts_with(line_start, sline_end, "G1 "))
             line.type = CoolingLine::TYPE_G1;
-        else if (boost::starts_with(sline, "G92 "))
+        else if (starts_with(line_start, sline_end, "G92 "))
             line.type = CoolingLine::TYPE_G92;
         if (line.type) {
             // G0, G1 or G92
             // Parse the G-code line.
-            std::vector<float> new_pos(current_pos);
-            const char *c = sline.data() + 3;
+            float new_pos[5];
+            memcpy(new_pos, current_pos.data(), sizeof(new_pos));
+            const char *c = line_start + 3;
             for (;;) {
                 // Skip whitespaces.
-                for (; *c == ' ' || *c == '\t'; ++ c);
-                if (*c == 0 || *c == ';')
+                for (; c != sline_end && (*c == ' ' || *c == '\t'); ++ c);
+                if (c == sline_end || *c == ';')
                     break;
                 // Parse the axis.
                 size_t axis = (*c >= 'X' && *c <= 'Z') ? (*c - 'X') :
                               (*c == extrusion_axis) ? 3 : (*c == 'F') ? 4 : size_t(-1);
                 if (axis != size_t(-1)) {
-                    new_pos[axis] = float(atof(++c));
+                    new_pos[axis] = parse_float(++ c, sline_end);
                     if (axis == 4) {
                         // Convert mm/min to mm/sec.
                         new_pos[4] /= 60.f;
@@ -300,15 +328,17 @@ std::vector<PerExtruderAdjustments> CoolingBuffer::parse_layer_gcode(const std::
                     }
                 }
                 // Skip this word.
-                for (; *c != ' ' && *c != '\t' && *c != 0; ++ c);
+                for (; c != sline_end && *c != ' ' && *c != '\t'; ++ c);
             }
-            bool external_perimeter = boost::contains(sline, ";_EXTERNAL_PERIMETER");
-            bool wipe               = boost::contains(sline, ";_WIPE");
+            // The markers are G-code comments, search for them in the comment only.
+            const char *comment            = (const char*)memchr(line_start, ';', sline_end - line_start);
+            bool        external_perimeter = comment_contains(comment, sline_end, ";_EXTERNAL_PERIMETER");
+            bool        wipe               = comment_contains(comment, sline_end, ";_WIPE");
             if (external_perimeter)
                 line.type |= CoolingLine::TYPE_EXTERNAL_PERIMETER;
             if (wipe)
                 line.type |= CoolingLine::TYPE_WIPE;
-            if (boost::contains(sline, ";_EXTRUDE_SET_SPEED") && ! wipe) {
+            if (comment_contains(comment, sline_end, ";_EXTRUDE_SET_SPEED") && ! wipe) {
                 line.type |= CoolingLine::TYPE_ADJUSTABLE;
                 active_speed_modifier = adjustment->lines.size();
             }
@@ -353,30 +383,34 @@ std::vector<PerExtruderAdjustments> CoolingBuffer::parse_layer_gcode(const std::
                     line.type = 0;
                 }
             }
-            current_pos = std::move(new_pos);
-        } else if (boost::starts_with(sline, ";_EXTRUDE_END")) {
+            memcpy(current_pos.data(), new_pos, sizeof(new_pos));
+        } else if (starts_with(line_start, sline_end, ";_EXTRUDE_END")) {
             line.type = CoolingLine::TYPE_EXTRUDE_END;
             active_speed_modifier = size_t(-1);
-        } else if (boost::starts_with(sline, toolchange_prefix)) {
+        } else if (starts_with(line_start, sline_end, toolchange_prefix.c_str())) {
             // Switch the tool.
             line.type = CoolingLine::TYPE_SET_TOOL;
-            unsigned int new_extruder = (unsigned int)atoi(sline.c_str() + toolchange_prefix.size());
+            unsigned int new_extruder = (unsigned int)atoi(line_start + toolchange_prefix.size());
             if (new_extruder != current_extruder) {
                 current_extruder = new_extruder;
                 adjustment         = &per_extruder_adjustments[map_extruder_to_per_extruder_adjustment[current_extruder]];
             }
-        } else if (boost::starts_with(sline, ";_BRIDGE_FAN_START")) {
+        } else if (starts_with(line_start, sline_end, ";_BRIDGE_FAN_START")) {
             line.type = CoolingLine::TYPE_BRIDGE_FAN_START;
-        } else if (boost::starts_with(sline, ";_BRIDGE_FAN_END")) {
+        } else if (starts_with(line_start, sline_end, ";_BRIDGE_FAN_END")) {
             line.type = CoolingLine::TYPE_BRIDGE_FAN_END;
-        } else if (boost::starts_with(sline, "G4 ")) {
+        } else if (starts_with(line_start, sline_end, "G4 ")) {
             // Parse the wait time.
             line.type = CoolingLine::TYPE_G4;
-            size_t pos_S = sline.find('S', 3);
-            size_t pos_P = sline.find('P', 3);
-            line.time = line.time_max = float(
-                (pos_S > 0) ? atof(sline.c_str() + pos_S + 1) :
-                (pos_P > 0) ? atof(sline.c_str() + pos_P + 1) * 0.001 : 0.);
+            // Don't search the comment for the parameter.
+            const char *comment = (const char*)memchr(line_start + 3, ';', sline_end - line_start - 3);
+            const char *end     = (comment == nullptr) ? sline_end : comment;
+            const char *pos_S   = (const char*)memchr(line_start + 3, 'S', end - line_start - 3);
+            const char *pos_P   = (const char*)memchr(line_start + 3, 'P', end - line_start - 3);
+            // S is the wait time in seconds, P in milliseconds.
+            line.time = line.time_max = 
+                (pos_S != nullptr) ? parse_float(pos_S + 1, end) :
+                (pos_P != nullptr) ? parse_float(pos_P + 1, end) * 0.001f : 0.f;
         }
         if (line.type != 0)
             adjustment->lines.emplace_back(std::move(line));
@@ -722,13 +756,20 @@ std::string CoolingBuffer::apply_layer_cooldown(
             if (end < line_end) {
                 if (line->type & (CoolingLine::TYPE_ADJUSTABLE | CoolingLine::TYPE_EXTERNAL_PERIMETER | CoolingLine::TYPE_WIPE)) {
                     // Process comments, remove ";_EXTRUDE_SET_SPEED", ";_EXTERNAL_PERIMETER", ";_WIPE"
-                    std::string comment(end, line_end);
-                    boost::replace_all(comment, ";_EXTRUDE_SET_SPEED", "");
-                    if (line->type & CoolingLine::TYPE_EXTERNAL_PERIMETER)
-                        boost::replace_all(comment, ";_EXTERNAL_PERIMETER", "");
-                    if (line->type & CoolingLine::TYPE_WIPE)
-                        boost::replace_all(comment, ";_WIPE", "");
-                    new_gcode += comment;
+                    // The comment is split at the ';' characters, as all the markers start with ';'.
+                    for (const char *c = end; c < line_end;) {
+                        const char *next = (const char*)memchr(c + 1, ';', line_end - c - 1);
+                        if (next == nullptr)
+                            next = line_end;
+                        if (starts_with(c, next, ";_EXTRUDE_SET_SPEED"))
+                            c += strlen(";_EXTRUDE_SET_SPEED");
+                        else if ((line->type & CoolingLine::TYPE_EXTERNAL_PERIMETER) && starts_with(c, next, ";_EXTERNAL_PERIMETER"))
+                            c += strlen(";_EXTERNAL_PERIMETER");
+                        else if ((line->type & CoolingLine::TYPE_WIPE) && starts_with(c, next, ";_WIPE"))
+                            c += strlen(";_WIPE");
+                        new_gcode.append(c, next - c);
+                        c = next;
+                    }
                 } else {
                     // Just attach the rest of the source line.
                     new_gcode.append(end, line_end - end);
@@ -0,0 +1,228 @@
+#include "OutputSink.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdarg>
+#include <stdexcept>
+
+#include <boost/nowide/cstdio.hpp>
+
+#include <miniz/miniz.h>
+
+namespace Slic3r {
+
+GCodeOutputSink::GCodeOutputSink(size_t buffer_size) : m_error(false), m_flushed(0)
+{
+    m_buffer.assign(std::max<size_t>(buffer_size, 1024), 0);
+    m_ptr        = m_buffer.data();
+    m_buffer_end = m_ptr + m_buffer.size();
+}
+
+void GCodeOutputSink::write_format(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    for (;;) {
+        va_list args2;
+        va_copy(args2, args);
+        size_t space = m_buffer_end - m_ptr;
+        int    len   = ::vsnprintf(m_ptr, space, format, args2);
+        va_end(args2);
+#ifdef _MSC_VER
+        if (len < 0) {
+            // vsnprintf() of MSVC 2013 returns -1 if the output does not fit.
+            va_copy(args2, args);
+            len = ::_vscprintf(format, args2);
+            va_end(args2);
+        }
+#endif
+        if (len < 0)
+            // Formatting error.
+            break;
+        if (size_t(len) < space) {
+            // Fits into the buffer including the trailing zero.
+            m_ptr += len;
+            break;
+        }
+        if (m_ptr == m_buffer.data()) {
+            // Does not fit even into an empty buffer.
+            std::vector<char> long_buffer(size_t(len) + 1);
+            ::vsnprintf(long_buffer.data(), long_buffer.size(), format, args);
+            this->write_block(long_buffer.data(), size_t(len));
+            m_flushed += size_t(len);
+            break;
+        }
+        this->flush_buffer();
+    }
+    va_end(args);
+}
+
+bool GCodeOutputSink::close()
+{
+    this->flush_buffer();
+    this->close_target();
+    return ! m_error;
+}
+
+void GCodeOutputSink::flush_buffer()
+{
+    if (m_ptr > m_buffer.data()) {
+        this->write_block(m_buffer.data(), m_ptr - m_buffer.data());
+        m_flushed += m_ptr - m_buffer.data();
+    }
+    m_ptr = m_buffer.data();
+}
+
+void GCodeOutputSink::write_long(const char *data, size_t len)
+{
+    this->flush_buffer();
+    if (len < m_buffer.size()) {
+        memcpy(m_ptr, data, len);
+        m_ptr += len;
+    } else {
+        // Don't copy a block longer than the buffer, pass it to the target directly.
+        this->write_block(data, len);
+        m_flushed += len;
+    }
+}
+
+GCodeFileSink::GCodeFileSink(FILE *file, size_t buffer_size) : GCodeOutputSink(buffer_size), m_file(file)
+{
+    // The data are written in large blocks, don't copy them into the stdio buffer.
+    setvbuf(m_file, nullptr, _IONBF, 0);
+}
+
+void GCodeFileSink::write_block(const char *data, size_t len)
+{
+    if (fwrite(data, 1, len, m_file) != len)
+        m_error = true;
+}
+
+void GCodeFileSink::close_target()
+{
+    if (fflush(m_file) != 0 || ferror(m_file))
+        m_error = true;
+}
+
+bool GCodeFileSink::patch(size_t offset, const char *data, size_t len)
+{
+    assert(offset + len <= this->position());
+#ifdef _WIN32
+    bool ok = _fseeki64(m_file, __int64(offset), SEEK_SET) == 0;
+#else
+    bool ok = fseeko(m_file, off_t(offset), SEEK_SET) == 0;
+#endif
+    ok = ok && fwrite(data, 1, len, m_file) == len && fseek(m_file, 0, SEEK_END) == 0;
+    if (! ok)
+        m_error = true;
+    return ok;
+}
+
+bool GCodeMemorySink::patch(size_t offset, const char *data, size_t len)
+{
+    assert(offset + len <= m_data.size());
+    m_data.replace(offset, len, data, len);
+    return true;
+}
+
+GCodeGzipSink::GCodeGzipSink(FILE *file, int level, size_t buffer_size) :
+    GCodeOutputSink(buffer_size), m_file(file), m_stream(new mz_stream), m_compressed(buffer_size, 0), m_crc(MZ_CRC32_INIT), m_size(0)
+{
+    setvbuf(m_file, nullptr, _IONBF, 0);
+    memset(m_stream.get(), 0, sizeof(mz_stream));
+    // Raw deflate stream, the gzip header and trailer are written by the sink.
+    if (mz_deflateInit2(m_stream.get(), level, MZ_DEFLATED, - MZ_DEFAULT_WINDOW_BITS, 9, MZ_DEFAULT_STRATEGY) != MZ_OK)
+        throw std::runtime_error("Failed to initialize the gzip compressor.");
+    // ID1, ID2, deflate compression method, no flags, no modification time, no extra flags, unknown operating system.
+    static const unsigned char header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+    if (fwrite(header, 1, sizeof(header), m_file) != sizeof(header))
+        m_error = true;
+}
+
+GCodeGzipSink::~GCodeGzipSink()
+{
+    mz_deflateEnd(m_stream.get());
+}
+
+void GCodeGzipSink::write_block(const char *data, size_t len)
+{
+    m_crc   = uint32_t(mz_crc32(m_crc, (const unsigned char*)data, len));
+    m_size += uint32_t(len);
+    // mz_stream counts the input in 32 bits.
+    while (len > 0) {
+        size_t chunk = std::min<size_t>(len, 1 << 30);
+        m_stream->next_in  = (const unsigned char*)data;
+        m_stream->avail_in = (unsigned int)chunk;
+        this->deflate_input(MZ_NO_FLUSH);
+        data += chunk;
+        len  -= chunk;
+    }
+}
+
+void GCodeGzipSink::close_target()
+{
+    m_stream->next_in  = nullptr;
+    m_stream->avail_in = 0;
+    this->deflate_input(MZ_FINISH);
+    // CRC-32 and length of the uncompressed data modulo 2^32, both little endian.
+    unsigned char trailer[8];
+    for (int i = 0; i < 4; ++ i) {
+        trailer[i]     = (unsigned char)(m_crc  >> (8 * i));
+        trailer[i + 4] = (unsigned char)(m_size >> (8 * i));
+    }
+    if (fwrite(trailer, 1, sizeof(trailer), m_file) != sizeof(trailer) || fflush(m_file) != 0 || ferror(m_file))
+        m_error = true;
+}
+
+void GCodeGzipSink::deflate_input(int flush)
+{
+    for (;;) {
+        m_stream->next_out  = m_compressed.data();
+        m_stream->avail_out = (unsigned int)m_compressed.size();
+        int status = mz_deflate(m_stream.get(), flush);
+        if (status != MZ_OK && status != MZ_STREAM_END && status != MZ_BUF_ERROR) {
+            m_error = true;
+            return;
+        }
+        size_t compressed = m_compressed.size() - m_stream->avail_out;
+        if (compressed > 0 && fwrite(m_compressed.data(), 1, compressed, m_file) != compressed)
+            m_error = true;
+        if (flush == MZ_FINISH ? (status == MZ_STREAM_END) : (m_stream->avail_in == 0 && m_stream->avail_out > 0))
+            return;
+    }
+}
+
+void GCodeGzipSink::compress_file(const std::string &path_src, const std::string &path_dst)
+{
+    FILE *src = boost::nowide::fopen(path_src.c_str(), "rb");
+    if (src == nullptr)
+        throw std::runtime_error(std::string("Cannot open ") + path_src + " for reading.\n");
+    FILE *dst = boost::nowide::fopen(path_dst.c_str(), "wb");
+    if (dst == nullptr) {
+        fclose(src);
+        throw std::runtime_error(std::string("Cannot open ") + path_dst + " for writing.\n");
+    }
+    bool read_error = false;
+    bool write_error;
+    {
+        GCodeGzipSink     sink(dst);
+        std::vector<char> buffer(DEFAULT_BUFFER_SIZE);
+        for (;;) {
+            size_t len = fread(buffer.data(), 1, buffer.size(), src);
+            sink.write(buffer.data(), len);
+            if (len < buffer.size()) {
+                read_error = ferror(src) != 0;
+                break;
+            }
+        }
+        write_error = ! sink.close();
+    }
+    fclose(src);
+    fclose(dst);
+    if (read_error || write_error) {
+        boost::nowide::remove(path_dst.c_str());
+        throw std::runtime_error(std::string("Failed to compress ") + path_src + " into " + path_dst + (read_error ? ".\n" : ".\nIs the disk full?\n"));
+    }
+}
+
+} // namespace Slic3r
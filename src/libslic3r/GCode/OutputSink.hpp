@@ -0,0 +1,130 @@
+#ifndef slic3r_OutputSink_hpp_
+#define slic3r_OutputSink_hpp_
+
+#include "libslic3r.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/align/aligned_allocator.hpp>
+
+struct mz_stream_s;
+
+namespace Slic3r {
+
+// Target of the G-code export.
+// The G-code is collected into a large page aligned buffer, which is handed over to the target (a file, a memory block
+// or a gzip compressor) once full. The export thus pays for a library call per megabyte of G-code, not per G-code line.
+class GCodeOutputSink
+{
+public:
+    enum { DEFAULT_BUFFER_SIZE = 1024 * 1024 };
+
+    GCodeOutputSink(size_t buffer_size = DEFAULT_BUFFER_SIZE);
+    virtual ~GCodeOutputSink() {}
+
+    void write(const char *data, size_t len) {
+        if (len <= size_t(m_buffer_end - m_ptr)) {
+            memcpy(m_ptr, data, len);
+            m_ptr += len;
+        } else
+            this->write_long(data, len);
+    }
+    void write(const std::string &data) { this->write(data.data(), data.size()); }
+    // Format the data directly into the buffer.
+    void write_format(const char *format, ...);
+
+    // Number of bytes written into the sink.
+    size_t position() const { return m_flushed + (m_ptr - m_buffer.data()); }
+
+    // Hand over the buffered data to the target and finalize the target. No data shall be written after close().
+    // Returns false if writing to the target failed.
+    bool close();
+    // Overwrite the data at the given offset after close(), the data shall not extend the output.
+    // Returns false if writing to the target failed or if the target does not support overwriting.
+    virtual bool patch(size_t /* offset */, const char * /* data */, size_t /* len */) { return false; }
+    // Did writing to the target fail?
+    bool error() const { return m_error; }
+
+protected:
+    virtual void write_block(const char *data, size_t len) = 0;
+    virtual void close_target() {}
+
+    bool    m_error;
+
+private:
+    void flush_buffer();
+    void write_long(const char *data, size_t len);
+
+    std::vector<char, boost::alignment::aligned_allocator<char, 4096>> m_buffer;
+    char   *m_ptr;
+    char   *m_buffer_end;
+    // Number of bytes handed over to the target.
+    size_t  m_flushed;
+};
+
+// Writes into a file opened by the caller. The file is not closed by the sink.
+class GCodeFileSink : public GCodeOutputSink
+{
+public:
+    GCodeFileSink(FILE *file, size_t buffer_size = DEFAULT_BUFFER_SIZE);
+
+    bool patch(size_t offset, const char *data, size_t len) override;
+
+protected:
+    void write_block(const char *data, size_t len) override;
+    void close_target() override;
+
+private:
+    FILE   *m_file;
+};
+
+// Collects the G-code in memory.
+class GCodeMemorySink : public GCodeOutputSink
+{
+public:
+    GCodeMemorySink(size_t buffer_size = 64 * 1024) : GCodeOutputSink(buffer_size) {}
+
+    const std::string&  data() const { return m_data; }
+
+    bool patch(size_t offset, const char *data, size_t len) override;
+
+protected:
+    void write_block(const char *data, size_t len) override { m_data.append(data, len); }
+
+private:
+    std::string m_data;
+};
+
+// Compresses the G-code on the fly into a gzip file opened by the caller. The file is not closed by the sink.
+// The default compression level compresses G-code nearly as well as the zlib default level 6 at twice the speed.
+class GCodeGzipSink : public GCodeOutputSink
+{
+public:
+    GCodeGzipSink(FILE *file, int level = 3, size_t buffer_size = DEFAULT_BUFFER_SIZE);
+    ~GCodeGzipSink();
+
+    // Compress the src file into the dst file. Throws std::runtime_error on failure.
+    static void compress_file(const std::string &path_src, const std::string &path_dst);
+
+protected:
+    void write_block(const char *data, size_t len) override;
+    void close_target() override;
+
+private:
+    // Run the compressor with the given flush mode until it consumes all its input, write the compressed data to the file.
+    void deflate_input(int flush);
+
+    FILE                            *m_file;
+    std::unique_ptr<mz_stream_s>     m_stream;
+    std::vector<unsigned char>       m_compressed;
+    uint32_t                         m_crc;
+    uint32_t                         m_size;
+};
+
+} // namespace Slic3r
+
+#endif /* slic3r_OutputSink_hpp_ */
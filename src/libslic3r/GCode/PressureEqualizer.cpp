@@ -7,6 +7,8 @@
 
 #include "PressureEqualizer.hpp"
 
+#include <boost/log/trivial.hpp>
+
 namespace Slic3r {
 
 PressureEqualizer::PressureEqualizer(const Slic3r::GCodeConfig *config) : 
@@ -25,6 +27,8 @@ void PressureEqualizer::reset()
     circular_buffer_size    = 100;
     circular_buffer_items   = 0;
     circular_buffer.assign(circular_buffer_size, GCodeLine());
+    text_arena_slot_size    = 128;
+    text_arena.assign(circular_buffer_size * text_arena_slot_size, 0);
 
     // Preallocate some data, so that output_buffer.data() will return an empty string.
     output_buffer.assign(32, 0);
@@ -84,13 +88,13 @@ const char* PressureEqualizer::process(const char *szGCode, bool flush)
             for (; *endl != 0 && *endl != '\n'; ++ endl) ;
             if (circular_buffer_items == circular_buffer_size)
                 // Buffer is full. Push out the oldest line.
-                output_gcode_line(circular_buffer[circular_buffer_pos]);
+                output_gcode_line(circular_buffer_pos);
             else
                 ++ circular_buffer_items;
             // Process a G-code line, store it into the provided GCodeLine object.
             size_t idx_tail = circular_buffer_pos;
             circular_buffer_pos = circular_buffer_idx_next(circular_buffer_pos);
-            if (! process_line(p, endl - p, circular_buffer[idx_tail])) {
+            if (! process_line(p, endl - p, idx_tail)) {
                 // The line has to be forgotten. It contains comment marks, which shall be
                 // filtered out of the target g-code.
                 circular_buffer_pos = idx_tail;
@@ -105,7 +109,7 @@ const char* PressureEqualizer::process(const char *szGCode, bool flush)
     if (flush) {
         // Flush the remaining valid lines of the circular buffer.
         for (size_t idx = circular_buffer_idx_head(); circular_buffer_items > 0; -- circular_buffer_items) {
-            output_gcode_line(circular_buffer[idx]);
+            output_gcode_line(idx);
             if (++ idx == circular_buffer_size)
                 idx = 0;
         }
@@ -113,15 +117,11 @@ const char* PressureEqualizer::process(const char *szGCode, bool flush)
         assert(circular_buffer_items == 0);
         circular_buffer_pos = 0;
 
-#if 1 
-        printf("Statistics: \n"); 
-        printf("Minimum volumetric extrusion rate: %f\n", m_stat.volumetric_extrusion_rate_min);
-        printf("Maximum volumetric extrusion rate: %f\n", m_stat.volumetric_extrusion_rate_max);
         if (m_stat.extrusion_length > 0)
             m_stat.volumetric_extrusion_rate_avg /= m_stat.extrusion_length;
-        printf("Average volumetric extrusion rate: %f\n", m_stat.volumetric_extrusion_rate_avg);
+        BOOST_LOG_TRIVIAL(debug) << "PressureEqualizer statistics: volumetric extrusion rate minimum " << m_stat.volumetric_extrusion_rate_min << 
+            ", maximum " << m_stat.volumetric_extrusion_rate_max << ", average " << m_stat.volumetric_extrusion_rate_avg;
         m_stat.reset();
-#endif
     } 
 
     return output_buffer.data();
@@ -166,8 +166,10 @@ static inline float parse_float(const char *&line)
 };
 
 #define EXTRUSION_ROLE_TAG ";_EXTRUSION_ROLE:"
-bool PressureEqualizer::process_line(const char *line, const size_t len, GCodeLine &buf)
+bool PressureEqualizer::process_line(const char *line, const size_t len, size_t idx)
 {
+    GCodeLine &buf = circular_buffer[idx];
+
     if (strncmp(line, EXTRUSION_ROLE_TAG, strlen(EXTRUSION_ROLE_TAG)) == 0) {
         line += strlen(EXTRUSION_ROLE_TAG);
         int role = atoi(line);
@@ -179,11 +181,20 @@ bool PressureEqualizer::process_line(const char *line, const size_t len, GCodeLi
     // Set the type, copy the line to the buffer.
     buf.type = GCODELINETYPE_OTHER;
     buf.modified = false;
-    if (buf.raw.size() < len + 1)
-        buf.raw.assign(line, line + len + 1);
-    else
-        memcpy(buf.raw.data(), line, len);
-    buf.raw[len] = 0;
+    if (text_arena_slot_size < len + 1) {
+        // Grow the slots of the text arena, move the text of the lines to the new slots.
+        size_t slot_size = text_arena_slot_size;
+        while (slot_size < len + 1)
+            slot_size *= 2;
+        std::vector<char> arena(circular_buffer_size * slot_size, 0);
+        for (size_t i = 0; i < circular_buffer_size; ++ i)
+            memcpy(arena.data() + i * slot_size, raw_text(i), circular_buffer[i].raw_length + 1);
+        text_arena.swap(arena);
+        text_arena_slot_size = slot_size;
+    }
+    char *raw = raw_text(idx);
+    memcpy(raw, line, len);
+    raw[len] = 0;
     buf.raw_length = len;
 
     memcpy(buf.pos_start, m_current_pos, sizeof(float)*5);
@@ -262,14 +273,11 @@ bool PressureEqualizer::process_line(const char *line, const size_t len, GCodeLi
                     buf.volumetric_extrusion_rate_start = rate;
                     buf.volumetric_extrusion_rate_end   = rate;
                     m_stat.update(rate, sqrt(len2));
-                    if (rate < 40.f) {
-                    	printf("Extremely low flow rate: %f. Line %d, Length: %f, extrusion: %f Old position: (%f, %f, %f), new position: (%f, %f, %f)\n", 
-                            rate, 
-                            int(line_idx),
-                            sqrt(len2), sqrt((diff[3]*diff[3])/len2),
-                            m_current_pos[0], m_current_pos[1], m_current_pos[2],
-                            new_pos[0], new_pos[1], new_pos[2]);
-                    }
+                    if (rate < 40.f)
+                        BOOST_LOG_TRIVIAL(trace) << "PressureEqualizer: Extremely low flow rate: " << rate << ". Line " << line_idx << 
+                            ", Length: " << sqrt(len2) << ", extrusion: " << sqrt((diff[3]*diff[3])/len2) << 
+                            " Old position: (" << m_current_pos[0] << ", " << m_current_pos[1] << ", " << m_current_pos[2] << 
+                            "), new position: (" << new_pos[0] << ", " << new_pos[1] << ", " << new_pos[2] << ")";
                 }
             } else if (changed[0] || changed[1] || changed[2]) {
                 // Moving without extrusion.
@@ -350,22 +358,24 @@ bool PressureEqualizer::process_line(const char *line, const size_t len, GCodeLi
 
     buf.extruder_id = m_current_extruder;
     memcpy(buf.pos_end, m_current_pos, sizeof(float)*5);
+    buf.move_time = buf.extruding() ? buf.time() : 0.f;
 
     adjust_volumetric_rate();
     ++ line_idx;
 	return true;
 }
 
-void PressureEqualizer::output_gcode_line(GCodeLine &line)
+void PressureEqualizer::output_gcode_line(size_t idx)
 {
+    GCodeLine &line = circular_buffer[idx];
     if (! line.modified) {
-        push_to_output(line.raw.data(), line.raw_length, true);
+        push_to_output(raw_text(idx), line.raw_length, true);
         return;
     }
 
     // The line was modified.
     // Find the comment.
-    const char *comment = line.raw.data();
+    const char *comment = raw_text(idx);
     while (*comment != ';' && *comment != 0) ++comment;
     if (*comment != ';')
         comment = NULL;
@@ -471,6 +481,10 @@ void PressureEqualizer::adjust_volumetric_rate()
     for (size_t i = 0; i < numExtrusionRoles; ++ i)
         feedrate_per_extrusion_role[i] = FLT_MAX;
     feedrate_per_extrusion_role[circular_buffer[idx].extrusion_role] = circular_buffer[idx].volumetric_extrusion_rate_start;
+    // Bit mask of the extrusion roles with a limited rate. The roles with an unlimited rate have no effect on the lines
+    // of other roles, skip them cheaply. The roles have to be processed in their order, as each role may lower the rates
+    // of the line, which are then used by the next roles.
+    uint32_t roles_limited = 1 << circular_buffer[idx].extrusion_role;
 
     bool modified = true;
     while (modified && idx != idx_head) {
@@ -483,7 +497,11 @@ void PressureEqualizer::adjust_volumetric_rate()
         // What is the gradient of the extrusion rate between idx_prev and idx?
         idx = idx_prev;
         GCodeLine &line = circular_buffer[idx];
+        roles_limited |= 1 << line.extrusion_role;
         for (size_t iRole = 1; iRole < numExtrusionRoles; ++ iRole) {
+            if ((roles_limited & (1 << iRole)) == 0)
+                // The rate for ExtrusionRole iRole is unlimited.
+                continue;
             float rate_slope = m_max_volumetric_extrusion_rate_slopes[iRole].negative;
             if (rate_slope == 0)
                 // The negative rate is unlimited.
@@ -521,6 +539,7 @@ void PressureEqualizer::adjust_volumetric_rate()
     for (size_t i = 0; i < numExtrusionRoles; ++ i)
         feedrate_per_extrusion_role[i] = FLT_MAX;
     feedrate_per_extrusion_role[circular_buffer[idx].extrusion_role] = circular_buffer[idx].volumetric_extrusion_rate_end;
+    roles_limited = 1 << circular_buffer[idx].extrusion_role;
 
     assert(circular_buffer[idx].extruding());
     while (idx != idx_tail) {
@@ -532,7 +551,11 @@ void PressureEqualizer::adjust_volumetric_rate()
         // What is the gradient of the extrusion rate between idx_prev and idx?
         idx = idx_next;
         GCodeLine &line = circular_buffer[idx];
+        roles_limited |= 1 << line.extrusion_role;
         for (size_t iRole = 1; iRole < numExtrusionRoles; ++ iRole) {
+            if ((roles_limited & (1 << iRole)) == 0)
+                // The rate for ExtrusionRole iRole is unlimited.
+                continue;
             float rate_slope = m_max_volumetric_extrusion_rate_slopes[iRole].positive;
             if (rate_slope == 0)
                 // The positive rate is unlimited.
@@ -89,6 +89,7 @@ private:
         GCodeLine() : 
             type(GCODELINETYPE_INVALID),
             raw_length(0),
+            move_time(0.f),
             modified(false),
             extruder_id(0), 
             volumetric_extrusion_rate(0.f), 
@@ -117,12 +118,12 @@ private:
             assert(avg_correction <= 1.00000001f);
             return avg_correction;
         }
-        float       time_corrected()  const { return time() * volumetric_correction_avg(); }
+        // Uses the time of the move cached by process_line(), the time_corrected() is evaluated repeatedly by adjust_volumetric_rate().
+        float       time_corrected()  const { return move_time * volumetric_correction_avg(); }
 
         GCodeLineType type;
 
-        // We try to keep the string buffer once it has been allocated, so it will not be reallocated over and over.
-        std::vector<char>   raw;
+        // The raw text is stored in the text_arena at the slot of this line, zero terminated.
         size_t              raw_length;
         // If modified, the raw text has to be adapted by the new extrusion rate,
         // or maybe the line needs to be split into multiple lines.
@@ -135,6 +136,8 @@ private:
         float       pos_end[5];
         // Was the axis found on the G-code line? X,Y,Z,F
         bool        pos_provided[5];
+        // time() of an extruding move, zero otherwise.
+        float       move_time;
 
         // Index of the active extruder.
         size_t      extruder_id;
@@ -162,6 +165,10 @@ private:
     size_t                          circular_buffer_size;
     // Number of valid lines in the circular buffer. Lower or equal to circular_buffer_size.
     size_t                          circular_buffer_items;
+    // Raw text of the lines of the circular buffer, a slot of text_arena_slot_size bytes per line, so that the text
+    // of the lines is not allocated per line. The slots grow if a line does not fit.
+    std::vector<char>               text_arena;
+    size_t                          text_arena_slot_size;
 
     // Output buffer will only grow. It will not be reallocated over and over.
     std::vector<char>               output_buffer;
@@ -170,8 +177,8 @@ private:
     // For debugging purposes. Index of the G-code line processed.
     size_t                          line_idx;
 
-    bool process_line(const char *line, const size_t len, GCodeLine &buf);
-    void output_gcode_line(GCodeLine &buf);
+    bool process_line(const char *line, const size_t len, size_t idx);
+    void output_gcode_line(size_t idx);
 
     // Go back from the current circular_buffer_pos and lower the feedtrate to decrease the slope of the extrusion rate changes.
     // Then go forward and adjust the feedrate to decrease the slope of the extrusion rate changes.
@@ -184,6 +191,9 @@ private:
     // Push a G-code line to the output, 
     void push_line_to_output(const GCodeLine &line, const float new_feedrate, const char *comment);
 
+    char*       raw_text(size_t idx)       { return text_arena.data() + idx * text_arena_slot_size; }
+    const char* raw_text(size_t idx) const { return text_arena.data() + idx * text_arena_slot_size; }
+
     size_t circular_buffer_idx_head() const {
         size_t idx = circular_buffer_pos + circular_buffer_size - circular_buffer_items;
         if (idx >= circular_buffer_size)
@@ -38,19 +38,138 @@ std::vector<unsigned char> GCodePreviewData::Color::as_bytes() const
     return ret;
 }
 
-GCodePreviewData::Extrusion::Layer::Layer(float z, const ExtrusionPaths& paths)
+GCodePreviewData::Extrusion::Layer::Layer(float z)
     : z(z)
-    , paths(paths)
 {
+    path_starts.push_back(0);
 }
 
-GCodePreviewData::Travel::Polyline::Polyline(EType type, EDirection direction, float feedrate, unsigned int extruder_id, const Polyline3& polyline)
-    : type(type)
-    , direction(direction)
-    , feedrate(feedrate)
-    , extruder_id(extruder_id)
-    , polyline(polyline)
+size_t GCodePreviewData::Extrusion::Layer::vertices_count(unsigned int lod) const
 {
+    return (lod == 0) ? path_starts.back() : lods[lod - 1].path_starts.back();
+}
+
+void GCodePreviewData::Extrusion::Layer::add_path(ExtrusionRole role, float width, float height, float feedrate, float mm3_per_mm, unsigned int extruder_id, unsigned int cp_color_id,
+    const float* xy, size_t num_vertices)
+{
+    vertices.insert(vertices.end(), xy, xy + 2 * num_vertices);
+    path_starts.push_back((uint32_t)(vertices.size() / 2));
+    roles.push_back(role);
+    widths.push_back(width);
+    heights.push_back(height);
+    feedrates.push_back(feedrate);
+    this->mm3_per_mm.push_back(mm3_per_mm);
+    extruder_ids.push_back(extruder_id);
+    cp_color_ids.push_back(cp_color_id);
+}
+
+ExtrusionPath GCodePreviewData::Extrusion::Layer::path(size_t path_id, unsigned int lod) const
+{
+    ExtrusionPath path(roles[path_id], (double)mm3_per_mm[path_id], widths[path_id], heights[path_id]);
+    path.feedrate = feedrates[path_id];
+    path.extruder_id = extruder_ids[path_id];
+    path.cp_color_id = cp_color_ids[path_id];
+
+    auto scaled_point = [this](uint32_t id) { return Point(scale_(vertices[2 * id]), scale_(vertices[2 * id + 1])); };
+    if (lod == 0)
+    {
+        path.polyline.points.reserve(path_starts[path_id + 1] - path_starts[path_id]);
+        for (uint32_t id = path_starts[path_id]; id < path_starts[path_id + 1]; ++id)
+        {
+            path.polyline.points.emplace_back(scaled_point(id));
+        }
+    }
+    else
+    {
+        const LOD& level = lods[lod - 1];
+        path.polyline.points.reserve(level.path_starts[path_id + 1] - level.path_starts[path_id]);
+        for (uint32_t i = level.path_starts[path_id]; i < level.path_starts[path_id + 1]; ++i)
+        {
+            path.polyline.points.emplace_back(scaled_point(level.vertex_ids[i]));
+        }
+    }
+    return path;
+}
+
+void GCodePreviewData::Extrusion::Layer::finalize()
+{
+    for (unsigned int lod = 1; lod < Num_LODs; ++lod)
+    {
+        LOD& level = lods[lod - 1];
+        level.vertex_ids.clear();
+        level.path_starts.assign(1, 0);
+        for (size_t i = 0; i + 1 < path_starts.size(); ++i)
+        {
+            MultiPoint::_douglas_peucker_ids([this](uint32_t id) { return Vec2d(vertices[2 * id], vertices[2 * id + 1]); },
+                path_starts[i], path_starts[i + 1] - 1, (double)LOD_Tolerances[lod], level.vertex_ids);
+            level.path_starts.push_back((uint32_t)level.vertex_ids.size());
+        }
+        level.vertex_ids.shrink_to_fit();
+        level.path_starts.shrink_to_fit();
+    }
+
+    vertices.shrink_to_fit();
+    path_starts.shrink_to_fit();
+    roles.shrink_to_fit();
+    widths.shrink_to_fit();
+    heights.shrink_to_fit();
+    feedrates.shrink_to_fit();
+    mm3_per_mm.shrink_to_fit();
+    extruder_ids.shrink_to_fit();
+    cp_color_ids.shrink_to_fit();
+}
+
+void GCodePreviewData::Travel::Polylines::clear()
+{
+    vertices.clear();
+    starts.assign(1, 0);
+    types.clear();
+    directions.clear();
+    feedrates.clear();
+    extruder_ids.clear();
+}
+
+void GCodePreviewData::Travel::Polylines::add(EType type, EDirection direction, float feedrate, unsigned int extruder_id, const float* xyz, size_t num_vertices)
+{
+    if (starts.empty())
+        starts.push_back(0);
+    vertices.insert(vertices.end(), xyz, xyz + 3 * num_vertices);
+    starts.push_back((uint32_t)(vertices.size() / 3));
+    types.push_back(type);
+    directions.push_back(direction);
+    feedrates.push_back(feedrate);
+    extruder_ids.push_back(extruder_id);
+}
+
+Polyline3 GCodePreviewData::Travel::Polylines::polyline(size_t idx) const
+{
+    Polyline3 polyline;
+    polyline.points.reserve(starts[idx + 1] - starts[idx]);
+    for (uint32_t id = starts[idx]; id < starts[idx + 1]; ++id)
+    {
+        polyline.points.emplace_back(scale_(vertices[3 * id]), scale_(vertices[3 * id + 1]), scale_(vertices[3 * id + 2]));
+    }
+    return polyline;
+}
+
+float GCodePreviewData::Travel::Polylines::min_z(size_t idx) const
+{
+    float z = FLT_MAX;
+    for (uint32_t id = starts[idx]; id < starts[idx + 1]; ++id)
+    {
+        z = std::min(z, vertices[3 * id + 2]);
+    }
+    return z;
+}
+
+void GCodePreviewData::Travel::Polylines::shrink_to_fit()
+{
+    vertices.shrink_to_fit();
+    starts.shrink_to_fit();
+    types.shrink_to_fit();
+    directions.shrink_to_fit();
+    feedrates.shrink_to_fit();
+    extruder_ids.shrink_to_fit();
 }
 
 const GCodePreviewData::Color GCodePreviewData::Range::Default_Colors[Colors_Count] =
@@ -177,6 +296,8 @@ const std::string GCodePreviewData::Extrusion::Default_Extrusion_Role_Names[Num_
 
 const GCodePreviewData::Extrusion::EViewType GCodePreviewData::Extrusion::Default_View_Type = GCodePreviewData::Extrusion::FeatureType;
 
+const float GCodePreviewData::Extrusion::LOD_Tolerances[Num_LODs] = { 0.0f, 0.05f, 0.2f };
+
 void GCodePreviewData::Extrusion::set_default()
 {
     view_type = Default_View_Type;
@@ -205,6 +326,21 @@ bool GCodePreviewData::Extrusion::is_role_flag_set(unsigned int flags, Extrusion
     return GCodeAnalyzer::is_valid_extrusion_role(role) && (flags & (1 << (role - erPerimeter))) != 0;
 }
 
+unsigned int GCodePreviewData::Extrusion::lod_for_vertices(size_t max_vertices) const
+{
+    for (unsigned int lod = 0; lod + 1 < Num_LODs; ++lod)
+    {
+        size_t count = 0;
+        for (const Layer& layer : layers)
+        {
+            count += layer.vertices_count(lod);
+        }
+        if (count <= max_vertices)
+            return lod;
+    }
+    return Num_LODs - 1;
+}
+
 const float GCodePreviewData::Travel::Default_Width = 0.075f;
 const float GCodePreviewData::Travel::Default_Height = 0.075f;
 const GCodePreviewData::Color GCodePreviewData::Travel::Default_Type_Colors[Num_Types] =
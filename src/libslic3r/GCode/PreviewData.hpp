@@ -80,12 +80,51 @@ public:
         static const std::string Default_Extrusion_Role_Names[Num_Extrusion_Roles];
         static const EViewType Default_View_Type;
 
+        // Levels of detail of the extrusion paths, the level 0 is not simplified.
+        static const unsigned int Num_LODs = 3;
+        // Tolerance of the simplification of the paths for each level of detail, in mm.
+        static const float LOD_Tolerances[Num_LODs];
+
+        // Extrusion paths of a layer, stored by columns: The vertices of all the paths are stored in a single array,
+        // the attributes of the paths are stored in arrays indexed by the path.
         struct Layer
         {
-            float z;
-            ExtrusionPaths paths;
+            // Paths simplified for a level of detail, stored as indices of the retained vertices.
+            struct LOD
+            {
+                std::vector<uint32_t> vertex_ids;
+                // Index of the first retained vertex of each path into vertex_ids, followed by the size of vertex_ids.
+                std::vector<uint32_t> path_starts;
+            };
 
-            Layer(float z, const ExtrusionPaths& paths);
+            float z;
+            // x, y coordinates of the vertices of all the paths, mm
+            std::vector<float> vertices;
+            // Index of the first vertex of each path, followed by the number of vertices.
+            std::vector<uint32_t> path_starts;
+            std::vector<ExtrusionRole> roles;
+            std::vector<float> widths;    // mm
+            std::vector<float> heights;   // mm
+            std::vector<float> feedrates; // mm/s
+            std::vector<float> mm3_per_mm;
+            std::vector<unsigned int> extruder_ids;
+            std::vector<unsigned int> cp_color_ids;
+            // Levels of detail 1 to Num_LODs - 1.
+            LOD lods[Num_LODs - 1];
+
+            explicit Layer(float z);
+
+            size_t paths_count() const { return roles.size(); }
+            size_t vertices_count(unsigned int lod = 0) const;
+
+            // Adds a path with the given attributes and the given x, y coordinates of its vertices.
+            void add_path(ExtrusionRole role, float width, float height, float feedrate, float mm3_per_mm, unsigned int extruder_id, unsigned int cp_color_id,
+                const float* xy, size_t num_vertices);
+            // Returns the path with the given index at the given level of detail, in scaled coordinates.
+            ExtrusionPath path(size_t path_id, unsigned int lod = 0) const;
+
+            // Calculates the levels of detail once all the paths have been added, releases the unused memory.
+            void finalize();
         };
 
         typedef std::vector<Layer> LayersList;
@@ -98,6 +137,8 @@ public:
 
         void set_default();
         bool is_role_flag_set(ExtrusionRole role) const;
+        // Returns the finest level of detail, at which the vertices of all the layers fit into the given budget.
+        unsigned int lod_for_vertices(size_t max_vertices) const;
 
         static bool is_role_flag_set(unsigned int flags, ExtrusionRole role);
     };
@@ -116,27 +157,40 @@ public:
         static const float Default_Height;
         static const Color Default_Type_Colors[Num_Types];
 
-        struct Polyline
+        enum EDirection : unsigned char
         {
-            enum EDirection
-            {
-                Vertical,
-                Generic,
-                Num_Directions
-            };
-
-            EType type;
-            EDirection direction;
-            float feedrate;
-            unsigned int extruder_id;
-            Polyline3 polyline;
-
-            Polyline(EType type, EDirection direction, float feedrate, unsigned int extruder_id, const Polyline3& polyline);
+            Vertical,
+            Generic,
+            Num_Directions
         };
 
-        typedef std::vector<Polyline> PolylinesList;
+        // Travel polylines, stored by columns as the extrusion paths.
+        struct Polylines
+        {
+            // x, y, z coordinates of the vertices of all the polylines, mm
+            std::vector<float> vertices;
+            // Index of the first vertex of each polyline, followed by the number of vertices.
+            std::vector<uint32_t> starts;
+            std::vector<EType> types;
+            std::vector<EDirection> directions;
+            std::vector<float> feedrates; // mm/s
+            std::vector<unsigned int> extruder_ids;
+
+            size_t size() const { return types.size(); }
+            bool empty() const { return types.empty(); }
+            void clear();
+
+            // Adds a polyline with the given attributes and the given x, y, z coordinates of its vertices.
+            void add(EType type, EDirection direction, float feedrate, unsigned int extruder_id, const float* xyz, size_t num_vertices);
+            // Returns the polyline with the given index, in scaled coordinates.
+            Polyline3 polyline(size_t idx) const;
+            // Returns the minimum z of the polyline with the given index, in mm.
+            float min_z(size_t idx) const;
+            // Releases the unused memory once all the polylines have been added.
+            void shrink_to_fit();
+        };
 
-        PolylinesList polylines;
+        Polylines polylines;
         float width;
         float height;
         Color type_colors[Num_Types];
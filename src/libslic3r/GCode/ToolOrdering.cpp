@@ -96,6 +96,43 @@ ToolOrdering::ToolOrdering(const Print &print, unsigned int first_extruder, bool
     this->collect_extruder_statistics(prime_multi_material);
 }
 
+// For the streaming export of a single object (see GCode::_do_export()), where the layers are finished bottom up.
+// The extruders of a layer do not depend on the layers above, if there is no wipe tower and no wiping into the object.
+const LayerTools& ToolOrdering::append_layer(const PrintObject &object, const Layer *object_layer, const SupportLayer *support_layer)
+{
+    assert(object_layer != nullptr || support_layer != nullptr);
+    ToolOrdering layer;
+    layer.m_print_config_ptr = &object.print()->config();
+    {
+        std::vector<coordf_t> zs;
+        if (object_layer != nullptr)
+            zs.emplace_back(object_layer->print_z);
+        if (support_layer != nullptr)
+            zs.emplace_back(support_layer->print_z);
+        layer.initialize_layers(zs);
+    }
+    assert(layer.m_layer_tools.size() == 1);
+    if (support_layer != nullptr)
+        layer.collect_support_extruders(object, *support_layer);
+    if (object_layer != nullptr)
+        layer.collect_object_extruders(object, *object_layer);
+    layer.sort_extruders();
+    // Continue the tool sequence of the layers below.
+    layer.reorder_extruders(m_last_printing_extruder);
+    layer.collect_extruder_statistics(false);
+
+    if (layer.m_first_printing_extruder != (unsigned int)-1) {
+        if (m_first_printing_extruder == (unsigned int)-1)
+            m_first_printing_extruder = layer.m_first_printing_extruder;
+        m_last_printing_extruder = layer.m_last_printing_extruder;
+        append(m_all_printing_extruders, layer.m_all_printing_extruders);
+        sort_remove_duplicates(m_all_printing_extruders);
+    }
+    assert(m_layer_tools.empty() || m_layer_tools.back().print_z < layer.m_layer_tools.front().print_z);
+    m_layer_tools.emplace_back(std::move(layer.m_layer_tools.front()));
+    return m_layer_tools.back();
+}
+
 
 LayerTools& ToolOrdering::tools_for_layer(coordf_t print_z)
 {
@@ -132,79 +169,91 @@ void ToolOrdering::initialize_layers(std::vector<coordf_t> &zs)
 void ToolOrdering::collect_extruders(const PrintObject &object)
 {
     // Collect the support extruders.
-    for (auto support_layer : object.support_layers()) {
-        LayerTools   &layer_tools = this->tools_for_layer(support_layer->print_z);
-        ExtrusionRole role = support_layer->support_fills.role();
-        bool         has_support        = role == erMixed || role == erSupportMaterial;
-        bool         has_interface      = role == erMixed || role == erSupportMaterialInterface;
-        unsigned int extruder_support   = object.config().support_material_extruder.value;
-        unsigned int extruder_interface = object.config().support_material_interface_extruder.value;
-        if (has_support)
-            layer_tools.extruders.push_back(extruder_support);
-        if (has_interface)
-            layer_tools.extruders.push_back(extruder_interface);
-        if (has_support || has_interface)
-            layer_tools.has_support = true;
-    }
+    for (auto support_layer : object.support_layers())
+        this->collect_support_extruders(object, *support_layer);
     // Collect the object extruders.
-    for (auto layer : object.layers()) {
-        LayerTools &layer_tools = this->tools_for_layer(layer->print_z);
-        // What extruders are required to print this object layer?
-        for (size_t region_id = 0; region_id < object.region_volumes.size(); ++ region_id) {
-			const LayerRegion *layerm = (region_id < layer->regions().size()) ? layer->regions()[region_id] : nullptr;
-            if (layerm == nullptr)
-                continue;
-            const PrintRegion &region = *object.print()->regions()[region_id];
-
-            if (! layerm->perimeters.entities.empty()) {
-                bool something_nonoverriddable = true;
-
-                if (m_print_config_ptr) { // in this case complete_objects is false (see ToolOrdering constructors)
-                    something_nonoverriddable = false;
-                    for (const auto& eec : layerm->perimeters.entities) // let's check if there are nonoverriddable entities
-                        if (!layer_tools.wiping_extrusions().is_overriddable(dynamic_cast<const ExtrusionEntityCollection&>(*eec), *m_print_config_ptr, object, region)) {
-                            something_nonoverriddable = true;
-                            break;
-                        }
-                }
+    for (auto layer : object.layers())
+        this->collect_object_extruders(object, *layer);
+    this->sort_extruders();
+}
 
-                if (something_nonoverriddable)
-                        layer_tools.extruders.push_back(region.config().perimeter_extruder.value);
+void ToolOrdering::collect_support_extruders(const PrintObject &object, const SupportLayer &support_layer)
+{
+    LayerTools   &layer_tools = this->tools_for_layer(support_layer.print_z);
+    ExtrusionRole role = support_layer.support_fills.role();
+    bool         has_support        = role == erMixed || role == erSupportMaterial;
+    bool         has_interface      = role == erMixed || role == erSupportMaterialInterface;
+    unsigned int extruder_support   = object.config().support_material_extruder.value;
+    unsigned int extruder_interface = object.config().support_material_interface_extruder.value;
+    if (has_support)
+        layer_tools.extruders.push_back(extruder_support);
+    if (has_interface)
+        layer_tools.extruders.push_back(extruder_interface);
+    if (has_support || has_interface)
+        layer_tools.has_support = true;
+}
 
-                layer_tools.has_object = true;
-            }
+void ToolOrdering::collect_object_extruders(const PrintObject &object, const Layer &layer)
+{
+    LayerTools &layer_tools = this->tools_for_layer(layer.print_z);
+    // What extruders are required to print this object layer?
+    for (size_t region_id = 0; region_id < object.region_volumes.size(); ++ region_id) {
+		const LayerRegion *layerm = (region_id < layer.regions().size()) ? layer.regions()[region_id] : nullptr;
+        if (layerm == nullptr)
+            continue;
+        const PrintRegion &region = *object.print()->regions()[region_id];
 
+        if (! layerm->perimeters.entities.empty()) {
+            bool something_nonoverriddable = true;
 
-            bool has_infill       = false;
-            bool has_solid_infill = false;
-            bool something_nonoverriddable = false;
-            for (const ExtrusionEntity *ee : layerm->fills.entities) {
-                // fill represents infill extrusions of a single island.
-                const auto *fill = dynamic_cast<const ExtrusionEntityCollection*>(ee);
-                ExtrusionRole role = fill->entities.empty() ? erNone : fill->entities.front()->role();
-                if (is_solid_infill(role))
-                    has_solid_infill = true;
-                else if (role != erNone)
-                    has_infill = true;
-
-                if (m_print_config_ptr) {
-                    if (!something_nonoverriddable && !layer_tools.wiping_extrusions().is_overriddable(*fill, *m_print_config_ptr, object, region))
+            if (m_print_config_ptr) { // in this case complete_objects is false (see ToolOrdering constructors)
+                something_nonoverriddable = false;
+                for (const auto& eec : layerm->perimeters.entities) // let's check if there are nonoverriddable entities
+                    if (!layer_tools.wiping_extrusions().is_overriddable(dynamic_cast<const ExtrusionEntityCollection&>(*eec), *m_print_config_ptr, object, region)) {
                         something_nonoverriddable = true;
-                }
+                        break;
+                    }
             }
 
-            if (something_nonoverriddable || !m_print_config_ptr)
-            {
-                if (has_solid_infill)
-                    layer_tools.extruders.push_back(region.config().solid_infill_extruder);
-                if (has_infill)
-                    layer_tools.extruders.push_back(region.config().infill_extruder);
+            if (something_nonoverriddable)
+                    layer_tools.extruders.push_back(region.config().perimeter_extruder.value);
+
+            layer_tools.has_object = true;
+        }
+
+
+        bool has_infill       = false;
+        bool has_solid_infill = false;
+        bool something_nonoverriddable = false;
+        for (const ExtrusionEntity *ee : layerm->fills.entities) {
+            // fill represents infill extrusions of a single island.
+            const auto *fill = dynamic_cast<const ExtrusionEntityCollection*>(ee);
+            ExtrusionRole role = fill->entities.empty() ? erNone : fill->entities.front()->role();
+            if (is_solid_infill(role))
+                has_solid_infill = true;
+            else if (role != erNone)
+                has_infill = true;
+
+            if (m_print_config_ptr) {
+                if (!something_nonoverriddable && !layer_tools.wiping_extrusions().is_overriddable(*fill, *m_print_config_ptr, object, region))
+                    something_nonoverriddable = true;
             }
-            if (has_solid_infill || has_infill)
-                layer_tools.has_object = true;
         }
+
+        if (something_nonoverriddable || !m_print_config_ptr)
+        {
+            if (has_solid_infill)
+                layer_tools.extruders.push_back(region.config().solid_infill_extruder);
+            if (has_infill)
+                layer_tools.extruders.push_back(region.config().infill_extruder);
+        }
+        if (has_solid_infill || has_infill)
+            layer_tools.has_object = true;
     }
+}
 
+void ToolOrdering::sort_extruders()
+{
     for (auto& layer : m_layer_tools) {
         // Sort and remove duplicates
         sort_remove_duplicates(layer.extruders);
@@ -610,19 +659,20 @@ void WipingExtrusions::ensure_perimeters_infills_order(const Print& print)
 // so -1 was used as "print as usual".
 // The resulting vector has to keep track of which extrusions are the ones that were overridden and which were not. In the extruder is used as overridden,
 // its number is saved as it is (zero-based index). Usual extrusions are saved as -number-1 (unfortunately there is no negative zero).
-const std::vector<int>* WipingExtrusions::get_extruder_overrides(const ExtrusionEntity* entity, int correct_extruder_id, int num_of_copies)
+std::vector<int> WipingExtrusions::get_extruder_overrides(const ExtrusionEntity* entity, int correct_extruder_id, int num_of_copies) const
 {
+    std::vector<int> overrides;
     auto entity_map_it = entity_map.find(entity);
-    if (entity_map_it == entity_map.end())
-        entity_map_it = (entity_map.insert(std::make_pair(entity, std::vector<int>()))).first;
+    if (entity_map_it != entity_map.end())
+        overrides = entity_map_it->second;
 
-    // Now the entity_map_it should be valid, let's make sure the vector is long enough:
-    entity_map_it->second.resize(num_of_copies, -1);
+    // Make sure the vector is long enough:
+    overrides.resize(num_of_copies, -1);
 
     // Each -1 now means "print as usual" - we will replace it with actual extruder id (shifted it so we don't lose that information):
-    std::replace(entity_map_it->second.begin(), entity_map_it->second.end(), -1, -correct_extruder_id-1);
+    std::replace(overrides.begin(), overrides.end(), -1, -correct_extruder_id-1);
 
-    return &(entity_map_it->second);
+    return overrides;
 }
     
 
@@ -9,6 +9,8 @@ namespace Slic3r {
 
 class Print;
 class PrintObject;
+class Layer;
+class SupportLayer;
 class LayerTools;
 
 
@@ -23,8 +25,9 @@ public:
         return something_overridden;
     }
 
-    // This is called from GCode::process_layer - see implementation for further comments:
-    const std::vector<int>* get_extruder_overrides(const ExtrusionEntity* entity, int correct_extruder_id, int num_of_copies);
+    // This is called from GCode::collect_layer_extrusions - see implementation for further comments.
+    // Read only, so that the extrusions of multiple layers could be collected in parallel.
+    std::vector<int> get_extruder_overrides(const ExtrusionEntity* entity, int correct_extruder_id, int num_of_copies) const;
 
     // This function goes through all infill entities, decides which ones will be used for wiping and
     // marks them by the extruder id. Returns volume that remains to be wiped on the wipe tower:
@@ -91,6 +94,7 @@ public:
         m_wiping_extrusions.set_layer_tools_ptr(this);
         return m_wiping_extrusions;
     }
+    const WipingExtrusions& wiping_extrusions() const { return m_wiping_extrusions; }
 
 private:
     // This object holds list of extrusion that will be used for extruder wiping
@@ -112,6 +116,10 @@ public:
 	// (print.config.complete_objects is false).
 	ToolOrdering(const Print &print, unsigned int first_extruder = (unsigned int)-1, bool prime_multi_material = false);
 
+	// For the streaming G-code export of a single object printed layer by layer without a wipe tower:
+	// Collect the extruders of the next object layer and / or support layer with the same print_z once the layer is finished.
+	const LayerTools&	append_layer(const PrintObject &object, const Layer *object_layer, const SupportLayer *support_layer);
+
 	void 				clear() { m_layer_tools.clear(); }
 
 	// Get the first extruder printing, including the extruder priming areas, returns -1 if there is no layer printed.
@@ -139,6 +147,9 @@ public:
 private:
 	void				initialize_layers(std::vector<coordf_t> &zs);
 	void 				collect_extruders(const PrintObject &object);
+	void 				collect_support_extruders(const PrintObject &object, const SupportLayer &support_layer);
+	void 				collect_object_extruders(const PrintObject &object, const Layer &layer);
+	void 				sort_extruders();
 	void				reorder_extruders(unsigned int last_extruder_id);
 	void 				fill_wipe_tower_partitions(const PrintConfig &config, coordf_t object_bottom_z);
     void 				collect_extruder_statistics(bool prime_multi_material);
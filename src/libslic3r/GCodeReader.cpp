@@ -1,13 +1,54 @@
 #include "GCodeReader.hpp"
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
-#include <fstream>
+#include <boost/nowide/cstdio.hpp>
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <vector>
 
 #include <Shiny/Shiny.h>
 
+#include <tbb/parallel_for.h>
+
 namespace Slic3r {
 
+// Parses the axis value of a G-code word. The values exported by Slic3r have a fixed decimal format, they are parsed
+// without the overhead of strtod(). The result is bitwise equal to strtod(): Up to 15 decimal digits, both the digits
+// converted to an integer and the power of ten are exact doubles, therefore their quotient is correctly rounded.
+// Any other format (exponent, hexadecimal, inf, leading whitespaces) is passed to strtod().
+static inline double parse_axis_value(const char *c, char **pend)
+{
+    const char *p = c;
+    bool negative = false;
+    if (*p == '-' || *p == '+')
+        negative = *p ++ == '-';
+    uint64_t digits     = 0;
+    int      num_digits = 0;
+    int      num_frac   = 0;
+    for (; *p >= '0' && *p <= '9'; ++ p, ++ num_digits)
+        digits = digits * 10 + (*p - '0');
+    if (*p == '.')
+        for (++ p; *p >= '0' && *p <= '9'; ++ p, ++ num_digits, ++ num_frac)
+            digits = digits * 10 + (*p - '0');
+    if (num_digits > 0 && num_digits <= 15 && (*p == ' ' || *p == '\t' || *p == ';' || *p == '\r' || *p == '\n' || *p == 0)) {
+        static const double pow10[16] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+        double v = double(digits) / pow10[num_frac];
+        *pend = const_cast<char*>(p);
+        return negative ? - v : v;
+    }
+    // strtod() skips the leading whitespaces, don't let it continue on the next line of a buffer.
+    for (p = c; *p == ' ' || *p == '\t'; ++ p)
+        ; // silence -Wempty-body
+    if (*p == '\r' || *p == '\n' || *p == 0) {
+        *pend = const_cast<char*>(c);
+        return 0.;
+    }
+    return strtod(c, pend);
+}
+
 void GCodeReader::apply_config(const GCodeConfig &config)
 {
     m_config = config;
@@ -20,7 +61,7 @@ void GCodeReader::apply_config(const DynamicPrintConfig &config)
     m_extrusion_axis = m_config.get_extrusion_axis()[0];
 }
 
-const char* GCodeReader::parse_line_internal(const char *ptr, GCodeLine &gline, std::pair<const char*, const char*> &command)
+const char* GCodeReader::parse_line_internal(const char *ptr, GCodeLine &gline, std::pair<const char*, const char*> &command) const
 {
     PROFILE_FUNC();
     
@@ -53,7 +94,7 @@ const char* GCodeReader::parse_line_internal(const char *ptr, GCodeLine &gline,
             if (axis != NUM_AXES) {
                 // Try to parse the numeric value.
                 char   *pend = nullptr;
-                double  v = strtod(++ c, &pend);
+                double  v = parse_axis_value(++ c, &pend);
                 if (pend != nullptr && is_end_of_word(*pend)) {
                     // The axis value has been parsed correctly.
                     gline.m_axis[int(axis)] = float(v);
@@ -68,9 +109,6 @@ const char* GCodeReader::parse_line_internal(const char *ptr, GCodeLine &gline,
         }
     }
     
-    if (gline.has(E) && m_config.use_relative_e_distances)
-        m_position[E] = 0;
-
     // Skip the rest of the line.
     for (; ! is_end_of_line(*c); ++ c);
 
@@ -108,10 +146,99 @@ void GCodeReader::update_coordinates(GCodeLine &gline, std::pair<const char*, co
 
 void GCodeReader::parse_file(const std::string &file, callback_t callback)
 {
-    std::ifstream f(file);
-    std::string line;
-    while (std::getline(f, line))
-        this->parse_line(line, callback);
+    FILE *f = boost::nowide::fopen(file.c_str(), "rb");
+    if (f == nullptr)
+        return;
+
+    // The file is read in large blocks and the lines are parsed in place, the line ends are searched by memchr(),
+    // which is vectorized by the C runtime.
+    // The complete lines of a block are split into chunks, which are parsed in parallel, as parsing of a line does
+    // not depend on the preceding lines. The modal state (the axes positions, relative extrusion) is then applied
+    // to the parsed lines in order, which is cheap compared to the parsing.
+    // The parsed lines are reused for the following blocks, so that their raw strings are not reallocated.
+    struct Chunk {
+        const char                                      *begin;
+        const char                                      *end;
+        size_t                                           num_lines;
+        std::vector<GCodeLine>                           lines;
+        std::vector<std::pair<const char*, const char*>> commands;
+    };
+    static const size_t chunk_size = 64 * 1024;
+    std::vector<char>   buffer(16 * chunk_size + 1);
+    std::vector<Chunk>  chunks;
+    size_t              len = 0;
+    bool                eof = false;
+    while (! eof) {
+        size_t space = buffer.size() - 1 - len;
+        size_t read  = fread(buffer.data() + len, 1, space, f);
+        eof  = read < space;
+        len += read;
+        // Zero terminate the last line of the file.
+        buffer[len] = 0;
+        const char *ptr = buffer.data();
+        const char *end = ptr + len;
+
+        // Split the complete lines into chunks.
+        size_t num_chunks = 0;
+        for (const char *chunk_begin = ptr; chunk_begin < end;) {
+            // The chunk ends with the first newline after chunk_size bytes, or with the last newline of the block.
+            const char *split = chunk_begin + std::min<size_t>(chunk_size, end - chunk_begin) - 1;
+            const char *eol   = (const char*)memchr(split, '\n', end - split);
+            if (eol == nullptr) {
+                for (eol = split; eol > chunk_begin && *eol != '\n'; -- eol)
+                    ; // silence -Wempty-body
+                if (*eol != '\n')
+                    break;
+            }
+            if (chunks.size() == num_chunks)
+                chunks.emplace_back();
+            chunks[num_chunks].begin = chunk_begin;
+            chunks[num_chunks].end   = eol + 1;
+            ++ num_chunks;
+            chunk_begin = eol + 1;
+        }
+        if (num_chunks > 0)
+            ptr = chunks[num_chunks - 1].end;
+
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, num_chunks),
+            [this, &chunks](const tbb::blocked_range<size_t> &range) {
+            for (size_t i = range.begin(); i < range.end(); ++ i) {
+                Chunk &chunk = chunks[i];
+                chunk.num_lines = 0;
+                for (const char *line = chunk.begin; line < chunk.end; ++ chunk.num_lines) {
+                    if (chunk.lines.size() == chunk.num_lines) {
+                        chunk.lines.emplace_back();
+                        chunk.commands.emplace_back();
+                    }
+                    GCodeLine &gline = chunk.lines[chunk.num_lines];
+                    gline.reset();
+                    this->parse_line_internal(line, gline, chunk.commands[chunk.num_lines]);
+                    // parse_line_internal() stops at a '\r' or a zero, continue with the next line as std::getline() would.
+                    line = (const char*)memchr(line, '\n', chunk.end - line) + 1;
+                }
+            }
+        });
+
+        for (size_t i = 0; i < num_chunks; ++ i) {
+            Chunk &chunk = chunks[i];
+            for (size_t j = 0; j < chunk.num_lines; ++ j)
+                this->process_parsed_line(chunk.lines[j], chunk.commands[j], callback);
+        }
+
+        if (eof && ptr < end) {
+            // The last line of the file is not terminated by a newline.
+            GCodeLine gline;
+            this->parse_line(ptr, gline, callback);
+            ptr = end;
+        }
+
+        // Move the incomplete last line to the start of the buffer, grow the buffer if the line does not fit.
+        len = end - ptr;
+        memmove(buffer.data(), ptr, len);
+        if (len + 1 == buffer.size())
+            buffer.resize(buffer.size() * 2);
+    }
+    fclose(f);
 }
 
 bool GCodeReader::GCodeLine::has(char axis) const
@@ -153,7 +280,7 @@ bool GCodeReader::GCodeLine::has_value(char axis, float &value) const
         if (*c == axis) {
             // Try to parse the numeric value.
             char   *pend = nullptr;
-            double  v = strtod(++ c, &pend);
+            double  v = parse_axis_value(++ c, &pend);
             if (pend != nullptr && is_end_of_word(*pend)) {
                 // The axis value has been parsed correctly.
                 value = float(v);
@@ -94,8 +94,7 @@ public:
     {
         std::pair<const char*, const char*> cmd;
         const char *end = parse_line_internal(ptr, gline, cmd);
-        callback(*this, gline);
-        update_coordinates(gline, cmd);
+        process_parsed_line(gline, cmd, callback);
         return end;
     }
 
@@ -103,6 +102,7 @@ public:
     void parse_line(const std::string &line, Callback callback)
         { GCodeLine gline; this->parse_line(line.c_str(), gline, callback); }
 
+    // Parses the file by blocks, the lines of a block are parsed in parallel, the callback is called in order of the lines.
     void parse_file(const std::string &file, callback_t callback);
 
     float& x()       { return m_position[X]; }
@@ -119,9 +119,20 @@ public:
     char   extrusion_axis() const { return m_extrusion_axis; }
 
 private:
-    const char* parse_line_internal(const char *ptr, GCodeLine &gline, std::pair<const char*, const char*> &command);
+    // Parsing of a line does not depend on the preceding lines, it may be called in parallel.
+    const char* parse_line_internal(const char *ptr, GCodeLine &gline, std::pair<const char*, const char*> &command) const;
     void        update_coordinates(GCodeLine &gline, std::pair<const char*, const char*> &command);
 
+    // Applies the modal state to a parsed line, the lines shall be processed in order.
+    template<typename Callback>
+    void process_parsed_line(GCodeLine &gline, std::pair<const char*, const char*> &command, Callback &callback)
+    {
+        if (gline.has(E) && m_config.use_relative_e_distances)
+            m_position[E] = 0;
+        callback(*this, gline);
+        update_coordinates(gline, command);
+    }
+
     static bool         is_whitespace(char c)           { return c == ' ' || c == '\t'; }
     static bool         is_end_of_line(char c)          { return c == '\r' || c == '\n' || c == 0; }
     static bool         is_end_of_gcode_line(char c)    { return c == ';' || is_end_of_line(c); }
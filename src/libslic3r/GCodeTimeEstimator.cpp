@@ -1,17 +1,21 @@
 #include "GCodeTimeEstimator.hpp"
 #include "Utils.hpp"
-#include <boost/bind.hpp>
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <cstring>
+#include <limits>
 
 #include <Shiny/Shiny.h>
 
-#include <boost/nowide/fstream.hpp>
-#include <boost/nowide/cstdio.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem/operations.hpp>
 
 static const float MMMIN_TO_MMSEC = 1.0f / 60.0f;
 static const float MILLISEC_TO_SEC = 0.001f;
 static const float INCHES_TO_MM = 25.4f;
+// Smaller G-code files are estimated at the calling thread, starting a worker thread does not pay off for them.
+static const boost::uintmax_t WORKER_THREAD_MIN_FILE_SIZE = 1024 * 1024;
 
 static const float DEFAULT_FEEDRATE = 1500.0f; // from Prusa Firmware (Marlin_main.cpp)
 static const float DEFAULT_ACCELERATION = 1500.0f; // Prusa Firmware 1_75mm_MK2
@@ -169,9 +173,6 @@ namespace Slic3r {
     }
 #endif // ENABLE_MOVE_STATS
 
-    const std::string GCodeTimeEstimator::Normal_First_M73_Output_Placeholder_Tag = "; NORMAL_FIRST_M73_OUTPUT_PLACEHOLDER";
-    const std::string GCodeTimeEstimator::Silent_First_M73_Output_Placeholder_Tag = "; SILENT_FIRST_M73_OUTPUT_PLACEHOLDER";
-
     GCodeTimeEstimator::GCodeTimeEstimator(EMode mode)
         : _mode(mode)
     {
@@ -187,6 +188,13 @@ namespace Slic3r {
         { this->_process_gcode_line(reader, line); });
     }
 
+    void GCodeTimeEstimator::add_gcode_line(const GCodeReader::GCodeLine& gcode_line)
+    {
+        PROFILE_FUNC();
+        _last_line_block_id = -1;
+        this->_process_gcode_line(_parser, gcode_line);
+    }
+
     void GCodeTimeEstimator::add_gcode_block(const char *ptr)
     {
         PROFILE_FUNC();
@@ -199,15 +207,11 @@ namespace Slic3r {
         }
     }
 
-    void GCodeTimeEstimator::calculate_time(bool start_from_beginning)
+    void GCodeTimeEstimator::calculate_time()
     {
         PROFILE_FUNC();
-        if (start_from_beginning)
-        {
-            _reset_time();
-            _last_st_synchronized_block_id = -1;
-        }
         _calculate_time();
+        _flush_layer_time();
 
 #if ENABLE_MOVE_STATS
         _log_moves_stats();
@@ -223,6 +227,7 @@ namespace Slic3r {
         { this->_process_gcode_line(reader, line); });
 
         _calculate_time();
+        _flush_layer_time();
 
 #if ENABLE_MOVE_STATS
         _log_moves_stats();
@@ -233,12 +238,18 @@ namespace Slic3r {
     {
         reset();
 
-        _parser.parse_file(file, boost::bind(&GCodeTimeEstimator::_process_gcode_line, this, _1, _2));
-        _calculate_time();
-
-#if ENABLE_MOVE_STATS
-        _log_moves_stats();
-#endif // ENABLE_MOVE_STATS
+        GCodeReader parser;
+        boost::system::error_code ec;
+        boost::uintmax_t file_size = boost::filesystem::file_size(file, ec);
+        if (ec || file_size < WORKER_THREAD_MIN_FILE_SIZE) {
+            parser.parse_file(file, [this](GCodeReader&, const GCodeReader::GCodeLine& line) { this->add_gcode_line(line); });
+            calculate_time();
+        } else {
+            // Parse the file at this thread, plan the moves at a worker thread.
+            GCodeTimeEstimatorWorkers workers({ this });
+            parser.parse_file(file, [&workers](GCodeReader&, const GCodeReader::GCodeLine& line) { workers.add_gcode_line(line); });
+            workers.calculate_time();
+        }
     }
 
     void GCodeTimeEstimator::calculate_time_from_lines(const std::vector<std::string>& gcode_lines)
@@ -250,129 +261,54 @@ namespace Slic3r {
         for (const std::string& line : gcode_lines)
             _parser.parse_line(line, action);
         _calculate_time();
+        _flush_layer_time();
 
 #if ENABLE_MOVE_STATS
         _log_moves_stats();
 #endif // ENABLE_MOVE_STATS
     }
 
-    bool GCodeTimeEstimator::post_process_remaining_times(const std::string& filename, float interval)
+    bool GCodeTimeEstimator::is_remaining_time_due(float interval_sec) const
     {
-        boost::nowide::ifstream in(filename);
-        if (!in.good())
-            throw std::runtime_error(std::string("Remaining times export failed.\nCannot open file for reading.\n"));
-
-        std::string path_tmp = filename + ".times";
-
-        FILE* out = boost::nowide::fopen(path_tmp.c_str(), "wb");
-        if (out == nullptr)
-            throw std::runtime_error(std::string("Remaining times export failed.\nCannot open file for writing.\n"));
-
-        std::string time_mask;
-        switch (_mode)
-        {
-        default:
-        case Normal:
-        {
-            time_mask = "M73 P%s R%s\n";
-            break;
-        }
-        case Silent:
-        {
-            time_mask = "M73 Q%s S%s\n";
-            break;
-        }
-        }
-
-        unsigned int g1_lines_count = 0;
-        float last_recorded_time = 0.0f;
-        std::string gcode_line;
-        // buffer line to export only when greater than 64K to reduce writing calls
-        std::string export_line;
-        char time_line[64];
-        while (std::getline(in, gcode_line))
-        {
-            if (!in.good())
-            {
-                fclose(out);
-                throw std::runtime_error(std::string("Remaining times export failed.\nError while reading from file.\n"));
-            }
-
-            // replaces placeholders for initial line M73 with the real lines
-            if (((_mode == Normal) && (gcode_line == Normal_First_M73_Output_Placeholder_Tag)) ||
-                ((_mode == Silent) && (gcode_line == Silent_First_M73_Output_Placeholder_Tag)))
-            {
-                sprintf(time_line, time_mask.c_str(), "0", _get_time_minutes(_time).c_str());
-                gcode_line = time_line;
-            }
-            else
-               gcode_line += "\n";
-
-            // add remaining time lines where needed
-            _parser.parse_line(gcode_line,
-                [this, &g1_lines_count, &last_recorded_time, &time_line, &gcode_line, time_mask, interval](GCodeReader& reader, const GCodeReader::GCodeLine& line)
-            {
-                if (line.cmd_is("G1"))
-                {
-                    ++g1_lines_count;
-
-                    if (!line.has_e())
-                        return;
-
-                    G1LineIdToBlockIdMap::const_iterator it = _g1_line_ids.find(g1_lines_count);
-                    if ((it != _g1_line_ids.end()) && (it->second < (unsigned int)_blocks.size()))
-                    {
-                        const Block& block = _blocks[it->second];
-                        if (block.elapsed_time != -1.0f)
-                        {
-                            float block_remaining_time = _time - block.elapsed_time;
-                            if (std::abs(last_recorded_time - block_remaining_time) > interval)
-                            {
-                                sprintf(time_line, time_mask.c_str(), std::to_string((int)(100.0f * block.elapsed_time / _time)).c_str(), _get_time_minutes(block_remaining_time).c_str());
-                                gcode_line += time_line;
-
-                                last_recorded_time = block_remaining_time;
-                            }
-                        }
-                    }
-                }
-            });
+        return _last_line_block_id != -1 && _provisional_time - _last_remaining_time_provisional_time > interval_sec;
+    }
 
-            export_line += gcode_line;
-            if (export_line.length() > 65535)
-            {
-                fwrite((const void*)export_line.c_str(), 1, export_line.length(), out);
-                if (ferror(out))
-                {
-                    in.close();
-                    fclose(out);
-                    boost::nowide::remove(path_tmp.c_str());
-                    throw std::runtime_error(std::string("Remaining times export failed.\nIs the disk full?\n"));
-                }
-                export_line.clear();
-            }
-        }
+    std::string GCodeTimeEstimator::add_remaining_time_placeholder(size_t offset)
+    {
+        RemainingTimePlaceholder placeholder;
+        placeholder.offset   = offset;
+        placeholder.block_id = _last_line_block_id;
+        placeholder.elapsed_time = -1.0f;
+        _remaining_time_placeholders.emplace_back(placeholder);
+        if (_last_line_block_id != -1)
+            _last_remaining_time_provisional_time = _provisional_time;
+        // A valid G-code line until it is overwritten by fill_remaining_time_placeholders().
+        char line[64];
+        sprintf(line, (_mode == Silent) ? "M73 Q%03d S%05d\n" : "M73 P%03d R%05d\n", 0, 0);
+        return line;
+    }
 
-        if (export_line.length() > 0)
+    void GCodeTimeEstimator::fill_remaining_time_placeholders(const std::function<void(size_t, const std::string&)> &patch) const
+    {
+        // The values are zero padded to a fixed width, so that the line overwrites the whole placeholder.
+        const char *time_mask = (_mode == Silent) ? "M73 Q%03d S%05d" : "M73 P%03d R%05d";
+        char        time_line[64];
+        // Values of the last line filled in, reused for a placeholder whose block time is not known.
+        int         percent   = 0;
+        int         remaining = _get_time_minutes_int(_time);
+        for (const RemainingTimePlaceholder &placeholder : _remaining_time_placeholders)
         {
-            fwrite((const void*)export_line.c_str(), 1, export_line.length(), out);
-            if (ferror(out))
-            {
-                in.close();
-                fclose(out);
-                boost::nowide::remove(path_tmp.c_str());
-                throw std::runtime_error(std::string("Remaining times export failed.\nIs the disk full?\n"));
+            if (placeholder.block_id == -1) {
+                percent   = 0;
+                remaining = _get_time_minutes_int(_time);
+            } else if (placeholder.elapsed_time != -1.0f) {
+                percent   = (_time > 0.0f) ? (int)(100.0f * placeholder.elapsed_time / _time) : 100;
+                remaining = _get_time_minutes_int(_time - placeholder.elapsed_time);
             }
+            sprintf(time_line, time_mask, std::max(0, std::min(100, percent)), std::max(0, std::min(99999, remaining)));
+            assert(strlen(time_line) == Remaining_Time_Line_Length);
+            patch(placeholder.offset, time_line);
         }
-
-        fclose(out);
-        in.close();
-
-        if (rename_file(path_tmp, filename) != 0)
-            throw std::runtime_error(std::string("Failed to rename the output G-code file from ") + path_tmp + " to " + filename + '\n' +
-            "Is " + path_tmp + " locked?" + '\n');
-
-        return true;
     }
 
     void GCodeTimeEstimator::set_axis_position(EAxis axis, float position)
@@ -642,6 +578,44 @@ namespace Slic3r {
         _state.filament_unload_times.clear();
     }
 
+    void GCodeTimeEstimator::set_from_config(const PrintConfig& config)
+    {
+        set_dialect(config.gcode_flavor);
+
+        // Until we have a UI support for the other firmwares than the Marlin, use the hardcoded default values
+        // and let the user to enter the G-code limits into the start G-code.
+        if (config.gcode_flavor.value == gcfMarlin)
+        {
+            // The normal mode limits are stored first, the silent mode limits second.
+            size_t idx = (_mode == Silent) ? 1 : 0;
+            set_max_acceleration(config.machine_max_acceleration_extruding.values[idx]);
+            set_retract_acceleration(config.machine_max_acceleration_retracting.values[idx]);
+            set_minimum_feedrate(config.machine_min_extruding_rate.values[idx]);
+            set_minimum_travel_feedrate(config.machine_min_travel_rate.values[idx]);
+            set_axis_max_acceleration(X, config.machine_max_acceleration_x.values[idx]);
+            set_axis_max_acceleration(Y, config.machine_max_acceleration_y.values[idx]);
+            set_axis_max_acceleration(Z, config.machine_max_acceleration_z.values[idx]);
+            set_axis_max_acceleration(E, config.machine_max_acceleration_e.values[idx]);
+            set_axis_max_feedrate(X, config.machine_max_feedrate_x.values[idx]);
+            set_axis_max_feedrate(Y, config.machine_max_feedrate_y.values[idx]);
+            set_axis_max_feedrate(Z, config.machine_max_feedrate_z.values[idx]);
+            set_axis_max_feedrate(E, config.machine_max_feedrate_e.values[idx]);
+            set_axis_max_jerk(X, config.machine_max_jerk_x.values[idx]);
+            set_axis_max_jerk(Y, config.machine_max_jerk_y.values[idx]);
+            set_axis_max_jerk(Z, config.machine_max_jerk_z.values[idx]);
+            set_axis_max_jerk(E, config.machine_max_jerk_e.values[idx]);
+        }
+
+        // Filament load / unload times are not specific to a firmware flavor. Let anybody use it if they find it useful.
+        if (config.single_extruder_multi_material)
+        {
+            // As of now the fields are shown at the UI dialog in the same combo box as the ramming values, so they
+            // are considered to be active for the single extruder multi-material printers only.
+            set_filament_load_times(config.filament_load_time.values);
+            set_filament_unload_times(config.filament_unload_time.values);
+        }
+    }
+
     void GCodeTimeEstimator::reset()
     {
         _reset_time();
@@ -680,58 +654,44 @@ namespace Slic3r {
 
         reset_extruder_id();
         reset_g1_line_id();
-        _g1_line_ids.clear();
-
-        _last_st_synchronized_block_id = -1;
+        _remaining_time_placeholders.clear();
+        _next_placeholder_id = 0;
+        _last_line_block_id = -1;
+        _provisional_time = 0.0f;
+        // The first remaining time line after the start of the G-code follows the first extrusion.
+        _last_remaining_time_provisional_time = - std::numeric_limits<float>::max();
     }
 
     void GCodeTimeEstimator::_reset_time()
     {
         _time = 0.0f;
+        for (float& time : _role_times)
+        {
+            time = 0.0f;
+        }
+        _layer_time.z = 0.0f;
+        for (float& time : _layer_time.time)
+        {
+            time = 0.0f;
+        }
+        _layer_time_has_extrusion = false;
     }
 
     void GCodeTimeEstimator::_reset_blocks()
     {
         _blocks.clear();
+        _first_block_id = 0;
     }
 
 
     void GCodeTimeEstimator::_calculate_time()
     {
         PROFILE_FUNC();
-        _forward_pass();
-        _reverse_pass();
-        _recalculate_trapezoids();
-
-        _time += get_additional_time();
-
-        for (int i = _last_st_synchronized_block_id + 1; i < (int)_blocks.size(); ++i)
-        {
-            Block& block = _blocks[i];
-
-#if ENABLE_MOVE_STATS
-            float block_time = 0.0f;
-            block_time += block.acceleration_time();
-            block_time += block.cruise_time();
-            block_time += block.deceleration_time();
-            _time += block_time;
-            block.elapsed_time = _time;
-
-            MovesStatsMap::iterator it = _moves_stats.find(block.move_type);
-            if (it == _moves_stats.end())
-                it = _moves_stats.insert(MovesStatsMap::value_type(block.move_type, MoveStats())).first;
-
-            it->second.count += 1;
-            it->second.time += block_time;
-#else
-            _time += block.acceleration_time();
-            _time += block.cruise_time();
-            _time += block.deceleration_time();
-            block.elapsed_time = _time;
-#endif // ENABLE_MOVE_STATS
-        }
-
-        _last_st_synchronized_block_id = (int)_blocks.size() - 1;
+        float additional_time = get_additional_time();
+        _time += additional_time;
+        _add_role_time(Additional_Time, _layer_time.z, additional_time);
+        // Plan all the blocks in the lookahead, the last one decelerates to its safe feedrate.
+        _finalize_blocks(_blocks.size());
         // The additional time has been consumed (added to the total time), reset it to zero.
         set_additional_time(0.);
     }
@@ -968,7 +928,7 @@ namespace Slic3r {
 
         // calculates block entry feedrate
         float vmax_junction = _curr.safe_feedrate;
-        if (!_blocks.empty() && (_prev.feedrate > PREVIOUS_FEEDRATE_THRESHOLD))
+        if ((_first_block_id > 0 || !_blocks.empty()) && (_prev.feedrate > PREVIOUS_FEEDRATE_THRESHOLD))
         {
             bool prev_speed_larger = _prev.feedrate > block.feedrate.cruise;
             float smaller_speed_factor = prev_speed_larger ? (block.feedrate.cruise / _prev.feedrate) : (_prev.feedrate / block.feedrate.cruise);
@@ -1035,6 +995,7 @@ namespace Slic3r {
         block.flags.nominal_length = (block.feedrate.cruise <= v_allowable);
         block.flags.recalculate = true;
         block.safe_feedrate = _curr.safe_feedrate;
+        block.end_z = new_pos[Z];
 
         // calculates block trapezoid
         block.calculate_trapezoid();
@@ -1070,9 +1031,19 @@ namespace Slic3r {
             block.move_type = Block::Move;
 #endif // ENABLE_MOVE_STATS
 
+        if (block.is_extruder_only_move())
+            block.time_role = Retraction_Time;
+        else if (block.delta_pos[E] > 0.0f)
+            block.time_role = Extrusion_Time;
+        else
+            block.time_role = Travel_Time;
+
         // adds block to blocks list
+        _provisional_time += block.acceleration_time() + block.cruise_time() + block.deceleration_time();
         _blocks.emplace_back(block);
-        _g1_line_ids.insert(G1LineIdToBlockIdMap::value_type(get_g1_line_id(), (unsigned int)_blocks.size() - 1));
+        if (line.has_e())
+            _last_line_block_id = _first_block_id + (int)_blocks.size() - 1;
+        _plan_last_block();
     }
 
     void GCodeTimeEstimator::_processG4(const GCodeReader::GCodeLine& line)
@@ -1352,28 +1323,82 @@ namespace Slic3r {
         _calculate_time();
     }
 
-    void GCodeTimeEstimator::_forward_pass()
+    void GCodeTimeEstimator::_plan_last_block()
     {
         PROFILE_FUNC();
-        if (_blocks.size() > 1)
-        {
-            for (int i = _last_st_synchronized_block_id + 1; i < (int)_blocks.size() - 1; ++i)
-            {
-                _planner_forward_pass_kernel(_blocks[i], _blocks[i + 1]);
-            }
-        }
+        size_t last = _blocks.size() - 1;
+        if (last == 0)
+            return;
+
+        _planner_forward_pass_kernel(_blocks[last - 1], _blocks[last]);
+
+        // The entry speed of the block preceding the new one is final if the reverse pass will not change it,
+        // that is if the block enters at its maximum entry speed or if it is long enough to reach the maximum entry speed.
+        // The reverse pass over the blocks in front of it then does not depend on the blocks to come.
+        const Block& prev = _blocks[last - 1];
+        if (last > 1 && ((prev.feedrate.entry == prev.max_entry_speed) || prev.flags.nominal_length))
+            _finalize_blocks(last - 1);
+        else if (_blocks.size() > Max_Lookahead_Blocks)
+            _finalize_blocks(_blocks.size() / 2);
     }
 
-    void GCodeTimeEstimator::_reverse_pass()
+    void GCodeTimeEstimator::_finalize_blocks(size_t count)
     {
         PROFILE_FUNC();
-        if (_blocks.size() > 1)
+        for (int i = (int)_blocks.size() - 2; i >= 0; --i)
+        {
+            _planner_reverse_pass_kernel(_blocks[i], _blocks[i + 1]);
+        }
+
+        for (size_t i = 0; i < count; ++i)
         {
-            for (int i = (int)_blocks.size() - 1; i >= _last_st_synchronized_block_id + 2; --i)
+            Block& block = _blocks[i];
+
+            // NOTE: Entry and exit factors always > 0 by all previous logic operations.
+            // The last block of the lookahead decelerates to its safe feedrate.
+            Block trapezoid_block = block;
+            trapezoid_block.feedrate.exit = (i + 1 < _blocks.size()) ? _blocks[i + 1].feedrate.entry : block.safe_feedrate;
+            trapezoid_block.calculate_trapezoid();
+            block.trapezoid = trapezoid_block.trapezoid;
+
+            float block_time = 0.0f;
+#if ENABLE_MOVE_STATS
+            block_time += block.acceleration_time();
+            block_time += block.cruise_time();
+            block_time += block.deceleration_time();
+            _time += block_time;
+            block.elapsed_time = _time;
+
+            MovesStatsMap::iterator it = _moves_stats.find(block.move_type);
+            if (it == _moves_stats.end())
+                it = _moves_stats.insert(MovesStatsMap::value_type(block.move_type, MoveStats())).first;
+
+            it->second.count += 1;
+            it->second.time += block_time;
+#else
+            float acceleration_time = block.acceleration_time();
+            float cruise_time = block.cruise_time();
+            float deceleration_time = block.deceleration_time();
+            _time += acceleration_time;
+            _time += cruise_time;
+            _time += deceleration_time;
+            block.elapsed_time = _time;
+            block_time = acceleration_time + cruise_time + deceleration_time;
+#endif // ENABLE_MOVE_STATS
+            _add_role_time(block.time_role, block.end_z, block_time);
+
+            // The placeholders are sorted by their block ids.
+            int block_id = _first_block_id + (int)i;
+            for (; _next_placeholder_id < _remaining_time_placeholders.size() && _remaining_time_placeholders[_next_placeholder_id].block_id <= block_id; ++_next_placeholder_id)
             {
-                _planner_reverse_pass_kernel(_blocks[i - 1], _blocks[i]);
+                RemainingTimePlaceholder& placeholder = _remaining_time_placeholders[_next_placeholder_id];
+                if (placeholder.block_id == block_id)
+                    placeholder.elapsed_time = block.elapsed_time;
             }
         }
+
+        _blocks.erase(_blocks.begin(), _blocks.begin() + count);
+        _first_block_id += (int)count;
     }
 
     void GCodeTimeEstimator::_planner_forward_pass_kernel(Block& prev, Block& curr)
@@ -1417,43 +1442,38 @@ namespace Slic3r {
         }
     }
 
-    void GCodeTimeEstimator::_recalculate_trapezoids()
+    void GCodeTimeEstimator::_add_role_time(ETimeRole role, float z, float time)
     {
-        PROFILE_FUNC();
-        Block* curr = nullptr;
-        Block* next = nullptr;
-
-        for (int i = _last_st_synchronized_block_id + 1; i < (int)_blocks.size(); ++i)
+        _role_times[role] += time;
+        if (!_layer_time_has_extrusion)
+            _layer_time.z = z;
+        if (role == Extrusion_Time)
         {
-            Block& b = _blocks[i];
-
-            curr = next;
-            next = &b;
-
-            if (curr != nullptr)
+            if (_layer_time_has_extrusion && (z != _layer_time.z))
             {
-                // Recalculate if current block entry or exit junction speed has changed.
-                if (curr->flags.recalculate || next->flags.recalculate)
-                {
-                    // NOTE: Entry and exit factors always > 0 by all previous logic operations.
-                    Block block = *curr;
-                    block.feedrate.exit = next->feedrate.entry;
-                    block.calculate_trapezoid();
-                    curr->trapezoid = block.trapezoid;
-                    curr->flags.recalculate = false; // Reset current only to ensure next trapezoid is computed
-                }
+                // First extrusion of the next layer.
+                _flush_layer_time();
+                _layer_time.z = z;
             }
+            _layer_time_has_extrusion = true;
         }
+        _layer_time.time[role] += time;
+    }
 
-        // Last/newest block in buffer. Always recalculated.
-        if (next != nullptr)
+    void GCodeTimeEstimator::_flush_layer_time()
+    {
+        float layer_time = 0.0f;
+        for (float& time : _layer_time.time)
+        {
+            layer_time += time;
+        }
+        if (_layer_time_callback && (layer_time > 0.0f))
+            _layer_time_callback(_layer_time);
+        for (float& time : _layer_time.time)
         {
-            Block block = *next;
-            block.feedrate.exit = next->safe_feedrate;
-            block.calculate_trapezoid();
-            next->trapezoid = block.trapezoid;
-            next->flags.recalculate = false;
+            time = 0.0f;
         }
+        _layer_time_has_extrusion = false;
     }
 
     std::string GCodeTimeEstimator::_get_time_dhms(float time_in_secs)
@@ -1480,7 +1500,12 @@ namespace Slic3r {
 
     std::string GCodeTimeEstimator::_get_time_minutes(float time_in_secs)
     {
-        return std::to_string((int)(::roundf(time_in_secs / 60.0f)));
+        return std::to_string(_get_time_minutes_int(time_in_secs));
+    }
+
+    int GCodeTimeEstimator::_get_time_minutes_int(float time_in_secs)
+    {
+        return (int)(::roundf(time_in_secs / 60.0f));
     }
 
 #if ENABLE_MOVE_STATS
@@ -1502,4 +1527,189 @@ namespace Slic3r {
         std::cout << std::endl;
     }
 #endif // ENABLE_MOVE_STATS
+
+    GCodeTimeEstimatorWorkers::GCodeTimeEstimatorWorkers(const std::vector<GCodeTimeEstimator*>& estimators)
+        : _batches(Num_Batches)
+        , _batch(nullptr)
+        , _stop(false)
+    {
+        for (Batch& batch : _batches)
+        {
+            _free_batches.push_back(&batch);
+        }
+        for (GCodeTimeEstimator* estimator : estimators)
+        {
+            _workers.emplace_back(new Worker);
+            _workers.back()->estimator = estimator;
+        }
+        for (std::unique_ptr<Worker>& worker : _workers)
+        {
+            Worker* w = worker.get();
+            w->thread = std::thread([this, w]() { this->_run(*w); });
+        }
+    }
+
+    GCodeTimeEstimatorWorkers::~GCodeTimeEstimatorWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cond_queued.notify_all();
+        for (std::unique_ptr<Worker>& worker : _workers)
+        {
+            worker->thread.join();
+        }
+    }
+
+    void GCodeTimeEstimatorWorkers::add_gcode_line(const GCodeReader::GCodeLine& gcode_line)
+    {
+        if (_batch == nullptr)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond_processed.wait(lock, [this]() { return !_free_batches.empty(); });
+            _batch = _free_batches.back();
+            _free_batches.pop_back();
+            _batch->num_lines = 0;
+        }
+
+        if (_batch->num_lines < _batch->lines.size())
+            // Assignment reuses the memory of the line stored by the previous use of the batch.
+            _batch->lines[_batch->num_lines] = gcode_line;
+        else
+            _batch->lines.emplace_back(gcode_line);
+
+        if (++_batch->num_lines == Batch_Lines)
+            _submit_batch();
+    }
+
+    void GCodeTimeEstimatorWorkers::calculate_time()
+    {
+        if (_batch != nullptr)
+            _submit_batch();
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond_processed.wait(lock, [this]() { return _free_batches.size() == Num_Batches; });
+        }
+        if (_exception)
+            std::rethrow_exception(_exception);
+
+        for (std::unique_ptr<Worker>& worker : _workers)
+        {
+            worker->estimator->calculate_time();
+        }
+    }
+
+    void GCodeTimeEstimatorWorkers::_submit_batch()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _batch->num_pending = _workers.size();
+            if (_workers.empty())
+                _free_batches.push_back(_batch);
+            for (std::unique_ptr<Worker>& worker : _workers)
+            {
+                worker->queue.push_back(_batch);
+            }
+        }
+        _batch = nullptr;
+        _cond_queued.notify_all();
+    }
+
+    void GCodeTimeEstimatorWorkers::_run(Worker& worker)
+    {
+        bool failed = false;
+        for (;;)
+        {
+            Batch* batch;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cond_queued.wait(lock, [this, &worker]() { return _stop || !worker.queue.empty(); });
+                if (_stop)
+                    return;
+                batch = worker.queue.front();
+            }
+
+            // After an exception the batches are just passed through, so that the caller is not blocked.
+            if (!failed)
+            {
+                try
+                {
+                    for (size_t i = 0; i < batch->num_lines; ++i)
+                    {
+                        worker.estimator->add_gcode_line(batch->lines[i]);
+                    }
+                }
+                catch (...)
+                {
+                    failed = true;
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (!_exception)
+                        _exception = std::current_exception();
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                worker.queue.pop_front();
+                if (--batch->num_pending == 0)
+                    _free_batches.push_back(batch);
+            }
+            _cond_processed.notify_all();
+        }
+    }
+
+    // Is the line a part of the machine envelope block written by GCode::print_machine_envelope()? The G-code export writes the block
+    // bypassing the time estimators, which take the machine limits from the config. The limits set by the custom G-code are applied.
+    static bool is_machine_envelope_line(const GCodeReader::GCodeLine& line)
+    {
+        static const char* envelope[][2] = {
+            { "M201", " sets maximum accelerations, mm/sec^2" },
+            { "M203", " sets maximum feedrates, mm/sec" },
+            { "M204", " sets acceleration (P, T) and retract acceleration (R), mm/sec^2" },
+            { "M205", " sets the jerk limits, mm/sec" },
+            { "M205", " sets the minimum extruding and travel feed rate, mm/sec" }
+        };
+        for (const auto& cmd_comment : envelope)
+        {
+            if (line.cmd_is(cmd_comment[0]))
+                return line.comment() == cmd_comment[1];
+        }
+        return false;
+    }
+
+    std::string estimate_print_time(const std::string& file, const PrintConfig& config)
+    {
+        if (!boost::filesystem::exists(file))
+            return file + ": No such file";
+
+        GCodeTimeEstimator normal_time_estimator(GCodeTimeEstimator::Normal);
+        GCodeTimeEstimator silent_time_estimator(GCodeTimeEstimator::Silent);
+        bool silent_time_estimator_enabled = (config.gcode_flavor.value == gcfMarlin) && config.silent_mode.value;
+        normal_time_estimator.set_from_config(config);
+        if (silent_time_estimator_enabled)
+            silent_time_estimator.set_from_config(config);
+
+        // Parse the file once for both modes. The command line mode estimates the files in parallel, therefore the estimators run at this thread.
+        // The lines are passed to the estimators as by GCode::_write(), skipping the machine envelope, which contains the limits of the normal mode.
+        GCodeReader reader;
+        reader.parse_file(file, [&](GCodeReader&, const GCodeReader::GCodeLine& line)
+        {
+            if (is_machine_envelope_line(line))
+                return;
+            normal_time_estimator.add_gcode_line(line);
+            if (silent_time_estimator_enabled)
+                silent_time_estimator.add_gcode_line(line);
+        });
+
+        normal_time_estimator.calculate_time();
+        std::string result = file + ": " + normal_time_estimator.get_time_dhms();
+        if (silent_time_estimator_enabled)
+        {
+            silent_time_estimator.calculate_time();
+            result += " (silent mode " + silent_time_estimator.get_time_dhms() + ")";
+        }
+        return result;
+    }
 }
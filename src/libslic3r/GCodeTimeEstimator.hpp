@@ -5,6 +5,12 @@
 #include "PrintConfig.hpp"
 #include "GCodeReader.hpp"
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
 #define ENABLE_MOVE_STATS 0
 
 namespace Slic3r {
@@ -17,8 +23,11 @@ namespace Slic3r {
     class GCodeTimeEstimator
     {
     public:
-        static const std::string Normal_First_M73_Output_Placeholder_Tag;
-        static const std::string Silent_First_M73_Output_Placeholder_Tag;
+        // Length of the M73 line with the remaining time, without the trailing newline.
+        static const size_t Remaining_Time_Line_Length = 15;
+        // Maximum number of blocks held in the lookahead of the planner. Reached only by long sequences of short moves
+        // accelerating or decelerating, the oldest half of the lookahead is then planned as if the rest did not exist yet.
+        static const size_t Max_Lookahead_Blocks = 4096;
 
         enum EMode : unsigned char
         {
@@ -47,6 +56,28 @@ namespace Slic3r {
             Relative
         };
 
+        // Split of the printing time reported by get_role_time() and by the layer time callback.
+        enum ETimeRole : unsigned char
+        {
+            Extrusion_Time,
+            Travel_Time,
+            // Retractions and unretractions not combined with a move.
+            Retraction_Time,
+            // Dwells, filament loading and unloading.
+            Additional_Time,
+            Num_Time_Roles
+        };
+
+        // Printing time of a single layer, reported once the time of all the moves of the layer is known.
+        // A layer starts with the first extrusion at a new Z, the travel moves are accounted to the preceding layer.
+        struct LayerTime
+        {
+            float z;                    // mm, Z of the extrusions of the layer
+            float time[Num_Time_Roles]; // s
+        };
+
+        typedef std::function<void(const LayerTime&)> LayerTimeCallback;
+
     private:
         struct Axis
         {
@@ -144,12 +175,14 @@ namespace Slic3r {
 #if ENABLE_MOVE_STATS
             EMoveType move_type;
 #endif // ENABLE_MOVE_STATS
+            ETimeRole time_role;
             Flags flags;
 
             float delta_pos[Num_Axis]; // mm
             float acceleration;        // mm/s^2
             float max_entry_speed;     // mm/s
             float safe_feedrate;       // mm/s
+            float end_z;               // mm
 
             FeedrateProfile feedrate;
             Trapezoid trapezoid;
@@ -195,7 +228,7 @@ namespace Slic3r {
             static float intersection_distance(float initial_rate, float final_rate, float acceleration, float distance);
         };
 
-        typedef std::vector<Block> BlocksList;
+        typedef std::deque<Block> BlocksList;
 
 #if ENABLE_MOVE_STATS
         struct MoveStats
@@ -209,7 +242,16 @@ namespace Slic3r {
         typedef std::map<Block::EMoveType, MoveStats> MovesStatsMap;
 #endif // ENABLE_MOVE_STATS
 
-        typedef std::map<unsigned int, unsigned int> G1LineIdToBlockIdMap;
+        // M73 line with the remaining time, inserted into the G-code during the export before the time is known.
+        struct RemainingTimePlaceholder
+        {
+            // Offset of the line in the G-code.
+            size_t offset;
+            // Block of the G1 line, which the M73 line follows. -1 for the first M73 line at the start of the G-code.
+            int block_id;
+            // Elapsed time of the block, filled in once the block leaves the lookahead of the planner. -1 if not known yet.
+            float elapsed_time;
+        };
 
     private:
         EMode _mode;
@@ -217,12 +259,27 @@ namespace Slic3r {
         State _state;
         Feedrates _curr;
         Feedrates _prev;
+        // Lookahead of the planner: The blocks, which may still be slowed down by the blocks following them.
+        // The blocks are removed once their time is final, so the memory use does not grow with the length of the G-code.
         BlocksList _blocks;
-        // Map between g1 line id and blocks id, used to speed up export of remaining times
-        G1LineIdToBlockIdMap _g1_line_ids;
-        // Index of the last block already st_synchronized
-        int _last_st_synchronized_block_id;
+        // Number of blocks already removed from the lookahead, that is the id of the first block of _blocks.
+        int _first_block_id;
+        // Remaining time lines inserted into the G-code, to be filled in once the time is known.
+        std::vector<RemainingTimePlaceholder> _remaining_time_placeholders;
+        // First placeholder, which has not received its elapsed time yet.
+        size_t _next_placeholder_id;
+        // Block added by the last G1 line with an extrusion axis, -1 if the last line added was not such a line.
+        int _last_line_block_id;
+        // Sum of the block times at the time the blocks were added, before the planner adjusted the junction speeds.
+        // Used to space the remaining time lines during the export.
+        float _provisional_time;
+        float _last_remaining_time_provisional_time;
         float _time; // s
+        float _role_times[Num_Time_Roles]; // s
+        // Layer being accounted, reported by _layer_time_callback once the next layer starts.
+        LayerTime _layer_time;
+        bool _layer_time_has_extrusion;
+        LayerTimeCallback _layer_time_callback;
 
 #if ENABLE_MOVE_STATS
         MovesStatsMap _moves_stats;
@@ -233,31 +290,45 @@ namespace Slic3r {
 
         // Adds the given gcode line
         void add_gcode_line(const std::string& gcode_line);
+        // Adds the given gcode line, parsed by the caller
+        void add_gcode_line(const GCodeReader::GCodeLine& gcode_line);
 
         void add_gcode_block(const char *ptr);
         void add_gcode_block(const std::string &str) { this->add_gcode_block(str.c_str()); }
 
         // Calculates the time estimate from the gcode lines added using add_gcode_line() or add_gcode_block()
-        // start_from_beginning:
-        // if set to true all blocks will be used to calculate the time estimate,
-        // if set to false only the blocks not yet processed will be used and the calculated time will be added to the current calculated time
-        void calculate_time(bool start_from_beginning);
+        // The moves still held in the lookahead of the planner are planned to a stop, as at the end of the print,
+        // and the time of the last layer is reported to the layer time callback.
+        void calculate_time();
 
         // Calculates the time estimate from the given gcode in string format
         void calculate_time_from_text(const std::string& gcode);
 
         // Calculates the time estimate from the gcode contained in the file with the given filename
+        // A large file is parsed at the calling thread while the estimator runs at a worker thread.
+        //FIXME Only the parsing of the lines is parallel (see GCodeReader::parse_file()). The moves are processed in order,
+        // as the position, units and positioning modes are modal and the planner joins each block with the preceding ones.
         void calculate_time_from_file(const std::string& file);
 
         // Calculates the time estimate from the gcode contained in given list of gcode lines
         void calculate_time_from_lines(const std::vector<std::string>& gcode_lines);
 
-        // Process the gcode contained in the file with the given filename, 
-        // placing in it new lines (M73) containing the remaining time, at the given interval in seconds
-        // and saving the result back in the same file
-        // This time estimator should have been already used to calculate the time estimate for the gcode
-        // contained in the given file before to call this method
-        bool post_process_remaining_times(const std::string& filename, float interval_sec);
+        // The remaining times (M73 lines) are exported in a single pass: During the G-code export, fixed length placeholders
+        // are inserted at the start of the G-code and after the G1 lines, for which is_remaining_time_due() returns true.
+        // Once the time estimate has been calculated, the placeholders are overwritten with the remaining times.
+        //
+        // Returns true if a remaining time line shall follow the last gcode line added, so that the lines are placed
+        // at the given interval in seconds.
+        bool is_remaining_time_due(float interval_sec) const;
+        // Records a remaining time line inserted at the given offset of the gcode, following the last gcode line added,
+        // or at the start of the gcode if no move was added yet. Returns the placeholder line to be inserted.
+        std::string add_remaining_time_placeholder(size_t offset);
+        // Calls patch(offset, line) for each placeholder with the remaining time line of Remaining_Time_Line_Length characters.
+        // The time estimate shall be calculated before calling this method.
+        void fill_remaining_time_placeholders(const std::function<void(size_t, const std::string&)> &patch) const;
+
+        // The callback receives the time of each layer as soon as it is known, while the gcode lines are being added.
+        void set_layer_time_callback(LayerTimeCallback callback) { _layer_time_callback = callback; }
 
         // Set current position on the given axis with the given value
         void set_axis_position(EAxis axis, float position);
@@ -326,12 +397,18 @@ namespace Slic3r {
 
         void set_default();
 
+        // Sets the dialect, the machine limits of this estimator's mode and the filament load / unload times from the print config
+        void set_from_config(const PrintConfig& config);
+
         // Call this method before to start adding lines using add_gcode_line() when reusing an instance of GCodeTimeEstimator
         void reset();
 
         // Returns the estimated time, in seconds
         float get_time() const;
 
+        // Returns the part of the estimated time spent in the given role, in seconds
+        float get_role_time(ETimeRole role) const { return _role_times[role]; }
+
         // Returns the estimated time, in format DDd HHh MMm SSs
         std::string get_time_dhms() const;
 
@@ -412,25 +489,90 @@ namespace Slic3r {
         // Simulates firmware st_synchronize() call
         void _simulate_st_synchronize();
 
-        void _forward_pass();
-        void _reverse_pass();
+        // Plans the block just added to the lookahead, removes the blocks, which became final.
+        void _plan_last_block();
+        // Runs the reverse pass over the lookahead, calculates the time of the first count blocks and removes them.
+        void _finalize_blocks(size_t count);
 
         void _planner_forward_pass_kernel(Block& prev, Block& curr);
         void _planner_reverse_pass_kernel(Block& curr, Block& next);
 
-        void _recalculate_trapezoids();
+        void _add_role_time(ETimeRole role, float z, float time);
+        // Reports the time of the layer being accounted to the layer time callback.
+        void _flush_layer_time();
 
         // Returns the given time is seconds in format DDd HHh MMm SSs
         static std::string _get_time_dhms(float time_in_secs);
 
         // Returns the given, in minutes (integer)
         static std::string _get_time_minutes(float time_in_secs);
+        static int _get_time_minutes_int(float time_in_secs);
 
 #if ENABLE_MOVE_STATS
         void _log_moves_stats() const;
 #endif // ENABLE_MOVE_STATS
     };
 
+    //
+    // Runs a set of time estimators at worker threads, one thread per estimator.
+    // The parsed gcode lines are collected into batches shared by all the estimators, a batch is reused
+    // once all the estimators processed it. The caller is blocked only if the estimators fall behind by all the batches.
+    //
+    class GCodeTimeEstimatorWorkers
+    {
+    public:
+        explicit GCodeTimeEstimatorWorkers(const std::vector<GCodeTimeEstimator*>& estimators);
+        // Stops the worker threads, the lines not processed yet are dropped.
+        ~GCodeTimeEstimatorWorkers();
+
+        // Adds the given gcode line to all the estimators
+        void add_gcode_line(const GCodeReader::GCodeLine& gcode_line);
+
+        // Waits for the estimators to process all the lines added, then calculates the time estimates.
+        // Rethrows the exception thrown by an estimator, if any.
+        void calculate_time();
+
+    private:
+        static const size_t Batch_Lines = 4096;
+        static const size_t Num_Batches = 8;
+
+        struct Batch
+        {
+            // The lines past num_lines are kept to reuse their memory.
+            std::vector<GCodeReader::GCodeLine> lines;
+            size_t num_lines;
+            // Number of estimators, which did not process this batch yet.
+            size_t num_pending;
+        };
+
+        struct Worker
+        {
+            GCodeTimeEstimator* estimator;
+            std::deque<Batch*> queue;
+            std::thread thread;
+        };
+
+        void _run(Worker& worker);
+        void _submit_batch();
+
+        std::vector<Batch> _batches;
+        std::vector<Batch*> _free_batches;
+        // Batch being filled by add_gcode_line(), nullptr if none.
+        Batch* _batch;
+        std::vector<std::unique_ptr<Worker>> _workers;
+        std::mutex _mutex;
+        // Signalled when a batch is queued for the workers or when the workers shall stop.
+        std::condition_variable _cond_queued;
+        // Signalled when a worker finished a batch.
+        std::condition_variable _cond_processed;
+        bool _stop;
+        std::exception_ptr _exception;
+    };
+
+    // Estimates the printing time of a G-code file using the machine limits of the given config, as the --estimate-time
+    // command line mode does. Returns "<file>: <time>", followed by " (silent mode <time>)" if the silent mode is enabled.
+    std::string estimate_print_time(const std::string& file, const PrintConfig& config);
+
 } /* namespace Slic3r */
 
 #endif /* slic3r_GCodeTimeEstimator_hpp_ */
@@ -1,5 +1,7 @@
 #include "GCodeWriter.hpp"
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <iomanip>
 #include <iostream>
 #include <map>
@@ -9,8 +11,8 @@
 #define FLAVOR_IS_NOT(val) this->config.gcode_flavor != val
 #define COMMENT(comment) if (this->config.gcode_comments && !comment.empty()) gcode << " ; " << comment;
 #define PRECISION(val, precision) std::fixed << std::setprecision(precision) << val
-#define XYZF_NUM(val) PRECISION(val, 3)
-#define E_NUM(val) PRECISION(val, 5)
+#define XYZF_NUM(val) PRECISION(val, XYZF_EXPORT_DIGITS)
+#define E_NUM(val) PRECISION(val, E_EXPORT_DIGITS)
 
 namespace Slic3r {
 
@@ -281,13 +283,10 @@ std::string GCodeWriter::travel_to_xy(const Vec2d &point, const std::string &com
     m_pos(0) = point(0);
     m_pos(1) = point(1);
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point(0))
-          <<   " Y" << XYZF_NUM(point(1))
-          <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
-    COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    GCodeG1Formatter w;
+    w.emit_xy(point);
+    w.emit_f(this->config.travel_speed.value * 60.0);
+    return w.string(this->config.gcode_comments ? comment : std::string());
 }
 
 std::string GCodeWriter::travel_to_xyz(const Vec3d &point, const std::string &comment)
@@ -307,14 +306,10 @@ std::string GCodeWriter::travel_to_xyz(const Vec3d &point, const std::string &co
     m_lifted = 0;
     m_pos = point;
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point(0))
-          <<   " Y" << XYZF_NUM(point(1))
-          <<   " Z" << XYZF_NUM(point(2))
-          <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
-    COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    GCodeG1Formatter w;
+    w.emit_xyz(point);
+    w.emit_f(this->config.travel_speed.value * 60.0);
+    return w.string(this->config.gcode_comments ? comment : std::string());
 }
 
 std::string GCodeWriter::travel_to_z(double z, const std::string &comment)
@@ -338,12 +333,10 @@ std::string GCodeWriter::_travel_to_z(double z, const std::string &comment)
 {
     m_pos(2) = z;
     
-    std::ostringstream gcode;
-    gcode << "G1 Z" << XYZF_NUM(z)
-          <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
-    COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    GCodeG1Formatter w;
+    w.emit_axis('Z', z, XYZF_EXPORT_DIGITS);
+    w.emit_f(this->config.travel_speed.value * 60.0);
+    return w.string(this->config.gcode_comments ? comment : std::string());
 }
 
 bool GCodeWriter::will_move_z(double z) const
@@ -364,13 +357,10 @@ std::string GCodeWriter::extrude_to_xy(const Vec2d &point, double dE, const std:
     m_pos(1) = point(1);
     m_extruder->extrude(dE);
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point(0))
-          <<   " Y" << XYZF_NUM(point(1))
-          <<    " " << m_extrusion_axis << E_NUM(m_extruder->E());
-    COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    GCodeG1Formatter w;
+    w.emit_xy(point);
+    w.emit_e(m_extrusion_axis, m_extruder->E());
+    return w.string(this->config.gcode_comments ? comment : std::string());
 }
 
 std::string GCodeWriter::extrude_to_xyz(const Vec3d &point, double dE, const std::string &comment)
@@ -379,14 +369,10 @@ std::string GCodeWriter::extrude_to_xyz(const Vec3d &point, double dE, const std
     m_lifted = 0;
     m_extruder->extrude(dE);
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point(0))
-          <<   " Y" << XYZF_NUM(point(1))
-          <<   " Z" << XYZF_NUM(point(2))
-          <<    " " << m_extrusion_axis << E_NUM(m_extruder->E());
-    COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    GCodeG1Formatter w;
+    w.emit_xyz(point);
+    w.emit_e(m_extrusion_axis, m_extruder->E());
+    return w.string(this->config.gcode_comments ? comment : std::string());
 }
 
 std::string GCodeWriter::retract(bool before_wipe)
@@ -506,4 +492,60 @@ std::string GCodeWriter::unlift()
     return gcode;
 }
 
+std::string GCodeG1Formatter::string(const std::string &comment) const
+{
+    std::string out;
+    out.reserve((m_ptr - m_buf) + (comment.empty() ? 0 : comment.size() + 3) + 1);
+    out.append(m_buf, m_ptr - m_buf);
+    if (! comment.empty()) {
+        out += " ; ";
+        out += comment;
+    }
+    out += '\n';
+    return out;
+}
+
+char* GCodeG1Formatter::format_fixed(char *buffer, double value, int digits)
+{
+    static const double   pow10d[] = { 1., 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    static const uint64_t pow10i[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+    assert(digits >= 0 && digits <= 9);
+
+    // Fails for NaN as well.
+    double scaled = std::abs(value) * pow10d[digits];
+    if (scaled < 9007199254740992.) {
+        double integral   = std::floor(scaled);
+        double fractional = scaled - integral;
+        // The scaled value differs from the exact decimal value by a relative error of at most 2^-53. Unless the fractional part
+        // is close to one half, rounding the scaled value gives the same integer as the rounding of the exact value by printf().
+        if (std::abs(fractional - 0.5) > scaled * 1e-15) {
+            uint64_t n = uint64_t(integral) + (fractional > 0.5 ? 1 : 0);
+            // printf() keeps the sign of negative values rounded to zero.
+            if (std::signbit(value))
+                *buffer ++ = '-';
+            uint64_t integer_part = n / pow10i[digits];
+            char     integer_digits[20];
+            int      num_integer_digits = 0;
+            do {
+                integer_digits[num_integer_digits ++] = char('0' + integer_part % 10);
+                integer_part /= 10;
+            } while (integer_part > 0);
+            while (num_integer_digits > 0)
+                *buffer ++ = integer_digits[-- num_integer_digits];
+            if (digits > 0) {
+                uint64_t fractional_part = n % pow10i[digits];
+                *buffer ++ = '.';
+                for (int i = digits - 1; i >= 0; -- i) {
+                    buffer[i] = char('0' + fractional_part % 10);
+                    fractional_part /= 10;
+                }
+                buffer += digits;
+            }
+            return buffer;
+        }
+    }
+    // Close to a tie, or out of the range of the fast path: Let printf() round the exact decimal value.
+    return buffer + sprintf(buffer, "%.*f", digits, value);
+}
+
 }
@@ -2,6 +2,7 @@
 #define slic3r_GCodeWriter_hpp_
 
 #include "libslic3r.h"
+#include <cassert>
 #include <string>
 #include "Extruder.hpp"
 #include "Point.hpp"
@@ -87,6 +88,57 @@ private:
     std::string _retract(double length, double restart_extra, const std::string &comment);
 };
 
+// Number of decimal digits of the X, Y, Z coordinates and of the feed rate, and of the extruder axis in the exported G-code.
+static const int XYZF_EXPORT_DIGITS = 3;
+static const int E_EXPORT_DIGITS    = 5;
+
+// Emits the G1 moves of GCodeWriter into a buffer on the stack, avoiding the construction of std::ostringstream,
+// the locale lookups and the memory allocations for each number. The numbers are formatted exactly as
+// by std::fixed << std::setprecision(digits), that is by printf("%.*f").
+class GCodeG1Formatter
+{
+public:
+    GCodeG1Formatter() : m_ptr(m_buf) { *m_ptr ++ = 'G'; *m_ptr ++ = '1'; }
+
+    void emit_axis(char axis, double value, int digits) {
+        assert(m_ptr + max_number_length + 2 <= m_buf + sizeof(m_buf));
+        *m_ptr ++ = ' ';
+        *m_ptr ++ = axis;
+        m_ptr = format_fixed(m_ptr, value, digits);
+    }
+    void emit_xy(const Vec2d &point) {
+        this->emit_axis('X', point(0), XYZF_EXPORT_DIGITS);
+        this->emit_axis('Y', point(1), XYZF_EXPORT_DIGITS);
+    }
+    void emit_xyz(const Vec3d &point) {
+        this->emit_xy(to_2d(point));
+        this->emit_axis('Z', point(2), XYZF_EXPORT_DIGITS);
+    }
+    void emit_e(const std::string &axis, double e) {
+        assert(axis.size() <= 1 && m_ptr + max_number_length + 2 <= m_buf + sizeof(m_buf));
+        *m_ptr ++ = ' ';
+        for (char c : axis)
+            *m_ptr ++ = c;
+        m_ptr = format_fixed(m_ptr, e, E_EXPORT_DIGITS);
+    }
+    void emit_f(double speed) { this->emit_axis('F', speed, XYZF_EXPORT_DIGITS); }
+
+    // Finish the G-code line with an optional comment and a new line.
+    std::string string(const std::string &comment = std::string()) const;
+
+    // Format the value into buffer with the given number of decimal digits (up to 9), return pointer after the last character written.
+    // The result is equal to the output of printf("%.*f", digits, value). At most max_number_length characters are written.
+    static char* format_fixed(char *buffer, double value, int digits);
+
+private:
+    // Length of the longest number printed by "%.9f": sign, 309 integer digits of DBL_MAX, decimal point and 9 decimal digits.
+    static const size_t max_number_length = 1 + 309 + 1 + 9;
+
+    // "G1" and up to four axes, each prefixed by a space and an axis letter.
+    char  m_buf[2 + 4 * (2 + max_number_length)];
+    char *m_ptr;
+};
+
 } /* namespace Slic3r */
 
 #endif /* slic3r_GCodeWriter_hpp_ */
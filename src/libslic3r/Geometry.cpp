@@ -8,6 +8,8 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <functional>
+#include <iterator>
 #include <list>
 #include <map>
 #include <set>
@@ -1001,6 +1003,84 @@ MedialAxis::build(Polylines* polylines)
     polylines->insert(polylines->end(), tp.begin(), tp.end());
 }
 
+static inline void hash_combine(size_t &seed, size_t value)
+{
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+static inline void hash_points(size_t &seed, const Points &points)
+{
+    hash_combine(seed, points.size());
+    for (const Point &pt : points) {
+        hash_combine(seed, size_t(pt(0)));
+        hash_combine(seed, size_t(pt(1)));
+    }
+}
+
+static inline bool expolygons_equal(const ExPolygon &expoly1, const ExPolygon &expoly2)
+{
+    if (expoly1.contour.points != expoly2.contour.points || expoly1.holes.size() != expoly2.holes.size())
+        return false;
+    for (size_t i = 0; i < expoly1.holes.size(); ++ i)
+        if (expoly1.holes[i].points != expoly2.holes[i].points)
+            return false;
+    return true;
+}
+
+void MedialAxisCache::medial_axis(const ExPolygon &expolygon, double max_width, double min_width, ThickPolylines *polylines)
+{
+    // Maximum number of points of the cached ExPolygons and medial axes, roughly 100MB.
+    static const size_t max_points = 8000000;
+
+    size_t key = std::hash<double>()(max_width);
+    hash_combine(key, std::hash<double>()(min_width));
+    hash_points(key, expolygon.contour.points);
+    for (const Polygon &hole : expolygon.holes)
+        hash_points(key, hole.points);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto range = m_entries.equal_range(key);
+        for (auto it = range.first; it != range.second; ++ it) {
+            const Entry &entry = it->second;
+            if (entry.max_width == max_width && entry.min_width == min_width && expolygons_equal(entry.expolygon, expolygon)) {
+                polylines->insert(polylines->end(), entry.polylines.begin(), entry.polylines.end());
+                return;
+            }
+        }
+    }
+
+    ThickPolylines out;
+    expolygon.medial_axis(max_width, min_width, &out);
+
+    size_t num_points = expolygon.contour.points.size();
+    for (const Polygon &hole : expolygon.holes)
+        num_points += hole.points.size();
+    for (const ThickPolyline &polyline : out)
+        num_points += polyline.points.size();
+    {
+        // Another thread may have cached the same ExPolygon in the meantime, which only wastes some memory.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_num_points + num_points <= max_points) {
+            m_num_points += num_points;
+            Entry entry;
+            entry.expolygon = expolygon;
+            entry.max_width = max_width;
+            entry.min_width = min_width;
+            entry.polylines = out;
+            m_entries.emplace(key, std::move(entry));
+        }
+    }
+    polylines->insert(polylines->end(), std::make_move_iterator(out.begin()), std::make_move_iterator(out.end()));
+}
+
+void MedialAxisCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_num_points = 0;
+}
+
 void
 MedialAxis::process_edge_neighbors(const VD::edge_type* edge, ThickPolyline* polyline)
 {
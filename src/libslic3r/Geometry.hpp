@@ -7,6 +7,9 @@
 #include "Polygon.hpp"
 #include "Polyline.hpp"
 
+#include <mutex>
+#include <unordered_map>
+
 #include "boost/polygon/voronoi.hpp"
 using boost::polygon::voronoi_builder;
 using boost::polygon::voronoi_diagram;
@@ -171,6 +174,38 @@ class MedialAxis {
     const Point& retrieve_endpoint(const VD::cell_type* cell) const;
 };
 
+// Medial axes extracted by ExPolygon::medial_axis() for the thin walls and the gap fill, shared by the threads
+// generating the perimeters of a PrintObject. The islands of a prismatic object repeat on the consecutive layers,
+// their medial axes are extracted once and copied for the other layers.
+// The cache is keyed by a hash of the ExPolygon and of the widths, the ExPolygon is stored to resolve hash collisions.
+// Nothing is evicted: Once the cached ExPolygons and medial axes reach their maximum number of points, no more medial axes
+// are cached. The medial axes cached up to then are still returned, the other ones are extracted on each call until clear().
+class MedialAxisCache {
+public:
+    MedialAxisCache() : m_num_points(0) {}
+    // Append the medial axis of the expolygon to polylines, extract it with ExPolygon::medial_axis() if not cached.
+    // Thread safe, the medial axis is extracted outside of the lock.
+    void medial_axis(const ExPolygon &expolygon, double max_width, double min_width, ThickPolylines *polylines);
+    // Release the cached medial axes.
+    void clear();
+
+private:
+    MedialAxisCache(const MedialAxisCache&) = delete;
+    MedialAxisCache& operator=(const MedialAxisCache&) = delete;
+
+    struct Entry {
+        ExPolygon           expolygon;
+        double              max_width;
+        double              min_width;
+        ThickPolylines      polylines;
+    };
+    std::mutex                                  m_mutex;
+    std::unordered_multimap<size_t, Entry>      m_entries;
+    // Number of points of the cached ExPolygons and medial axes, limits the memory consumed by the cache
+    // for the non-prismatic objects, whose islands do not repeat.
+    size_t                                      m_num_points;
+};
+
 // Sets the given transform by assembling the given transformations in the following order:
 // 1) mirror
 // 2) scale
@@ -5,6 +5,7 @@
 #include "Fill/Fill.hpp"
 #include "SVG.hpp"
 
+#include <boost/functional/hash.hpp>
 #include <boost/log/trivial.hpp>
 
 namespace Slic3r {
@@ -158,6 +159,37 @@ void Layer::make_fills()
     }
 }
 
+size_t Layer::fill_surfaces_hash() const
+{
+    size_t seed = 0;
+    auto hash_polygon = [&seed](const Polygon &polygon) {
+        boost::hash_combine(seed, polygon.points.size());
+        for (const Point &pt : polygon.points) {
+            boost::hash_combine(seed, pt(0));
+            boost::hash_combine(seed, pt(1));
+        }
+    };
+    boost::hash_combine(seed, m_id);
+    boost::hash_combine(seed, this->print_z);
+    boost::hash_combine(seed, this->height);
+    for (const LayerRegion *layerm : m_regions) {
+        boost::hash_combine(seed, layerm->fill_surfaces.surfaces.size());
+        for (const Surface &surface : layerm->fill_surfaces.surfaces) {
+            boost::hash_combine(seed, int(surface.surface_type));
+            boost::hash_combine(seed, surface.thickness);
+            boost::hash_combine(seed, surface.thickness_layers);
+            boost::hash_combine(seed, surface.bridge_angle);
+            boost::hash_combine(seed, surface.extra_perimeters);
+            boost::hash_combine(seed, surface.expolygon.holes.size());
+            hash_polygon(surface.expolygon.contour);
+            for (const Polygon &hole : surface.expolygon.holes)
+                hash_polygon(hole);
+        }
+    }
+    // Zero is reserved for the invalid fills.
+    return (seed == 0) ? 1 : seed;
+}
+
 void Layer::export_region_slices_to_svg(const char *path) const
 {
     BoundingBox bbox;
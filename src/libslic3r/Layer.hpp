@@ -102,6 +102,8 @@ public:
     coordf_t            slice_z;       // Z used for slicing in unscaled coordinates
     coordf_t            print_z;       // Z used for printing in unscaled coordinates
     coordf_t            height;        // layer height in unscaled coordinates
+    // fill_surfaces_hash() at the time the fills were generated, zero if the fills have to be regenerated.
+    size_t              fills_hash;
 
     // collection of expolygons generated by slicing the original geometry;
     // also known as 'islands' (all regions and surface types are merged here)
@@ -127,6 +129,9 @@ public:
     }
     void                    make_perimeters();
     void                    make_fills();
+    // Hash of the layer position and of the fill surfaces of all regions, from which make_fills() generates the fills.
+    // The gap fills produced by make_perimeters() are copied to the fills too, make_perimeters() resets fills_hash.
+    size_t                  fill_surfaces_hash() const;
 
     void                    export_region_slices_to_svg(const char *path) const;
     void                    export_region_fill_surfaces_to_svg(const char *path) const;
@@ -142,7 +147,7 @@ protected:
 
     Layer(size_t id, PrintObject *object, coordf_t height, coordf_t print_z, coordf_t slice_z) :
         upper_layer(nullptr), lower_layer(nullptr), slicing_errors(false),
-        slice_z(slice_z), print_z(print_z), height(height),
+        slice_z(slice_z), print_z(print_z), height(height), fills_hash(0),
         m_id(id), m_object(object) {}
     virtual ~Layer();
 
@@ -73,6 +73,7 @@ void LayerRegion::make_perimeters(const SurfaceCollection &slices, SurfaceCollec
     if (this->layer()->lower_layer != NULL)
         // Cummulative sum of polygons over all the regions.
         g.lower_slices = &this->layer()->lower_layer->slices;
+    g.medial_axis_cache = this->layer()->object()->medial_axis_cache();
     
     g.layer_id              = this->layer()->id();
     g.ext_perimeter_flow    = this->flow(frExternalPerimeter);
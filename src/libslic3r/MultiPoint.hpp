@@ -81,9 +81,54 @@ public:
     bool first_intersection(const Line& line, Point* intersection) const;
     
     static Points _douglas_peucker(const Points &points, const double tolerance);
+    // Douglas-Peucker simplification of the polyline with the points [first, last], which are accessed by point(index) as Vec2d.
+    // Appends the indices of the points retained by _douglas_peucker() to out, including first and last.
+    template<typename PointFn, typename Index>
+    static void _douglas_peucker_ids(PointFn point, Index first, Index last, const double tolerance, std::vector<Index> &out);
     static Points visivalingam(const Points& pts, const double& tolerance);
 };
 
+template<typename PointFn, typename Index>
+void MultiPoint::_douglas_peucker_ids(PointFn point, Index first, Index last, const double tolerance, std::vector<Index> &out)
+{
+    assert(first <= last);
+    // Ranges to be simplified. The range to the left is processed first, so that the indices are emitted in order.
+    std::vector<std::pair<Index, Index>> ranges(1, std::make_pair(first, last));
+    while (! ranges.empty()) {
+        const Index begin = ranges.back().first;
+        const Index end   = ranges.back().second;
+        ranges.pop_back();
+        const Vec2d  a  = point(begin);
+        const Vec2d  b  = point(end);
+        const Vec2d  v  = b - a;
+        const double l2 = v.squaredNorm();
+        double dmax  = 0.;
+        Index  index = begin;
+        for (Index i = begin + 1; i < end; ++ i) {
+            // we use shortest distance, not perpendicular distance, see Line::distance_to()
+            const Vec2d p  = point(i);
+            const Vec2d va = p - a;
+            double d;
+            if (l2 == 0.) {
+                d = va.norm();
+            } else {
+                const double t = va.dot(v) / l2;
+                d = (t < 0.) ? va.norm() : (t > 1.) ? (p - b).norm() : (t * v - va).norm();
+            }
+            if (d > dmax) {
+                index = i;
+                dmax  = d;
+            }
+        }
+        if (dmax >= tolerance && index != begin) {
+            ranges.emplace_back(index, end);
+            ranges.emplace_back(begin, index);
+        } else
+            out.emplace_back(begin);
+    }
+    out.emplace_back(last);
+}
+
 class MultiPoint3
 {
 public:
@@ -1,6 +1,7 @@
 #include "PerimeterGenerator.hpp"
 #include "ClipperUtils.hpp"
 #include "ExtrusionEntityCollection.hpp"
+#include "Geometry.hpp"
 #include <cmath>
 #include <cassert>
 
@@ -59,6 +60,8 @@ void PerimeterGenerator::process()
             std::vector<PerimeterGeneratorLoops> contours(loop_number+1);    // depth => loops
             std::vector<PerimeterGeneratorLoops> holes(loop_number+1);       // depth => loops
             ThickPolylines thin_walls;
+            // Each onion shell of perimeters is offsetted from the previous one, the gaps are detected between the successive shells.
+            OnionShells shells(last);
             // we loop one time more than needed in order to find gaps after the last perimeter was applied
             for (int i = 0;; ++ i) {  // outer loop is 0
                 // Calculate next onion shell of perimeters.
@@ -67,11 +70,10 @@ void PerimeterGenerator::process()
                     // the minimum thickness of a single loop is:
                     // ext_width/2 + ext_spacing/2 + spacing/2 + width/2
                     offsets = this->config->thin_walls ? 
-                        offset2_ex(
-                            last,
+                        shells.next2(
                             -(ext_perimeter_width / 2 + ext_min_spacing / 2 - 1),
                             +(ext_min_spacing / 2 - 1)) :
-                        offset_ex(last, - ext_perimeter_width / 2);
+                        shells.next(- ext_perimeter_width / 2);
                     // look for thin walls
                     if (this->config->thin_walls) {
                         // the following offset2 ensures almost nothing in @thin_walls is narrower than $min_width
@@ -85,7 +87,7 @@ void PerimeterGenerator::process()
                             - min_width / 2, min_width / 2);
                         // the maximum thickness of our thin wall area is equal to the minimum thickness of a single loop
                         for (ExPolygon &ex : expp)
-                            ex.medial_axis(ext_perimeter_width + ext_perimeter_spacing2, min_width, &thin_walls);
+                            this->_medial_axis(ex, ext_perimeter_width + ext_perimeter_spacing2, min_width, &thin_walls);
                     }
                 } else {
                     //FIXME Is this offset correct if the line width of the inner perimeters differs
@@ -98,20 +100,20 @@ void PerimeterGenerator::process()
                         // reliable gap fill algorithm.
                         // Also the offset2(perimeter, -x, x) may sometimes lead to a perimeter, which is larger than
                         // the original.
-                        offset2_ex(last,
+                        shells.next2(
                                 - (distance + min_spacing / 2 - 1),
                                 min_spacing / 2 - 1) :
                         // If "detect thin walls" is not enabled, this paths will be entered, which 
                         // leads to overflows, as in prusa3d/Slic3r GH #32
-                        offset_ex(last, - distance);
+                        shells.next(- distance);
                     // look for gaps
                     if (this->config->gap_fill_speed.value > 0 && this->config->fill_density.value > 0)
                         // not using safety offset here would "detect" very narrow gaps
                         // (but still long enough to escape the area threshold) that gap fill
                         // won't be able to fill but we'd still remove from infill area
-                        append(gaps, diff_ex(
-                            offset(last,    -0.5 * distance),
-                            offset(offsets,  0.5 * distance + 10)));  // safety offset
+                        append(gaps, shells.gaps(
+                            -0.5 * distance,
+                             0.5 * distance + 10));  // safety offset
                 }
                 if (offsets.empty()) {
                     // Store the number of loops actually generated.
@@ -213,7 +215,7 @@ void PerimeterGenerator::process()
                 true);
             ThickPolylines polylines;
             for (const ExPolygon &ex : gaps_ex)
-                ex.medial_axis(max, min, &polylines);
+                this->_medial_axis(ex, max, min, &polylines);
             if (! polylines.empty()) {
                 ExtrusionEntityCollection gap_fill = this->_variable_width(polylines, 
                     erGapFill, this->solid_infill_flow);
@@ -466,6 +468,14 @@ ExtrusionEntityCollection PerimeterGenerator::_variable_width(const ThickPolylin
     return coll;
 }
 
+void PerimeterGenerator::_medial_axis(const ExPolygon &expolygon, double max_width, double min_width, ThickPolylines *polylines) const
+{
+    if (this->medial_axis_cache == nullptr)
+        expolygon.medial_axis(max_width, min_width, polylines);
+    else
+        this->medial_axis_cache->medial_axis(expolygon, max_width, min_width, polylines);
+}
+
 bool PerimeterGeneratorLoop::is_internal_contour() const
 {
     // An internal contour is a contour containing no other contours
@@ -11,6 +11,8 @@
 
 namespace Slic3r {
 
+namespace Geometry { class MedialAxisCache; }
+
 // Hierarchy of perimeters.
 class PerimeterGeneratorLoop {
 public:
@@ -48,6 +50,8 @@ public:
     const PrintRegionConfig     *config;
     const PrintObjectConfig     *object_config;
     const PrintConfig           *print_config;
+    // Medial axes of the thin walls and gap fills shared with the other layers of the object, may be null.
+    Geometry::MedialAxisCache   *medial_axis_cache;
     // Outputs:
     ExtrusionEntityCollection   *loops;
     ExtrusionEntityCollection   *gap_fill;
@@ -72,7 +76,7 @@ public:
             layer_id(-1), perimeter_flow(flow), ext_perimeter_flow(flow),
             overhang_flow(flow), solid_infill_flow(flow),
             config(config), object_config(object_config), print_config(print_config),
-            loops(loops), gap_fill(gap_fill), fill_surfaces(fill_surfaces),
+            medial_axis_cache(nullptr), loops(loops), gap_fill(gap_fill), fill_surfaces(fill_surfaces),
             _ext_mm3_per_mm(-1), _mm3_per_mm(-1), _mm3_per_mm_overhang(-1)
         {};
     void process();
@@ -85,6 +89,7 @@ private:
     
     ExtrusionEntityCollection _traverse_loops(const PerimeterGeneratorLoops &loops, ThickPolylines &thin_walls) const;
     ExtrusionEntityCollection _variable_width(const ThickPolylines &polylines, ExtrusionRole role, Flow flow) const;
+    void _medial_axis(const ExPolygon &expolygon, double max_width, double min_width, ThickPolylines *polylines) const;
 };
 
 }
@@ -3,7 +3,11 @@
 #include <ctime>
 #include <iomanip>
 #include <sstream>
+#include <list>
 #include <map>
+#include <memory>
+#include <limits>
+#include <algorithm>
 #ifdef _MSC_VER
     #include <stdlib.h>  // provides **_environ
 #else
@@ -24,6 +28,12 @@
 
 #include <boost/algorithm/string.hpp>
 
+// tbb/mutex.h includes Windows, which in turn defines min/max macros. Convince Windows.h to not define these min/max macros.
+#ifndef NOMINMAX
+    #define NOMINMAX
+#endif
+#include <tbb/mutex.h>
+
 // Spirit v2.5 allows you to suppress automatic generation
 // of predefined terminals to speed up complation. With
 // BOOST_SPIRIT_NO_PREDEFINED_TERMINALS defined, you are
@@ -393,7 +403,7 @@ namespace client
         {
             this->throw_if_not_numeric("Cannot divide a non-numeric type.");
             rhs.throw_if_not_numeric("Cannot divide with a non-numeric type.");
-            if ((this->type == TYPE_INT) ? (rhs.i() == 0) : (rhs.d() == 0.))
+            if ((this->type == TYPE_DOUBLE || rhs.type == TYPE_DOUBLE) ? (rhs.as_d() == 0.) : (rhs.i() == 0))
                 rhs.throw_exception("Division by zero");
             if (this->type == TYPE_DOUBLE || rhs.type == TYPE_DOUBLE) {
                 double d = this->as_d() / rhs.as_d();
@@ -405,11 +415,6 @@ namespace client
             return *this;
         }
 
-        static void to_string2(expr &self, std::string &out)
-        {
-            out = self.to_string();
-        }
-
         static void evaluate_boolean(expr &self, bool &out)
         {
             if (self.type != TYPE_BOOL)
@@ -460,6 +465,7 @@ namespace client
                 boost::throw_exception(qi::expectation_failure<Iterator>(
                     lhs.it_range.begin(), rhs.it_range.end(), spirit::info("*Cannot compare the types.")));
             }
+            lhs.reset();
             lhs.type = TYPE_BOOL;
             lhs.data.b = invert ? ! value : value;
         }
@@ -505,34 +511,25 @@ namespace client
         static void min(expr &param1, expr &param2) { function_2params(param1, param2, FUNCTION_MIN); }
         static void max(expr &param1, expr &param2) { function_2params(param1, param2, FUNCTION_MAX); }
 
-        static void regex_op(expr &lhs, boost::iterator_range<Iterator> &rhs, char op)
+        // Match lhs with a regular expression compiled from the rhs source range. Store the result into lhs.
+        static void regex_op(expr &lhs, const SLIC3R_REGEX_NAMESPACE::regex &regex, const boost::iterator_range<Iterator> &rhs, char op)
         {
-            const std::string *subject  = nullptr;
-            const std::string *mask     = nullptr;
-            if (lhs.type == TYPE_STRING) {
-                // One type is string, the other could be converted to string.
-                subject = &lhs.s();
-            } else {
+            if (lhs.type != TYPE_STRING)
                 lhs.throw_exception("Left hand side of a regex match must be a string.");
-            }
             try {
-                std::string pattern(++ rhs.begin(), -- rhs.end());
-                bool result = SLIC3R_REGEX_NAMESPACE::regex_match(*subject, SLIC3R_REGEX_NAMESPACE::regex(pattern));
+                bool result = SLIC3R_REGEX_NAMESPACE::regex_match(lhs.s(), regex);
                 if (op == '!')
                     result = ! result;
                 lhs.reset();
                 lhs.type = TYPE_BOOL;
                 lhs.data.b = result;
             } catch (SLIC3R_REGEX_NAMESPACE::regex_error &ex) {
-                // Syntax error in the regular expression
+                // The regular expression is too complex for the subject.
                 boost::throw_exception(qi::expectation_failure<Iterator>(
-                    rhs.begin(), rhs.end(), spirit::info(std::string("*Regular expression compilation failed: ") + ex.what())));
+                    rhs.begin(), rhs.end(), spirit::info(std::string("*Regular expression matching failed: ") + ex.what())));
             }
         }
 
-        static void regex_matches     (expr &lhs, boost::iterator_range<Iterator> &rhs) { return regex_op(lhs, rhs, '='); }
-        static void regex_doesnt_match(expr &lhs, boost::iterator_range<Iterator> &rhs) { return regex_op(lhs, rhs, '!'); }
-
         static void logical_op(expr &lhs, expr &rhs, char op)
         {
             bool value = false;
@@ -548,25 +545,6 @@ namespace client
         static void logical_or (expr &lhs, expr &rhs) { logical_op(lhs, rhs, '|'); }
         static void logical_and(expr &lhs, expr &rhs) { logical_op(lhs, rhs, '&'); }
 
-        static void ternary_op(expr &lhs, expr &rhs1, expr &rhs2)
-        {
-            bool value = false;
-            if (lhs.type != TYPE_BOOL)
-                lhs.throw_exception("Not a boolean expression");
-            if (lhs.b())
-                lhs = std::move(rhs1);
-            else
-                lhs = std::move(rhs2);
-        }
-
-        static void set_if(bool &cond, bool &not_yet_consumed, std::string &str_in, std::string &str_out)
-        {
-            if (cond && not_yet_consumed) {
-                str_out = str_in;
-                not_yet_consumed = false;
-            }
-        }
-
         void throw_exception(const char *message) const 
         {
             boost::throw_exception(qi::expectation_failure<Iterator>(
@@ -596,6 +574,72 @@ namespace client
         return os;
     }
 
+    // Node of a macro compiled by the macro_processor grammar.
+    template<typename Iterator>
+    struct Node
+    {
+        enum Type {
+            // Free-form text enclosed by it_range.
+            TEXT,
+            // Concatenation of the children.
+            BLOCK,
+            // {if}{elsif}{else}{endif}: The children are pairs of a condition and a block, optionally followed by the {else} block.
+            IF,
+            // Legacy [scalar_variable] or [vector_variable_index] expansion.
+            // args: variable slot, slot of the vector variable without the index suffix or -1, the index or -1 if invalid.
+            LEGACY_VARIABLE,
+            // Legacy [vector_variable[index_variable]] expansion.
+            // args: variable slot, slot of the variable without the trailing '_' or -1, slot of the index variable.
+            LEGACY_VECTOR_VARIABLE,
+            // Expression converted to string. args: expression.
+            TO_STRING,
+            // Boolean expression converted to "true" or "false". args: expression.
+            BOOL_TO_STRING,
+            // Numeric, boolean or string literal. args: index into Program::constants.
+            CONSTANT,
+            // args: variable slot.
+            SCALAR_VARIABLE,
+            // args: SCALAR_VARIABLE node, index expression.
+            VECTOR_VARIABLE,
+            // Expression in parentheses or with the unary plus, enclosed by it_range. args: expression.
+            SUBEXPRESSION,
+            // Unary operators starting at it_range.begin(). args: expression.
+            UNARY_MINUS,
+            NOT,
+            // Binary operators. args: left hand side, right hand side.
+            ADD,
+            SUBTRACT,
+            MULTIPLY,
+            DIVIDE,
+            EQUAL,
+            NOT_EQUAL,
+            LOWER,
+            GREATER,
+            LEQ,
+            GEQ,
+            LOGICAL_OR,
+            LOGICAL_AND,
+            MIN,
+            MAX,
+            // Regular expression enclosed by it_range. args: left hand side, index into Program::regexes.
+            REGEX_MATCHES,
+            REGEX_DOESNT_MATCH,
+            // args: condition, expression if true, expression if false.
+            TERNARY,
+        };
+
+        Type                             type;
+        // Child nodes or indices into the Program tables, see the Type description.
+        int                              args[3];
+        // Range of the source template covered by this node. Used for the free-form text and for throwing exceptions.
+        boost::iterator_range<Iterator>  it_range;
+        // Child nodes of BLOCK and IF.
+        std::vector<int>                 children;
+    };
+
+    template<typename Iterator> struct Program;
+
+    // Evaluation of a compiled macro.
     struct MyContext {
         const DynamicConfig     *config                 = nullptr;
         const DynamicConfig     *config_override        = nullptr;
@@ -603,13 +647,12 @@ namespace client
         // If false, the macro_processor will evaluate a full macro.
         // If true, the macro processor will evaluate just a boolean condition using the full expressive power of the macro processor.
         bool                     just_boolean_expression = false;
-        std::string              error_message;
+        // Variables of the program being evaluated, indexed by the variable slot. Null if the variable does not exist.
+        std::vector<const ConfigOption*> variables;
 
         // Table to translate symbol tag to a human readable error message.
         static std::map<std::string, std::string> tag_to_error_message;
 
-        static void             evaluate_full_macro(const MyContext *ctx, bool &result) { result = ! ctx->just_boolean_expression; }
-
         const ConfigOption*     resolve_symbol(const std::string &opt_key) const
         {
             const ConfigOption *opt = nullptr;
@@ -620,84 +663,78 @@ namespace client
             return opt;
         }
 
+        // Look up the variables of the program once, so that the program does not search the configs by name for each reference.
         template <typename Iterator>
-        static void legacy_variable_expansion(
-            const MyContext                 *ctx, 
-            boost::iterator_range<Iterator> &opt_key,
-            std::string                     &output)
+        void resolve_variables(const Program<Iterator> &program)
         {
-            std::string         opt_key_str(opt_key.begin(), opt_key.end());
-            const ConfigOption *opt = ctx->resolve_symbol(opt_key_str);
-            size_t              idx = ctx->current_extruder_id;
-            if (opt == nullptr) {
+            this->variables.clear();
+            this->variables.reserve(program.variables.size());
+            for (const std::string &opt_key : program.variables)
+                this->variables.emplace_back(this->resolve_symbol(opt_key));
+        }
+
+        template <typename Iterator>
+        void legacy_variable_expansion(const Node<Iterator> &node, std::string &output) const
+        {
+            const ConfigOption *opt = this->variables[node.args[0]];
+            size_t              idx = this->current_extruder_id;
+            if (opt == nullptr && node.args[1] != -1) {
                 // Check whether this is a legacy vector indexing.
-                idx = opt_key_str.rfind('_');
-                if (idx != std::string::npos) {
-                    opt = ctx->resolve_symbol(opt_key_str.substr(0, idx));
-                    if (opt != nullptr) {
-                        if (! opt->is_vector())
-                            ctx->throw_exception("Trying to index a scalar variable", opt_key);
-                        char *endptr = nullptr;
-                        idx = strtol(opt_key_str.c_str() + idx + 1, &endptr, 10);
-                        if (endptr == nullptr || *endptr != 0)
-                            ctx->throw_exception("Invalid vector index", boost::iterator_range<Iterator>(opt_key.begin() + idx + 1, opt_key.end()));
+                opt = this->variables[node.args[1]];
+                if (opt != nullptr) {
+                    if (! opt->is_vector())
+                        throw_exception("Trying to index a scalar variable", node.it_range);
+                    if (node.args[2] == -1) {
+                        std::string opt_key_str(node.it_range.begin(), node.it_range.end());
+                        throw_exception("Invalid vector index", boost::iterator_range<Iterator>(node.it_range.begin() + opt_key_str.rfind('_') + 1, node.it_range.end()));
                     }
+                    idx = size_t(node.args[2]);
                 }
             }
             if (opt == nullptr)
-                ctx->throw_exception("Variable does not exist", boost::iterator_range<Iterator>(opt_key.begin(), opt_key.end()));
+                throw_exception("Variable does not exist", node.it_range);
             if (opt->is_scalar())
-                output = opt->serialize();
+                output += opt->serialize();
             else {
                 const ConfigOptionVectorBase *vec = static_cast<const ConfigOptionVectorBase*>(opt);
                 if (vec->empty())
-                    ctx->throw_exception("Indexing an empty vector variable", opt_key);
-                output = vec->vserialize()[(idx >= vec->size()) ? 0 : idx];
+                    throw_exception("Indexing an empty vector variable", node.it_range);
+                output += vec->vserialize()[(idx >= vec->size()) ? 0 : idx];
             }
         }
 
         template <typename Iterator>
-        static void legacy_variable_expansion2(
-            const MyContext                 *ctx, 
-            boost::iterator_range<Iterator> &opt_key,
-            boost::iterator_range<Iterator> &opt_vector_index,
-            std::string                     &output)
+        void legacy_variable_expansion2(const Node<Iterator> &node, std::string &output) const
         {
-            std::string         opt_key_str(opt_key.begin(), opt_key.end());
-            const ConfigOption *opt = ctx->resolve_symbol(opt_key_str);
-            if (opt == nullptr) {
-                // Check whether the opt_key ends with '_'.
-                if (opt_key_str.back() == '_')
-                    opt_key_str.resize(opt_key_str.size() - 1);
-                opt = ctx->resolve_symbol(opt_key_str);
-            }
+            const ConfigOption *opt = this->variables[node.args[0]];
+            if (opt == nullptr && node.args[1] != -1)
+                // Try the variable name without the trailing '_'.
+                opt = this->variables[node.args[1]];
+            if (opt == nullptr)
+                throw_exception("Variable does not exist", node.it_range);
             if (! opt->is_vector())
-                ctx->throw_exception("Trying to index a scalar variable", opt_key);
+                throw_exception("Trying to index a scalar variable", node.it_range);
             const ConfigOptionVectorBase *vec = static_cast<const ConfigOptionVectorBase*>(opt);
             if (vec->empty())
-                ctx->throw_exception("Indexing an empty vector variable", boost::iterator_range<Iterator>(opt_key.begin(), opt_key.end()));
-            const ConfigOption *opt_index = ctx->resolve_symbol(std::string(opt_vector_index.begin(), opt_vector_index.end()));
+                throw_exception("Indexing an empty vector variable", node.it_range);
+            const ConfigOption *opt_index = this->variables[node.args[2]];
             if (opt_index == nullptr)
-                ctx->throw_exception("Variable does not exist", opt_key);
+                throw_exception("Variable does not exist", node.it_range);
             if (opt_index->type() != coInt)
-                ctx->throw_exception("Indexing variable has to be integer", opt_key);
+                throw_exception("Indexing variable has to be integer", node.it_range);
 			int idx = opt_index->getInt();
 			if (idx < 0)
-                ctx->throw_exception("Negative vector index", opt_key);
-			output = vec->vserialize()[(idx >= (int)vec->size()) ? 0 : idx];
+                throw_exception("Negative vector index", node.it_range);
+			output += vec->vserialize()[(idx >= (int)vec->size()) ? 0 : idx];
         }
 
         template <typename Iterator>
-        static void resolve_variable(
-            const MyContext                 *ctx,
-            boost::iterator_range<Iterator> &opt_key,
-            OptWithPos<Iterator>            &output)
+        OptWithPos<Iterator> resolve_variable(const Node<Iterator> &node) const
         {
-            const ConfigOption *opt = ctx->resolve_symbol(std::string(opt_key.begin(), opt_key.end()));
+            const ConfigOption *opt = this->variables[node.args[0]];
             if (opt == nullptr)
-                ctx->throw_exception("Not a variable name", opt_key);
-            output.opt = opt;
-            output.it_range = opt_key;
+                throw_exception("Not a variable name", node.it_range);
+            return OptWithPos<Iterator>(opt, node.it_range);
         }
 
         template <typename Iterator>
@@ -769,9 +806,8 @@ namespace client
         }
 
         template <typename Iterator>
-        static void process_error_message(const MyContext *context, const boost::spirit::info &info, const Iterator &it_begin, const Iterator &it_end, const Iterator &it_error)
+        static void process_error_message(std::string &msg, const boost::spirit::info &info, const Iterator &it_begin, const Iterator &it_end, const Iterator &it_error)
         {
-            std::string &msg = const_cast<MyContext*>(context)->error_message;
             std::string  first(it_begin, it_error);
             std::string  last(it_error, it_end);
             auto         first_pos  = first.rfind('\n');
@@ -813,6 +849,132 @@ namespace client
                 msg += ' ';
             msg += "^\n";
         }
+
+        // Evaluate a text node, append the result to output.
+        template <typename Iterator>
+        void evaluate_text(const Program<Iterator> &program, int node_id, std::string &output) const
+        {
+            typedef client::Node<Iterator> Node;
+            const Node &node = program.nodes[node_id];
+            switch (node.type) {
+            case Node::TEXT:
+                output.append(node.it_range.begin(), node.it_range.end());
+                break;
+            case Node::BLOCK:
+                for (int child : node.children)
+                    this->evaluate_text(program, child, output);
+                break;
+            case Node::IF:
+            {
+                // Only the conditions up to the first satisfied one and the selected block are evaluated.
+                size_t i = 0;
+                for (; i + 1 < node.children.size(); i += 2) {
+                    expr<Iterator> condition = this->evaluate(program, node.children[i]);
+                    bool           value     = false;
+                    expr<Iterator>::evaluate_boolean(condition, value);
+                    if (value)
+                        break;
+                }
+                if (i < node.children.size())
+                    // Either the block of a satisfied condition, or the {else} block.
+                    this->evaluate_text(program, node.children[(i + 1 < node.children.size()) ? i + 1 : i], output);
+                break;
+            }
+            case Node::LEGACY_VARIABLE:
+                this->legacy_variable_expansion(node, output);
+                break;
+            case Node::LEGACY_VECTOR_VARIABLE:
+                this->legacy_variable_expansion2(node, output);
+                break;
+            case Node::TO_STRING:
+                output += this->evaluate(program, node.args[0]).to_string();
+                break;
+            case Node::BOOL_TO_STRING:
+            {
+                expr<Iterator> value = this->evaluate(program, node.args[0]);
+                std::string    out;
+                expr<Iterator>::evaluate_boolean_to_string(value, out);
+                output += out;
+                break;
+            }
+            default:
+                assert(false);
+            }
+        }
+
+        // Evaluate an expression node.
+        template <typename Iterator>
+        expr<Iterator> evaluate(const Program<Iterator> &program, int node_id) const
+        {
+            typedef client::Node<Iterator> Node;
+            typedef expr<Iterator>         Expr;
+            const Node &node = program.nodes[node_id];
+            switch (node.type) {
+            case Node::CONSTANT:
+                return program.constants[node.args[0]];
+            case Node::SCALAR_VARIABLE:
+            {
+                OptWithPos<Iterator> opt = this->resolve_variable(node);
+                Expr                 out;
+                scalar_variable_reference(this, opt, out);
+                return out;
+            }
+            case Node::VECTOR_VARIABLE:
+            {
+                OptWithPos<Iterator> opt        = this->resolve_variable(program.nodes[node.args[0]]);
+                Expr                 expr_index = this->evaluate(program, node.args[1]);
+                int                  index      = 0;
+                evaluate_index(expr_index, index);
+                Expr                 out;
+                vector_variable_reference(this, opt, index, node.it_range.end(), out);
+                return out;
+            }
+            case Node::SUBEXPRESSION:
+                return Expr(this->evaluate(program, node.args[0]), node.it_range.begin(), node.it_range.end());
+            case Node::UNARY_MINUS:
+                return this->evaluate(program, node.args[0]).unary_minus(node.it_range.begin());
+            case Node::NOT:
+                return this->evaluate(program, node.args[0]).unary_not(node.it_range.begin());
+            case Node::REGEX_MATCHES:
+            case Node::REGEX_DOESNT_MATCH:
+            {
+                Expr lhs = this->evaluate(program, node.args[0]);
+                Expr::regex_op(lhs, program.regexes[node.args[1]], node.it_range, (node.type == Node::REGEX_MATCHES) ? '=' : '!');
+                return lhs;
+            }
+            case Node::TERNARY:
+            {
+                Expr condition = this->evaluate(program, node.args[0]);
+                if (condition.type != Expr::TYPE_BOOL)
+                    condition.throw_exception("Not a boolean expression");
+                // Only the selected branch is evaluated.
+                return this->evaluate(program, node.args[condition.b() ? 1 : 2]);
+            }
+            default:
+                break;
+            }
+            // Binary operators, store the result into lhs.
+            Expr lhs = this->evaluate(program, node.args[0]);
+            Expr rhs = this->evaluate(program, node.args[1]);
+            switch (node.type) {
+            case Node::ADD:         lhs += rhs; break;
+            case Node::SUBTRACT:    lhs -= rhs; break;
+            case Node::MULTIPLY:    lhs *= rhs; break;
+            case Node::DIVIDE:      lhs /= rhs; break;
+            case Node::EQUAL:       Expr::equal(lhs, rhs); break;
+            case Node::NOT_EQUAL:   Expr::not_equal(lhs, rhs); break;
+            case Node::LOWER:       Expr::lower(lhs, rhs); break;
+            case Node::GREATER:     Expr::greater(lhs, rhs); break;
+            case Node::LEQ:         Expr::leq(lhs, rhs); break;
+            case Node::GEQ:         Expr::geq(lhs, rhs); break;
+            case Node::LOGICAL_OR:  Expr::logical_or(lhs, rhs); break;
+            case Node::LOGICAL_AND: Expr::logical_and(lhs, rhs); break;
+            case Node::MIN:         Expr::min(lhs, rhs); break;
+            case Node::MAX:         Expr::max(lhs, rhs); break;
+            default:                assert(false);
+            }
+            return lhs;
+        }
     };
 
     // Table to translate symbol tag to a human readable error message.
@@ -840,6 +1002,136 @@ namespace client
         { "regular_expression",         "Expecting a regular expression."}
     };
 
+    // Macro compiled by the macro_processor grammar into a tree of nodes. The program is compiled once per template
+    // and then evaluated by MyContext for each set of variables.
+    template<typename Iterator>
+    struct Program
+    {
+        typedef client::Node<Iterator>  Node;
+        typedef typename Node::Type     NodeType;
+
+        Program(const std::string &templ, bool just_boolean_expression) : templ(templ), just_boolean_expression(just_boolean_expression) {}
+        // The nodes point into templ, therefore the program shall not be copied.
+        Program(const Program&) = delete;
+        Program& operator=(const Program&) = delete;
+
+        // Source of the macro.
+        const std::string                           templ;
+        // If false, the macro_processor will compile a full macro.
+        // If true, the macro processor will compile just a boolean condition using the full expressive power of the macro processor.
+        const bool                                  just_boolean_expression;
+        std::vector<Node>                           nodes;
+        // Literals referenced by the CONSTANT nodes.
+        std::vector<expr<Iterator>>                 constants;
+        // Names of the variables referenced by the program, indexed by the variable slot.
+        std::vector<std::string>                    variables;
+        // Regular expressions referenced by the REGEX_MATCHES / REGEX_DOESNT_MATCH nodes.
+        std::vector<SLIC3R_REGEX_NAMESPACE::regex>  regexes;
+        // Root text node, -1 if the compilation failed.
+        int                                         root = -1;
+        // Syntax errors, empty if the compilation succeeded.
+        std::string                                 error_message;
+
+        int add_node(NodeType type, int arg0 = -1, int arg1 = -1, int arg2 = -1,
+            const boost::iterator_range<Iterator> &it_range = boost::iterator_range<Iterator>())
+        {
+            Node node;
+            node.type     = type;
+            node.args[0]  = arg0;
+            node.args[1]  = arg1;
+            node.args[2]  = arg2;
+            node.it_range = it_range;
+            this->nodes.emplace_back(std::move(node));
+            return int(this->nodes.size()) - 1;
+        }
+
+        int add_constant(expr<Iterator> &&value)
+        {
+            this->constants.emplace_back(std::move(value));
+            return this->add_node(Node::CONSTANT, int(this->constants.size()) - 1);
+        }
+
+        int variable_slot(const std::string &opt_key)
+        {
+            auto it = std::find(this->variables.begin(), this->variables.end(), opt_key);
+            if (it != this->variables.end())
+                return int(it - this->variables.begin());
+            this->variables.emplace_back(opt_key);
+            return int(this->variables.size()) - 1;
+        }
+
+        // Semantic actions of the macro_processor grammar.
+        // As the grammar back tracks, some of the nodes may end up not being referenced by the root node.
+        static void evaluate_full_macro(const Program *program, bool &result) { result = ! program->just_boolean_expression; }
+
+        static void new_node(Program *program, NodeType type, int &out) { out = program->add_node(type); }
+        static void add_child(Program *program, int &parent, int &child) { program->nodes[parent].children.emplace_back(child); }
+        static void add_text(Program *program, int &block, boost::iterator_range<Iterator> &text)
+        {
+            // add_node() may reallocate the nodes.
+            int node = program->add_node(Node::TEXT, -1, -1, -1, text);
+            program->nodes[block].children.emplace_back(node);
+        }
+        static void unary_op(Program *program, NodeType type, int &arg, int &out) { out = program->add_node(type, arg); }
+        // Store the result into lhs.
+        static void binary_op(Program *program, NodeType type, int &lhs, int &rhs) { lhs = program->add_node(type, lhs, rhs); }
+        static void ternary_op(Program *program, int &lhs, int &rhs1, int &rhs2) { lhs = program->add_node(Node::TERNARY, lhs, rhs1, rhs2); }
+
+        // Compile the regular expression enclosed in // at rhs, store the result into lhs.
+        static void regex_op(Program *program, NodeType type, int &lhs, boost::iterator_range<Iterator> &rhs)
+        {
+            try {
+                program->regexes.emplace_back(std::string(rhs.begin() + 1, rhs.end() - 1));
+            } catch (SLIC3R_REGEX_NAMESPACE::regex_error &ex) {
+                // Syntax error in the regular expression
+                boost::throw_exception(qi::expectation_failure<Iterator>(
+                    rhs.begin(), rhs.end(), spirit::info(std::string("*Regular expression compilation failed: ") + ex.what())));
+            }
+            lhs = program->add_node(type, lhs, int(program->regexes.size()) - 1, -1, rhs);
+        }
+
+        static void variable_reference(Program *program, boost::iterator_range<Iterator> &opt_key, int &out)
+            { out = program->add_node(Node::SCALAR_VARIABLE, program->variable_slot(std::string(opt_key.begin(), opt_key.end())), -1, -1, opt_key); }
+
+        // Turn the variable reference into a reference of a vector item.
+        static void vector_variable_reference(Program *program, int &variable, int &index, Iterator &it_end)
+        {
+            boost::iterator_range<Iterator> it_range(program->nodes[variable].it_range.begin(), it_end);
+            variable = program->add_node(Node::VECTOR_VARIABLE, variable, index, -1, it_range);
+        }
+
+        static void legacy_variable_expansion(Program *program, boost::iterator_range<Iterator> &opt_key, int &out)
+        {
+            std::string opt_key_str(opt_key.begin(), opt_key.end());
+            int         slot        = program->variable_slot(opt_key_str);
+            int         slot_vector = -1;
+            int         idx         = -1;
+            // Legacy vector indexing in the form of [vector_variable_index].
+            size_t      pos         = opt_key_str.rfind('_');
+            if (pos != std::string::npos) {
+                slot_vector = program->variable_slot(opt_key_str.substr(0, pos));
+                char *endptr = nullptr;
+                long  value  = strtol(opt_key_str.c_str() + pos + 1, &endptr, 10);
+                if (endptr != nullptr && *endptr == 0)
+                    // A negative index addresses the first item as an index out of range does.
+                    idx = (value < 0 || value > long(std::numeric_limits<int>::max())) ? std::numeric_limits<int>::max() : int(value);
+            }
+            out = program->add_node(Node::LEGACY_VARIABLE, slot, slot_vector, idx, opt_key);
+        }
+
+        static void legacy_variable_expansion2(Program *program, boost::iterator_range<Iterator> &opt_key, boost::iterator_range<Iterator> &opt_vector_index, int &out)
+        {
+            std::string opt_key_str(opt_key.begin(), opt_key.end());
+            int         slot        = program->variable_slot(opt_key_str);
+            int         slot_alt    = (opt_key_str.back() == '_') ? program->variable_slot(opt_key_str.substr(0, opt_key_str.size() - 1)) : -1;
+            out = program->add_node(Node::LEGACY_VECTOR_VARIABLE, slot, slot_alt, 
+                program->variable_slot(std::string(opt_vector_index.begin(), opt_vector_index.end())), opt_key);
+        }
+
+        static void process_error_message(Program *program, const boost::spirit::info &info, const Iterator &it_begin, const Iterator &it_end, const Iterator &it_error)
+            { MyContext::process_error_message(program->error_message, info, it_begin, it_end, it_error); }
+    };
+
     // For debugging the boost::spirit parsers. Print out the string enclosed in it_range.
     template<typename Iterator>
     std::ostream& operator<<(std::ostream& os, const boost::iterator_range<Iterator> &it_range)
@@ -922,8 +1214,9 @@ namespace client
     //  Our macro_processor grammar
     ///////////////////////////////////////////////////////////////////////////
     // Inspired by the C grammar rules https://www.lysator.liu.se/c/ANSI-C-grammar-y.html
+    // The grammar compiles the macro into a Program, the Program is then evaluated by MyContext.
     template <typename Iterator>
-    struct macro_processor : qi::grammar<Iterator, std::string(const MyContext*), qi::locals<bool>, spirit::ascii::space_type>
+    struct macro_processor : qi::grammar<Iterator, int(Program<Iterator>*), qi::locals<bool>, spirit::ascii::space_type>
     {
         macro_processor() : macro_processor::base_type(start)
         {
@@ -952,29 +1245,32 @@ namespace client
             qi::_3_type                 _3;
             qi::_4_type                 _4;
             qi::_a_type                 _a;
-            qi::_b_type                 _b;
             qi::_r1_type                _r1;
 
+            typedef Program<Iterator>   Program;
+            typedef Node<Iterator>      Node;
+
             // Starting symbol of the grammer.
             // The leading eps is required by the "expectation point" operator ">".
             // Without it, some of the errors would not trigger the error handler.
             // Also the start symbol switches between the "full macro syntax" and a "boolean expression only",
-            // depending on the context->just_boolean_expression flag. This way a single static expression parser
+            // depending on the program->just_boolean_expression flag. This way a single static expression parser
             // could serve both purposes.
-            start = eps[px::bind(&MyContext::evaluate_full_macro, _r1, _a)] >
+            start = eps[px::bind(&Program::evaluate_full_macro, _r1, _a)] >
                 (       eps(_a==true) > text_block(_r1) [_val=_1]
-                    |   conditional_expression(_r1) [ px::bind(&expr<Iterator>::evaluate_boolean_to_string, _1, _val) ]
+                    |   conditional_expression(_r1) [ px::bind(&Program::unary_op, _r1, Node::BOOL_TO_STRING, _1, _val) ]
 				) > eoi;
             start.name("start");
-            qi::on_error<qi::fail>(start, px::bind(&MyContext::process_error_message<Iterator>, _r1, _4, _1, _2, _3));
+            qi::on_error<qi::fail>(start, px::bind(&Program::process_error_message, _r1, _4, _1, _2, _3));
 
-            text_block = *(
-                        text [_val+=_1]
+            // The leading eps shall not skip the white spaces, they belong to the text.
+            text_block = no_skip[eps[px::bind(&Program::new_node, _r1, Node::BLOCK, _val)]] >> *(
+                        text [px::bind(&Program::add_text, _r1, _val, _1)]
                         // Allow back tracking after '{' in case of a text_block embedded inside a condition.
                         // In that case the inner-most {else} wins and the {if}/{elsif}/{else} shall be paired.
                         // {elsif}/{else} without an {if} will be allowed to back track from the embedded text_block.
-                    |   (lit('{') >> macro(_r1) [_val+=_1] > '}')
-                    |   (lit('[') > legacy_variable_expansion(_r1) [_val+=_1] > ']')
+                    |   (lit('{') >> macro(_r1) [px::bind(&Program::add_child, _r1, _val, _1)] > '}')
+                    |   (lit('[') > legacy_variable_expansion(_r1) [px::bind(&Program::add_child, _r1, _val, _1)] > ']')
                 );
             text_block.name("text_block");
 
@@ -988,18 +1284,19 @@ namespace client
             macro =
                     (kw["if"]     > if_else_output(_r1) [_val = _1])
 //                |   (kw["switch"] > switch_output(_r1)  [_val = _1])
-                |   additive_expression(_r1) [ px::bind(&expr<Iterator>::to_string2, _1, _val) ];
+                |   additive_expression(_r1) [ px::bind(&Program::unary_op, _r1, Node::TO_STRING, _1, _val) ];
             macro.name("macro");
 
             // An if expression enclosed in {} (the outmost {} are already parsed by the caller).
+            // The conditions and blocks are collected as children of the IF node.
             if_else_output =
-                eps[_b=true] >
-                bool_expr_eval(_r1)[_a=_1] > '}' > 
-                    text_block(_r1)[px::bind(&expr<Iterator>::set_if, _a, _b, _1, _val)] > '{' >
-                *(kw["elsif"] > bool_expr_eval(_r1)[_a=_1] > '}' > 
-                    text_block(_r1)[px::bind(&expr<Iterator>::set_if, _a, _b, _1, _val)] > '{') >
+                eps[px::bind(&Program::new_node, _r1, Node::IF, _val)] >
+                bool_expr_eval(_r1)[px::bind(&Program::add_child, _r1, _val, _1)] > '}' > 
+                    text_block(_r1)[px::bind(&Program::add_child, _r1, _val, _1)] > '{' >
+                *(kw["elsif"] > bool_expr_eval(_r1)[px::bind(&Program::add_child, _r1, _val, _1)] > '}' > 
+                    text_block(_r1)[px::bind(&Program::add_child, _r1, _val, _1)] > '{') >
                 -(kw["else"] > lit('}') > 
-                    text_block(_r1)[px::bind(&expr<Iterator>::set_if, _b, _b, _1, _val)] > '{') >
+                    text_block(_r1)[px::bind(&Program::add_child, _r1, _val, _1)] > '{') >
                 kw["endif"];
             if_else_output.name("if_else_output");
             // A switch expression enclosed in {} (the outmost {} are already parsed by the caller).
@@ -1015,9 +1312,9 @@ namespace client
             // Legacy variable expansion of the original Slic3r, in the form of [scalar_variable] or [vector_variable_index].
             legacy_variable_expansion =
                     (identifier >> &lit(']'))
-                        [ px::bind(&MyContext::legacy_variable_expansion<Iterator>, _r1, _1, _val) ]
+                        [ px::bind(&Program::legacy_variable_expansion, _r1, _1, _val) ]
                 |   (identifier > lit('[') > identifier > ']') 
-                        [ px::bind(&MyContext::legacy_variable_expansion2<Iterator>, _r1, _1, _2, _val) ]
+                        [ px::bind(&Program::legacy_variable_expansion2, _r1, _1, _2, _val) ]
                 ;
             legacy_variable_expansion.name("legacy_variable_expansion");
 
@@ -1028,104 +1325,103 @@ namespace client
 
             conditional_expression =
                 logical_or_expression(_r1)                [_val = _1]
-                >> -('?' > conditional_expression(_r1) > ':' > conditional_expression(_r1)) [px::bind(&expr<Iterator>::ternary_op, _val, _1, _2)];
+                >> -('?' > conditional_expression(_r1) > ':' > conditional_expression(_r1)) [px::bind(&Program::ternary_op, _r1, _val, _1, _2)];
             conditional_expression.name("conditional_expression");
 
             logical_or_expression = 
                 logical_and_expression(_r1)                [_val = _1]
-                >> *(   ((kw["or"] | "||") > logical_and_expression(_r1) ) [px::bind(&expr<Iterator>::logical_or, _val, _1)] );
+                >> *(   ((kw["or"] | "||") > logical_and_expression(_r1) ) [px::bind(&Program::binary_op, _r1, Node::LOGICAL_OR, _val, _1)] );
             logical_or_expression.name("logical_or_expression");
 
             logical_and_expression = 
                 equality_expression(_r1)                   [_val = _1]
-                >> *(   ((kw["and"] | "&&") > equality_expression(_r1) ) [px::bind(&expr<Iterator>::logical_and, _val, _1)] );
+                >> *(   ((kw["and"] | "&&") > equality_expression(_r1) ) [px::bind(&Program::binary_op, _r1, Node::LOGICAL_AND, _val, _1)] );
             logical_and_expression.name("logical_and_expression");
 
             equality_expression =
                 relational_expression(_r1)                   [_val = _1]
-                >> *(   ("==" > relational_expression(_r1) ) [px::bind(&expr<Iterator>::equal,     _val, _1)]
-                    |   ("!=" > relational_expression(_r1) ) [px::bind(&expr<Iterator>::not_equal, _val, _1)]
-                    |   ("<>" > relational_expression(_r1) ) [px::bind(&expr<Iterator>::not_equal, _val, _1)]
-                    |   ("=~" > regular_expression         ) [px::bind(&expr<Iterator>::regex_matches, _val, _1)]
-                    |   ("!~" > regular_expression         ) [px::bind(&expr<Iterator>::regex_doesnt_match, _val, _1)]
+                >> *(   ("==" > relational_expression(_r1) ) [px::bind(&Program::binary_op, _r1, Node::EQUAL,     _val, _1)]
+                    |   ("!=" > relational_expression(_r1) ) [px::bind(&Program::binary_op, _r1, Node::NOT_EQUAL, _val, _1)]
+                    |   ("<>" > relational_expression(_r1) ) [px::bind(&Program::binary_op, _r1, Node::NOT_EQUAL, _val, _1)]
+                    |   ("=~" > regular_expression         ) [px::bind(&Program::regex_op, _r1, Node::REGEX_MATCHES, _val, _1)]
+                    |   ("!~" > regular_expression         ) [px::bind(&Program::regex_op, _r1, Node::REGEX_DOESNT_MATCH, _val, _1)]
                     );
             equality_expression.name("bool expression");
 
-            // Evaluate a boolean expression stored as expr into a boolean value.
-            // Throw if the equality_expression does not produce a expr of boolean type.
-            bool_expr_eval = conditional_expression(_r1) [ px::bind(&expr<Iterator>::evaluate_boolean, _1, _val) ];
+            // A boolean expression. The evaluation throws if the expression does not produce a expr of boolean type.
+            bool_expr_eval = conditional_expression(_r1) [ _val = _1 ];
             bool_expr_eval.name("bool_expr_eval");
 
             relational_expression = 
                     additive_expression(_r1)                [_val  = _1]
-                >> *(   ("<="     > additive_expression(_r1) ) [px::bind(&expr<Iterator>::leq,     _val, _1)]
-                    |   (">="     > additive_expression(_r1) ) [px::bind(&expr<Iterator>::geq,     _val, _1)]
-                    |   (lit('<') > additive_expression(_r1) ) [px::bind(&expr<Iterator>::lower,   _val, _1)]
-                    |   (lit('>') > additive_expression(_r1) ) [px::bind(&expr<Iterator>::greater, _val, _1)]
+                >> *(   ("<="     > additive_expression(_r1) ) [px::bind(&Program::binary_op, _r1, Node::LEQ,     _val, _1)]
+                    |   (">="     > additive_expression(_r1) ) [px::bind(&Program::binary_op, _r1, Node::GEQ,     _val, _1)]
+                    |   (lit('<') > additive_expression(_r1) ) [px::bind(&Program::binary_op, _r1, Node::LOWER,   _val, _1)]
+                    |   (lit('>') > additive_expression(_r1) ) [px::bind(&Program::binary_op, _r1, Node::GREATER, _val, _1)]
                     );
             relational_expression.name("relational_expression");
 
             additive_expression =
                 multiplicative_expression(_r1)                       [_val  = _1]
-                >> *(   (lit('+') > multiplicative_expression(_r1) ) [_val += _1]
-                    |   (lit('-') > multiplicative_expression(_r1) ) [_val -= _1]
+                >> *(   (lit('+') > multiplicative_expression(_r1) ) [px::bind(&Program::binary_op, _r1, Node::ADD,      _val, _1)]
+                    |   (lit('-') > multiplicative_expression(_r1) ) [px::bind(&Program::binary_op, _r1, Node::SUBTRACT, _val, _1)]
                     );
             additive_expression.name("additive_expression");
 
             multiplicative_expression =
                 unary_expression(_r1)                       [_val  = _1]
-                >> *(   (lit('*') > unary_expression(_r1) ) [_val *= _1]
-                    |   (lit('/') > unary_expression(_r1) ) [_val /= _1]
+                >> *(   (lit('*') > unary_expression(_r1) ) [px::bind(&Program::binary_op, _r1, Node::MULTIPLY, _val, _1)]
+                    |   (lit('/') > unary_expression(_r1) ) [px::bind(&Program::binary_op, _r1, Node::DIVIDE,   _val, _1)]
                     );
             multiplicative_expression.name("multiplicative_expression");
 
             struct FactorActions {
-                static void set_start_pos(Iterator &start_pos, expr<Iterator> &out)
-                        { out.it_range = boost::iterator_range<Iterator>(start_pos, start_pos); }
-                static void int_(int &value, Iterator &end_pos, expr<Iterator> &out)
-                        { out = expr<Iterator>(value, out.it_range.begin(), end_pos); }
-                static void double_(double &value, Iterator &end_pos, expr<Iterator> &out)
-                        { out = expr<Iterator>(value, out.it_range.begin(), end_pos); }
-                static void bool_(bool &value, Iterator &end_pos, expr<Iterator> &out)
-                        { out = expr<Iterator>(value, out.it_range.begin(), end_pos); }
-                static void string_(boost::iterator_range<Iterator> &it_range, expr<Iterator> &out)
-                        { out = expr<Iterator>(std::string(it_range.begin() + 1, it_range.end() - 1), it_range.begin(), it_range.end()); }
-                static void expr_(expr<Iterator> &value, Iterator &end_pos, expr<Iterator> &out)
-                        { out = expr<Iterator>(std::move(value), out.it_range.begin(), end_pos); }
-                static void minus_(expr<Iterator> &value, expr<Iterator> &out)
-                        { out = value.unary_minus(out.it_range.begin()); }
-                static void not_(expr<Iterator> &value, expr<Iterator> &out)
-                        { out = value.unary_not(out.it_range.begin()); }
+                static void set_start_pos(Iterator &start_pos, boost::iterator_range<Iterator> &out)
+                        { out = boost::iterator_range<Iterator>(start_pos, start_pos); }
+                static void int_(Program *program, int &value, const boost::iterator_range<Iterator> &start_pos, Iterator &end_pos, int &out)
+                        { out = program->add_constant(expr<Iterator>(value, start_pos.begin(), end_pos)); }
+                static void double_(Program *program, double &value, const boost::iterator_range<Iterator> &start_pos, Iterator &end_pos, int &out)
+                        { out = program->add_constant(expr<Iterator>(value, start_pos.begin(), end_pos)); }
+                static void bool_(Program *program, bool &value, const boost::iterator_range<Iterator> &start_pos, Iterator &end_pos, int &out)
+                        { out = program->add_constant(expr<Iterator>(value, start_pos.begin(), end_pos)); }
+                static void string_(Program *program, boost::iterator_range<Iterator> &it_range, int &out)
+                        { out = program->add_constant(expr<Iterator>(std::string(it_range.begin() + 1, it_range.end() - 1), it_range.begin(), it_range.end())); }
+                static void expr_(Program *program, int &value, const boost::iterator_range<Iterator> &start_pos, Iterator &end_pos, int &out)
+                        { out = program->add_node(Node::SUBEXPRESSION, value, -1, -1, boost::iterator_range<Iterator>(start_pos.begin(), end_pos)); }
+                static void minus_(Program *program, int &value, const boost::iterator_range<Iterator> &start_pos, int &out)
+                        { out = program->add_node(Node::UNARY_MINUS, value, -1, -1, start_pos); }
+                static void not_(Program *program, int &value, const boost::iterator_range<Iterator> &start_pos, int &out)
+                        { out = program->add_node(Node::NOT, value, -1, -1, start_pos); }
             };
-            unary_expression = iter_pos[px::bind(&FactorActions::set_start_pos, _1, _val)] >> (
+            unary_expression = iter_pos[px::bind(&FactorActions::set_start_pos, _1, _a)] >> (
                     scalar_variable_reference(_r1)                  [ _val = _1 ]
-                |   (lit('(')  > conditional_expression(_r1) > ')' > iter_pos) [ px::bind(&FactorActions::expr_, _1, _2, _val) ]
-                |   (lit('-')  > unary_expression(_r1)           )  [ px::bind(&FactorActions::minus_,  _1,     _val) ]
-                |   (lit('+')  > unary_expression(_r1) > iter_pos)  [ px::bind(&FactorActions::expr_,   _1, _2, _val) ]
-                |   ((kw["not"] | '!') > unary_expression(_r1) > iter_pos) [ px::bind(&FactorActions::not_, _1, _val) ]
+                |   (lit('(')  > conditional_expression(_r1) > ')' > iter_pos) [ px::bind(&FactorActions::expr_, _r1, _1, _a, _2, _val) ]
+                |   (lit('-')  > unary_expression(_r1)           )  [ px::bind(&FactorActions::minus_,  _r1, _1, _a,     _val) ]
+                |   (lit('+')  > unary_expression(_r1) > iter_pos)  [ px::bind(&FactorActions::expr_,   _r1, _1, _a, _2, _val) ]
+                |   ((kw["not"] | '!') > unary_expression(_r1) > iter_pos) [ px::bind(&FactorActions::not_, _r1, _1, _a, _val) ]
                 |   (kw["min"] > '(' > conditional_expression(_r1) [_val = _1] > ',' > conditional_expression(_r1) > ')') 
-                                                                    [ px::bind(&expr<Iterator>::min, _val, _2) ]
+                                                                    [ px::bind(&Program::binary_op, _r1, Node::MIN, _val, _2) ]
                 |   (kw["max"] > '(' > conditional_expression(_r1) [_val = _1] > ',' > conditional_expression(_r1) > ')') 
-                                                                    [ px::bind(&expr<Iterator>::max, _val, _2) ]
-                |   (strict_double > iter_pos)                      [ px::bind(&FactorActions::double_, _1, _2, _val) ]
-                |   (int_      > iter_pos)                          [ px::bind(&FactorActions::int_,    _1, _2, _val) ]
-                |   (kw[bool_] > iter_pos)                          [ px::bind(&FactorActions::bool_,   _1, _2, _val) ]
+                                                                    [ px::bind(&Program::binary_op, _r1, Node::MAX, _val, _2) ]
+                |   (strict_double > iter_pos)                      [ px::bind(&FactorActions::double_, _r1, _1, _a, _2, _val) ]
+                |   (int_      > iter_pos)                          [ px::bind(&FactorActions::int_,    _r1, _1, _a, _2, _val) ]
+                |   (kw[bool_] > iter_pos)                          [ px::bind(&FactorActions::bool_,   _r1, _1, _a, _2, _val) ]
                 |   raw[lexeme['"' > *((utf8char - char_('\\') - char_('"')) | ('\\' > char_)) > '"']]
-                                                                    [ px::bind(&FactorActions::string_, _1,     _val) ]
+                                                                    [ px::bind(&FactorActions::string_, _r1, _1,     _val) ]
                 );
             unary_expression.name("unary_expression");
 
             scalar_variable_reference = 
-                variable_reference(_r1)[_a=_1] >>
+                variable_reference(_r1)[_val=_1] >>
                 (
-                        ('[' > additive_expression(_r1)[px::bind(&MyContext::evaluate_index<Iterator>, _1, _b)] > ']' > 
-                            iter_pos[px::bind(&MyContext::vector_variable_reference<Iterator>, _r1, _a, _b, _1, _val)])
-                    |   eps[px::bind(&MyContext::scalar_variable_reference<Iterator>, _r1, _a, _val)]
+                        ('[' > additive_expression(_r1)[_a=_1] > ']' > 
+                            iter_pos[px::bind(&Program::vector_variable_reference, _r1, _val, _a, _1)])
+                    |   eps
                 );
             scalar_variable_reference.name("scalar variable reference");
 
             variable_reference = identifier
-                [ px::bind(&MyContext::resolve_variable<Iterator>, _r1, _1, _val) ];
+                [ px::bind(&Program::variable_reference, _r1, _1, _val) ];
             variable_reference.name("variable reference");
 
             regular_expression = raw[lexeme['/' > *((utf8char - char_('\\') - char_('/')) | ('\\' > char_)) > '/']];
@@ -1169,19 +1465,19 @@ namespace client
             }
         }
 
-        // Generic expression over expr<Iterator>.
-        typedef qi::rule<Iterator, expr<Iterator>(const MyContext*), spirit::ascii::space_type> RuleExpression;
+        // Generic expression, compiled into a node of Program<Iterator>.
+        typedef qi::rule<Iterator, int(Program<Iterator>*), spirit::ascii::space_type> RuleExpression;
 
         // The start of the grammar.
-        qi::rule<Iterator, std::string(const MyContext*), qi::locals<bool>, spirit::ascii::space_type> start;
+        qi::rule<Iterator, int(Program<Iterator>*), qi::locals<bool>, spirit::ascii::space_type> start;
         // A free-form text.
-        qi::rule<Iterator, std::string(), spirit::ascii::space_type> text;
+        qi::rule<Iterator, boost::iterator_range<Iterator>(), spirit::ascii::space_type> text;
         // A free-form text, possibly empty, possibly containing macro expansions.
-        qi::rule<Iterator, std::string(const MyContext*), spirit::ascii::space_type> text_block;
+        qi::rule<Iterator, int(Program<Iterator>*), spirit::ascii::space_type> text_block;
         // Statements enclosed in curely braces {}
-        qi::rule<Iterator, std::string(const MyContext*), spirit::ascii::space_type> macro;
+        qi::rule<Iterator, int(Program<Iterator>*), spirit::ascii::space_type> macro;
         // Legacy variable expansion of the original Slic3r, in the form of [scalar_variable] or [vector_variable_index].
-        qi::rule<Iterator, std::string(const MyContext*), spirit::ascii::space_type> legacy_variable_expansion;
+        qi::rule<Iterator, int(Program<Iterator>*), spirit::ascii::space_type> legacy_variable_expansion;
         // Parsed identifier name.
         qi::rule<Iterator, boost::iterator_range<Iterator>(), spirit::ascii::space_type> identifier;
         // Ternary operator (?:) over logical_or_expression.
@@ -1199,44 +1495,109 @@ namespace client
         // Math expression consisting of */ operators over factors.
         RuleExpression multiplicative_expression;
         // Number literals, functions, braced expressions, variable references, variable indexing references.
-        RuleExpression unary_expression;
+        qi::rule<Iterator, int(Program<Iterator>*), qi::locals<boost::iterator_range<Iterator>>, spirit::ascii::space_type> unary_expression;
         // Rule to capture a regular expression enclosed in //.
         qi::rule<Iterator, boost::iterator_range<Iterator>(), spirit::ascii::space_type> regular_expression;
-        // Evaluate boolean expression into bool.
-        qi::rule<Iterator, bool(const MyContext*), spirit::ascii::space_type> bool_expr_eval;
+        // Boolean expression of a condition.
+        RuleExpression bool_expr_eval;
         // Reference of a scalar variable, or reference to a field of a vector variable.
-        qi::rule<Iterator, expr<Iterator>(const MyContext*), qi::locals<OptWithPos<Iterator>, int>, spirit::ascii::space_type> scalar_variable_reference;
-        // Rule to translate an identifier to a ConfigOption, or to fail.
-        qi::rule<Iterator, OptWithPos<Iterator>(const MyContext*), spirit::ascii::space_type> variable_reference;
+        qi::rule<Iterator, int(Program<Iterator>*), qi::locals<int>, spirit::ascii::space_type> scalar_variable_reference;
+        // Rule to translate an identifier to a variable reference.
+        RuleExpression variable_reference;
 
-        qi::rule<Iterator, std::string(const MyContext*), qi::locals<bool, bool>, spirit::ascii::space_type> if_else_output;
+        qi::rule<Iterator, int(Program<Iterator>*), spirit::ascii::space_type> if_else_output;
 //        qi::rule<Iterator, std::string(const MyContext*), qi::locals<expr<Iterator>, bool, std::string>, spirit::ascii::space_type> switch_output;
 
         qi::symbols<char> keywords;
     };
 }
 
-static std::string process_macro(const std::string &templ, client::MyContext &context)
+typedef std::string::const_iterator             iterator_type;
+typedef client::Program<iterator_type>          macro_program;
+
+// Compiled macros indexed by the template source, separately for the full macros and for the boolean expressions.
+// The custom G-code templates are processed at each layer or tool change, but there are just a few of them,
+// while the preset compatibility conditions are evaluated once per preset. The least recently used programs
+// are dropped once the cache grows over its capacity, so that the templates in use stay compiled.
+class MacroProgramCache
+{
+public:
+    MacroProgramCache(size_t capacity) : m_capacity(capacity) {}
+
+    std::shared_ptr<const macro_program> find(const std::string &templ)
+    {
+        auto it = m_index.find(templ);
+        if (it == m_index.end())
+            return std::shared_ptr<const macro_program>();
+        // Move the program to the front of the recently used list.
+        m_programs.splice(m_programs.begin(), m_programs, it->second);
+        return it->second->second;
+    }
+
+    void insert(const std::string &templ, std::shared_ptr<const macro_program> program)
+    {
+        m_programs.emplace_front(templ, std::move(program));
+        m_index[templ] = m_programs.begin();
+        if (m_programs.size() > m_capacity) {
+            m_index.erase(m_programs.back().first);
+            m_programs.pop_back();
+        }
+    }
+
+private:
+    typedef std::list<std::pair<std::string, std::shared_ptr<const macro_program>>> ProgramList;
+    size_t                                              m_capacity;
+    // Most recently used first.
+    ProgramList                                         m_programs;
+    std::map<std::string, ProgramList::iterator>        m_index;
+};
+
+static tbb::mutex               macro_program_cache_mutex;
+static MacroProgramCache        macro_program_cache[2] = { MacroProgramCache(256), MacroProgramCache(256) };
+
+// Compile the template, or return the program compiled by a previous call.
+static std::shared_ptr<const macro_program> compile_macro(const std::string &templ, bool just_boolean_expression)
 {
-    typedef std::string::const_iterator iterator_type;
     typedef client::macro_processor<iterator_type> macro_processor;
 
+    tbb::mutex::scoped_lock lock(macro_program_cache_mutex);
+    MacroProgramCache &cache = macro_program_cache[just_boolean_expression];
+    std::shared_ptr<const macro_program> cached = cache.find(templ);
+    if (cached)
+        return cached;
+
     // Our whitespace skipper.
     spirit::ascii::space_type   space;
     // Our grammar, statically allocated inside the method, meaning it will be allocated the first time
-    // PlaceholderParser::process() runs.
-    //FIXME this kind of initialization is not thread safe!
+    // a template is compiled. The initialization and the parsing are guarded by the mutex.
     static macro_processor      macro_processor_instance;
-    // Iterators over the source template.
-    std::string::const_iterator iter = templ.begin();
-    std::string::const_iterator end  = templ.end();
+    std::shared_ptr<macro_program> program = std::make_shared<macro_program>(templ, just_boolean_expression);
+    // Iterators over the source template, owned by the program.
+    iterator_type               iter = program->templ.begin();
+    iterator_type               end  = program->templ.end();
+    phrase_parse(iter, end, macro_processor_instance(program.get()), space, program->root);
+    if (! program->error_message.empty() && program->error_message.back() != '\n' && program->error_message.back() != '\r')
+        program->error_message += '\n';
+    cache.insert(templ, program);
+    return program;
+}
+
+static std::string process_macro(const std::string &templ, client::MyContext &context)
+{
+    std::shared_ptr<const macro_program> program = compile_macro(templ, context.just_boolean_expression);
+    if (! program->error_message.empty())
+        throw std::runtime_error(program->error_message);
     // Accumulator for the processed template.
-    std::string                 output;
-    bool res = phrase_parse(iter, end, macro_processor_instance(&context), space, output);
-	if (!context.error_message.empty()) {
-        if (context.error_message.back() != '\n' && context.error_message.back() != '\r')
-            context.error_message += '\n';
-        throw std::runtime_error(context.error_message);
+    std::string output;
+    if (program->root != -1) {
+        try {
+            context.resolve_variables(*program);
+            context.evaluate_text(*program, program->root, output);
+        } catch (qi::expectation_failure<iterator_type> &ex) {
+            std::string error_message;
+            client::MyContext::process_error_message(error_message, ex.what_, program->templ.begin(), program->templ.end(), ex.first);
+            throw std::runtime_error(error_message);
+        }
     }
     return output;
 }
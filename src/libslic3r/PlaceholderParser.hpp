@@ -36,6 +36,8 @@ public:
     const ConfigOption*     option(const std::string &key) const { return m_config.option(key); }
 
     // Fill in the template using a macro processing language.
+    // The template is compiled on the first call and the compiled program is cached, the following calls with the same template
+    // just evaluate the program. Only the selected {if}{elsif}{else} blocks are evaluated.
     // Throws std::runtime_error on syntax or runtime error.
     std::string process(const std::string &templ, unsigned int current_extruder_id, const DynamicConfig *config_override = nullptr) const;
     
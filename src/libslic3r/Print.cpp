@@ -9,9 +9,13 @@
 #include "GCode.hpp"
 #include "GCode/WipeTowerPrusaMM.hpp"
 #include <algorithm>
+#include <exception>
+#include <thread>
 #include <unordered_set>
 #include <boost/log/trivial.hpp>
 
+#include <tbb/parallel_for.h>
+
 #include "PrintExport.hpp"
 
 #include <boost/filesystem/path.hpp>
@@ -884,9 +888,7 @@ Print::ApplyStatus Print::apply(const Model &model, const DynamicPrintConfig &co
         bool support_enforcers_differ   = model_volume_list_changed(model_object, model_object_new, ModelVolume::SUPPORT_ENFORCER);
         if (model_parts_differ || modifiers_differ || 
             model_object.origin_translation         != model_object_new.origin_translation   ||
-            model_object.layer_height_ranges        != model_object_new.layer_height_ranges  || 
-            model_object.layer_height_profile       != model_object_new.layer_height_profile ||
-            model_object.layer_height_profile_valid != model_object_new.layer_height_profile_valid) {
+            model_object.layer_height_ranges        != model_object_new.layer_height_ranges) {
             // The very first step (the slicing step) is invalidated. One may freely remove all associated PrintObjects.
             auto range = print_object_status.equal_range(PrintObjectStatus(model_object.id()));
             for (auto it = range.first; it != range.second; ++ it) {
@@ -895,16 +897,30 @@ Print::ApplyStatus Print::apply(const Model &model, const DynamicPrintConfig &co
             }
             // Copy content of the ModelObject including its ID, do not change the parent.
             model_object.assign_copy(model_object_new);
-        } else if (support_blockers_differ || support_enforcers_differ) {
-            // First stop background processing before shuffling or deleting the ModelVolumes in the ModelObject's list.
-            this->call_cancell_callback();
-            update_apply_status(false);
-            // Invalidate just the supports step.
-            auto range = print_object_status.equal_range(PrintObjectStatus(model_object.id()));
-            for (auto it = range.first; it != range.second; ++ it)
-                update_apply_status(it->print_object->invalidate_step(posSupportMaterial));
-            // Copy just the support volumes.
-            model_volume_list_update_supports(model_object, model_object_new);
+        } else {
+            if (model_object.layer_height_profile       != model_object_new.layer_height_profile ||
+                model_object.layer_height_profile_valid != model_object_new.layer_height_profile_valid) {
+                // Just the layer height profile changed. Keep the PrintObjects, so that their layers with unchanged Z span
+                // will be reused by the next slicing. The new profile will be picked up by update_layer_height_profile() below.
+                this->call_cancell_callback();
+                update_apply_status(false);
+                model_object.layer_height_profile       = model_object_new.layer_height_profile;
+                model_object.layer_height_profile_valid = model_object_new.layer_height_profile_valid;
+                auto range = print_object_status.equal_range(PrintObjectStatus(model_object.id()));
+                for (auto it = range.first; it != range.second; ++ it)
+                    update_apply_status(it->print_object->invalidate_layer_height_profile());
+            }
+            if (support_blockers_differ || support_enforcers_differ) {
+                // First stop background processing before shuffling or deleting the ModelVolumes in the ModelObject's list.
+                this->call_cancell_callback();
+                update_apply_status(false);
+                // Invalidate just the supports step.
+                auto range = print_object_status.equal_range(PrintObjectStatus(model_object.id()));
+                for (auto it = range.first; it != range.second; ++ it)
+                    update_apply_status(it->print_object->invalidate_step(posSupportMaterial));
+                // Copy just the support volumes.
+                model_volume_list_update_supports(model_object, model_object_new);
+            }
         }
         if (! model_parts_differ && ! modifiers_differ) {
             // Synchronize Object's config.
@@ -1471,13 +1487,32 @@ void Print::auto_assign_extruders(ModelObject* model_object) const
 void Print::process()
 {
     BOOST_LOG_TRIVIAL(info) << "Staring the slicing process.";
-    for (PrintObject *obj : m_objects)
-        obj->make_perimeters();
+    // The objects are processed in parallel, as a plate of many small objects does not have enough layers
+    // per object to keep all the cores busy. The steps of a single object are still processed in order,
+    // guarded by the PrintObject state. The support generator requires the bridges detected by prepare_infill().
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, m_objects.size(), 1),
+        [this](const tbb::blocked_range<size_t>& range) {
+            for (size_t idx_object = range.begin(); idx_object < range.end(); ++ idx_object)
+                m_objects[idx_object]->make_perimeters();
+        }
+    );
     this->set_status(70, "Infilling layers");
-    for (PrintObject *obj : m_objects)
-        obj->infill();
-    for (PrintObject *obj : m_objects)
-        obj->generate_support_material();
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, m_objects.size(), 1),
+        [this](const tbb::blocked_range<size_t>& range) {
+            for (size_t idx_object = range.begin(); idx_object < range.end(); ++ idx_object) {
+                m_objects[idx_object]->infill();
+                m_objects[idx_object]->generate_support_material();
+            }
+        }
+    );
+    this->_make_skirt_brim_wipe_tower();
+    BOOST_LOG_TRIVIAL(info) << "Slicing process finished.";
+}
+
+void Print::_make_skirt_brim_wipe_tower()
+{
     if (this->set_started(psSkirt)) {
         m_skirt.clear();
         if (this->has_skirt()) {
@@ -1502,7 +1537,81 @@ void Print::process()
         }
        this->set_done(psWipeTower);
     }
-    BOOST_LOG_TRIVIAL(info) << "Slicing process finished.";
+}
+
+// Slicing process followed by the G-code export, see Print::process() and Print::export_gcode().
+// If possible, the G-code of the bottom layers is exported while the layers above are still being infilled.
+void Print::process_and_export_gcode(const std::string &path_template, GCodePreviewData *preview_data)
+{
+    if (! GCode::can_stream_export(*this)) {
+        this->process();
+        this->export_gcode(path_template, preview_data);
+        return;
+    }
+
+    BOOST_LOG_TRIVIAL(info) << "Starting the slicing process, streaming the G-code export.";
+    PrintObject *object = m_objects.front();
+    object->make_perimeters();
+    object->prepare_infill();
+    // There is no support material, so neither the support generator, nor the skirt and brim depend on the infill.
+    object->generate_support_material();
+    this->_make_skirt_brim_wipe_tower();
+
+    // Infill of the object running at a background thread. If the infill thread is left by an exception,
+    // the infill is stopped and the thread is joined.
+    struct InfillThread {
+        InfillThread(PrintObject *object) : object(object), canceled(false) {
+            object->reset_infilled_layers();
+            thread = std::thread([this]() {
+                try {
+                    this->object->infill();
+                } catch (CanceledException &) {
+                    this->exception = std::current_exception();
+                    this->canceled  = true;
+                    this->object->cancel_infilled_layers();
+                } catch (...) {
+                    this->exception = std::current_exception();
+                    // Release the G-code export waiting for the layers.
+                    this->object->cancel_infilled_layers();
+                }
+            });
+        }
+        ~InfillThread() {
+            if (thread.joinable()) {
+                object->cancel_infilled_layers();
+                thread.join();
+                object->reset_infilled_layers();
+            }
+        }
+        // Stop the infill if it is still running, wait for the infill thread to finish, rethrow the infill exception
+        // unless the infill was just stopped by this call.
+        void join(bool cancel) {
+            if (cancel)
+                object->cancel_infilled_layers();
+            thread.join();
+            object->reset_infilled_layers();
+            if (exception && ! (cancel && canceled))
+                std::rethrow_exception(exception);
+        }
+        PrintObject        *object;
+        std::exception_ptr  exception;
+        bool                canceled;
+        std::thread         thread;
+    };
+
+    // Infill the layers at a background thread, export the G-code of the layers as they are infilled.
+    this->set_status(70, "Infilling layers");
+    InfillThread infill_thread(object);
+    try {
+        this->_export_gcode(path_template, preview_data, true);
+    } catch (...) {
+        // If the infill failed or it was canceled, the export was stopped by the infill, therefore report the infill error.
+        // Otherwise the infill is stopped and the export error is reported.
+        infill_thread.join(true);
+        throw;
+    }
+    infill_thread.join(false);
+    BOOST_LOG_TRIVIAL(info) << "Slicing process and G-code export finished.";
 }
 
 // G-code export process, running at a background thread.
@@ -1510,6 +1619,11 @@ void Print::process()
 // write error into the G-code, cannot execute post-processing scripts).
 // It is up to the caller to show an error message.
 void Print::export_gcode(const std::string &path_template, GCodePreviewData *preview_data)
+{
+    this->_export_gcode(path_template, preview_data, false);
+}
+
+void Print::_export_gcode(const std::string &path_template, GCodePreviewData *preview_data, bool streaming)
 {
     // output everything to a G-code file
     // The following call may die if the output_filename_format template substitution fails.
@@ -1523,7 +1637,7 @@ void Print::export_gcode(const std::string &path_template, GCodePreviewData *pre
 
     // The following line may die for multiple reasons.
     GCode gcode;
-    gcode.do_export(this, path.c_str(), preview_data);
+    gcode.do_export(this, path.c_str(), preview_data, streaming);
 }
 
 void Print::_make_skirt()
@@ -12,6 +12,10 @@
 #include "GCode/ToolOrdering.hpp"
 #include "GCode/WipeTower.hpp"
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
 namespace Slic3r {
 
 class Print;
@@ -20,6 +24,8 @@ class ModelObject;
 class GCode;
 class GCodePreviewData;
 
+namespace Geometry { class MedialAxisCache; }
+
 // Print step IDs for keeping track of the print state.
 enum PrintStep {
     psSkirt, psBrim, psWipeTower, psGCodeExport, psCount,
@@ -76,6 +82,8 @@ private: // Prevents erroneous use by other classes.
     typedef PrintObjectBaseWithState<Print, PrintObjectStep, posCount> Inherited;
 
 public:
+    typedef PrintStateBase::LayerSpan LayerSpan;
+
     // vector of (vectors of volume ids), indexed by region_id
     std::vector<std::vector<int>> region_volumes;
 
@@ -154,33 +162,55 @@ public:
     std::vector<ExPolygons>     slice_support_enforcers() const;
     std::vector<ExPolygons>     slice_support_blockers() const;
 
+    // Streaming G-code export, see Print::process_and_export_gcode(): Block until the bottom num_layers are infilled.
+    // Throws CanceledException if the infill step was stopped before infilling these layers.
+    void                        wait_for_infilled_layers(size_t num_layers) const;
+
+    // Medial axes of the thin walls and gap fills shared by the layers, filled in and released by make_perimeters().
+    Geometry::MedialAxisCache*  medial_axis_cache()         { return m_medial_axis_cache.get(); }
+
 protected:
     // to be called from Print only.
     friend class Print;
 
 	PrintObject(Print* print, ModelObject* model_object, bool add_instances = true);
-	~PrintObject() {}
+	~PrintObject();
 
     void                    config_apply(const ConfigBase &other, bool ignore_nonexistent = false) { this->m_config.apply(other, ignore_nonexistent); }
     void                    config_apply_only(const ConfigBase &other, const t_config_option_keys &keys, bool ignore_nonexistent = false) { this->m_config.apply_only(other, keys, ignore_nonexistent); }
-    void                    set_trafo(const Transform3d& trafo) { m_trafo = trafo; }
+    void                    set_trafo(const Transform3d& trafo);
     bool                    set_copies(const Points &points);
     // Invalidates the step, and its depending steps in PrintObject and Print.
     bool                    invalidate_step(PrintObjectStep step);
+    // Invalidates the step for the layers of the span only. The depending steps are invalidated
+    // for the same layers if they are processed layer by layer, otherwise as a whole.
+    bool                    invalidate_step_layers(PrintObjectStep step, const LayerSpan &layers);
     // Invalidates all PrintObject and Print steps.
     bool                    invalidate_all_steps();
+    // Invalidates the slicing step due to a modification of the layer height profile.
+    // The layers not touched by the modification will be reused by the next slicing.
+    bool                    invalidate_layer_height_profile();
     // Invalidate steps based on a set of parameters changed.
     bool                    invalidate_state_by_config_options(const std::vector<t_config_option_key> &opt_keys);
 
 private:
+    // Range of indices of m_layers to be processed by a step, extended by extend_layers below and above the dirty layers.
+    std::pair<size_t, size_t> dirty_layer_range(PrintObjectStep step, size_t extend_layers = 0) const;
+
     void make_perimeters();
     void prepare_infill();
     void infill();
     void generate_support_material();
 
-    void _slice();
+    // Streaming G-code export: Track the layers finished by the infill step for wait_for_infilled_layers().
+    void reset_infilled_layers();
+    void set_layer_infilled(size_t layer_idx);
+    void cancel_infilled_layers();
+
+    // Returns indices of the layers sliced, the other layers were reused from the previous slicing.
+    std::vector<size_t> _slice();
     std::string _fix_slicing_errors();
-    void _simplify_slices(double distance);
+    void _simplify_slices(double distance, const std::vector<size_t> &layers);
     void _make_perimeters();
     bool has_support_material() const;
     void detect_surfaces_type();
@@ -204,9 +234,36 @@ private:
 
     LayerPtrs                               m_layers;
     SupportLayerPtrs                        m_support_layers;
+    // Set if posSlice was invalidated just by a modification of the layer height profile,
+    // therefore the existing layers may be reused by _slice() where their Z span did not change.
+    bool                                    m_layers_reusable = false;
+    // Number of the bottom layers finished by the infill step and the flags of the layers finished above them.
+    // Guarded by m_infilled_layers_mutex, as they are read by the G-code export running in parallel with the infill.
+    size_t                                  m_infilled_layers = 0;
+    std::vector<bool>                       m_layers_infilled;
+    bool                                    m_infill_canceled = false;
+    mutable std::mutex                      m_infilled_layers_mutex;
+    mutable std::condition_variable         m_infilled_layers_condition;
+    std::unique_ptr<Geometry::MedialAxisCache> m_medial_axis_cache;
 
     std::vector<ExPolygons> _slice_region(size_t region_id, const std::vector<float> &z, bool modifier);
     std::vector<ExPolygons> _slice_volumes(const std::vector<float> &z, const std::vector<const ModelVolume*> &volumes) const;
+    const TriangleMeshSlicer* _volumes_slicer(const std::vector<const ModelVolume*> &volumes) const;
+
+    // Mesh composed of a set of volumes, transformed into the object coordinate system, together with its slicer.
+    // Cached by _volumes_slicer(), so that the volumes are not merged, transformed and indexed for slicing
+    // again each time the object is re-sliced with a different set of layers.
+    struct VolumesSlicer {
+        std::vector<ModelID>        volume_ids;
+#if ENABLE_MODELVOLUME_TRANSFORM
+        std::vector<Transform3d>    volume_trafos;
+#endif // ENABLE_MODELVOLUME_TRANSFORM
+        TriangleMesh                mesh;
+        TriangleMeshSlicer          slicer;
+    };
+    // Only accessed by the background processing thread. Cleared if the object transformation changes or if the slicing step
+    // is invalidated. A slicer of moved volumes replaces the slicer of the same volumes, slicers of removed volumes are released.
+    mutable std::vector<std::unique_ptr<VolumesSlicer>> m_volumes_slicers;
 };
 
 struct WipeTowerData
@@ -241,6 +298,10 @@ struct PrintStatistics
     PrintStatistics() { clear(); }
     std::string                     estimated_normal_print_time;
     std::string                     estimated_silent_print_time;
+    // Estimated printing time of the normal mode in seconds, split into the extrusion, travel, retraction and additional time
+    // (GCodeTimeEstimator::ETimeRole), and the Z and the estimated printing time in seconds of each layer.
+    std::vector<float>              estimated_normal_role_times;
+    std::vector<std::pair<float, float>> estimated_normal_layer_times;
     double                          total_used_filament;
     double                          total_extruded_volume;
     double                          total_cost;
@@ -259,6 +320,8 @@ struct PrintStatistics
     void clear() {
         estimated_normal_print_time.clear();
         estimated_silent_print_time.clear();
+        estimated_normal_role_times.clear();
+        estimated_normal_layer_times.clear();
         total_used_filament    = 0.;
         total_extruded_volume  = 0.;
         total_cost             = 0.;
@@ -301,6 +364,12 @@ public:
 
     void                process() override;
     void                export_gcode(const std::string &path_template, GCodePreviewData *preview_data);
+    // Same as process() followed by export_gcode(). If the G-code of a layer does not depend on the layers above
+    // (see GCode::can_stream_export()), the layers are exported while the layers above them are still being infilled.
+    // The G-code is written to a .tmp file, which is renamed to the output path only once the export is complete,
+    // therefore a partially exported G-code is never visible at the output path.
+    // Only the command line slicer streams, the GUI slices with process() to show the preview before the export.
+    void                process_and_export_gcode(const std::string &path_template, GCodePreviewData *preview_data);
 
     // methods for handling state
     bool                is_step_done(PrintStep step) const { return Inherited::is_step_done(step); }
@@ -369,6 +438,9 @@ protected:
 private:
     bool                invalidate_state_by_config_options(const std::vector<t_config_option_key> &opt_keys);
 
+    void                _export_gcode(const std::string &path_template, GCodePreviewData *preview_data, bool streaming);
+    // Print steps processed after all the PrintObject steps are finished.
+    void                _make_skirt_brim_wipe_tower();
     void                _make_skirt();
     void                _make_brim();
     void                _make_wipe_tower();
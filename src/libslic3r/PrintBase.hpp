@@ -6,6 +6,7 @@
 #include <vector>
 #include <string>
 #include <functional>
+#include <limits>
 
 // tbb/mutex.h includes Windows, which in turn defines min/max macros. Convince Windows.h to not define these min/max macros.
 #ifndef NOMINMAX
@@ -42,6 +43,23 @@ public:
         TimeStamp   timestamp;
     };
 
+    // Span of print_z of the layers to be recalculated by an invalidated step.
+    // A step invalidated as a whole has all its layers dirty, a finished step has no dirty layer.
+    struct LayerSpan
+    {
+        LayerSpan() : z_min(std::numeric_limits<coordf_t>::max()), z_max(- std::numeric_limits<coordf_t>::max()) {}
+        LayerSpan(coordf_t z_min, coordf_t z_max) : z_min(z_min), z_max(z_max) {}
+        static LayerSpan all() { return LayerSpan(- std::numeric_limits<coordf_t>::max(), std::numeric_limits<coordf_t>::max()); }
+
+        bool        empty() const { return z_min > z_max; }
+        bool        contains(coordf_t print_z) const { return print_z > z_min - EPSILON && print_z < z_max + EPSILON; }
+        void        merge(coordf_t print_z) { z_min = std::min(z_min, print_z); z_max = std::max(z_max, print_z); }
+        void        merge(const LayerSpan &rhs) { z_min = std::min(z_min, rhs.z_min); z_max = std::max(z_max, rhs.z_max); }
+
+        coordf_t    z_min;
+        coordf_t    z_max;
+    };
+
 protected:
     //FIXME last timestamp is shared between Print & SLAPrint,
     // and if multiple Print or SLAPrint instances are executed in parallel, modification of g_last_timestamp
@@ -54,7 +72,7 @@ template <class StepType, size_t COUNT>
 class PrintState : public PrintStateBase
 {
 public:
-    PrintState() {}
+    PrintState() { for (size_t i = 0; i < COUNT; ++ i) m_dirty[i] = LayerSpan::all(); }
 
     StateWithTimeStamp state_with_timestamp(StepType step, tbb::mutex &mtx) const { 
         tbb::mutex::scoped_lock lock(mtx);
@@ -74,6 +92,12 @@ public:
         return this->state_with_timestamp_unguarded(step).state == DONE;
     }
 
+    // Layers to be recalculated by the step.
+    LayerSpan dirty_layers(StepType step, tbb::mutex &mtx) const {
+        tbb::mutex::scoped_lock lock(mtx);
+        return m_dirty[step];
+    }
+
     // Set the step as started. Block on mutex while the Print / PrintObject / PrintRegion objects are being
     // modified by the UI thread.
     // This is necessary to block until the Print::apply_config() updates its state, which may
@@ -100,6 +124,7 @@ public:
         assert(m_state[step].state != DONE);
         m_state[step].state = DONE;
         m_state[step].timestamp = ++ g_last_timestamp;
+        m_dirty[step] = LayerSpan();
         return m_state[step].timestamp;
     }
 
@@ -109,6 +134,7 @@ public:
     // processing by calling the cancel callback.
     template<typename CancelationCallback>
     bool invalidate(StepType step, CancelationCallback cancel) {
+        m_dirty[step] = LayerSpan::all();
         bool invalidated = m_state[step].state != INVALID;
         if (invalidated) {
 #if 0
@@ -127,11 +153,30 @@ public:
         return invalidated;
     }
 
+    // Make the step invalid for just the layers of the span, the other layers produced by the step are kept.
+    // PrintBase::m_state_mutex should be locked at this point, guarding access to m_state.
+    // In case the step has already been entered or finished, cancel the background
+    // processing by calling the cancel callback.
+    template<typename CancelationCallback>
+    bool invalidate_layers(StepType step, const LayerSpan &layers, CancelationCallback cancel) {
+        if (layers.empty())
+            return false;
+        m_dirty[step].merge(layers);
+        bool invalidated = m_state[step].state != INVALID;
+        if (invalidated) {
+            m_state[step].state = INVALID;
+            m_state[step].timestamp = ++ g_last_timestamp;
+            cancel();
+        }
+        return invalidated;
+    }
+
     template<typename CancelationCallback, typename StepTypeIterator>
     bool invalidate_multiple(StepTypeIterator step_begin, StepTypeIterator step_end, CancelationCallback cancel) {
         bool invalidated = false;
         for (StepTypeIterator it = step_begin; it != step_end; ++ it) {
             StateWithTimeStamp &state = m_state[*it];
+            m_dirty[*it] = LayerSpan::all();
             if (state.state != INVALID) {
                 invalidated = true;
                 state.state = INVALID;
@@ -162,6 +207,7 @@ public:
         bool invalidated = false;
         for (size_t i = 0; i < COUNT; ++ i) {
             StateWithTimeStamp &state = m_state[i];
+            m_dirty[i] = LayerSpan::all();
             if (state.state != INVALID) {
                 invalidated = true;
                 state.state = INVALID;
@@ -175,6 +221,7 @@ public:
 
 private:
     StateWithTimeStamp m_state[COUNT];
+    LayerSpan          m_dirty[COUNT];
 };
 
 class PrintBase;
@@ -381,6 +428,13 @@ protected:
         { return m_state.invalidate_multiple(il.begin(), il.end(), PrintObjectBase::cancel_callback(m_print)); }
     bool            invalidate_all_steps() 
         { return m_state.invalidate_all(PrintObjectBase::cancel_callback(m_print)); }
+    bool            invalidate_step_layers(PrintObjectStepEnum step, const PrintStateBase::LayerSpan &layers)
+        { return m_state.invalidate_layers(step, layers, PrintObjectBase::cancel_callback(m_print)); }
+    // Layers to be recalculated by the step, to be called by the worker thread after the step was started.
+    PrintStateBase::LayerSpan step_dirty_layers(PrintObjectStepEnum step) const
+        { return m_state.dirty_layers(step, PrintObjectBase::state_mutex(m_print)); }
+    // PrintBase::m_state_mutex should be locked at this point.
+    bool            is_step_done_unguarded(PrintObjectStepEnum step) const { return m_state.is_done_unguarded(step); }
 
 protected:
     // If the background processing stop was requested, throw CanceledException.
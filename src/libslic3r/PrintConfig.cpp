@@ -3020,6 +3020,13 @@ CLIConfigDef::CLIConfigDef()
     def->cli = "datadir";
     def->default_value = new ConfigOptionString();
 
+    def = this->add("estimate_time", coBool);
+    def->label = L("Estimate printing time");
+    def->tooltip = L("Estimate the printing time of the G-code files given as input, using the machine limits "
+                     "of the loaded configuration. The files are processed in parallel.");
+    def->cli = "estimate-time";
+    def->default_value = new ConfigOptionBool(false);
+
     def = this->add("export_3mf", coBool);
     def->label = L("Export 3MF");
     def->tooltip = L("Slice the model and export slices as 3MF.");
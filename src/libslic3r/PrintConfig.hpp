@@ -1096,6 +1096,7 @@ public:
     ConfigOptionFloat               cut;
     ConfigOptionString              datadir;
     ConfigOptionBool                dont_arrange;
+    ConfigOptionBool                estimate_time;
     ConfigOptionBool                export_3mf;
     ConfigOptionBool                gui;
     ConfigOptionBool                info;
@@ -1126,6 +1127,7 @@ public:
         OPT_PTR(cut);
         OPT_PTR(datadir);
         OPT_PTR(dont_arrange);
+        OPT_PTR(estimate_time);
         OPT_PTR(export_3mf);
         OPT_PTR(gui);
         OPT_PTR(help);
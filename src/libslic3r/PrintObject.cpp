@@ -5,7 +5,9 @@
 #include "SupportMaterial.hpp"
 #include "Surface.hpp"
 #include "Slicing.hpp"
+#include "Utils.hpp"
 
+#include <algorithm>
 #include <utility>
 #include <boost/log/trivial.hpp>
 #include <float.h>
@@ -38,7 +40,8 @@ PrintObject::PrintObject(Print* print, ModelObject* model_object, bool add_insta
     PrintObjectBaseWithState(print, model_object),
     typed_slices(false),
     size(Vec3crd::Zero()),
-    layer_height_profile_valid(false)
+    layer_height_profile_valid(false),
+    m_medial_axis_cache(new Geometry::MedialAxisCache())
 {
     // Compute the translation to be applied to our meshes so that we work with smaller coordinates
     {
@@ -68,6 +71,18 @@ PrintObject::PrintObject(Print* print, ModelObject* model_object, bool add_insta
     this->layer_height_profile = model_object->layer_height_profile;
 }
 
+PrintObject::~PrintObject()
+{
+}
+
+void PrintObject::set_trafo(const Transform3d& trafo)
+{
+    if (! trafo.isApprox(m_trafo))
+        // The cached meshes were transformed by the old transformation.
+        m_volumes_slicers.clear();
+    m_trafo = trafo;
+}
+
 bool PrintObject::set_copies(const Points &points)
 {
     // Order copies with a nearest-neighbor search.
@@ -104,7 +119,7 @@ void PrintObject::slice()
     if (! this->set_started(posSlice))
         return;
     m_print->set_status(10, "Processing triangulated mesh");
-    this->_slice();
+    std::vector<size_t> layers_sliced = this->_slice();
     m_print->throw_if_canceled();
     // Fix the model.
     //FIXME is this the right place to do? It is done repeateadly at the UI and now here at the backend.
@@ -114,7 +129,7 @@ void PrintObject::slice()
         BOOST_LOG_TRIVIAL(info) << warning;
     // Simplify slices if required.
     if (m_print->config().resolution)
-        this->_simplify_slices(scale_(this->print()->config().resolution));
+        this->_simplify_slices(scale_(this->print()->config().resolution), layers_sliced);
     if (m_layers.empty())
         throw std::runtime_error("No layers were detected. You might want to repair your STL file(s) or check their size or thickness and retry.\n");    
     this->set_done(posSlice);
@@ -142,6 +157,11 @@ void PrintObject::make_perimeters()
         }
         this->typed_slices = false;
     }
+
+    // Only the dirty layers and their neighbors are processed, as the extra perimeters are decided based on the layer above
+    // and the overhangs are detected against the layer below. The perimeters of the other layers are kept.
+    std::pair<size_t, size_t> layer_range = this->dirty_layer_range(posPerimeters, 1);
+    BOOST_LOG_TRIVIAL(debug) << "Generating perimeters for layers " << layer_range.first << " to " << layer_range.second << " of " << m_layers.size();
     
     // compare each layer to the one below, and mark those slices needing
     // one additional inner perimeter, like the top of domed objects-
@@ -150,76 +170,79 @@ void PrintObject::make_perimeters()
     // but we don't generate any extra perimeter if fill density is zero, as they would be floating
     // inside the object - infill_only_where_needed should be the method of choice for printing
     // hollow objects
+    std::vector<size_t> regions_extra_perimeters;
     for (size_t region_id = 0; region_id < this->region_volumes.size(); ++ region_id) {
         const PrintRegion &region = *m_print->regions()[region_id];
-        if (! region.config().extra_perimeters || region.config().perimeters == 0 || region.config().fill_density == 0 || this->layer_count() < 2)
-            continue;
-        
-        BOOST_LOG_TRIVIAL(debug) << "Generating extra perimeters for region " << region_id << " in parallel - start";
-        tbb::parallel_for(
-            tbb::blocked_range<size_t>(0, m_layers.size() - 1),
-            [this, &region, region_id](const tbb::blocked_range<size_t>& range) {
-                for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx) {
-                    m_print->throw_if_canceled();
-                    LayerRegion &layerm                     = *m_layers[layer_idx]->m_regions[region_id];
-                    const LayerRegion &upper_layerm         = *m_layers[layer_idx+1]->m_regions[region_id];
-                    const Polygons upper_layerm_polygons    = upper_layerm.slices;
-                    // Filter upper layer polygons in intersection_ppl by their bounding boxes?
-                    // my $upper_layerm_poly_bboxes= [ map $_->bounding_box, @{$upper_layerm_polygons} ];
-                    const double total_loop_length      = total_length(upper_layerm_polygons);
-                    const coord_t perimeter_spacing     = layerm.flow(frPerimeter).scaled_spacing();
-                    const Flow ext_perimeter_flow       = layerm.flow(frExternalPerimeter);
-                    const coord_t ext_perimeter_width   = ext_perimeter_flow.scaled_width();
-                    const coord_t ext_perimeter_spacing = ext_perimeter_flow.scaled_spacing();
-
-                    for (Surface &slice : layerm.slices.surfaces) {
-                        for (;;) {
-                            // compute the total thickness of perimeters
-                            const coord_t perimeters_thickness = ext_perimeter_width/2 + ext_perimeter_spacing/2
-                                + (region.config().perimeters-1 + slice.extra_perimeters) * perimeter_spacing;
-                            // define a critical area where we don't want the upper slice to fall into
-                            // (it should either lay over our perimeters or outside this area)
-                            const coord_t critical_area_depth = coord_t(perimeter_spacing * 1.5);
-                            const Polygons critical_area = diff(
-                                offset(slice.expolygon, float(- perimeters_thickness)),
-                                offset(slice.expolygon, float(- perimeters_thickness - critical_area_depth))
-                            );
-                            // check whether a portion of the upper slices falls inside the critical area
-                            const Polylines intersection = intersection_pl(to_polylines(upper_layerm_polygons), critical_area);
-                            // only add an additional loop if at least 30% of the slice loop would benefit from it
-                            if (total_length(intersection) <=  total_loop_length*0.3)
-                                break;
-                            /*
-                            if (0) {
-                                require "Slic3r/SVG.pm";
-                                Slic3r::SVG::output(
-                                    "extra.svg",
-                                    no_arrows   => 1,
-                                    expolygons  => union_ex($critical_area),
-                                    polylines   => [ map $_->split_at_first_point, map $_->p, @{$upper_layerm->slices} ],
-                                );
-                            }
-                            */
-                            ++ slice.extra_perimeters;
-                        }
-                        #ifdef DEBUG
-                            if (slice.extra_perimeters > 0)
-                                printf("  adding %d more perimeter(s) at layer %zu\n", slice.extra_perimeters, layer_idx);
-                        #endif
-                    }
-                }
-            });
-        m_print->throw_if_canceled();
-        BOOST_LOG_TRIVIAL(debug) << "Generating extra perimeters for region " << region_id << " in parallel - end";
+        if (region.config().extra_perimeters && region.config().perimeters > 0 && region.config().fill_density > 0 && this->layer_count() >= 2)
+            regions_extra_perimeters.emplace_back(region_id);
     }
 
+    // The extra perimeters of a layer are decided by the region slices of the layer above, and the perimeters
+    // of a layer are generated against the islands of the layer below. Neither of them is modified by this step,
+    // therefore both the extra perimeters and the perimeters are generated in a single pass without waiting for the other layers.
     BOOST_LOG_TRIVIAL(debug) << "Generating perimeters in parallel - start";
+    // The islands of the other steps or of the next slicing will not match, release the memory,
+    // also if the perimeter generation is canceled.
+    ScopeGuard medial_axis_cache_guard([this]() { m_medial_axis_cache->clear(); });
     tbb::parallel_for(
-        tbb::blocked_range<size_t>(0, m_layers.size()),
-        [this](const tbb::blocked_range<size_t>& range) {
+        tbb::blocked_range<size_t>(layer_range.first, layer_range.second),
+        [this, &regions_extra_perimeters](const tbb::blocked_range<size_t>& range) {
             for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx) {
                 m_print->throw_if_canceled();
+                if (layer_idx + 1 < m_layers.size()) {
+                    for (size_t region_id : regions_extra_perimeters) {
+                        const PrintRegion &region = *m_print->regions()[region_id];
+                        LayerRegion &layerm                     = *m_layers[layer_idx]->m_regions[region_id];
+                        const LayerRegion &upper_layerm         = *m_layers[layer_idx+1]->m_regions[region_id];
+                        const Polygons upper_layerm_polygons    = upper_layerm.slices;
+                        // Filter upper layer polygons in intersection_ppl by their bounding boxes?
+                        // my $upper_layerm_poly_bboxes= [ map $_->bounding_box, @{$upper_layerm_polygons} ];
+                        const double total_loop_length      = total_length(upper_layerm_polygons);
+                        const coord_t perimeter_spacing     = layerm.flow(frPerimeter).scaled_spacing();
+                        const Flow ext_perimeter_flow       = layerm.flow(frExternalPerimeter);
+                        const coord_t ext_perimeter_width   = ext_perimeter_flow.scaled_width();
+                        const coord_t ext_perimeter_spacing = ext_perimeter_flow.scaled_spacing();
+
+                        for (Surface &slice : layerm.slices.surfaces) {
+                            for (;;) {
+                                // compute the total thickness of perimeters
+                                const coord_t perimeters_thickness = ext_perimeter_width/2 + ext_perimeter_spacing/2
+                                    + (region.config().perimeters-1 + slice.extra_perimeters) * perimeter_spacing;
+                                // define a critical area where we don't want the upper slice to fall into
+                                // (it should either lay over our perimeters or outside this area)
+                                const coord_t critical_area_depth = coord_t(perimeter_spacing * 1.5);
+                                const Polygons critical_area = diff(
+                                    offset(slice.expolygon, float(- perimeters_thickness)),
+                                    offset(slice.expolygon, float(- perimeters_thickness - critical_area_depth))
+                                );
+                                // check whether a portion of the upper slices falls inside the critical area
+                                const Polylines intersection = intersection_pl(to_polylines(upper_layerm_polygons), critical_area);
+                                // only add an additional loop if at least 30% of the slice loop would benefit from it
+                                if (total_length(intersection) <=  total_loop_length*0.3)
+                                    break;
+                                /*
+                                if (0) {
+                                    require "Slic3r/SVG.pm";
+                                    Slic3r::SVG::output(
+                                        "extra.svg",
+                                        no_arrows   => 1,
+                                        expolygons  => union_ex($critical_area),
+                                        polylines   => [ map $_->split_at_first_point, map $_->p, @{$upper_layerm->slices} ],
+                                    );
+                                }
+                                */
+                                ++ slice.extra_perimeters;
+                            }
+                            #ifdef DEBUG
+                                if (slice.extra_perimeters > 0)
+                                    printf("  adding %d more perimeter(s) at layer %zu\n", slice.extra_perimeters, layer_idx);
+                            #endif
+                        }
+                    }
+                }
                 m_layers[layer_idx]->make_perimeters();
+                // The gap fills were regenerated, they are copied into the fills by make_fills().
+                m_layers[layer_idx]->fills_hash = 0;
             }
         }
     );
@@ -236,6 +259,9 @@ void PrintObject::make_perimeters()
     this->set_done(posPerimeters);
 }
 
+// The surface classification and the shells are propagated over a number of layers up and down,
+// therefore this step is always recalculated for the whole object. It is idempotent for the layers
+// with their perimeters kept, as the fill surfaces are regenerated from LayerRegion::fill_expolygons.
 void PrintObject::prepare_infill()
 {
     if (! this->set_started(posPrepareInfill))
@@ -253,13 +279,8 @@ void PrintObject::prepare_infill()
     // Decide what surfaces are to be filled.
     // Here the S_TYPE_TOP / S_TYPE_BOTTOMBRIDGE / S_TYPE_BOTTOM infill is turned to just S_TYPE_INTERNAL if zero top / bottom infill layers are configured.
     // Also tiny S_TYPE_INTERNAL surfaces are turned to S_TYPE_INTERNAL_SOLID.
-    BOOST_LOG_TRIVIAL(info) << "Preparing fill surfaces...";
-    for (auto *layer : m_layers)
-        for (auto *region : layer->m_regions) {
-            region->prepare_fill_surfaces();
-            m_print->throw_if_canceled();
-        }
-
+    // Done by process_external_surfaces() for each layer right before the external surfaces of that layer are processed.
+    //
     // this will detect bridges and reverse bridges
     // and rearrange top/bottom/internal surfaces
     // It produces enlarged overlapping bridging areas.
@@ -357,13 +378,30 @@ void PrintObject::infill()
     this->prepare_infill();
 
     if (this->set_started(posInfill)) {
+        // The infill of a layer depends on its own fill surfaces only. The fills are regenerated for the dirty layers
+        // and for the layers, whose fill surfaces or gap fills changed since their fills were generated.
+        // If just the perimeters of some layers were invalidated, prepare_infill() modifies the fill surfaces
+        // of the layers around them only, the fills of the other layers are kept.
+        LayerSpan dirty_layers = this->step_dirty_layers(posInfill);
+        {
+            std::lock_guard<std::mutex> lock(m_infilled_layers_mutex);
+            m_infilled_layers = 0;
+            m_layers_infilled.assign(m_layers.size(), false);
+        }
         BOOST_LOG_TRIVIAL(debug) << "Filling layers in parallel - start";
         tbb::parallel_for(
             tbb::blocked_range<size_t>(0, m_layers.size()),
-            [this](const tbb::blocked_range<size_t>& range) {
+            [this, &dirty_layers](const tbb::blocked_range<size_t>& range) {
                 for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx) {
                     m_print->throw_if_canceled();
-                    m_layers[layer_idx]->make_fills();
+                    Layer  *layer = m_layers[layer_idx];
+                    size_t  hash  = layer->fill_surfaces_hash();
+                    if (hash != layer->fills_hash || dirty_layers.contains(layer->print_z)) {
+                        layer->fills_hash = 0;
+                        layer->make_fills();
+                        layer->fills_hash = hash;
+                    }
+                    this->set_layer_infilled(layer_idx);
                 }
             }
         );
@@ -376,6 +414,44 @@ void PrintObject::infill()
     }
 }
 
+void PrintObject::reset_infilled_layers()
+{
+    std::lock_guard<std::mutex> lock(m_infilled_layers_mutex);
+    m_infilled_layers = this->is_step_done(posInfill) ? m_layers.size() : 0;
+    m_layers_infilled.clear();
+    m_infill_canceled = false;
+}
+
+void PrintObject::set_layer_infilled(size_t layer_idx)
+{
+    std::lock_guard<std::mutex> lock(m_infilled_layers_mutex);
+    if (m_infill_canceled)
+        // The streaming G-code export failed, stop the infill.
+        throw CanceledException();
+    m_layers_infilled[layer_idx] = true;
+    size_t infilled_layers = m_infilled_layers;
+    while (m_infilled_layers < m_layers_infilled.size() && m_layers_infilled[m_infilled_layers])
+        ++ m_infilled_layers;
+    if (m_infilled_layers > infilled_layers)
+        m_infilled_layers_condition.notify_all();
+}
+
+void PrintObject::cancel_infilled_layers()
+{
+    std::lock_guard<std::mutex> lock(m_infilled_layers_mutex);
+    m_infill_canceled = true;
+    m_infilled_layers_condition.notify_all();
+}
+
+void PrintObject::wait_for_infilled_layers(size_t num_layers) const
+{
+    std::unique_lock<std::mutex> lock(m_infilled_layers_mutex);
+    m_infilled_layers_condition.wait(lock, [this, num_layers]{ return m_infilled_layers >= num_layers || m_infill_canceled; });
+    if (m_infilled_layers < num_layers)
+        throw CanceledException();
+}
+
+// The support layers are generated for the whole object, they are not synchronized with the object layers.
 void PrintObject::generate_support_material()
 {
     if (this->set_started(posSupportMaterial)) {
@@ -544,6 +620,13 @@ bool PrintObject::invalidate_state_by_config_options(const std::vector<t_config_
 bool PrintObject::invalidate_step(PrintObjectStep step)
 {
 	bool invalidated = Inherited::invalidate_step(step);
+    if (step == posSlice) {
+        // The slices are invalidated by some other reason than a change of the layer height profile.
+        m_layers_reusable = false;
+        // The volumes may have been added, removed or modified, release the meshes composed of them.
+        // A change of the layer height profile invalidates just the slices of the layers touched, keeping the cached slicers.
+        m_volumes_slicers.clear();
+    }
     
     // propagate to dependent steps
     if (step == posPerimeters) {
@@ -568,11 +651,93 @@ bool PrintObject::invalidate_step(PrintObjectStep step)
     return invalidated;
 }
 
+bool PrintObject::invalidate_step_layers(PrintObjectStep step, const LayerSpan &layers)
+{
+    if (layers.empty())
+        return false;
+    if (step != posSlice && step != posPerimeters && step != posInfill)
+        // The other steps are not processed layer by layer.
+        return this->invalidate_step(step);
+
+    bool invalidated = Inherited::invalidate_step_layers(step, layers);
+
+    // propagate to dependent steps
+    if (step == posSlice) {
+        // The perimeters of the layers next to the dirty layers are extended by make_perimeters() itself,
+        // the supports are generated for the object as a whole.
+        invalidated |= this->invalidate_step_layers(posPerimeters, layers);
+        invalidated |= this->invalidate_step(posSupportMaterial);
+    } else if (step == posPerimeters) {
+        // The surface classification and the shells propagate over many layers, prepare_infill() runs for the whole object.
+        // The infill is regenerated for the dirty layers and for the layers, whose fill surfaces were modified
+        // by prepare_infill(), see PrintObject::infill().
+        invalidated |= Inherited::invalidate_step(posPrepareInfill);
+        invalidated |= Inherited::invalidate_step_layers(posInfill, layers);
+        invalidated |= m_print->invalidate_steps({ psSkirt, psBrim });
+    } else if (step == posInfill)
+        invalidated |= m_print->invalidate_steps({ psSkirt, psBrim });
+
+    invalidated |= m_print->invalidate_step(psWipeTower);
+    invalidated |= m_print->invalidate_step(psGCodeExport);
+    return invalidated;
+}
+
 bool PrintObject::invalidate_all_steps()
 {
+    m_layers_reusable = false;
+    m_volumes_slicers.clear();
     return Inherited::invalidate_all_steps() | m_print->invalidate_all_steps();
 }
 
+bool PrintObject::invalidate_layer_height_profile()
+{
+    this->layer_height_profile_valid = false;
+    // Only completely sliced layers may be reused.
+    if (! this->is_step_done_unguarded(posSlice))
+        return this->invalidate_step(posSlice);
+
+    // Collect print_z of the layers, which will not survive the next slicing with the new layer height profile
+    // stored at the ModelObject, and of the layers, which will be newly created. The criterion matches the one of _slice().
+    std::vector<coordf_t> layer_height_profile;
+    this->update_layer_height_profile(layer_height_profile);
+    SlicingParameters     slicing_params = this->slicing_parameters();
+    std::vector<coordf_t> object_layers  = generate_object_layers(slicing_params, layer_height_profile);
+    LayerSpan             layers_changed;
+    size_t                idx_old_layer  = 0;
+    for (size_t i_layer = 0; i_layer < object_layers.size(); i_layer += 2) {
+        coordf_t height  = object_layers[i_layer + 1] - object_layers[i_layer];
+        coordf_t print_z = object_layers[i_layer + 1] + slicing_params.object_print_z_min;
+        for (; idx_old_layer < m_layers.size() && m_layers[idx_old_layer]->print_z < print_z - EPSILON; ++ idx_old_layer)
+            layers_changed.merge(m_layers[idx_old_layer]->print_z);
+        if (idx_old_layer < m_layers.size() && 
+            std::abs(m_layers[idx_old_layer]->print_z - print_z) < EPSILON && 
+            std::abs(m_layers[idx_old_layer]->height - height) < EPSILON)
+            ++ idx_old_layer;
+        else
+            layers_changed.merge(print_z);
+    }
+    for (; idx_old_layer < m_layers.size(); ++ idx_old_layer)
+        layers_changed.merge(m_layers[idx_old_layer]->print_z);
+
+    bool invalidated = this->invalidate_step_layers(posSlice, layers_changed);
+    m_layers_reusable = true;
+    return invalidated;
+}
+
+std::pair<size_t, size_t> PrintObject::dirty_layer_range(PrintObjectStep step, size_t extend_layers) const
+{
+    LayerSpan layers = this->step_dirty_layers(step);
+    size_t    first  = 0;
+    size_t    last   = m_layers.size();
+    for (; first < last && ! layers.contains(m_layers[first]->print_z); ++ first) ;
+    for (; last > first && ! layers.contains(m_layers[last - 1]->print_z); -- last) ;
+    if (first < last) {
+        first = (first > extend_layers) ? first - extend_layers : 0;
+        last  = std::min(last + extend_layers, m_layers.size());
+    }
+    return std::make_pair(first, last);
+}
+
 bool PrintObject::has_support_material() const
 {
     return m_config.support_material
@@ -748,6 +913,15 @@ void PrintObject::detect_surfaces_type()
         #ifdef SLIC3R_DEBUG_SLICE_PROCESSING
                     layerm->export_region_slices_to_svg_debug("detect_surfaces_type-final");
         #endif /* SLIC3R_DEBUG_SLICE_PROCESSING */
+
+                    if (! interface_shells) {
+                        // The neighbor layers were only accessed through their islands, which are not modified here,
+                        // therefore the fill surfaces of this layer may be clipped right away without waiting for the other layers.
+                        layerm->slices_to_fill_surfaces_clipped();
+        #ifdef SLIC3R_DEBUG_SLICE_PROCESSING
+                        layerm->export_region_fill_surfaces_to_svg_debug("1_detect_surfaces_type-final");
+        #endif /* SLIC3R_DEBUG_SLICE_PROCESSING */
+                    }
                 }
             }
         ); // for each layer of a region
@@ -757,51 +931,53 @@ void PrintObject::detect_surfaces_type()
             // Move surfaces_new to layerm->slices.surfaces
             for (size_t idx_layer = 0; idx_layer < m_layers.size(); ++ idx_layer)
                 m_layers[idx_layer]->get_region(idx_region)->slices.surfaces = std::move(surfaces_new[idx_layer]);
-        }
 
-        BOOST_LOG_TRIVIAL(debug) << "Detecting solid surfaces for region " << idx_region << " - clipping in parallel - start";
-        // Fill in layerm->fill_surfaces by trimming the layerm->slices by the cummulative layerm->fill_surfaces.
-        tbb::parallel_for(
-            tbb::blocked_range<size_t>(0, m_layers.size()),
-            [this, idx_region, interface_shells, &surfaces_new](const tbb::blocked_range<size_t>& range) {
-                for (size_t idx_layer = range.begin(); idx_layer < range.end(); ++ idx_layer) {
-                    m_print->throw_if_canceled();
-                    LayerRegion *layerm = m_layers[idx_layer]->get_region(idx_region);
-                    layerm->slices_to_fill_surfaces_clipped();
+            BOOST_LOG_TRIVIAL(debug) << "Detecting solid surfaces for region " << idx_region << " - clipping in parallel - start";
+            // Fill in layerm->fill_surfaces by trimming the layerm->slices by the cummulative layerm->fill_surfaces.
+            tbb::parallel_for(
+                tbb::blocked_range<size_t>(0, m_layers.size()),
+                [this, idx_region](const tbb::blocked_range<size_t>& range) {
+                    for (size_t idx_layer = range.begin(); idx_layer < range.end(); ++ idx_layer) {
+                        m_print->throw_if_canceled();
+                        LayerRegion *layerm = m_layers[idx_layer]->get_region(idx_region);
+                        layerm->slices_to_fill_surfaces_clipped();
 #ifdef SLIC3R_DEBUG_SLICE_PROCESSING
-                    layerm->export_region_fill_surfaces_to_svg_debug("1_detect_surfaces_type-final");
+                        layerm->export_region_fill_surfaces_to_svg_debug("1_detect_surfaces_type-final");
 #endif /* SLIC3R_DEBUG_SLICE_PROCESSING */
-                } // for each layer of a region
-            });
-        m_print->throw_if_canceled();
-        BOOST_LOG_TRIVIAL(debug) << "Detecting solid surfaces for region " << idx_region << " - clipping in parallel - end";
+                    } // for each layer of a region
+                });
+            m_print->throw_if_canceled();
+            BOOST_LOG_TRIVIAL(debug) << "Detecting solid surfaces for region " << idx_region << " - clipping in parallel - end";
+        }
     } // for each this->print->region_count
 
     // Mark the object to have the region slices classified (typed, which also means they are split based on whether they are supported, bridging, top layers etc.)
     this->typed_slices = true;
 }
 
+// Both the preparation of the fill surfaces and the processing of the external surfaces work on a single layer region,
+// only reading the islands of the layer below. Therefore both are done in a single pass over the layers.
 void PrintObject::process_external_surfaces()
 {
-    BOOST_LOG_TRIVIAL(info) << "Processing external surfaces...";
+    BOOST_LOG_TRIVIAL(info) << "Preparing fill surfaces and processing external surfaces...";
 
-	for (size_t region_id = 0; region_id < this->region_volumes.size(); ++region_id) {
-        const PrintRegion &region = *m_print->regions()[region_id];
-        
-        BOOST_LOG_TRIVIAL(debug) << "Processing external surfaces for region " << region_id << " in parallel - start";
-        tbb::parallel_for(
-            tbb::blocked_range<size_t>(0, m_layers.size()),
-            [this, region_id](const tbb::blocked_range<size_t>& range) {
-                for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx) {
-                    m_print->throw_if_canceled();
-                    // BOOST_LOG_TRIVIAL(trace) << "Processing external surface, layer" << m_layers[layer_idx]->print_z;
-                    m_layers[layer_idx]->get_region(region_id)->process_external_surfaces((layer_idx == 0) ? NULL : m_layers[layer_idx - 1]);
+    BOOST_LOG_TRIVIAL(debug) << "Processing external surfaces in parallel - start";
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, m_layers.size()),
+        [this](const tbb::blocked_range<size_t>& range) {
+            for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx) {
+                m_print->throw_if_canceled();
+                // BOOST_LOG_TRIVIAL(trace) << "Processing external surface, layer" << m_layers[layer_idx]->print_z;
+                Layer *layer = m_layers[layer_idx];
+                for (LayerRegion *layerm : layer->m_regions) {
+                    layerm->prepare_fill_surfaces();
+                    layerm->process_external_surfaces((layer_idx == 0) ? NULL : m_layers[layer_idx - 1]);
                 }
             }
-        );
-        m_print->throw_if_canceled();
-        BOOST_LOG_TRIVIAL(debug) << "Processing external surfaces for region " << region_id << " in parallel - end";
-    }
+        }
+    );
+    m_print->throw_if_canceled();
+    BOOST_LOG_TRIVIAL(debug) << "Processing external surfaces in parallel - end";
 }
 
 void PrintObject::discover_vertical_shells()
@@ -1375,7 +1551,7 @@ bool PrintObject::update_layer_height_profile()
 // Resulting expolygons of layer regions are marked as Internal.
 //
 // this should be idempotent
-void PrintObject::_slice()
+std::vector<size_t> PrintObject::_slice()
 {
     BOOST_LOG_TRIVIAL(info) << "Slicing objects...";
 
@@ -1390,30 +1566,64 @@ void PrintObject::_slice()
     SlicingParameters slicing_params = this->slicing_parameters();
 
     // 1) Initialize layers and their slice heights.
-    std::vector<float> slice_zs;
+    // If just the layer height profile changed since the layers were sliced, the layers keeping their print_z and height
+    // are reused as they are, and only the layers of the modified Z bands are sliced.
+    // Indices of the layers to be sliced into m_layers.
+    std::vector<size_t> layers_sliced;
+    // Slice heights of layers_sliced.
+    std::vector<float>  slice_zs;
     {
-        this->clear_layers();
+        LayerPtrs old_layers;
+        if (m_layers_reusable)
+            old_layers.swap(m_layers);
+        else
+            this->clear_layers();
+        m_layers_reusable = false;
+        size_t idx_old_layer = 0;
         // Object layers (pairs of bottom/top Z coordinate), without the raft.
         std::vector<coordf_t> object_layers = generate_object_layers(slicing_params, this->layer_height_profile);
         // Reserve object layers for the raft. Last layer of the raft is the contact layer.
         int id = int(slicing_params.raft_layers());
         slice_zs.reserve(object_layers.size());
+        layers_sliced.reserve(object_layers.size());
         Layer *prev = nullptr;
         for (size_t i_layer = 0; i_layer < object_layers.size(); i_layer += 2) {
             coordf_t lo = object_layers[i_layer];
             coordf_t hi = object_layers[i_layer + 1];
             coordf_t slice_z = 0.5 * (lo + hi);
-            Layer *layer = this->add_layer(id ++, hi - lo, hi + slicing_params.object_print_z_min, slice_z);
-            slice_zs.push_back(float(slice_z));
+            coordf_t print_z = hi + slicing_params.object_print_z_min;
+            // Release the old layers below this layer, they have no counterpart in the new set of layers.
+            for (; idx_old_layer < old_layers.size() && old_layers[idx_old_layer]->print_z < print_z - EPSILON; ++ idx_old_layer)
+                delete old_layers[idx_old_layer];
+            Layer *layer = nullptr;
+            if (idx_old_layer < old_layers.size() && 
+                std::abs(old_layers[idx_old_layer]->print_z - print_z) < EPSILON && 
+                std::abs(old_layers[idx_old_layer]->height - (hi - lo)) < EPSILON) {
+                // Reuse the old layer with the same Z span.
+                layer = old_layers[idx_old_layer ++];
+                layer->set_id(id ++);
+                layer->upper_layer = nullptr;
+                layer->lower_layer = nullptr;
+                // Merge the slices classified by the previous run of prepare_infill() back to stInternal.
+                layer->merge_slices();
+                m_layers.emplace_back(layer);
+            } else {
+                layer = this->add_layer(id ++, hi - lo, print_z, slice_z);
+                layers_sliced.emplace_back(m_layers.size() - 1);
+                slice_zs.emplace_back(float(slice_z));
+                // Make sure all layers contain layer region objects for all regions.
+                for (size_t region_id = 0; region_id < this->region_volumes.size(); ++ region_id)
+                    layer->add_region(this->print()->regions()[region_id]);
+            }
             if (prev != nullptr) {
                 prev->upper_layer = layer;
                 layer->lower_layer = prev;
             }
-            // Make sure all layers contain layer region objects for all regions.
-            for (size_t region_id = 0; region_id < this->region_volumes.size(); ++ region_id)
-                layer->add_region(this->print()->regions()[region_id]);
             prev = layer;
         }
+        for (; idx_old_layer < old_layers.size(); ++ idx_old_layer)
+            delete old_layers[idx_old_layer];
+        BOOST_LOG_TRIVIAL(debug) << "Slicing objects - " << layers_sliced.size() << " layers to be sliced, " << m_layers.size() - layers_sliced.size() << " layers reused";
     }
     
     // Slice all non-modifier volumes.
@@ -1422,8 +1632,8 @@ void PrintObject::_slice()
         std::vector<ExPolygons> expolygons_by_layer = this->_slice_region(region_id, slice_zs, false);
         m_print->throw_if_canceled();
         BOOST_LOG_TRIVIAL(debug) << "Slicing objects - append slices " << region_id << " start";
-        for (size_t layer_id = 0; layer_id < expolygons_by_layer.size(); ++ layer_id)
-            m_layers[layer_id]->regions()[region_id]->slices.append(std::move(expolygons_by_layer[layer_id]), stInternal);
+        for (size_t i = 0; i < expolygons_by_layer.size(); ++ i)
+            m_layers[layers_sliced[i]]->regions()[region_id]->slices.append(std::move(expolygons_by_layer[i]), stInternal);
         m_print->throw_if_canceled();
         BOOST_LOG_TRIVIAL(debug) << "Slicing objects - append slices " << region_id << " end";
     }
@@ -1439,14 +1649,14 @@ void PrintObject::_slice()
             for (size_t other_region_id = 0; other_region_id < this->region_volumes.size(); ++ other_region_id) {
                 if (region_id == other_region_id)
                     continue;
-                for (size_t layer_id = 0; layer_id < expolygons_by_layer.size(); ++ layer_id) {
-                    Layer       *layer = m_layers[layer_id];
+                for (size_t i = 0; i < expolygons_by_layer.size(); ++ i) {
+                    Layer       *layer = m_layers[layers_sliced[i]];
                     LayerRegion *layerm = layer->m_regions[region_id];
                     LayerRegion *other_layerm = layer->m_regions[other_region_id];
                     if (layerm == nullptr || other_layerm == nullptr)
                         continue;
                     Polygons other_slices = to_polygons(other_layerm->slices);
-                    ExPolygons my_parts = intersection_ex(other_slices, to_polygons(expolygons_by_layer[layer_id]));
+                    ExPolygons my_parts = intersection_ex(other_slices, to_polygons(expolygons_by_layer[i]));
                     if (my_parts.empty())
                         continue;
                     // Remove such parts from original region.
@@ -1471,6 +1681,8 @@ void PrintObject::_slice()
         m_layers.pop_back();
 		if (! m_layers.empty())
 			m_layers.back()->upper_layer = nullptr;
+        if (! layers_sliced.empty() && layers_sliced.back() == m_layers.size())
+            layers_sliced.pop_back();
     }
     m_print->throw_if_canceled();
 end:
@@ -1478,10 +1690,11 @@ end:
 
     BOOST_LOG_TRIVIAL(debug) << "Slicing objects - make_slices in parallel - begin";
     tbb::parallel_for(
-        tbb::blocked_range<size_t>(0, m_layers.size()),
-        [this](const tbb::blocked_range<size_t>& range) {
-            for (size_t layer_id = range.begin(); layer_id < range.end(); ++ layer_id) {
+        tbb::blocked_range<size_t>(0, layers_sliced.size()),
+        [this, &layers_sliced](const tbb::blocked_range<size_t>& range) {
+            for (size_t i = range.begin(); i < range.end(); ++ i) {
                 m_print->throw_if_canceled();
+                size_t layer_id = layers_sliced[i];
                 Layer *layer = m_layers[layer_id];
                 // Apply size compensation and perform clipping of multi-part objects.
                 float delta = float(scale_(m_config.xy_size_compensation.value));
@@ -1519,6 +1732,7 @@ end:
         });
     m_print->throw_if_canceled();
     BOOST_LOG_TRIVIAL(debug) << "Slicing objects - make_slices in parallel - end";
+    return layers_sliced;
 }
 
 std::vector<ExPolygons> PrintObject::_slice_region(size_t region_id, const std::vector<float> &z, bool modifier)
@@ -1564,35 +1778,88 @@ std::vector<ExPolygons> PrintObject::_slice_volumes(const std::vector<float> &z,
 {
     std::vector<ExPolygons> layers;
     if (! volumes.empty()) {
-        // Compose mesh.
-        //FIXME better to perform slicing over each volume separately and then to use a Boolean operation to merge them.
-        TriangleMesh mesh;
-        for (const ModelVolume *v : volumes)
-#if ENABLE_MODELVOLUME_TRANSFORM
-        {
-            TriangleMesh vol_mesh(v->mesh);
-            vol_mesh.transform(v->get_matrix());
-            mesh.merge(vol_mesh);
-        }
-#else
-        mesh.merge(v->mesh);
-#endif // ENABLE_MODELVOLUME_TRANSFORM
-        if (mesh.stl.stats.number_of_facets > 0) {
-            mesh.transform(m_trafo);
-            // apply XY shift
-            mesh.translate(- unscale<float>(m_copies_shift(0)), - unscale<float>(m_copies_shift(1)), 0);
+        const TriangleMeshSlicer *mslicer = this->_volumes_slicer(volumes);
+        if (mslicer != nullptr) {
             // perform actual slicing
-            TriangleMeshSlicer mslicer;
             const Print *print = this->print();
             auto callback = TriangleMeshSlicer::throw_on_cancel_callback_type([print](){print->throw_if_canceled();});
-            mslicer.init(&mesh, callback);
-            mslicer.slice(z, &layers, callback);
+            mslicer->slice(z, &layers, callback);
             m_print->throw_if_canceled();
         }
     }
     return layers;
 }
 
+// Returns a slicer of the mesh composed of the volumes, or nullptr if the volumes are empty.
+// The composed mesh is cached together with its slicer, keyed by the IDs and transformations of the volumes.
+const TriangleMeshSlicer* PrintObject::_volumes_slicer(const std::vector<const ModelVolume*> &volumes) const
+{
+    // Slot of a cached slicer composed of the same volumes, but with some of the volumes transformed differently.
+    std::unique_ptr<VolumesSlicer> *slot = nullptr;
+    for (std::unique_ptr<VolumesSlicer> &cached : m_volumes_slicers) {
+        bool same_volumes = cached->volume_ids.size() == volumes.size();
+        for (size_t i = 0; same_volumes && i < volumes.size(); ++ i)
+            same_volumes = cached->volume_ids[i] == volumes[i]->id();
+        if (! same_volumes)
+            continue;
+#if ENABLE_MODELVOLUME_TRANSFORM
+        bool same_trafos = true;
+        for (size_t i = 0; same_trafos && i < volumes.size(); ++ i)
+            same_trafos = cached->volume_trafos[i].isApprox(volumes[i]->get_matrix());
+        if (! same_trafos) {
+            // The volumes were moved, the old composed mesh will not be used anymore. Replace it.
+            slot = &cached;
+            break;
+        }
+#endif // ENABLE_MODELVOLUME_TRANSFORM
+        return cached->mesh.stl.stats.number_of_facets > 0 ? &cached->slicer : nullptr;
+    }
+
+    if (slot == nullptr) {
+        // Release the slicers composed of volumes, which were removed from the ModelObject, for example of removed support enforcers.
+        std::vector<ModelID> volume_ids;
+        for (const ModelVolume *v : m_model_object->volumes)
+            volume_ids.emplace_back(v->id());
+        std::sort(volume_ids.begin(), volume_ids.end());
+        m_volumes_slicers.erase(std::remove_if(m_volumes_slicers.begin(), m_volumes_slicers.end(), 
+            [&volume_ids](const std::unique_ptr<VolumesSlicer> &cached) {
+                for (const ModelID &id : cached->volume_ids)
+                    if (! std::binary_search(volume_ids.begin(), volume_ids.end(), id))
+                        return true;
+                return false;
+            }), m_volumes_slicers.end());
+    }
+
+    std::unique_ptr<VolumesSlicer> volumes_slicer(new VolumesSlicer());
+    // Compose mesh.
+    //FIXME better to perform slicing over each volume separately and then to use a Boolean operation to merge them.
+    TriangleMesh &mesh = volumes_slicer->mesh;
+    for (const ModelVolume *v : volumes) {
+        volumes_slicer->volume_ids.emplace_back(v->id());
+#if ENABLE_MODELVOLUME_TRANSFORM
+        volumes_slicer->volume_trafos.emplace_back(v->get_matrix());
+        TriangleMesh vol_mesh(v->mesh);
+        vol_mesh.transform(v->get_matrix());
+        mesh.merge(vol_mesh);
+#else
+        mesh.merge(v->mesh);
+#endif // ENABLE_MODELVOLUME_TRANSFORM
+    }
+    if (mesh.stl.stats.number_of_facets > 0) {
+        mesh.transform(m_trafo);
+        // apply XY shift
+        mesh.translate(- unscale<float>(m_copies_shift(0)), - unscale<float>(m_copies_shift(1)), 0);
+        const Print *print = this->print();
+        volumes_slicer->slicer.init(&mesh, [print](){print->throw_if_canceled();});
+    }
+    if (slot == nullptr) {
+        m_volumes_slicers.emplace_back(std::move(volumes_slicer));
+        slot = &m_volumes_slicers.back();
+    } else
+        *slot = std::move(volumes_slicer);
+    return mesh.stl.stats.number_of_facets > 0 ? &(*slot)->slicer : nullptr;
+}
+
 std::string PrintObject::_fix_slicing_errors()
 {
     // Collect layers with slicing errors.
@@ -1679,15 +1946,16 @@ std::string PrintObject::_fix_slicing_errors()
 // Simplify the sliced model, if "resolution" configuration parameter > 0.
 // The simplification is problematic, because it simplifies the slices independent from each other,
 // which makes the simplified discretization visible on the object surface.
-void PrintObject::_simplify_slices(double distance)
+// Simplify the slices of the layers with the given indices.
+void PrintObject::_simplify_slices(double distance, const std::vector<size_t> &layers)
 {
     BOOST_LOG_TRIVIAL(debug) << "Slicing objects - siplifying slices in parallel - begin";
     tbb::parallel_for(
-        tbb::blocked_range<size_t>(0, m_layers.size()),
-        [this, distance](const tbb::blocked_range<size_t>& range) {
-            for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx) {
+        tbb::blocked_range<size_t>(0, layers.size()),
+        [this, distance, &layers](const tbb::blocked_range<size_t>& range) {
+            for (size_t i = range.begin(); i < range.end(); ++ i) {
                 m_print->throw_if_canceled();
-                Layer *layer = m_layers[layer_idx];
+                Layer *layer = m_layers[layers[i]];
                 for (size_t region_idx = 0; region_idx < layer->m_regions.size(); ++ region_idx)
                     layer->m_regions[region_idx]->slices.simplify(distance);
                 layer->slices.simplify(distance);
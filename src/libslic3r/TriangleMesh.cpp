@@ -14,6 +14,7 @@
 #include <algorithm>
 #include <math.h>
 #include <type_traits>
+#include <limits>
 
 #include <boost/log/trivial.hpp>
 
@@ -665,6 +666,34 @@ void TriangleMeshSlicer::init(TriangleMesh *_mesh, throw_on_cancel_callback_type
     for (int i = 0; i < this->mesh->stl.stats.shared_vertices; ++ i)
         this->v_scaled_shared[i] *= float(1. / SCALING_FACTOR);
 
+    // Index the facets by their Z span, so that slice() will only visit the facets crossing each slicing plane.
+    this->facets_by_min_z.assign(_mesh->stl.stats.number_of_facets, FacetZSpan());
+    for (int facet_idx = 0; facet_idx < int(_mesh->stl.stats.number_of_facets); ++ facet_idx) {
+        const stl_facet &facet = _mesh->stl.facet_start[facet_idx];
+        FacetZSpan      &span  = this->facets_by_min_z[facet_idx];
+        span.min_z     = fminf(facet.vertex[0](2), fminf(facet.vertex[1](2), facet.vertex[2](2)));
+        span.max_z     = fmaxf(facet.vertex[0](2), fmaxf(facet.vertex[1](2), facet.vertex[2](2)));
+        span.facet_idx = facet_idx;
+    }
+    std::sort(this->facets_by_min_z.begin(), this->facets_by_min_z.end(), 
+        [](const FacetZSpan &s1, const FacetZSpan &s2) { return s1.min_z < s2.min_z || (s1.min_z == s2.min_z && s1.facet_idx < s2.facet_idx); });
+    {
+        // Binary tree of the maximum Z over blocks of FACETS_PER_BLOCK consecutive facets of facets_by_min_z.
+        // Root at index 1, leaves at indices <num_leaves, 2 * num_leaves).
+        size_t num_blocks = (this->facets_by_min_z.size() + FACETS_PER_BLOCK - 1) / FACETS_PER_BLOCK;
+        size_t num_leaves = 1;
+        while (num_leaves < num_blocks)
+            num_leaves *= 2;
+        this->facets_max_z_tree.assign(2 * num_leaves, - std::numeric_limits<float>::max());
+        for (size_t i = 0; i < this->facets_by_min_z.size(); ++ i) {
+            float &max_z = this->facets_max_z_tree[num_leaves + i / FACETS_PER_BLOCK];
+            max_z = std::max(max_z, this->facets_by_min_z[i].max_z);
+        }
+        for (size_t i = num_leaves - 1; i > 0; -- i)
+            this->facets_max_z_tree[i] = std::max(this->facets_max_z_tree[2 * i], this->facets_max_z_tree[2 * i + 1]);
+    }
+    throw_on_cancel();
+
     // Create a mapping from triangle edge into face.
     struct EdgeToFace {
         // Index of the 1st vertex of the triangle edge. vertex_low <= vertex_high.
@@ -740,6 +769,43 @@ void TriangleMeshSlicer::init(TriangleMesh *_mesh, throw_on_cancel_callback_type
     }
 }
 
+// Enumerate the facets crossing the slicing plane at slice_z, that is min_z <= slice_z <= max_z.
+// Only the facets with min_z <= slice_z form a prefix of facets_by_min_z, and the blocks of the prefix,
+// which do not contain any facet reaching up to slice_z, are culled by the tree of the maximum Z values.
+template<typename FN>
+void TriangleMeshSlicer::foreach_facet_crossing(float slice_z, FN fn) const
+{
+    size_t end = std::upper_bound(this->facets_by_min_z.begin(), this->facets_by_min_z.end(), slice_z, 
+        [](float z, const FacetZSpan &span) { return z < span.min_z; }) - this->facets_by_min_z.begin();
+    if (end == 0)
+        return;
+    const size_t last_block  = (end - 1) / FACETS_PER_BLOCK;
+    const size_t num_leaves  = this->facets_max_z_tree.size() / 2;
+    // Depth first traversal of the tree, pruning the subtrees not reaching up to slice_z
+    // and the subtrees starting above slice_z. 64 levels are more than enough for any tree.
+    struct Node { size_t idx; size_t first_block; size_t num_blocks; };
+    Node   stack[64];
+    size_t stack_size = 0;
+    stack[stack_size ++] = { 1, 0, num_leaves };
+    while (stack_size > 0) {
+        Node node = stack[-- stack_size];
+        if (node.first_block > last_block || this->facets_max_z_tree[node.idx] < slice_z)
+            continue;
+        if (node.num_blocks == 1) {
+            // Leaf, test the facets of the block one by one.
+            size_t i_end = std::min(end, (node.first_block + 1) * FACETS_PER_BLOCK);
+            for (size_t i = node.first_block * FACETS_PER_BLOCK; i < i_end; ++ i)
+                if (this->facets_by_min_z[i].max_z >= slice_z)
+                    fn(this->facets_by_min_z[i]);
+        } else {
+            // Push the right child first to visit the facets in the order of their minimum Z.
+            size_t half = node.num_blocks / 2;
+            stack[stack_size ++] = { 2 * node.idx + 1, node.first_block + half, half };
+            stack[stack_size ++] = { 2 * node.idx,     node.first_block,        half };
+        }
+    }
+}
+
 void TriangleMeshSlicer::slice(const std::vector<float> &z, std::vector<Polygons>* layers, throw_on_cancel_callback_type throw_on_cancel) const
 {
     BOOST_LOG_TRIVIAL(debug) << "TriangleMeshSlicer::slice";
@@ -773,19 +839,21 @@ void TriangleMeshSlicer::slice(const std::vector<float> &z, std::vector<Polygons
     
     BOOST_LOG_TRIVIAL(debug) << "TriangleMeshSlicer::_slice_do";
     std::vector<IntersectionLines> lines(z.size());
-    {
-        boost::mutex lines_mutex;
-        tbb::parallel_for(
-            tbb::blocked_range<int>(0,this->mesh->stl.stats.number_of_facets),
-            [&lines, &lines_mutex, &z, throw_on_cancel, this](const tbb::blocked_range<int>& range) {
-                for (int facet_idx = range.begin(); facet_idx < range.end(); ++ facet_idx) {
-                    if ((facet_idx & 0x0ffff) == 0)
-                        throw_on_cancel();
-                    this->_slice_do(facet_idx, &lines, &lines_mutex, z);
-                }
+    // Each layer collects the intersection lines of just the facets crossing its slicing plane,
+    // as enumerated by the Z index of the facets built by init(). Therefore the layers
+    // are sliced in parallel without any synchronization.
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, z.size()),
+        [&lines, &z, throw_on_cancel, this](const tbb::blocked_range<size_t>& range) {
+            for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx) {
+                throw_on_cancel();
+                const float slice_z = z[layer_idx];
+                this->foreach_facet_crossing(slice_z, [this, slice_z, &lines, layer_idx](const FacetZSpan &span) {
+                    this->_slice_do(span.facet_idx, span.min_z, span.max_z, slice_z, &lines[layer_idx]);
+                });
             }
-        );
-    }
+        }
+    );
     throw_on_cancel();
 
     // v_scaled_shared could be freed here
@@ -839,63 +907,46 @@ void TriangleMeshSlicer::slice(const std::vector<float> &z, std::vector<Polygons
 #endif
 }
 
-void TriangleMeshSlicer::_slice_do(size_t facet_idx, std::vector<IntersectionLines>* lines, boost::mutex* lines_mutex, 
-    const std::vector<float> &z) const
+void TriangleMeshSlicer::_slice_do(size_t facet_idx, float min_z, float max_z, float slice_z, IntersectionLines* lines) const
 {
     const stl_facet &facet = this->mesh->stl.facet_start[facet_idx];
     
-    // find facet extents
-    const float min_z = fminf(facet.vertex[0](2), fminf(facet.vertex[1](2), facet.vertex[2](2)));
-    const float max_z = fmaxf(facet.vertex[0](2), fmaxf(facet.vertex[1](2), facet.vertex[2](2)));
-    
     #ifdef SLIC3R_TRIANGLEMESH_DEBUG
     printf("\n==> FACET %d (%f,%f,%f - %f,%f,%f - %f,%f,%f):\n", facet_idx,
         facet.vertex[0].x, facet.vertex[0].y, facet.vertex[0](2),
         facet.vertex[1].x, facet.vertex[1].y, facet.vertex[1](2),
         facet.vertex[2].x, facet.vertex[2].y, facet.vertex[2](2));
-    printf("z: min = %.2f, max = %.2f\n", min_z, max_z);
+    printf("z: min = %.2f, max = %.2f, slice_z = %.2f\n", min_z, max_z, slice_z);
     #endif /* SLIC3R_TRIANGLEMESH_DEBUG */
     
-    // find layer extents
-    std::vector<float>::const_iterator min_layer, max_layer;
-    min_layer = std::lower_bound(z.begin(), z.end(), min_z); // first layer whose slice_z is >= min_z
-    max_layer = std::upper_bound(z.begin() + (min_layer - z.begin()), z.end(), max_z); // first layer, whose slice_z is > max_z
-    #ifdef SLIC3R_TRIANGLEMESH_DEBUG
-    printf("layers: min = %d, max = %d\n", (int)(min_layer - z.begin()), (int)(max_layer - z.begin()) - 1);
-    #endif /* SLIC3R_TRIANGLEMESH_DEBUG */
-    
-    for (std::vector<float>::const_iterator it = min_layer; it != max_layer; ++it) {
-        std::vector<float>::size_type layer_idx = it - z.begin();
-        IntersectionLine il;
-        if (this->slice_facet(*it / SCALING_FACTOR, facet, facet_idx, min_z, max_z, &il) == TriangleMeshSlicer::Slicing) {
-            boost::lock_guard<boost::mutex> l(*lines_mutex);
-            if (il.edge_type == feHorizontal) {
-                // Insert all marked edges of the face. The marked edges do not share an edge with another horizontal face
-                // (they may not have a nighbor, or their neighbor is vertical)
-                const int *vertices = this->mesh->stl.v_indices[facet_idx].vertex;
-                const bool reverse  = this->mesh->stl.facet_start[facet_idx].normal(2) < 0;
-                for (int j = 0; j < 3; ++ j)
-                    if (il.flags & ((IntersectionLine::EDGE0_NO_NEIGHBOR | IntersectionLine::EDGE0_FOLD) << j)) {
-                        int a_id = vertices[j % 3];
-                        int b_id = vertices[(j+1) % 3];
-                        if (reverse)
-                            std::swap(a_id, b_id);
-                        const stl_vertex &a = this->v_scaled_shared[a_id];
-                        const stl_vertex &b = this->v_scaled_shared[b_id];
-                        il.a(0)    = a(0);
-                        il.a(1)    = a(1);
-                        il.b(0)    = b(0);
-                        il.b(1)    = b(1);
-                        il.a_id   = a_id;
-                        il.b_id   = b_id;
-                        assert(il.a != il.b);
-                        // This edge will not be used as a seed for loop extraction if it was added due to a fold of two overlapping horizontal faces.
-                        il.set_no_seed((IntersectionLine::EDGE0_FOLD << j) != 0);
-                        (*lines)[layer_idx].emplace_back(il);
-                    }
-            } else
-                (*lines)[layer_idx].emplace_back(il);
-        }
+    IntersectionLine il;
+    if (this->slice_facet(slice_z / SCALING_FACTOR, facet, facet_idx, min_z, max_z, &il) == TriangleMeshSlicer::Slicing) {
+        if (il.edge_type == feHorizontal) {
+            // Insert all marked edges of the face. The marked edges do not share an edge with another horizontal face
+            // (they may not have a nighbor, or their neighbor is vertical)
+            const int *vertices = this->mesh->stl.v_indices[facet_idx].vertex;
+            const bool reverse  = this->mesh->stl.facet_start[facet_idx].normal(2) < 0;
+            for (int j = 0; j < 3; ++ j)
+                if (il.flags & ((IntersectionLine::EDGE0_NO_NEIGHBOR | IntersectionLine::EDGE0_FOLD) << j)) {
+                    int a_id = vertices[j % 3];
+                    int b_id = vertices[(j+1) % 3];
+                    if (reverse)
+                        std::swap(a_id, b_id);
+                    const stl_vertex &a = this->v_scaled_shared[a_id];
+                    const stl_vertex &b = this->v_scaled_shared[b_id];
+                    il.a(0)    = a(0);
+                    il.a(1)    = a(1);
+                    il.b(0)    = b(0);
+                    il.b(1)    = b(1);
+                    il.a_id   = a_id;
+                    il.b_id   = b_id;
+                    assert(il.a != il.b);
+                    // This edge will not be used as a seed for loop extraction if it was added due to a fold of two overlapping horizontal faces.
+                    il.set_no_seed((IntersectionLine::EDGE0_FOLD << j) != 0);
+                    lines->emplace_back(il);
+                }
+        } else
+            lines->emplace_back(il);
     }
 }
 
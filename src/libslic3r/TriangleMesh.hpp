@@ -180,8 +180,21 @@ private:
     std::vector<int>         facets_edges;
     // Scaled copy of this->mesh->stl.v_shared
     std::vector<stl_vertex>  v_scaled_shared;
-
-    void _slice_do(size_t facet_idx, std::vector<IntersectionLines>* lines, boost::mutex* lines_mutex, const std::vector<float> &z) const;
+    // Z span of a facet, indexing this->mesh->stl.facet_start.
+    struct FacetZSpan {
+        float   min_z;
+        float   max_z;
+        int     facet_idx;
+    };
+    // Facets sorted by their minimum Z. Built once by init() and reused by all the slice() calls.
+    std::vector<FacetZSpan>  facets_by_min_z;
+    // Maximum Z of the facets over blocks of FACETS_PER_BLOCK consecutive facets_by_min_z,
+    // stored as an implicit complete binary tree to cull the facets not crossing a slicing plane.
+    std::vector<float>       facets_max_z_tree;
+    static const size_t      FACETS_PER_BLOCK = 32;
+
+    template<typename FN> void foreach_facet_crossing(float slice_z, FN fn) const;
+    void _slice_do(size_t facet_idx, float min_z, float max_z, float slice_z, IntersectionLines* lines) const;
     void make_loops(std::vector<IntersectionLine> &lines, Polygons* loops) const;
     void make_expolygons(const Polygons &loops, ExPolygons* slices) const;
     void make_expolygons_simple(std::vector<IntersectionLine> &lines, ExPolygons* slices) const;
@@ -93,6 +93,7 @@
 #include <boost/version.hpp>
 
 #include <tbb/atomic.h>
+#include <tbb/enumerable_thread_specific.h>
 #include <tbb/parallel_for.h>
 #include <tbb/spin_mutex.h>
 #include <tbb/mutex.h>
@@ -22,8 +22,11 @@
 #include <boost/nowide/cenv.hpp>
 #include <boost/nowide/iostream.hpp>
 
+#include <tbb/parallel_for.h>
+
 #include "libslic3r/libslic3r.h"
 #include "libslic3r/Config.hpp"
+#include "libslic3r/GCodeTimeEstimator.hpp"
 #include "libslic3r/Geometry.hpp"
 #include "libslic3r/Model.hpp"
 #include "libslic3r/Print.hpp"
@@ -136,6 +139,22 @@ int main(int argc, char **argv)
         return 0;
     }
 
+    if (cli_config.estimate_time) {
+        // The input files are G-code files. Estimate them in parallel, print the results in the order of the input files.
+        print_config.normalize();
+        PrintConfig config;
+        config.apply(print_config, true);
+        std::vector<std::string> results(input_files.size());
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, input_files.size()),
+            [&input_files, &config, &results](const tbb::blocked_range<size_t> &range) {
+                for (size_t i = range.begin(); i < range.end(); ++ i)
+                    results[i] = estimate_print_time(input_files[i], config);
+            });
+        for (const std::string &result : results)
+            boost::nowide::cout << result << std::endl;
+        return 0;
+    }
+
     // read input file(s) if any
     std::vector<Model> models;
     for (const t_config_option_key &file : input_files) {
@@ -230,7 +249,7 @@ int main(int argc, char **argv)
             std::string err = print->validate();
             if (err.empty()) {
                 if (printer_technology == ptFFF) {
-                    fff_print.export_gcode(outfile, nullptr);
+                    fff_print.process_and_export_gcode(outfile, nullptr);
                 } else {
                     assert(printer_technology == ptSLA);
 					//FIXME add the output here
@@ -73,6 +73,9 @@ static const float DEFAULT_BG_LIGHT_COLOR[3] = { 0.753f, 0.753f, 0.753f };
 static const float ERROR_BG_DARK_COLOR[3] = { 0.478f, 0.192f, 0.039f };
 static const float ERROR_BG_LIGHT_COLOR[3] = { 0.753f, 0.192f, 0.039f };
 
+// Above this number of vertices, the extrusion paths of the G-code preview are simplified.
+static const size_t MAX_PREVIEW_EXTRUSION_VERTICES = 4000000;
+
 namespace Slic3r {
 namespace GUI {
 
@@ -6909,24 +6912,24 @@ void GLCanvas3D::_load_gcode_extrusion_paths(const GCodePreviewData& preview_dat
     // helper functions to select data in dependence of the extrusion view type
     struct Helper
     {
-        static float path_filter(GCodePreviewData::Extrusion::EViewType type, const ExtrusionPath& path)
+        static float path_filter(GCodePreviewData::Extrusion::EViewType type, const GCodePreviewData::Extrusion::Layer& layer, size_t path_id)
         {
             switch (type)
             {
             case GCodePreviewData::Extrusion::FeatureType:
-                return (float)path.role();
+                return (float)layer.roles[path_id];
             case GCodePreviewData::Extrusion::Height:
-                return path.height;
+                return layer.heights[path_id];
             case GCodePreviewData::Extrusion::Width:
-                return path.width;
+                return layer.widths[path_id];
             case GCodePreviewData::Extrusion::Feedrate:
-                return path.feedrate;
+                return layer.feedrates[path_id];
             case GCodePreviewData::Extrusion::VolumetricRate:
-                return path.feedrate * (float)path.mm3_per_mm;
+                return layer.feedrates[path_id] * layer.mm3_per_mm[path_id];
             case GCodePreviewData::Extrusion::Tool:
-                return (float)path.extruder_id;
+                return (float)layer.extruder_ids[path_id];
             case GCodePreviewData::Extrusion::ColorPrint:
-                return (float)path.cp_color_id;
+                return (float)layer.cp_color_ids[path_id];
             default:
                 return 0.0f;
             }
@@ -7004,10 +7007,10 @@ void GLCanvas3D::_load_gcode_extrusion_paths(const GCodePreviewData& preview_dat
     FiltersList filters;
     for (const GCodePreviewData::Extrusion::Layer& layer : preview_data.extrusion.layers)
     {
-        for (const ExtrusionPath& path : layer.paths)
+        for (size_t i = 0; i < layer.paths_count(); ++i)
         {
-            ExtrusionRole role = path.role();
-            float path_filter = Helper::path_filter(preview_data.extrusion.view_type, path);
+            ExtrusionRole role = layer.roles[i];
+            float path_filter = Helper::path_filter(preview_data.extrusion.view_type, layer, i);
             if (std::find(filters.begin(), filters.end(), Filter(path_filter, role)) == filters.end())
                 filters.emplace_back(path_filter, role);
         }
@@ -7047,15 +7050,19 @@ void GLCanvas3D::_load_gcode_extrusion_paths(const GCodePreviewData& preview_dat
         }
     }
 
+    // the paths of dense prints are simplified so that the preview fits into the memory of the graphics card
+    unsigned int lod = preview_data.extrusion.lod_for_vertices(MAX_PREVIEW_EXTRUSION_VERTICES);
+
     // populates volumes
     for (const GCodePreviewData::Extrusion::Layer& layer : preview_data.extrusion.layers)
     {
-        for (const ExtrusionPath& path : layer.paths)
+        for (size_t i = 0; i < layer.paths_count(); ++i)
         {
-            float path_filter = Helper::path_filter(preview_data.extrusion.view_type, path);
-            FiltersList::iterator filter = std::find(filters.begin(), filters.end(), Filter(path_filter, path.role()));
+            float path_filter = Helper::path_filter(preview_data.extrusion.view_type, layer, i);
+            FiltersList::iterator filter = std::find(filters.begin(), filters.end(), Filter(path_filter, layer.roles[i]));
             if (filter != filters.end())
             {
+                ExtrusionPath path = layer.path(i, lod);
                 filter->volume->print_zs.push_back(layer.z);
                 filter->volume->offsets.push_back(filter->volume->indexed_vertex_array.quad_indices.size());
                 filter->volume->offsets.push_back(filter->volume->indexed_vertex_array.triangle_indices.size());
@@ -7158,10 +7165,11 @@ bool GLCanvas3D::_travel_paths_by_type(const GCodePreviewData& preview_data)
 
     // detects types
     TypesList types;
-    for (const GCodePreviewData::Travel::Polyline& polyline : preview_data.travel.polylines)
+    const GCodePreviewData::Travel::Polylines& polylines = preview_data.travel.polylines;
+    for (size_t i = 0; i < polylines.size(); ++i)
     {
-        if (std::find(types.begin(), types.end(), Type(polyline.type)) == types.end())
-            types.emplace_back(polyline.type);
+        if (std::find(types.begin(), types.end(), Type(polylines.types[i])) == types.end())
+            types.emplace_back(polylines.types[i]);
     }
 
     // nothing to render, return
@@ -7182,16 +7190,16 @@ bool GLCanvas3D::_travel_paths_by_type(const GCodePreviewData& preview_data)
     }
 
     // populates volumes
-    for (const GCodePreviewData::Travel::Polyline& polyline : preview_data.travel.polylines)
+    for (size_t i = 0; i < polylines.size(); ++i)
     {
-        TypesList::iterator type = std::find(types.begin(), types.end(), Type(polyline.type));
+        TypesList::iterator type = std::find(types.begin(), types.end(), Type(polylines.types[i]));
         if (type != types.end())
         {
-            type->volume->print_zs.push_back(unscale<double>(polyline.polyline.bounding_box().min(2)));
+            type->volume->print_zs.push_back(polylines.min_z(i));
             type->volume->offsets.push_back(type->volume->indexed_vertex_array.quad_indices.size());
             type->volume->offsets.push_back(type->volume->indexed_vertex_array.triangle_indices.size());
 
-            _3DScene::polyline3_to_verts(polyline.polyline, preview_data.travel.width, preview_data.travel.height, *type->volume);
+            _3DScene::polyline3_to_verts(polylines.polyline(i), preview_data.travel.width, preview_data.travel.height, *type->volume);
         }
     }
 
@@ -7224,10 +7232,11 @@ bool GLCanvas3D::_travel_paths_by_feedrate(const GCodePreviewData& preview_data)
 
     // detects feedrates
     FeedratesList feedrates;
-    for (const GCodePreviewData::Travel::Polyline& polyline : preview_data.travel.polylines)
+    const GCodePreviewData::Travel::Polylines& polylines = preview_data.travel.polylines;
+    for (size_t i = 0; i < polylines.size(); ++i)
     {
-        if (std::find(feedrates.begin(), feedrates.end(), Feedrate(polyline.feedrate)) == feedrates.end())
-            feedrates.emplace_back(polyline.feedrate);
+        if (std::find(feedrates.begin(), feedrates.end(), Feedrate(polylines.feedrates[i])) == feedrates.end())
+            feedrates.emplace_back(polylines.feedrates[i]);
     }
 
     // nothing to render, return
@@ -7248,16 +7257,16 @@ bool GLCanvas3D::_travel_paths_by_feedrate(const GCodePreviewData& preview_data)
     }
 
     // populates volumes
-    for (const GCodePreviewData::Travel::Polyline& polyline : preview_data.travel.polylines)
+    for (size_t i = 0; i < polylines.size(); ++i)
     {
-        FeedratesList::iterator feedrate = std::find(feedrates.begin(), feedrates.end(), Feedrate(polyline.feedrate));
+        FeedratesList::iterator feedrate = std::find(feedrates.begin(), feedrates.end(), Feedrate(polylines.feedrates[i]));
         if (feedrate != feedrates.end())
         {
-            feedrate->volume->print_zs.push_back(unscale<double>(polyline.polyline.bounding_box().min(2)));
+            feedrate->volume->print_zs.push_back(polylines.min_z(i));
             feedrate->volume->offsets.push_back(feedrate->volume->indexed_vertex_array.quad_indices.size());
             feedrate->volume->offsets.push_back(feedrate->volume->indexed_vertex_array.triangle_indices.size());
 
-            _3DScene::polyline3_to_verts(polyline.polyline, preview_data.travel.width, preview_data.travel.height, *feedrate->volume);
+            _3DScene::polyline3_to_verts(polylines.polyline(i), preview_data.travel.width, preview_data.travel.height, *feedrate->volume);
         }
     }
 
@@ -7290,10 +7299,11 @@ bool GLCanvas3D::_travel_paths_by_tool(const GCodePreviewData& preview_data, con
 
     // detects tools
     ToolsList tools;
-    for (const GCodePreviewData::Travel::Polyline& polyline : preview_data.travel.polylines)
+    const GCodePreviewData::Travel::Polylines& polylines = preview_data.travel.polylines;
+    for (size_t i = 0; i < polylines.size(); ++i)
     {
-        if (std::find(tools.begin(), tools.end(), Tool(polyline.extruder_id)) == tools.end())
-            tools.emplace_back(polyline.extruder_id);
+        if (std::find(tools.begin(), tools.end(), Tool(polylines.extruder_ids[i])) == tools.end())
+            tools.emplace_back(polylines.extruder_ids[i]);
     }
 
     // nothing to render, return
@@ -7314,16 +7324,16 @@ bool GLCanvas3D::_travel_paths_by_tool(const GCodePreviewData& preview_data, con
     }
 
     // populates volumes
-    for (const GCodePreviewData::Travel::Polyline& polyline : preview_data.travel.polylines)
+    for (size_t i = 0; i < polylines.size(); ++i)
     {
-        ToolsList::iterator tool = std::find(tools.begin(), tools.end(), Tool(polyline.extruder_id));
+        ToolsList::iterator tool = std::find(tools.begin(), tools.end(), Tool(polylines.extruder_ids[i]));
         if (tool != tools.end())
         {
-            tool->volume->print_zs.push_back(unscale<double>(polyline.polyline.bounding_box().min(2)));
+            tool->volume->print_zs.push_back(polylines.min_z(i));
             tool->volume->offsets.push_back(tool->volume->indexed_vertex_array.quad_indices.size());
             tool->volume->offsets.push_back(tool->volume->indexed_vertex_array.triangle_indices.size());
 
-            _3DScene::polyline3_to_verts(polyline.polyline, preview_data.travel.width, preview_data.travel.height, *tool->volume);
+            _3DScene::polyline3_to_verts(polylines.polyline(i), preview_data.travel.width, preview_data.travel.height, *tool->volume);
         }
     }
 
@@ -2,7 +2,7 @@ use Test::More;
 use strict;
 use warnings;
 
-plan tests => 14;
+plan tests => 17;
 
 BEGIN {
     use FindBin;
@@ -138,6 +138,20 @@ $config->set('disable_fan_first_layers',    [ 0 ]);
     like $gcode, qr/.*M107/, 'fan is disabled for the 2nd tool';
 }
 
+{
+    # The dwell extends the layer time above the fan threshold.
+    my %thresholds = (
+            'fan_below_layer_time'      => [ $print_time1 + 2 ],
+            'slowdown_below_layer_time' => [ $print_time1 * 0.5 ]
+        );
+    unlike buffer($config, \%thresholds)->process_layer($gcode1 . "G4 S3\n", 0), qr/M106/,
+        'wait time in seconds is counted into the layer time';
+    unlike buffer($config, \%thresholds)->process_layer($gcode1 . "G4 P3000 ; Stop\n", 0), qr/M106/,
+        'wait time in milliseconds is counted into the layer time';
+    like buffer($config, \%thresholds)->process_layer($gcode1 . "G4 ; S3\n", 0), qr/M106/,
+        'wait time is not read from the comment';
+}
+
 {
     my $config = Slic3r::Config::new_from_defaults;
     $config->set('cooling', [ 1 ]);
@@ -1,4 +1,4 @@
-use Test::More tests => 81;
+use Test::More tests => 96;
 use strict;
 use warnings;
 
@@ -107,6 +107,47 @@ use Slic3r::Test;
     is $parser->evaluate_boolean_expression('printer_notes=~/.*PRINTER_VENDOR_PRUSA3D.*/ and printer_notes=~/.*PRINTER_MODEL_MK2.*/ and nozzle_diameter[0]==0.6 and num_extruders>1'), 1, 'complex expression';
     is $parser->evaluate_boolean_expression('printer_notes=~/.*PRINTER_VEwerfNDOR_PRUSA3D.*/ or printer_notes=~/.*PRINTertER_MODEL_MK2.*/ or (nozzle_diameter[0]==0.6 and num_extruders>1)'), 1, 'complex expression2';
     is $parser->evaluate_boolean_expression('printer_notes=~/.*PRINTER_VEwerfNDOR_PRUSA3D.*/ or printer_notes=~/.*PRINTertER_MODEL_MK2.*/ or (nozzle_diameter[0]==0.3 and num_extruders>1)'), 0, 'complex expression3';
+
+    # Regression tests.
+    is $parser->process('{1 / 0.5}'), '2', 'math: integer divided by a double';
+    eval { $parser->process('{1.5 / 0}') };
+    like $@, qr/Division by zero/, 'math: double divided by integer zero';
+    is $parser->evaluate_boolean_expression('"abc" == "abc"'), 1, 'boolean expression parser: strings equal';
+    is $parser->evaluate_boolean_expression('"abc" < "abd"'),  1, 'boolean expression parser: strings lower than';
+    eval { $parser->process('[not_a_variable_[foo]]') };
+    like $@, qr/Variable does not exist/, 'indexing a variable, which does not exist (legacy syntax)';
+    eval { $parser->process('[nozzle_diameter_1x]') };
+    like $@, qr/Invalid vector index\n\[nozzle_diameter_1x\]\n {17}\^/, 'invalid vector index is reported at the index (legacy syntax)';
+}
+
+{
+    # The compiled templates are cached, the cached program shall be evaluated against the current config.
+    my $parser = Slic3r::GCode::PlaceholderParser->new;
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('temperature', [ 200, 210 ]);
+    $parser->apply_config($config);
+    $parser->set('foo' => 0);
+    $parser->set('bar' => 2);
+    my $templ = '{if foo == 0}first{elsif foo == 1}T[temperature_[foo]] {bar * 2}{else}{temperature[0] + bar}{endif}';
+    my $expr  = 'foo + 2 == bar and temperature[0] > 205';
+    is $parser->process($templ), 'first', 'template cache: first call';
+    is $parser->process($templ), 'first', 'template cache: same output on a cache hit';
+    is $parser->evaluate_boolean_expression($expr), 0, 'expression cache: first call';
+    $parser->set('foo' => 1);
+    $parser->set('bar' => 3);
+    is $parser->process($templ), 'T210 6', 'template cache: variables changed between the calls';
+    is $parser->evaluate_boolean_expression($expr), 0, 'expression cache: variables changed between the calls';
+    $config->set('temperature', [ 220, 230 ]);
+    $parser->apply_config($config);
+    $parser->set('foo' => 2);
+    $parser->set('bar' => 4);
+    is $parser->process($templ), '224', 'template cache: config changed between the calls';
+    is $parser->evaluate_boolean_expression('foo + 2 == bar and temperature[0] > 205'), 1, 'expression cache: config changed between the calls';
+    eval { $parser->process('{if foo == 0}x{else') } for 1..2;
+    like $@, qr/Parsing error at line 1/, 'template cache: a syntax error is reported on a cache hit';
+    # Process more templates than the cache holds, the least recently used ones are dropped and compiled again.
+    my $evicted = join '', map $parser->process("{bar + $_}") . $parser->process($templ), 1..600;
+    is $evicted, join('', map { (4 + $_) . '224' } 1..600), 'template cache: least recently used templates evicted';
 }
 
 {
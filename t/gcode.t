@@ -1,4 +1,4 @@
-use Test::More tests => 25;
+use Test::More tests => 42;
 use strict;
 use warnings;
 
@@ -8,7 +8,7 @@ BEGIN {
     use local::lib "$FindBin::Bin/../local-lib";
 }
 
-use List::Util qw(first);
+use List::Util qw(first sum);
 use Slic3r;
 use Slic3r::Geometry qw(scale convex_hull);
 use Slic3r::Test;
@@ -243,4 +243,155 @@ use Slic3r::Test;
     ok !$has_m204, 'M204 is not generated for repetier firmware';
 }
 
+{
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('gcode_comments', 1);
+    $config->set('skirts', 1);
+    # The G-code header contains a time stamp.
+    my $gcode = sub {
+        my ($streaming) = @_;
+        my $gcode = Slic3r::Test::gcode(Slic3r::Test::init_print('cube_with_hole', config => $config), streaming => $streaming);
+        $gcode =~ s/^; generated by .*$//m;
+        return $gcode;
+    };
+    ok $gcode->(1) eq $gcode->(0), 'G-code exported while infilling the layers is equal to the G-code exported after slicing';
+}
+
+{
+    # A failed G-code export stops the infill running in parallel with the export and reports the export error.
+    my $print = Slic3r::Test::init_print('cube_with_hole');
+    $print->print->set_status_silent;
+    eval { $print->print->process_and_export_gcode('/nonexistent-directory/out.gcode') };
+    like $@, qr/G-code export to .* failed/, 'export error reported';
+    my $gcode = Slic3r::Test::gcode($print, streaming => 1);
+    ok length($gcode) > 0, 'G-code exported after the failed export';
+}
+
+{
+    my $config = Slic3r::Config::new_from_defaults;
+    # The G-code header contains a time stamp.
+    my $gcode = sub {
+        my ($gzip) = @_;
+        my $gcode = Slic3r::Test::gcode(Slic3r::Test::init_print('20mm_cube', config => $config), gzip => $gzip);
+        $gcode =~ s/^; generated by .*$//m;
+        return $gcode;
+    };
+    ok $gcode->(1) eq $gcode->(0), 'G-code compressed on the fly is equal to the uncompressed G-code';
+    $config->set('remaining_times', 1);
+    ok $gcode->(1) eq $gcode->(0), 'G-code compressed after the remaining times were filled in is equal to the uncompressed G-code';
+}
+
+{
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('remaining_times', 1);
+    my (@percent, @remaining);
+    Slic3r::GCode::Reader->new->parse(Slic3r::Test::gcode(Slic3r::Test::init_print('20mm_cube', config => $config)), sub {
+        my ($self, $cmd, $args, $info) = @_;
+        
+        if ($cmd eq 'M73') {
+            push @percent, $args->{P};
+            push @remaining, $args->{R};
+        }
+    });
+    ok @percent > 2 && $percent[0] == 0 && $remaining[0] > 0
+        && ! grep({ $percent[$_] < $percent[$_ - 1] || $remaining[$_] > $remaining[$_ - 1] } 1..$#percent),
+        'remaining times are filled in after the export';
+}
+
+{
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('remaining_times', 1);
+    my @lines = grep /^M73/, split /\n/, Slic3r::Test::gcode(Slic3r::Test::init_print('20mm_cube', config => $config));
+    ok @lines > 2 && ! grep(!/^M73 P\d+ R\d+$/, @lines), 'remaining time lines are not padded with spaces';
+}
+
+{
+    # The estimated printing time is split into the time roles and into the layers.
+    my $print = Slic3r::Test::init_print('20mm_cube', config => Slic3r::Config::new_from_defaults);
+    Slic3r::Test::gcode($print);
+    my @role_times  = @{$print->print->estimated_normal_role_times};
+    my @layer_times = @{$print->print->estimated_normal_layer_times};
+    my ($d, $h, $m, $s) = map { $print->print->estimated_normal_print_time =~ /(\d+)$_/ ? $1 : 0 } qw(d h m s);
+    my $time = (($d * 24 + $h) * 60 + $m) * 60 + $s;
+    my $role_sum  = sum(@role_times);
+    my $layer_sum = sum(@layer_times);
+    ok @role_times == 4 && $role_times[0] > 0 && $role_times[1] > 0 && $role_sum >= $time - 0.01 && $role_sum < $time + 1.01,
+        'time roles add up to the estimated printing time';
+    is scalar(@layer_times), $print->print->get_object(0)->layer_count, 'estimated time of each layer';
+    ok abs($layer_sum - $role_sum) < 0.001 * $role_sum, 'layer times add up to the estimated printing time';
+}
+
+{
+    # The --estimate-time command line mode estimates an exported G-code file as the G-code export did.
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('gcode_flavor', 'marlin');
+    $config->set('silent_mode', 1);
+    my $print = Slic3r::Test::init_print('20mm_cube', config => $config);
+    my $gcode_file = "$FindBin::Bin/estimate_time.gcode.temp";
+    $print->print->set_status_silent;
+    $print->print->process;
+    $print->print->export_gcode($gcode_file);
+    is Slic3r::GCode::estimate_print_time($gcode_file, $print->print->config),
+        "$gcode_file: " . $print->print->estimated_normal_print_time . ' (silent mode ' . $print->print->estimated_silent_print_time . ')',
+        'estimated time of a G-code file in both modes';
+    $config->set('silent_mode', 0);
+    $print = Slic3r::Test::init_print('20mm_cube', config => $config);
+    $print->print->set_status_silent;
+    $print->print->process;
+    $print->print->export_gcode($gcode_file);
+    is Slic3r::GCode::estimate_print_time($gcode_file, $print->print->config),
+        "$gcode_file: " . $print->print->estimated_normal_print_time,
+        'estimated time of a G-code file in the normal mode';
+    # The acceleration set by the start G-code applies to both modes, only the machine envelope of the normal mode is skipped.
+    $config->set('silent_mode', 1);
+    $config->set('start_gcode', "M204 S200\n");
+    $print = Slic3r::Test::init_print('20mm_cube', config => $config);
+    $print->print->set_status_silent;
+    $print->print->process;
+    $print->print->export_gcode($gcode_file);
+    is Slic3r::GCode::estimate_print_time($gcode_file, $print->print->config),
+        "$gcode_file: " . $print->print->estimated_normal_print_time . ' (silent mode ' . $print->print->estimated_silent_print_time . ')',
+        'estimated time of a G-code file setting the acceleration in the start G-code';
+    unlink $gcode_file;
+    is Slic3r::GCode::estimate_print_time($gcode_file, $print->print->config), "$gcode_file: No such file",
+        'missing G-code file reported';
+}
+
+{
+    # The levels of detail of the G-code preview keep a subset of the vertices of the full resolution paths.
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('cooling', [ 0 ]);
+    my $print = Slic3r::Test::init_print('gt2_teeth', config => $config);
+    my $gcode_file = "$FindBin::Bin/preview.gcode.temp";
+    my $preview = Slic3r::GCode::PreviewData->new;
+    $print->print->set_status_silent;
+    $print->print->process;
+    Slic3r::GCode->new->do_export_w_preview($print->print, $gcode_file, $preview);
+    unlink $gcode_file;
+    my @vertices = map $preview->extrusion_vertices_count($_), 0..2;
+    ok $vertices[0] > $vertices[1] && $vertices[1] > $vertices[2] && $vertices[2] > 0, 'levels of detail reduce the number of vertices';
+    is_deeply [ map $preview->extrusion_lod_for_vertices($_), $vertices[0], $vertices[0] - 1, $vertices[1] - 1, 0 ], [ 0, 1, 2, 2 ],
+        'level of detail selected by the number of vertices';
+    my $subsets = 1;
+    foreach my $layer_id (0..($preview->extrusion_layers_count - 1)) {
+        foreach my $path_id (0..($preview->extrusion_paths_count($layer_id) - 1)) {
+            my $path = $preview->extrusion_path($layer_id, $path_id, 0);
+            my @points = map "@$_", @{$path->pp};
+            foreach my $lod (1..2) {
+                my $simplified = $preview->extrusion_path($layer_id, $path_id, $lod);
+                my @simplified = map "@$_", @{$simplified->pp};
+                # The simplified path shall start and end at the same points and map back onto the full resolution path in order.
+                my $i = 0;
+                foreach my $point (@simplified) {
+                    ++ $i while $i < @points && $points[$i] ne $point;
+                    ++ $i;
+                }
+                $subsets = 0 if $i > @points || $simplified[0] ne $points[0] || $simplified[-1] ne $points[-1]
+                    || $simplified->role != $path->role || $simplified->width != $path->width || $simplified->height != $path->height;
+            }
+        }
+    }
+    ok $subsets, 'levels of detail map back onto the vertices of the full resolution paths';
+}
+
 __END__
@@ -0,0 +1,94 @@
+use Test::More tests => 8;
+use strict;
+use warnings;
+
+BEGIN {
+    use FindBin;
+    use lib "$FindBin::Bin/../lib";
+    use local::lib "$FindBin::Bin/../local-lib";
+}
+
+use Slic3r;
+use Slic3r::Test;
+
+{
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('layer_height', 0.2);
+    $config->set('first_layer_height', 0.2);
+    $config->set('extra_perimeters', 1);
+    $config->set('support_material', 1);
+
+    my $model = Slic3r::Test::model('overhang');
+    $model->center_instances_around_point(Slic3r::Pointf->new(100,100));
+    my $height = $model->bounding_box->size->z;
+
+    # The G-code header contains a time stamp.
+    my $gcode = sub {
+        my ($print) = @_;
+        my $gcode = Slic3r::Test::gcode($print);
+        $gcode =~ s/^; generated by .*$//m;
+        return $gcode;
+    };
+
+    my $print = Slic3r::Print->new;
+    $model->get_object(0)->set_layer_height_profile([ 0, 0.2, $height, 0.2 ]);
+    $print->apply($model, $config);
+    $gcode->($print);
+    ok $print->get_object(0)->step_done(Slic3r::Print::State::STEP_PERIMETERS), 'perimeters done';
+
+    # Thin the layers in the middle of the object only.
+    $model->get_object(0)->set_layer_height_profile([ 0, 0.2, 4, 0.2, 4, 0.1, 6, 0.1, 6, 0.2, $height, 0.2 ]);
+    $print->apply($model, $config);
+    ok !$print->get_object(0)->step_done(Slic3r::Print::State::STEP_SLICE), 'slicing invalidated by the layer height profile';
+    my $gcode_incremental = $gcode->($print);
+
+    my $print_full = Slic3r::Print->new;
+    $print_full->apply($model, $config);
+    my $gcode_full = $gcode->($print_full);
+
+    ok length($gcode_full) > 0, 'G-code generated';
+    ok $gcode_incremental eq $gcode_full, 'G-code of the modified layers only is equal to the G-code of the whole object';
+}
+
+{
+    # The infill of the layers, whose fill surfaces were not modified by the re-slicing, is kept.
+    # The solid shells and the combined infill propagate over the layers around the modified ones.
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('layer_height', 0.2);
+    $config->set('first_layer_height', 0.2);
+    $config->set('fill_density', 40);
+    $config->set('top_solid_layers', 4);
+    $config->set('bottom_solid_layers', 3);
+    $config->set('infill_every_layers', 2);
+
+    my $model = Slic3r::Test::model('20mm_cube');
+    $model->center_instances_around_point(Slic3r::Pointf->new(100,100));
+    my $height = $model->bounding_box->size->z;
+
+    my $gcode = sub {
+        my ($print) = @_;
+        my $gcode = Slic3r::Test::gcode($print);
+        $gcode =~ s/^; generated by .*$//m;
+        return $gcode;
+    };
+
+    my $print = Slic3r::Print->new;
+    $model->get_object(0)->set_layer_height_profile([ 0, 0.2, $height, 0.2 ]);
+    $print->apply($model, $config);
+    $gcode->($print);
+    ok $print->get_object(0)->step_done(Slic3r::Print::State::STEP_INFILL), 'infill done';
+
+    $model->get_object(0)->set_layer_height_profile([ 0, 0.2, 10, 0.2, 10, 0.1, 12, 0.1, 12, 0.2, $height, 0.2 ]);
+    $print->apply($model, $config);
+    ok !$print->get_object(0)->step_done(Slic3r::Print::State::STEP_INFILL), 'infill invalidated by the layer height profile';
+    my $gcode_incremental = $gcode->($print);
+
+    my $print_full = Slic3r::Print->new;
+    $print_full->apply($model, $config);
+    my $gcode_full = $gcode->($print_full);
+
+    ok length($gcode_full) > 0, 'G-code generated';
+    ok $gcode_incremental eq $gcode_full, 'G-code with the infill of the modified layers only is equal to the G-code of the whole object';
+}
+
+__END__
@@ -1,4 +1,4 @@
-use Test::More tests => 59;
+use Test::More tests => 61;
 use strict;
 use warnings;
 
@@ -441,4 +441,57 @@ use Slic3r::Test;
     $test->('small_dorito');
 }
 
+{
+    # The medial axes of the thin walls and of the gap fill are shared through the cache with the other layers of an object.
+    # The perimeters and the gap fill shall not depend on whether the medial axes were extracted or taken from the cache.
+    my $flow = Slic3r::Flow->new(
+        width           => 0.5,
+        height          => 0.3,
+        nozzle_diameter => 0.5,
+    );
+    my $config = Slic3r::Config->new;
+    $config->set('thin_walls', 1);
+    $config->set('perimeters', 3);
+    $config->set('gap_fill_speed', 20);
+    $config->set('fill_density', 20);
+    my $slices = Slic3r::Surface::Collection->new;
+    $slices->append(Slic3r::Surface->new(
+        surface_type => S_TYPE_INTERNAL,
+        expolygon => Slic3r::ExPolygon->new(
+            [ map [ scale($_->[0]), scale($_->[1]) ], [0,0], [20,0], [20,20], [0,20] ],
+            # narrow wall between the contour and the hole, filled in by the gap fill
+            [ map [ scale($_->[0]), scale($_->[1]) ], [2.2,5], [2.2,15], [6.3,15], [6.3,5] ],
+        ),
+    ));
+    $slices->append(Slic3r::Surface->new(
+        surface_type => S_TYPE_INTERNAL,
+        # thin wall
+        expolygon => Slic3r::ExPolygon->new([ map [ scale($_->[0]), scale($_->[1]) ], [30,0], [30.4,0], [30.4,20], [30,20] ]),
+    ));
+    my $cache = Slic3r::Geometry::MedialAxisCache->new;
+    my $generate = sub {
+        my ($cache) = @_;
+        my ($region_config, $object_config, $print_config, $loops, $gap_fill, $fill_surfaces);
+        my $g = Slic3r::Layer::PerimeterGenerator->new(
+            $slices, 0.3, $flow,
+            ($region_config = Slic3r::Config::PrintRegion->new),
+            ($object_config = Slic3r::Config::PrintObject->new),
+            ($print_config  = Slic3r::Config::Print->new),
+            ($loops         = Slic3r::ExtrusionPath::Collection->new),
+            ($gap_fill      = Slic3r::ExtrusionPath::Collection->new),
+            ($fill_surfaces = Slic3r::Surface::Collection->new),
+        );
+        $g->config->apply_dynamic($config);
+        $g->set_medial_axis_cache($cache) if $cache;
+        $g->process;
+        my $dump = sub { [ map { [ ref($_), map $_->pp, @{$_->polygons_covered_by_width} ] } @{$_[0]->flatten} ] };
+        return ($dump->($loops), $dump->($gap_fill));
+    };
+    my @extracted = $generate->();
+    # The first run fills the cache, the second one takes the medial axes from the cache.
+    my @cached = ($generate->($cache), $generate->($cache));
+    ok scalar(grep { $_->[0] ne 'Slic3r::ExtrusionLoop' } @{$extracted[0]}) && @{$extracted[1]} > 0, 'thin walls and gap fill generated';
+    is_deeply \@cached, [ @extracted, @extracted ], 'same perimeters and gap fill with the medial axis cache';
+}
+
 __END__
@@ -37,10 +37,13 @@ REGISTER_CLASS(ModelVolume, "Model::Volume");
 REGISTER_CLASS(ModelInstance, "Model::Instance");
 REGISTER_CLASS(MotionPlanner, "MotionPlanner");
 REGISTER_CLASS(BoundingBox, "Geometry::BoundingBox");
+REGISTER_CLASS(OnionShells, "Geometry::Clipper::OnionShells");
 REGISTER_CLASS(BoundingBoxf, "Geometry::BoundingBoxf");
 REGISTER_CLASS(BoundingBoxf3, "Geometry::BoundingBoxf3");
 REGISTER_CLASS(BridgeDetector, "BridgeDetector");
 REGISTER_CLASS(Point, "Point");
+namespace Geometry { class MedialAxisCache; }
+__REGISTER_CLASS(Geometry::MedialAxisCache, "Geometry::MedialAxisCache");
 __REGISTER_CLASS(Vec2d, "Pointf");
 __REGISTER_CLASS(Vec3d, "Pointf3");
 REGISTER_CLASS(DynamicPrintConfig, "Config");
@@ -5,7 +5,7 @@ use warnings;
 
 use List::Util qw(sum);
 use Slic3r::XS;
-use Test::More tests => 16;
+use Test::More tests => 23;
 
 my $square = Slic3r::Polygon->new(  # ccw
     [200, 100],
@@ -160,6 +160,77 @@ if (0) {  # Clipper does not preserve polyline orientation
     is $result->[0]->length, $subject->length, 'intersection_pl - result has same length as subject polyline';
 }
 
+{
+    # The Clipper engines are reused by the following operations of the same thread. The result of an operation
+    # shall not depend on the preceding operations, including an operation large enough for the engine to be trimmed.
+    my $polyline = Slic3r::Polyline->new([50,150], [300,150]);
+    my $run = sub {
+        my $offset = Slic3r::Geometry::Clipper::offset([ $square, $hole_in_square ], 5);
+        my $offset2_ex = Slic3r::Geometry::Clipper::offset2_ex([ @$expolygon ], 5, -2);
+        my $diff_pl = Slic3r::Geometry::Clipper::diff_pl([$polyline], [$square, $hole_in_square]);
+        my $union_ex = Slic3r::Geometry::Clipper::union_ex([ $square, $hole_in_square ]);
+        return (
+            [ map $_->pp, @$offset ],
+            [ map $_->pp, @$offset2_ex ],
+            [ sort map $_->length, @$diff_pl ],
+            [ map $_->pp, @$union_ex ],
+        );
+    };
+    my @first = $run->();
+    my @squares;
+    for my $i (0..159) {
+        for my $j (0..159) {
+            push @squares, Slic3r::Polygon->new([$i*300, $j*300], [$i*300+200, $j*300], [$i*300+200, $j*300+200], [$i*300, $j*300+200]);
+        }
+    }
+    Slic3r::Geometry::Clipper::union_ex(Slic3r::Geometry::Clipper::offset(\@squares, 10));
+    my @second = $run->();
+    is_deeply $second[0], $first[0], 'offset - reused engine gives the same result';
+    is_deeply $second[1], $first[1], 'offset2_ex - reused engine gives the same result';
+    is_deeply $second[2], $first[2], 'diff_pl - reused engine gives the same result';
+    is_deeply $second[3], $first[3], 'union_ex - reused engine gives the same result';
+}
+
+{
+    # The onion shells shall be the same as those produced by offsetting the ExPolygons one shell after the other,
+    # ring order included, for the perimeters and the gap fill not to change.
+    my $island = [
+        Slic3r::ExPolygon->new(
+            [ [0,0], [20000000,0], [20000000,20000000], [0,20000000] ],
+            [ [2000000,2000000], [2000000,8000000], [8000000,8000000], [8000000,2000000] ],
+            [ [600000,12000000], [600000,19400000], [18000000,19400000], [18000000,12000000] ],
+        ),
+        Slic3r::ExPolygon->new(
+            [ [30000000,0], [40000000,0], [40000000,10000000], [35300000,10000000], [35300000,15000000], [40000000,15000000],
+              [40000000,25000000], [30000000,25000000], [30000000,15000000], [34700000,15000000], [34700000,10000000], [30000000,10000000] ],
+        ),
+    ];
+    my $shells = Slic3r::Geometry::Clipper::OnionShells->new($island);
+    my $last = $island;
+    my (@shells, @expected_shells, @gaps, @expected_gaps);
+    foreach my $i (0..5) {
+        my $distance = ($i == 0) ? 225000 : 400000 + 10000 * $i;
+        my ($shell, $expected_shell);
+        if ($i % 2) {
+            $shell = $shells->next(- $distance);
+            $expected_shell = Slic3r::Geometry::Clipper::offset_ex_expolygons($last, - $distance);
+        } else {
+            $shell = $shells->next2(- ($distance + 199999), 199999);
+            $expected_shell = Slic3r::Geometry::Clipper::offset2_ex_expolygons($last, - ($distance + 199999), 199999);
+        }
+        push @shells, [ map $_->pp, @$shell ];
+        push @expected_shells, [ map $_->pp, @$expected_shell ];
+        push @gaps, [ map $_->pp, @{$shells->gaps(-0.5 * $distance, 0.5 * $distance + 10)} ];
+        push @expected_gaps, [ map $_->pp, @{Slic3r::Geometry::Clipper::diff_ex(
+            Slic3r::Geometry::Clipper::offset_expolygons($last, -0.5 * $distance),
+            Slic3r::Geometry::Clipper::offset_expolygons($expected_shell, 0.5 * $distance + 10))} ];
+        $last = $expected_shell;
+    }
+    ok scalar(@{$shells[-1]}) > 0 && scalar(grep @$_, @expected_gaps) > 0, 'onion shells - shells and gaps are not empty';
+    is_deeply \@shells, \@expected_shells, 'onion shells - same shells as offset_ex() and offset2_ex() of the ExPolygons';
+    is_deeply \@gaps, \@expected_gaps, 'onion shells - same gaps as diff_ex() of the offset() of the ExPolygons';
+}
+
 if (0) {
     # Disabled until Clipper bug #127 is fixed
     my $subject = [